@@ -0,0 +1,35 @@
+/********************************************************
+ *	Line detection, see line_detection.h
+ ********************************************************/
+
+#include "line_detection.h"
+
+IplImage* getThresholdedImage(IplImage* img)
+{
+	//convert image to HSV image (HSV is a color format: Hue, Saturation, value aka brightness)
+	IplImage* imgHSV = cvCreateImage(cvGetSize(img), 8, 3);
+	cvCvtColor(img, imgHSV, CV_BGR2HSV);
+
+	IplImage* imgThreshed = cvCreateImage(cvGetSize(img), 8, 1);
+
+	//what color you want to detect
+	cvInRangeS(imgHSV, cvScalar(2,160,50), cvScalar(7, 210, 150), imgThreshed);
+	cvReleaseImage(&imgHSV);
+
+	return imgThreshed;
+}
+
+void line_position(IplImage* imgThreshed, LinePosition &line)
+{
+	//Get moment of thresholded object to track
+	CvMoments moments;
+	cvMoments(imgThreshed, &moments, 1);
+
+	line.moment10 = cvGetSpatialMoment(&moments, 1, 0);
+	line.moment01 = cvGetSpatialMoment(&moments, 0, 1);
+	line.area = cvGetCentralMoment(&moments, 0, 0);
+
+	//x/y position of center of gravity, off the left edge with no line like the 0/0 used to give
+	line.x = line.area > 0 ? (int)(line.moment10 / line.area) : -1;
+	line.y = line.area > 0 ? (int)(line.moment01 / line.area) : -1;
+}
@@ -0,0 +1,30 @@
+/********************************************************
+ *	Finding the red line in a camera frame
+ *
+ *	The color detection line_following does on every
+ *	frame, out of main so vision_replay can time it on
+ *	recorded frames.
+ ********************************************************/
+
+#ifndef LINE_DETECTION_H
+#define LINE_DETECTION_H
+
+#include <opencv/cv.h>
+
+//where the line is in the image
+struct LinePosition
+{
+	double moment10;
+	double moment01;
+	double area;			//line pixels, moment 00 of the binary image
+	int x;					//center of gravity [pixels]
+	int y;
+};
+
+//Color Detection, 255 where img (BGR) has the line's color. The caller releases it
+IplImage* getThresholdedImage(IplImage* img);
+
+//center of gravity of the thresholded line, -1 if there's none
+void line_position(IplImage* imgThreshed, LinePosition &line);
+
+#endif
@@ -13,6 +13,10 @@
  *
  *	Created By: Daniel Kulas, Bethune-Cookman University
  *				9/23/12
+ *
+ *	-replay <file> takes the frames from an opencv_circle_detection recording, a video or an image sequence
+ *	(frame_source.h) instead of the camera. No robot is connected then, the frames go through as fast as they
+ *	can and the time each one took is printed.
  ********************************************************************************************************************/
 
 
@@ -23,10 +27,13 @@
 #include "Aria.h"
 
 #include <iostream>
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
 
 #include "FlyCapture2.h"
+#include "../opencv_circle_detection/flycapture_source.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+#include "line_detection.h"
 
 #define DISTANCE_THRESHOLD	400
 
@@ -40,9 +47,12 @@ IplImage* destImage,
 IplImage* imgScribble = NULL;
 Error error;
 
-//FlyCapture class
-Image colorImage;
-bool bInit = false;
+//camera frames, allocated once at the camera's size
+FramePool frames;
+FrameHandle frame;
+
+//the camera or a replay
+FrameSource* source = NULL;
 
 
 //sonar thing
@@ -107,165 +117,20 @@ void PrintError(Error error)
 }
 
 /*
- *	Important function!	[Point Grey code]
- *	Converts the raw image taken from the Bumblebee2 camera into an
- *	IplImage format so opencv can understand the data.	
+ *	The left eye of the next frame into frame, tries again while no
+ *	frame buffer is free. false once a replay has run out or the camera
+ *	failed
  */
-IplImage* ConvertImageToOpenCV(Image* pImage)
+bool grab_frame()
 {
-	IplImage* cvImage = NULL;
-	bool bColor = true;
-	CvSize mySize;
-	mySize.height = pImage->GetRows();
-	mySize.width  = pImage->GetCols();
-
-	//switch used in the event that a different camera is being used
-		switch ( pImage->GetPixelFormat() )
+	StereoFrame pair;
+	while(!source->grab(pair))
 	{
-		case PIXEL_FORMAT_MONO8:	 cvImage = cvCreateImageHeader(mySize, 8, 1 );
-									 cvImage->depth = IPL_DEPTH_8U;
-									 cvImage->nChannels = 1;
-									 bColor = false;
-									 printf("PIXEL_FORMAT_MON08()\n");
-									 break;
-
-		case PIXEL_FORMAT_411YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_411YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_422YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_433YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_444YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_444YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_RGB8:      cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-                                    // printf("PIXEL_FORMAT_RGB8\n");
-									 break;
-
-		case PIXEL_FORMAT_MONO16:    cvImage = cvCreateImageHeader(mySize, 16, 1 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 1;
-									 printf("PIXEL_FORMAT_MONO16\n");
-									 bColor = false;
-                                     break;
-
-		case PIXEL_FORMAT_RGB16:     cvImage = cvCreateImageHeader(mySize, 16, 3 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 3;
-                                     printf("PIXEL_FORMAT_RGB16\n");
-									 break;
-
-		case PIXEL_FORMAT_S_MONO16:  cvImage = cvCreateImageHeader(mySize, 16, 1 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 1;									
-									 bColor = false;
-									 printf("PIXEL_FORMAT_S_MONO16\n");
-                                     break;
-
-		case PIXEL_FORMAT_S_RGB16:   cvImage = cvCreateImageHeader(mySize, 16, 3 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 3;
-									 printf("PIXEL_FORMAT_X_RGB16\n");
-                                     break;
-
-		case PIXEL_FORMAT_RAW8:      cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 printf("PIXEL_FORMAT_RAW8\n");
-                                     break;
-
-		case PIXEL_FORMAT_RAW16:     cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 printf("PIXEL_FORMAT_RAW16\n");
-                                     break;
-
-		case PIXEL_FORMAT_MONO12:    printf("Not supported by OpenCV");
-									 bColor = false;
-                                     break;
-
-		case PIXEL_FORMAT_RAW12:	 printf("Not supported by OpenCV");
-									 break;
-
-		case PIXEL_FORMAT_BGR:       cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 printf("PIXEL_FORMAT_BGR\n");
-                                     break;
-
-		case PIXEL_FORMAT_BGRU:      cvImage = cvCreateImageHeader(mySize, 8, 4 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 4;
-									 printf("PIXEL_FORMAT_BGRU\n");
-                                     break;
-
-		case PIXEL_FORMAT_RGBU:      cvImage = cvCreateImageHeader(mySize, 8, 4 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 4;
-									 printf("PIXEL_FORMAT_RGBU\n");
-                                     break;
-
-		default: printf("Some error occured...\n");
-				 return NULL;
+		if(source->atEnd())
+			return false;
 	}
-
-	if(bColor)
-	{
-		if(!bInit)
-		{
-			//sets size of buffer to place image data
-			colorImage.SetData(new unsigned char[pImage->GetCols() * pImage->GetRows()*3], pImage->GetCols() * pImage->GetRows()*3);
-			bInit = true;
-		}
-		pImage->Convert(PIXEL_FORMAT_BGR, &colorImage); //needs to be BGR format to save 
-		//sets IplImage header values
-		cvImage->width = colorImage.GetCols();
-		cvImage->height = colorImage.GetRows();
-		cvImage->widthStep = colorImage.GetStride();
-		cvImage->origin = 0;		//interleaved color channels
-		cvImage->imageDataOrigin = (char*)colorImage.GetData();	//no region of interest, same pointer
-		cvImage->imageData = (char*)(colorImage.GetData());
-		cvImage->widthStep = colorImage.GetStride();
-		cvImage->nSize = sizeof(IplImage);
-		cvImage->imageSize = cvImage->height * cvImage->widthStep;
-	}
-	else
-	{
-        cvImage->imageDataOrigin = (char*)(pImage->GetData());
-        cvImage->imageData         = (char*)(pImage->GetData());
-        cvImage->widthStep         = pImage->GetStride();
-        cvImage->nSize             = sizeof (IplImage);
-        cvImage->imageSize         = cvImage->height * cvImage->widthStep;
-		//at this point cvImage contains a valid IplImage
-     }
-	return cvImage;
-}
-
-//Color Detection 
-IplImage* getThresholdedImage(IplImage* img)
-{
-	//convert image to HSV image (HSV is a color format: Hue, Saturation, value aka brightness)
-	IplImage* imgHSV = cvCreateImage(cvGetSize(img), 8, 3);
-	cvCvtColor(img, imgHSV, CV_BGR2HSV);
-
-	IplImage* imgThreshed = cvCreateImage(cvGetSize(img), 8, 1);
-
-	//what color you want to detect
-	cvInRangeS(imgHSV, cvScalar(2,160,50), cvScalar(7, 210, 150), imgThreshed);
-	cvReleaseImage(&imgHSV);
-
-	return imgThreshed;
+	frame = pair.left;
+	return true;
 }
 
 int main(int argc, char* argv[])
@@ -276,15 +141,14 @@ int main(int argc, char* argv[])
 	//using sonar due to issues connecting the laser
 	ArSonarDevice sonar;	
 
-	//now camera stuff
-	Camera cam;
-	Image rawImage;
-
 	char keypress;
 
 	//Connect robot
 	Aria::init();
 
+	ArArgumentParser parser(&argc, argv);
+	const char* replay_path = parser.checkParameterArgument("-replay");
+
 	ArSimpleConnector connector(&argc, argv);
 	connector.parseArgs();
 
@@ -294,102 +158,72 @@ int main(int argc, char* argv[])
 		exit(1);
 	}
 
-	Aria::setKeyHandler(&keyHandler);
-	robot.attachKeyHandler(&keyHandler);
-
 	robot.addRangeDevice(&sonar);
-	if(!connector.connectRobot(&robot))
-	{
-		print("Could not connect to robot...abort");
-		Aria::shutdown();
-		exit(1);
-	}
-
-	//motors on, sounds off
-	robot.comInt(ArCommands::ENABLE, 1);
-	robot.comInt(ArCommands::SOUNDTOG, 0);
-	robot.runAsync(true);
 
-	//Deal with camera now
-	PrintBuildInfo();
-	Error error;
-
-	BusManager busMgr;
-	unsigned int numCameras;
-
-	error = busMgr.GetNumOfCameras(&numCameras);
-	if(error != PGRERROR_OK)
+	//a replay has no robot, the sonar never sees anything and the line gets followed
+	if(!replay_path)
 	{
-		PrintError(error);
-		exit(1);
-	}
-	printf("Number of cameras detected: %u\n", numCameras);
-	PGRGuid guid;
-	for(unsigned int i = 0; i < numCameras; i++)
-	{
-		error = busMgr.GetCameraFromIndex(i, &guid);
-		if(error != PGRERROR_OK)
+		Aria::setKeyHandler(&keyHandler);
+		robot.attachKeyHandler(&keyHandler);
+
+		if(!connector.connectRobot(&robot))
 		{
-			PrintError(error);
+			print("Could not connect to robot...abort");
+			Aria::shutdown();
 			exit(1);
 		}
-	}
 
-	//connect and startup camera
-	error = cam.Connect(&guid);
-	if(error != PGRERROR_OK)
-	{
-		PrintError(error);
-		exit(1);
+		//motors on, sounds off
+		robot.comInt(ArCommands::ENABLE, 1);
+		robot.comInt(ArCommands::SOUNDTOG, 0);
+		robot.runAsync(true);
 	}
 
-	CameraInfo camInfo;
-	error = cam.GetCameraInfo(&camInfo);
-	if(error != PGRERROR_OK)
+	//Deal with camera now, or the recording in its place
+	if(replay_path)
 	{
-		PrintError(error);
-		exit(1);
+		source = open_replay_source(replay_path, NULL, frames);
+		if(!source)
+		{
+			printf("Could not open %s\n", replay_path);
+			Aria::shutdown();
+			exit(1);
+		}
+		printf("Replaying %s as fast as it goes\n", replay_path);
 	}
-
-	error = cam.StartCapture();
-	if(error != PGRERROR_OK)
+	else
 	{
-		PrintError(error);
-		exit(1);
+		PrintBuildInfo();
+
+		//connect and startup camera
+		FlyCaptureSource* camera = new FlyCaptureSource(frames, FLYCAPTURE_SINGLE);
+		if(!camera->open())
+			exit(1);
+		source = camera;
 	}
 
 	while(1)
 	{
-		//grab image
-		error = cam.RetrieveBuffer(&rawImage);
-		if(error != PGRERROR_OK)
-		{
-			PrintError(error);
-			exit(1);
-		}
-
-		//convert raw image to opencv format IplImage
-		destImage = ConvertImageToOpenCV(&rawImage);
+		//grab image, converted to opencv format into a pooled frame
+		double start = now_seconds();
+		if(!grab_frame())
+			break;
+		IplImage destHeader = frame.image();
+		destImage = &destHeader;
 		
 		//color detection stuff
+		double grabbed = now_seconds();
 		IplImage* imgColorThreshold = getThresholdedImage(destImage);
 
 		//Get moment of thresholded object to track
-		CvMoments* moments = (CvMoments*)malloc(sizeof(CvMoments));
-		cvMoments(imgColorThreshold, moments, 1);
-
-		double moment10 = cvGetSpatialMoment(moments, 1, 0);
-		double moment01 = cvGetSpatialMoment(moments, 0, 1);
-		double area = cvGetCentralMoment(moments, 0, 0);
+		LinePosition line;
+		line_position(imgColorThreshold, line);
+		if(replay_path)
+			printf("Frame: grab %.2f ms, line %.2f ms\n", (grabbed - start) * 1e3, (now_seconds() - grabbed) * 1e3);
 
 		//hold x/y position of center of gravity
-		static int posX = 0;
-		static int posY = 0;
-		int lastX = posX;
-		int lastY = posY;
-
-		posX = moment10/area;
-		posY = moment01/area;
+		int posX = line.x;
+		int posY = line.y;
 		printf("Position (%d, %d)\n", posX, posY);
 
 		//check if front is clear from sonar data
@@ -444,38 +278,22 @@ int main(int argc, char* argv[])
 					leftReading  = sonar.currentReadingPolar( 30,  50, &readingAngle);
 					cout << "leftside " << leftSideReading << endl;
 					cout << "leftReading" << leftReading << endl;
-					//grab image
-					error = cam.RetrieveBuffer(&rawImage);
-					if(error != PGRERROR_OK)
-					{
-						PrintError(error);
-						exit(1);
-					}
-
-					//convert raw image to opencv format IplImage
-					destImage = ConvertImageToOpenCV(&rawImage);
+					//grab image, a replay that ran out ends the main loop too
+					if(!grab_frame())
+						break;
+					IplImage destHeader = frame.image();
+					destImage = &destHeader;
 					
 					//color detection stuff
 					IplImage* imgColorThreshold = getThresholdedImage(destImage);
 
 					//Get moment of thresholded object to track
-					CvMoments* moments = (CvMoments*)malloc(sizeof(CvMoments));
-					cvMoments(imgColorThreshold, moments, 1);
-
-					double moment10 = cvGetSpatialMoment(moments, 1, 0);
-					double moment01 = cvGetSpatialMoment(moments, 0, 1);
-					double area = cvGetCentralMoment(moments, 0, 0);
-					cout << "Moment10 " << moment10 << endl;
-					cout << "Moment01 " << moment01 << endl;
+					LinePosition line;
+					line_position(imgColorThreshold, line);
+					double area = line.area;
+					cout << "Moment10 " << line.moment10 << endl;
+					cout << "Moment01 " << line.moment01 << endl;
 					cout << "Area " << area << endl;
-					//hold x/y position of center of gravity
-					static int posX = 0;
-					static int posY = 0;
-					int lastX = posX;
-					int lastY = posY;
-
-					posX = moment10/area;
-					posY = moment01/area;
 					cvShowImage("Color detection", imgColorThreshold);
 					keypress = cvWaitKey(10);
 
@@ -499,14 +317,12 @@ int main(int argc, char* argv[])
 						robot.setVel(150);
 						robot.setRotVel(-20);			
 					}
+					cvReleaseImage(&imgColorThreshold);
 					if(area > 2500)
 					{
 						print("Line found");
 						break;
 					}
-
-					cvReleaseImage(&imgColorThreshold);
-					delete moments;
 				}			
 			}
 			else if( rightReading > leftReading)
@@ -522,38 +338,22 @@ int main(int argc, char* argv[])
 					rightReading  = sonar.currentReadingPolar( -30,  -50, &readingAngle);
 					cout << "rightSideReading " << rightSideReading << endl;
 					cout << "rightReading" << rightReading << endl;
-					//grab image
-					error = cam.RetrieveBuffer(&rawImage);
-					if(error != PGRERROR_OK)
-					{
-						PrintError(error);
-						exit(1);
-					}
-
-					//convert raw image to opencv format IplImage
-					destImage = ConvertImageToOpenCV(&rawImage);
+					//grab image, a replay that ran out ends the main loop too
+					if(!grab_frame())
+						break;
+					IplImage destHeader = frame.image();
+					destImage = &destHeader;
 					
 					//color detection stuff
 					IplImage* imgColorThreshold = getThresholdedImage(destImage);
 
 					//Get moment of thresholded object to track
-					CvMoments* moments = (CvMoments*)malloc(sizeof(CvMoments));
-					cvMoments(imgColorThreshold, moments, 1);
-
-					double moment10 = cvGetSpatialMoment(moments, 1, 0);
-					double moment01 = cvGetSpatialMoment(moments, 0, 1);
-					double area = cvGetCentralMoment(moments, 0, 0);
-					cout << "Moment10 " << moment10 << endl;
-					cout << "Moment01 " << moment01 << endl;
+					LinePosition line;
+					line_position(imgColorThreshold, line);
+					double area = line.area;
+					cout << "Moment10 " << line.moment10 << endl;
+					cout << "Moment01 " << line.moment01 << endl;
 					cout << "Area " << area << endl;
-					//hold x/y position of center of gravity
-					static int posX = 0;
-					static int posY = 0;
-					int lastX = posX;
-					int lastY = posY;
-
-					posX = moment10/area;
-					posY = moment01/area;
 					cvShowImage("Color detection", imgColorThreshold);
 					keypress = cvWaitKey(10);
 
@@ -577,14 +377,12 @@ int main(int argc, char* argv[])
 						robot.setVel(150);
 						robot.setRotVel(20);
 					}
+					cvReleaseImage(&imgColorThreshold);
 					if(area > 2500)
 					{
 						print("Line found");
 						break;
 					}
-
-					cvReleaseImage(&imgColorThreshold);
-					delete moments;
 				}			
 			}
 			else
@@ -595,25 +393,12 @@ int main(int argc, char* argv[])
 		keypress = cvWaitKey(10);
 
 		cvReleaseImage(&imgColorThreshold);
-		delete moments;
 	}
 
-	cvReleaseImageHeader(&destImage);
-	cvReleaseImage(&destImage);
-
-	error = cam.StopCapture();
-	if(error != PGRERROR_OK)
-	{
-		PrintError(error);
-		exit(1);
-	}
+	frame.release();
 
-	error = cam.Disconnect();
-	if(error != PGRERROR_OK)
-	{
-		PrintError(error);
-		exit(1);
-	}
+	//stops the camera
+	delete source;
 	print("Done");
 	Aria::shutdown();
 
@@ -12,27 +12,35 @@
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 load robot_map.dat
 robotmap = robot_map;
+[rows, cols] = size(robotmap);
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%%%%%% The mapper only writes the explored area now. robot_map_origin.dat   %%%%%%%%
+%%%%%%%% holds the cell coordinate of the first row/column, so the map lands  %%%%%%%%
+%%%%%%%% in the robot's odometry frame. Old files without it start at (0,0)   %%%%%%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+origin = [0 0];
+if exist('robot_map_origin.dat', 'file')
+    origin = load('robot_map_origin.dat');
+end
 
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-%%%%%%%% The (0,0) is the starting coordinate for the map, and the (120, 120)  %%%%%%%%
-%%%%%%%% value is the max location/size of map. Create a rectangle in place    %%%%%%%% 
-%%%%%%%%         of where the map specifies an obstacle                        %%%%%%%%
-%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+%%%%%%%% Draw the outline of the explored area, then create a rectangle in     %%%%%%%%
+%%%%%%%%           place of where the map specifies an obstacle                %%%%%%%%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 
-rectangle('Position',[0,0,120,120]) % 8m x 8m
+rectangle('Position',[origin(1),origin(2),rows,cols])
 val = 0;
 
 free_val = 0;
 obstacle_val = 0;
 
-for i = 1:1:120
-    for j = 1:1:120
+for i = 1:1:rows
+    for j = 1:1:cols
         val = robotmap(i,j);
         if val >= 1
-            rectangle('Position',[i-1,j-1, 1, 1]);
+            rectangle('Position',[origin(1)+i-1,origin(2)+j-1, 1, 1]);
         end
     end
 end
-
-
@@ -9,11 +9,29 @@
  ********************************************************/
 
 #include "Aria.h"
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
-
-// Refer BOOST's site for more info on the multi_array: http://www.boost.org/doc/libs/1_52_0/libs/multi_array/doc/reference.html
-#include <boost/multi_array.hpp>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+//sparse tiled grid, tiles get allocated the first time a sonar touches them
+#include "tiled_grid.h"
+//log-odds fuzzy sonar model, all 16 cones get rasterized in one pass
+#include "sonar_model.h"
+#include "sonar_snapshot.h"
+#include "sonar_mapper.h"
+#include "sensor_log.h"
+#include "cycle_timer.h"
+#include "map_file.h"
+#include "map_journal.h"
+#include "map_pyramid.h"
+#include "distance_map.h"
+#include "scan_matcher.h"
+#include "frontier_map.h"
+#include "grid_planner.h"
+#include "bit_planes.h"
+#include "likelihood_field.h"
+#include "particle_localizer.h"
+#include "vector_field_histogram.h"
+#include "map_export.h"
 
 #include <iostream>
 #include <cstring>
@@ -21,239 +39,446 @@
 #include <cassert>
 #include <iomanip>
 #include <algorithm>
-#include <stack>
 #include <cmath>
+#include <vector>
+
+#include <boost/thread.hpp>
 
 #define PI	3.14159
 #define KR	0.1 		//KR = constant
+#define CHECKPOINT_INTERVAL	5.0		//[s] between map file checkpoints
+#define JOURNAL_SNAPSHOT_INTERVAL	3000	//[cycles] between full map snapshots in the journal
+#define DEFAULT_TIME_LIMIT	300.0	//[s] mapping run length unless -time says otherwise
+#define STATUS_INTERVAL		10.0	//[s] between progress lines
+#define GOAL_INTERVAL		2.0		//[s] between picking the frontier to drive to
+#define GOAL_REACHED		400.0	//[mm] a goal this close is done, pick the next one
+#define PLANNER_WINDOW		400		//[cells] side of the square the planner covers, centered on the start
+#define PLANNER_RADIUS		3		//[cells] obstacles closer than this to a cell block it, about the robot's half width
+#define PATH_LOOKAHEAD		5		//[cells] how far down the path the robot steers for
+#define PLANNER_BUDGET		20000	//cells a path repair may expand per cycle, about 10ms, the rest waits for the next
+#define LOCALIZED_SPREAD	300.0	//[mm] particles this close together say where the robot is
+#define STEER_TIMEOUT		0.5		//[s] the robot stops if the mapper thread hasn't steered for this long
+#define MAPPER_QUEUE_LIMIT	50		//cycles waiting for the mapper thread, more get dropped
 
 using namespace std;
 
-typedef boost::multi_array<int, 2> array_type;	
-typedef array_type::index index;
-
 void msg(char* str)
 {
 	cout << str << endl;
 }
 
-/*	
- *	The fuzzy_map function will handle uncertainties in the sonar.
- *	Function needs the sonar device, the value returned by the sonar, the distance threshold of the users choosing
- *	that will deteremine some offset value due to the sonar, the robots theta orientation (should already be in degrees),
- *	robots x position, and the robots y position.
- *
- *	The "cell_x" variables represent the 9 cells that the function will map values to
- *	_____________
- *	|	|	|	|
- *	|C2_|C5_|C8_|
- *	|	|	|	|
- *	|C1_|C4_|C7_|
- *	|	|	|	|
- *	|C3_|C6_|C9_|
- *
- *	Refer to thesis for more information on this implementation
+/*
+ *	Reads the pose and all 16 sonars of the current robot cycle. A sonar
+ *	fires only every few cycles, so fresh[i] says whether sonar i has a
+ *	reading it didn't have the last time, going by the robot cycle the
+ *	reading was taken in. Called from the sensor task, where the robot is
+ *	already locked.
  */
-
-void fuzzy_map_obstacles( ArRobot* robot, array_type &map, double sonarReading, int sonarIndex, double distanceThreshold, 
-						  double robotTh, double robot_x_pos, double robot_y_pos, 
-						  std::stack<double>* fuzzy_obstacle_stack_x, std::stack<double>* fuzzy_obstacle_stack_y )
+int read_sensors(ArRobot &robot, double time, unsigned int* lastCounter, SensorLogRecord &record, bool* fresh)
 {
-	double cell_1x, cell_1y, cell_2x, cell_2y, cell_3x, cell_3y,
-		   cell_4x, cell_4y, cell_5x, cell_5y, cell_6x, cell_6y,
-		   cell_7x, cell_7y, cell_8x, cell_8y, cell_9x, cell_9y;
-
-	sonarReading = robot->getSonarReading(sonarIndex)->getRange();
-
-	cell_1x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_1y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	//place values onto the stack for faster traversing through the 2D vector
-	fuzzy_obstacle_stack_x->push(cell_1x);
-	fuzzy_obstacle_stack_y->push(cell_1y);
-	//write value at that map index location
-	map[cell_1x][cell_1y] = 0.8;
-
-	cell_2x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_2y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	map[cell_2x][cell_2y] = 0.8 * cos( (12/180) * PI);
-	fuzzy_obstacle_stack_x->push(cell_2x);
-	fuzzy_obstacle_stack_y->push(cell_2y);
-
-
-	cell_3x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( (	(robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_3y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( (	(robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_3x);
-	fuzzy_obstacle_stack_y->push(cell_3y);
-	map[cell_3x][cell_3y] = 0.8 * cos( (12/180) * PI);
-	
-	cell_4x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_4y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_4x);
-	fuzzy_obstacle_stack_y->push(cell_4y);
-	map[cell_4x][cell_4y] = 1;
-
-	cell_5x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_5y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_5x);
-	fuzzy_obstacle_stack_y->push(cell_5y);
-	map[cell_5x][cell_5y] = 0.8 * cos( (12/180) * PI);
-
-	cell_6x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_6y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_6x);
-	fuzzy_obstacle_stack_y->push(cell_6y);
-	map[cell_6x][cell_6y] = 0.8 * cos( (12/180) * PI);
-
-	cell_7x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_7y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_7x);
-	fuzzy_obstacle_stack_y->push(cell_7y);
-	map[cell_7x][cell_7y] = 0.8;
-
-	cell_8x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_8y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_8x);
-	fuzzy_obstacle_stack_y->push(cell_8y);
-	map[cell_8x][cell_8y] = 0.8 * cos( (12/180) * PI);
-
-	cell_9x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_9y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	fuzzy_obstacle_stack_x->push(cell_9x);
-	fuzzy_obstacle_stack_y->push(cell_9y);
-	map[cell_9x][cell_9y] = 0.8 * cos( (12/180) * PI);
+	int count = 0;
+	record.time = time;
+	for(int i = 0; i < SONAR_COUNT; i++)
+	{
+		ArSensorReading* reading = robot.getSonarReading(i);
+		record.range[i] = (float)reading->getRange();
+		record.sensorTh[i] = (float)reading->getSensorTh();
+
+		unsigned int counter = reading->getCounterTaken();
+		fresh[i] = counter != lastCounter[i];
+		lastCounter[i] = counter;
+		if(fresh[i])
+			count++;
+	}
+	record.x = robot.getX();
+	record.y = robot.getY();
+	record.th = robot.getTh();
+	return count;
 }
 
-void fuzzy_map_empty( ArRobot* robot, array_type &map, double sonarReading, int sonarIndex, double distanceThreshold, 
-					  double robotTh, double robot_x_pos, double robot_y_pos,
-					  std::stack<double>* fuzzy_empty_stack_x, std::stack<double>* fuzzy_empty_stack_y )
+/*
+ *	Where to steer to get around whatever the sonars and the map show near
+ *	the robot, towards target (NULL to just keep going). pose is where the
+ *	robot is on the map, range[] the latest reading of each sonar
+ */
+SteeringCommand decide_steering(VectorFieldHistogram &vfh, const ArPose &pose, const SensorLogRecord &sensors,
+								const ArPose* target)
 {
-	double cell_1x, cell_1y, cell_2x, cell_2y, cell_3x, cell_3y,
-		   cell_4x, cell_4y, cell_5x, cell_5y, cell_6x, cell_6y,
-		   cell_7x, cell_7y, cell_8x, cell_8y, cell_9x, cell_9y;
+	double heading = target ? atan2(target->getY() - pose.getY(), target->getX() - pose.getX()) * 180 / PI : 0;
+	return vfh.decide(pose.getX(), pose.getY(), pose.getTh(), sensors.range, sensors.sensorTh, heading, target != NULL);
+}
 
-	sonarReading = robot->getSonarReading(sonarIndex)->getRange();
-	
-	cell_1x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_1y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_1x);
-	fuzzy_empty_stack_y->push(cell_1y);
-	map[cell_1x][cell_1y] = 0.5;
-
-	cell_2x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_2y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_2x);
-	fuzzy_empty_stack_y->push(cell_2y);
-	map[cell_2x][cell_2y] = 0.5 * cos( (12/180) * PI);
-	
-	cell_3x = floor( (robot_x_pos + (sonarReading - distanceThreshold) * cos( (	(robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_3y = floor( (robot_y_pos + (sonarReading - distanceThreshold) * sin( (	(robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_3x);
-	fuzzy_empty_stack_y->push(cell_3y);
-	map[cell_3x][cell_3y] = 0.5 * cos( (12/180) * PI);
-
-	cell_4x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_4y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_4x);
-	fuzzy_empty_stack_y->push(cell_4y);
-	map[cell_4x][cell_4y] = 0;
-
-	cell_5x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_5y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_5x);
-	fuzzy_empty_stack_y->push(cell_5y);
-	map[cell_5x][cell_5y] = 0;
-
-	cell_6x = floor( (robot_x_pos + sonarReading * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_6y = floor( (robot_y_pos + sonarReading * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	map[cell_6x][cell_6y] = 0;
-	fuzzy_empty_stack_x->push(cell_6x);
-	fuzzy_empty_stack_y->push(cell_6y);
-
-	cell_7x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	cell_7y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh()) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_7x);
-	fuzzy_empty_stack_y->push(cell_7y);
-	map[cell_7x][cell_7y] = 1;
-
-	cell_8x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	cell_8y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() + 12) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_8x);
-	fuzzy_empty_stack_y->push(cell_8y);
-	map[cell_8x][cell_8y] = 1;
-
-	cell_9x = floor( (robot_x_pos + (sonarReading + distanceThreshold) * cos( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	cell_9y = floor( (robot_y_pos + (sonarReading + distanceThreshold) * sin( ( (robot->getSonarReading(sonarIndex)->getSensorTh() + robot->getTh() - 12) / 180) * PI )) / 100) + 1;
-	fuzzy_empty_stack_x->push(cell_9x);
-	fuzzy_empty_stack_y->push(cell_9y);
-	map[cell_9x][cell_9y] = 1;
+/*
+ *	Steers the robot by decide_steering. Called from the robot's own
+ *	thread, the robot is already locked. Returns how long the decision
+ *	took [s].
+ */
+double avoid_obstacles(ArRobot &robot, VectorFieldHistogram &vfh, const ArPose &pose, const SensorLogRecord &sensors,
+					 const ArPose* target)
+{
+	SteeringCommand command = decide_steering(vfh, pose, sensors, target);
+	robot.setVel(command.speed);
+	robot.setDeltaHeading(command.turn);
+	return command.seconds;
 }
 
-int main(int argc, char** argv)
+/*
+ *	The mapper. ArRobot runs the task half as a sensor interpretation
+ *	task once per robot cycle (~100ms), right after the new sonar packets
+ *	are in. All it does there is read the pose and the sonars, queue the
+ *	cycle for the mapper thread and steer by the last command that thread
+ *	came up with, so a slow map update never holds up the robot's packet
+ *	loop. A command older than STEER_TIMEOUT stops the robot until the
+ *	mapper thread catches up.
+ *
+ *	The mapper thread takes the queued cycles in order. Only sonars with a
+ *	new reading go into the map, so nothing gets counted twice, and a
+ *	cycle with no new reading at all isn't queued. Each cycle is logged
+ *	with the raw odometry, its echoes get scan matched against the map
+ *	and the map goes by the corrected pose, all inside SonarMapper, so
+ *	mapping_replay makes the same map out of the log. Then it steers for the
+ *	latest cycle, new readings or not: every few seconds it picks the
+ *	best frontier as the place to explore next, the planner repairs the
+ *	path there around whatever the map learned and the robot steers for
+ *	a point a few cells down that path. Cycles that pile up past
+ *	MAPPER_QUEUE_LIMIT are dropped, from the map and the log both.
+ *
+ *	The run ends after timeLimit seconds, or once coverageLimit square
+ *	meters have been seen (0 for no coverage limit).
+ */
+class MappingTask
 {
-	//We will be writing data to a file, so create a file
-	ofstream output("robot_map.dat");
+public:
+	MappingTask(ArRobot &robot, SonarMapper &mapper, FrontierMap &frontiers,
+				const OccupancyPlanes &planes, GridPlanner &planner, ScanMatcher &matcher, SensorLogWriter &recorder,
+				double timeLimit, double coverageLimit)
+		: myRobot(robot), myMapper(mapper), myFrontiers(frontiers), myPlanes(planes), myPlanner(planner),
+		  myMatcher(matcher), myRecorder(recorder), myVfh(mapper.getMap().getCellSize()),
+		  myTimeLimit(timeLimit), myCoverageLimit(coverageLimit),
+		  myTaskCB(this, &MappingTask::run),
+		  myDone(false), myHasSteer(false), myHasCommand(false), myCommandAt(0), myCoverage(0), myStop(false),
+		  myTasks(0), myTaskSeconds(0), myTaskWorst(0), myCycles(0), mySkipped(0), myDropped(0), myMappingSeconds(0),
+		  myMatched(0), myMatchSeconds(0), mySteered(0), mySteerSeconds(0), myLastStatus(0), myHasGoal(false),
+		  myLastGoal(-GOAL_INTERVAL), myHasPath(false)
+	{
+		myVfh.setMap(&mapper.getMap(), &planes.getGlobal());
+		for(int i = 0; i < SONAR_COUNT; i++)
+			myLastCounter[i] = 0;
+		myStartSeconds = now_seconds();
+		myThread = boost::thread(&MappingTask::mapperLoop, this);
+		myRobot.addSensorInterpTask("mapping", 50, &myTaskCB);
+	}
 
-	/*
-	 * stacks are used so when we update our map, we don't have to trace through the entire 2D vector to 
-	 * and deal with the slow computation time due to the robots crappy hardware
-	 */ 
-
-	std::stack<double> fuzzy_obstacle_stack_x;
-	std::stack<double> fuzzy_obstacle_stack_y;
-	double update_obstacle_x = NULL;
-	double update_obstacle_y = NULL;
-
-	std::stack<double> fuzzy_empty_stack_x;
-	std::stack<double> fuzzy_empty_stack_y;
-	double update_empty_x = NULL;
-	double update_empty_y = NULL;
-	
-	/* 
-	 *	Obstacle map maps obstacles and uses fuzzy logic to do some things
-	 *	Empty map maps empty regions and uses fuzzy logic to do some things
-	 *	Global map is updated at the very end of the program 
-	 */
+	~MappingTask() { stop(); }
+
+	//blocks the calling thread until the run is over, waking up once a second
+	void waitUntilDone()
+	{
+		while(!isDone())
+			myDoneCondition.timedWait(1000);
+	}
+
+	bool isDone()
+	{
+		myMutex.lock();
+		bool done = myDone;
+		myMutex.unlock();
+		return done;
+	}
+
+	//maps what is still queued and ends the mapper thread, the map is all this thread's again after
+	void stop()
+	{
+		{
+			boost::mutex::scoped_lock lock(myQueueMutex);
+			myStop = true;
+		}
+		myQueueCond.notify_all();
+		if(myThread.joinable())
+			myThread.join();
+	}
+
+	//counters, read them once stop() returned
+	long getTasks() const { return myTasks; }
+	double getTaskSeconds() const { return myTaskSeconds; }
+	double getTaskWorst() const { return myTaskWorst; }
+	long getCycles() const { return myCycles; }
+	long getSkipped() const { return mySkipped; }
+	long getDropped() const { return myDropped; }
+	double getMappingSeconds() const { return myMappingSeconds; }
+	long getMatched() const { return myMatched; }
+	double getMatchSeconds() const { return myMatchSeconds; }
+	long getSteered() const { return mySteered; }
+	double getSteerSeconds() const { return mySteerSeconds; }
+
+	//area that has had at least one sonar cone over it, [m^2], mapper thread or after stop()
+	double getCoverage() const
+	{
+		double cell = myMapper.getMap().getCellSize() / 1000;
+		return myPlanes.getSeen().count() * cell * cell;
+	}
+
+private:
+	//the robot cycle: readings in, last command out, nothing that touches the map
+	void run()
+	{
+		if(isDone())
+			return;
+
+		double cycle_start = now_seconds();
+		double elapsed = cycle_start - myStartSeconds;
+
+		SensorLogRecord sensors;
+		bool fresh[SONAR_COUNT];
+		int fresh_count = read_sensors(myRobot, elapsed, myLastCounter, sensors, fresh);
+
+		boost::mutex::scoped_lock lock(myQueueMutex);
+
+		//setDeltaHeading turns from wherever the robot points now, a command is only good once
+		if(myHasCommand)
+		{
+			myRobot.setVel(myCommand.speed);
+			myRobot.setDeltaHeading(myCommand.turn);
+			myHasCommand = false;
+		}
+		else if(elapsed - myCommandAt > STEER_TIMEOUT)
+			myRobot.setVel(0);
 
-	array_type robot_map_obstacles(boost::extents[160][160]);
-	array_type robot_map_obstacles_new(boost::extents[160][160]);
+		//steering always goes by the latest reading of each sonar, new or not
+		mySteer = sensors;
+		myHasSteer = true;
 
-	array_type robot_map_empty(boost::extents[160][160]);
-	array_type robot_map_empty_new(boost::extents[160][160]);
+		if(fresh_count > 0)
+		{
+			//sonars without a new reading get range 0, below SONAR_MIN_RANGE, so they add nothing
+			for(int i = 0; i < SONAR_COUNT; i++)
+				if(!fresh[i])
+					sensors.range[i] = 0;
+
+			if(myQueue.size() < MAPPER_QUEUE_LIMIT)
+				myQueue.push_back(sensors);
+			else
+				myDropped++;
+		}
+		else
+			mySkipped++;
+
+		bool covered = myCoverageLimit > 0 && myCoverage >= myCoverageLimit;
+		lock.unlock();
+		myQueueCond.notify_one();
 
-	array_type robot_map_global(boost::extents[160][160]);
+		if(elapsed >= myTimeLimit || covered)
+		{
+			myRobot.setVel(0);
+			myRobot.setRotVel(0);
+
+			myMutex.lock();
+			myDone = true;
+			myMutex.unlock();
+			myDoneCondition.broadcast();
+		}
 
-	//set initial values of matrix 
-	for(index i = 0; i != 160; ++i)
+		double seconds = now_seconds() - cycle_start;
+		myTasks++;
+		myTaskSeconds += seconds;
+		myTaskWorst = max(myTaskWorst, seconds);
+	}
+
+	//takes whatever the robot cycles queued until stop(), the map is only ever changed here
+	void mapperLoop()
 	{
-		for(index j = 0; j != 160; ++j)
+		std::vector<SensorLogRecord> cycles;
+		boost::mutex::scoped_lock lock(myQueueMutex);
+		while(true)
 		{
-			robot_map_obstacles[i][j] = 0;
-			robot_map_obstacles_new[i][j] = 0;
-			
-			robot_map_empty[i][j] = 1;		//empty map represents 1 as empty spot. 
-			robot_map_empty_new[i][j] = 1;
+			while(myQueue.empty() && !myHasSteer && !myStop)
+				myQueueCond.wait(lock);
+			if(myQueue.empty() && myStop)
+				return;
+
+			cycles.swap(myQueue);
+			myQueue.clear();
+			SensorLogRecord steer = mySteer;
+			bool steering = myHasSteer && !myStop;
+			myHasSteer = false;
+			lock.unlock();
+
+			for(size_t i = 0; i < cycles.size(); i++)
+				mapCycle(cycles[i]);
+
+			SteeringCommand command = SteeringCommand();
+			if(steering)
+				command = decideSteering(steer);
+			double coverage = getCoverage();
+			if(steer.time - myLastStatus >= STATUS_INTERVAL)
+			{
+				myLastStatus = steer.time;
+				cout << (int)steer.time << " s: " << myCycles << " map updates, " << coverage << " m^2 seen, "
+					 << myFrontiers.size() << " frontier cells" << endl;
+			}
 
-			robot_map_global[i][j] = 0;
+			lock.lock();
+			if(steering)
+			{
+				myCommand = command;
+				myHasCommand = true;
+				myCommandAt = steer.time;
+			}
+			myCoverage = coverage;
 		}
 	}
 
-	//Have user specify where the robot is initially located in relation to the map
-	int init_x, init_y;
+	void mapCycle(SensorLogRecord &sensors)
+	{
+		double start = now_seconds();
+		myRecorder.write(sensors);
+
+		//scan match, cones, journal, merge and checkpoint, what mapping_replay does with the log
+		ScanMatchResult match;
+		myMapper.update(sensors, &match);
+		myMatchSeconds += match.seconds;
+		if(match.matched)
+			myMatched++;
+		sync_planner(myPlanner, myMapper.getMap(), myMapper.getDirty());
+
+		myMappingSeconds += now_seconds() - start;
+		myCycles++;
+	}
 
-	cout << "x position: ";
-	cin >> init_x;
+	SteeringCommand decideSteering(const SensorLogRecord &sensors)
+	{
+		updatePose(sensors);
+		updateGoal(sensors.time);
+		updatePath();
+		SteeringCommand command = decide_steering(myVfh, myPose, sensors, myHasGoal ? &myTarget : NULL);
+		mySteerSeconds += command.seconds;
+		mySteered++;
+		return command;
+	}
 
-	cout << "\n y position: ";
-	cin >> init_y;
-	
-	//Start up Robot stuff
-	Aria::init();
+	//the odometry pose moved onto the map with the last scan match correction
+	void updatePose(const SensorLogRecord &sensors)
+	{
+		double x, y, th;
+		myMatcher.getCorrection(x, y, th);
+		double a = th / 180 * PI;
+		myPose.setPose(cos(a) * sensors.x - sin(a) * sensors.y + x, sin(a) * sensors.x + cos(a) * sensors.y + y, sensors.th + th);
+	}
 
-	ArRobot robot;
-	ArKeyHandler keyHandler;
-	ArSonarDevice sonar;
+	//picks the frontier to head for every GOAL_INTERVAL, or right away once the robot got there
+	void updateGoal(double elapsed)
+	{
+		double x = myPose.getX(), y = myPose.getY();
+		bool reached = myHasGoal && (myGoal.goalX - x) * (myGoal.goalX - x) + (myGoal.goalY - y) * (myGoal.goalY - y) < GOAL_REACHED * GOAL_REACHED;
+		if(!reached && elapsed - myLastGoal < GOAL_INTERVAL)
+			return;
+		myLastGoal = elapsed;
+		myHasGoal = myFrontiers.selectGoal(x, y, myGoal);
+		myHasPath = false;
+
+		const logodds_grid &map = myMapper.getMap();
+		if(myHasGoal)
+			myHasGoal = myPlanner.setGoal(map.worldToCell(myGoal.goalX), map.worldToCell(myGoal.goalY));
+	}
 
-	ArSimpleConnector connector(&argc, argv);
+	/*
+	 *	Repairs the path to the goal from where the robot is now, at most
+	 *	PLANNER_BUDGET cells a cycle. A repair that needs more goes on next
+	 *	cycle and the robot keeps steering for the last path's point
+	 *	meanwhile. Without a path (boxed in, a new goal still being
+	 *	searched, or the map isn't sure yet) it heads straight for the
+	 *	frontier and lets the sonars sort it out, like before
+	 */
+	void updatePath()
+	{
+		if(!myHasGoal)
+			return;
+
+		const logodds_grid &map = myMapper.getMap();
+		if(!myPlanner.setStart(map.worldToCell(myPose.getX()), map.worldToCell(myPose.getY())))
+			myHasPath = false;
+		else
+		{
+			bool found = myPlanner.plan(PLANNER_BUDGET);
+			if(!myPlanner.isFinished() && myHasPath)
+				return;
+			myHasPath = found && myPlanner.getPath(myPathX, myPathY);
+		}
+		if(!myHasPath)
+		{
+			myTarget.setPose(myGoal.goalX, myGoal.goalY);
+			return;
+		}
+
+		size_t ahead = min((size_t)PATH_LOOKAHEAD, myPathX.size() - 1);
+		double cell = map.getCellSize();
+		myTarget.setPose((myPathX[ahead] + 0.5) * cell, (myPathY[ahead] + 0.5) * cell);
+	}
+
+	ArRobot &myRobot;
+	SonarMapper &myMapper;
+	FrontierMap &myFrontiers;
+	const OccupancyPlanes &myPlanes;
+	GridPlanner &myPlanner;
+	ScanMatcher &myMatcher;
+	SensorLogWriter &myRecorder;
+	VectorFieldHistogram myVfh;
+	double myTimeLimit;
+	double myCoverageLimit;
+	ArFunctorC<MappingTask> myTaskCB;
+
+	ArMutex myMutex;
+	ArCondition myDoneCondition;
+	bool myDone;
+
+	//between the robot cycle and the mapper thread
+	boost::mutex myQueueMutex;
+	boost::condition_variable myQueueCond;
+	std::vector<SensorLogRecord> myQueue;	//cycles with new readings, oldest first
+	SensorLogRecord mySteer;				//latest cycle, for steering
+	bool myHasSteer;
+	SteeringCommand myCommand;				//not applied yet
+	bool myHasCommand;
+	double myCommandAt;						//[s] of the cycle the last command went by
+	double myCoverage;						//[m^2]
+	bool myStop;
+	boost::thread myThread;
+
+	//robot cycle only
+	unsigned int myLastCounter[SONAR_COUNT];
+	double myStartSeconds;
+	long myTasks;
+	double myTaskSeconds;
+	double myTaskWorst;
+
+	//mapper thread only, except mySkipped and myDropped, which are under myQueueMutex
+	long myCycles;
+	long mySkipped;
+	long myDropped;
+	double myMappingSeconds;
+	long myMatched;
+	double myMatchSeconds;
+	long mySteered;
+	double mySteerSeconds;
+	ArPose myPose;							//scan matched, map frame
+	double myLastStatus;
+
+	FrontierCluster myGoal;
+	bool myHasGoal;
+	double myLastGoal;
+
+	std::vector<int> myPathX, myPathY;		//map cells, robot to goal
+	bool myHasPath;
+	ArPose myTarget;						//where the robot steers for this cycle
+};
+
+/*
+ *	Connects to the robot with whatever the connector parsed out of the
+ *	command line and turns the motors on. Leftover arguments print the
+ *	options and exit, so does a failed connection
+ */
+void start_robot(ArRobot &robot, ArSimpleConnector &connector, ArKeyHandler &keyHandler, ArSonarDevice &sonar, int argc)
+{
 	connector.parseArgs();
 
 	if(argc > 1)
@@ -275,166 +500,359 @@ int main(int argc, char** argv)
 
 	ArLog::log(ArLog::Normal, "Connected to robot");
 
-	int robot_x = robot.getX();
-	int robot_y = robot.getY();
-
 	robot.comInt(ArCommands::ENABLE, 1);
 	robot.comInt(ArCommands::SOUNDTOG, 0);
-	
-	//init front sonar vars for obstacle avoidance 
-	double left_sonar_0;
-	double front_left_sonar_1, front_left_sonar_2;
-	double front_sonar_1, front_sonar_2;
-	double front_right_sonar_1, front_right_sonar_2;
-	double right_sonar_7;
+}
 
-	double sonar_range;
+/*
+ *	Localizes on a map of an earlier run instead of making a new one, run
+ *	by ArRobot as a sensor interpretation task like MappingTask. The robot
+ *	wanders while the particle filter works out where on the map it is,
+ *	from nothing, steering by the sonars alone until then and by the
+ *	map's obstacles as well while the particles stay together. The run
+ *	ends after timeLimit seconds.
+ */
+class LocalizationTask
+{
+public:
+	LocalizationTask(ArRobot &robot, ParticleLocalizer &localizer, const logodds_grid &map, const OccupancyPlanes &planes,
+					 double timeLimit)
+		: myRobot(robot), myLocalizer(localizer), myMap(map), myPlanes(planes), myVfh(map.getCellSize()), myTimeLimit(timeLimit),
+		  myTaskCB(this, &LocalizationTask::run),
+		  myDone(false), myUpdates(0), myUpdateSeconds(0), mySlowest(0), myLastStatus(0), myLocalizedAt(-1), myOnMap(false)
+	{
+		for(int i = 0; i < SONAR_COUNT; i++)
+			myLastCounter[i] = 0;
+		myStartSeconds = now_seconds();
+		myRobot.addSensorInterpTask("localization", 50, &myTaskCB);
+	}
+
+	void waitUntilDone()
+	{
+		while(!isDone())
+			myDoneCondition.timedWait(1000);
+	}
 
-	//feedback velocity and rotation velocity
-	double vel;
-	double robot_th;
+	bool isDone()
+	{
+		myMutex.lock();
+		bool done = myDone;
+		myMutex.unlock();
+		return done;
+	}
 
-	robot.runAsync(true);
-	msg("Robot connected successfully...continuing");
+	long getUpdates() const { return myUpdates; }
+	double getUpdateSeconds() const { return myUpdateSeconds; }
+	double getSlowest() const { return mySlowest; }
+	double getLocalizedAt() const { return myLocalizedAt; }
+	const LocalizerResult& getLast() const { return myLast; }
 
-	// I'm ashamded on this "counter" that ends the program after a set number of cycles :(
-	int x = 300000;
-	while(x != 0)
+private:
+	void run()
 	{
-		robot_x  = robot.getX() + init_x;
-		robot_y  = robot.getY() + init_y;
-		robot_th = robot.getTh();
-
-		//get front sonar values for obstacle avoidance
-		left_sonar_0		=	robot.getSonarReading(0)->getRange();
-		front_left_sonar_1	=	robot.getSonarReading(1)->getRange();
-		front_left_sonar_2	=	robot.getSonarReading(2)->getRange();
-		front_sonar_1		=	robot.getSonarReading(3)->getRange();
-		front_sonar_2		=	robot.getSonarReading(4)->getRange();
-		front_right_sonar_1 =	robot.getSonarReading(5)->getRange();
-		front_right_sonar_2 =	robot.getSonarReading(6)->getRange();
-		right_sonar_7		=	robot.getSonarReading(7)->getRange();
-
-		//trace through all 16 sonars and update the map if required
-		for(int i = 0; i < 16; i++)
-		{
-			sonar_range = robot.getSonarReading(i)->getRange();
-			
-			if(sonar_range < 4500 && sonar_range > 200)
-			{
-				fuzzy_map_obstacles( &robot, robot_map_obstacles, sonar_range, i, 10.0, 
-									 robot_th, robot_x, robot_y, 
-									 &fuzzy_obstacle_stack_x, &fuzzy_obstacle_stack_y );
+		if(isDone())
+			return;
 
-				fuzzy_map_empty	   ( &robot, robot_map_empty, sonar_range, i, 10.0, 
-									 robot_th, robot_x, robot_y, 
-									 &fuzzy_empty_stack_x, &fuzzy_empty_stack_y );
-			}
-		}
+		double elapsed = now_seconds() - myStartSeconds;
 
-		//update obstacle map by popping off values from the (x,y) stacks for obstacles
-		while(!fuzzy_obstacle_stack_x.empty() && !fuzzy_obstacle_stack_x.empty())
-		{
-			//grab the coordinates at which the map got updated
-			update_obstacle_x = fuzzy_obstacle_stack_x.top();
-			update_obstacle_y = fuzzy_obstacle_stack_y.top();
-			//pop to remove the value...we don't need it anymore after we use it
-			fuzzy_obstacle_stack_x.pop();
-			fuzzy_obstacle_stack_y.pop();
-			//based on those coordinates, update the map at only at THAT location
-			robot_map_obstacles_new[ update_obstacle_x ][ update_obstacle_y ] |= robot_map_obstacles[ update_obstacle_x ][ update_obstacle_y ];
-		}
+		SensorLogRecord sensors;
+		bool fresh[SONAR_COUNT];
+		read_sensors(myRobot, elapsed, myLastCounter, sensors, fresh);
 
-		//update empty map by popping off values from the (x,y) stacks for obstacles
-		while(!fuzzy_empty_stack_x.empty() && !fuzzy_empty_stack_y.empty())
-		{
-			update_obstacle_x = fuzzy_empty_stack_x.top();
-			update_obstacle_y = fuzzy_empty_stack_y.top();
-			fuzzy_empty_stack_x.pop();
-			fuzzy_empty_stack_y.pop();
+		//the map only helps steering once the robot is on it
+		avoid_obstacles(myRobot, myVfh, myPose, sensors, NULL);
 
-			robot_map_empty_new[ update_obstacle_x ][ update_obstacle_y ] &= robot_map_empty[ update_obstacle_x ][ update_obstacle_y ];
-		}
+		//a sonar without a new reading would count its old echo again
+		for(int i = 0; i < SONAR_COUNT; i++)
+			if(!fresh[i])
+				sensors.range[i] = 0;
 
-		//now avoid obstacles and things
-		if(front_sonar_1 < 800 || front_sonar_2 < 800)
+		myLast = myLocalizer.update(sensors);
+		myPose.setPose(myLast.x, myLast.y, myLast.th);
+		if(myLast.updated)
 		{
-			//cout << "Front blocked. Checking left and rightt" << endl;
-			if(front_left_sonar_1 < 800 || front_left_sonar_2 < 800 || left_sonar_0 < 800)
-			{
-				//cout << "Left blocked. Turning right" << endl;
-				//based on how close the robot is to the obstacle, it will gradually speed up if far away, or slow down if closer
-				vel = (min(front_left_sonar_1, front_left_sonar_2) - 200) / 6;
-				robot.setVel(vel);
-				robot.setDeltaHeading(-20);
-				//cout << "Robot angle: " << robot.getTh() << endl;
-			}
-			else if(front_right_sonar_1 < 800 || front_right_sonar_2 < 800 || right_sonar_7 < 800)
-			{
-			//	cout << "Right blocked. Turning left" << endl;
-				vel = (min(front_right_sonar_1, front_right_sonar_2) - 200) / 6;
-				robot.setVel(vel);
-				robot.setDeltaHeading(20);
-				//cout << "Robot angle: " << robot.getTh() << endl;
-			}
-			else
-			{
-				robot.setVel(-100);
-				robot.setDeltaHeading(20);
-				//cout << "Robot angle: " << robot.getTh() << endl;
-			}
+			myUpdates++;
+			myUpdateSeconds += myLast.seconds;
+			mySlowest = max(mySlowest, myLast.seconds);
 		}
-		else if(front_left_sonar_1 < 800 || front_left_sonar_2 < 800 || left_sonar_0 < 800)
+		//a cloud that spread out again may be anywhere, its map obstacles would steer the robot by a wrong pose
+		bool localized = myLast.spread < LOCALIZED_SPREAD;
+		if(localized != myOnMap)
 		{
-			//cout << "Approaching obstacle on the left. Turning Right" << endl;
-			vel = (min(front_left_sonar_1, front_left_sonar_2) - 200)/6;
-			robot.setVel(vel);
-			robot.setDeltaHeading(-20);
-			//cout << "Robot angle: " << robot.getTh() << endl;
+			myOnMap = localized;
+			if(localized)
+				myVfh.setMap(&myMap, &myPlanes.getGlobal());
+			else
+				myVfh.setMap(NULL, NULL);
+			if(localized && myLocalizedAt < 0)
+				myLocalizedAt = elapsed;
+			cout << (int)elapsed << " s: " << (localized ? "localized at " : "lost, particles spread out around ")
+				 << (int)myLast.x << ", " << (int)myLast.y << ", " << (int)myLast.th << " deg" << endl;
 		}
-		else if(front_right_sonar_1 < 800 || front_right_sonar_2 < 800 || right_sonar_7 < 800)
+
+		if(elapsed - myLastStatus >= STATUS_INTERVAL)
 		{
-			//cout << "Approaching obstacle on the right. Turning Left." << endl;
-			vel = (min(front_right_sonar_1, front_right_sonar_2) - 200)/6;
-			robot.setVel(vel);
-			robot.setDeltaHeading(20);
-			//cout << "Robot angle: " << robot.getTh() << endl;
+			myLastStatus = elapsed;
+			cout << (int)elapsed << " s: " << (int)myLast.x << ", " << (int)myLast.y << ", " << (int)myLast.th
+				 << " deg, spread " << (int)myLast.spread << " mm, " << myLast.particles << " particles, "
+				 << (myUpdates > 0 ? myUpdateSeconds / myUpdates * 1e3 : 0) << " ms per update" << endl;
 		}
-		else
+
+		if(elapsed >= myTimeLimit)
 		{
-			robot.setVel(300);
-			robot.setDeltaHeading(0);
+			myRobot.setVel(0);
+			myRobot.setRotVel(0);
+
+			myMutex.lock();
+			myDone = true;
+			myMutex.unlock();
+			myDoneCondition.broadcast();
 		}
-		
-		x--;
-		cout << "X = " << x << endl;
 	}
 
-	//stop robot, once it breaks out of the loop, it would keep the velocity it currently had without this
+	ArRobot &myRobot;
+	ParticleLocalizer &myLocalizer;
+	const logodds_grid &myMap;
+	const OccupancyPlanes &myPlanes;
+	VectorFieldHistogram myVfh;
+	double myTimeLimit;
+	ArFunctorC<LocalizationTask> myTaskCB;
+
+	ArMutex myMutex;
+	ArCondition myDoneCondition;
+	bool myDone;
+
+	unsigned int myLastCounter[SONAR_COUNT];
+	double myStartSeconds;
+	long myUpdates;
+	double myUpdateSeconds;
+	double mySlowest;
+	double myLastStatus;
+	double myLocalizedAt;				//[s] when the particles first pulled together, -1 before
+	bool myOnMap;						//steering by the map's obstacles, the particles are together
+	LocalizerResult myLast;
+	ArPose myPose;
+};
+
+//-localize <map.bin>: finds the robot on the map of an earlier run, the map files are left alone
+int localize(int argc, char** argv)
+{
+	Aria::init();
+
+	ArArgumentParser parser(&argc, argv);
+	const char* map_path = parser.checkParameterArgument("-localize");
+	double time_limit = DEFAULT_TIME_LIMIT;
+	parser.checkParameterArgumentDouble("-time", &time_limit);
+
+	logodds_grid map(0);
+	if(map_path == NULL || !load_map_file(map_path, map))
+	{
+		cout << "Could not read map " << (map_path ? map_path : "") << endl;
+		Aria::shutdown();
+		return 1;
+	}
+
+	//echo likelihoods and obstacle cells over the whole map, computed once
+	LikelihoodField field;
+	field.build(map);
+	OccupancyPlanes planes;
+	planes.build(map);
+	cout << "Loaded " << map_path << ", " << field.getFreeCells().size() << " free cells, "
+		 << field.getMemoryUsage() / 1024 << " KB likelihood field" << endl;
+
+	ParticleLocalizer localizer(field);
+	localizer.initGlobal();
+
+	ArRobot robot;
+	ArKeyHandler keyHandler;
+	ArSonarDevice sonar;
+	ArSimpleConnector connector(&argc, argv);
+	start_robot(robot, connector, keyHandler, sonar, argc);
+
+	LocalizationTask task(robot, localizer, map, planes, time_limit);
+	robot.runAsync(true);
+	task.waitUntilDone();
+
+	robot.lock();
 	robot.setVel(0);
 	robot.setRotVel(0);
+	robot.unlock();
+
+	const LocalizerResult &last = task.getLast();
+	if(task.getLocalizedAt() >= 0)
+		cout << "Localized after " << task.getLocalizedAt() << " s, last pose " << last.x << ", " << last.y << ", "
+			 << last.th << " deg, spread " << last.spread << " mm" << endl;
+	else
+		cout << "Never localized, spread still " << last.spread << " mm" << endl;
+	if(task.getUpdates() > 0)
+		cout << "Filter update: " << task.getUpdateSeconds() / task.getUpdates() * 1e3 << " ms on average, "
+			 << task.getSlowest() * 1e3 << " ms worst over " << task.getUpdates() << " updates" << endl;
 
-	/*
-	 * AND together the obstacle map and the empty map and set it equal to the global map
-	 * Nested loop to ensure that the WHOLE map gets updated
+	Aria::shutdown();
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	//-localize works on an existing map, before anything below truncates the map files
+	for(int i = 1; i < argc; i++)
+		if(strcmp(argv[i], "-localize") == 0)
+			return localize(argc, argv);
+
+	/* 
+	 *	Global map is the log-odds of each cell being occupied.
+	 *	The cycle evidence holds the obstacle (log-odds > 0) and empty (log-odds < 0) evidence
+	 *	of the current cycle plus the set of cells it touched, so when we update our map we only
+	 *	visit each touched cell once instead of tracing through the entire map
 	 */
-	for(index i = 0; i != 160; ++i)
-		for(index j = 0; j != 160; ++j)
-			robot_map_global[i][j] = robot_map_obstacles_new[i][j] & ~(robot_map_empty_new[i][j]);
+
+	SonarMapper mapper;
+	logodds_grid &robot_map_global = mapper.getMap();
+
+	//the map also goes to robot_map.bin as it gets built, so a dead battery doesn't lose the run
+	MapCheckpointer checkpointer("robot_map.bin", robot_map_global.getCellSize(), CHECKPOINT_INTERVAL);
+	if(!checkpointer.isOpen())
+		cout << "Could not create robot_map.bin, map will only be saved at the end" << endl;
+	mapper.setCheckpointer(&checkpointer);
+
+	//max-pooled levels over the map, "anything in this block?" without scanning it
+	MapPyramid pyramid;
+	mapper.setPyramid(&pyramid);
+
+	//distance to the closest obstacle cell, kept current around the cells each cycle changes
+	DistanceMap distance;
+	mapper.setDistanceMap(&distance);
+
+	//edge between seen free space and the unknown, where the robot goes next
+	FrontierMap frontiers;
+	mapper.setFrontiers(&frontiers);
+
+	//obstacle, empty, global and seen layers, a bit per cell, the global one recomposed every cycle
+	OccupancyPlanes planes;
+	mapper.setPlanes(&planes);
+
+	//paths to the frontiers, repaired every cycle instead of planned over, a bounded amount each cycle
+	GridPlanner planner(PLANNER_WINDOW, PLANNER_WINDOW, -PLANNER_WINDOW / 2, -PLANNER_WINDOW / 2, PLANNER_RADIUS);
+
+	//lines the sonar echoes up with the map to take the odometry drift out of the poses
+	ScanMatcher matcher;
+	mapper.setMatcher(&matcher);
+
+	//Start up Robot stuff
+	Aria::init();
+
+	ArRobot robot;
+	ArKeyHandler keyHandler;
+	ArSonarDevice sonar;
+
+	//-resume picks the map back up from the journal of the last run. Start the robot
+	//from the same spot and heading as that run, odometry starts over at 0
+	ArArgumentParser parser(&argc, argv);
+	bool resume = parser.checkArgument("-resume");
+
+	//-record <file> logs the raw pose and sonar readings, mapping_replay maps them again without a robot
+	const char* record_path = parser.checkParameterArgument("-record");
+
+	//-time <s> and -coverage <m^2> end the run, whichever comes first
+	double time_limit = DEFAULT_TIME_LIMIT;
+	double coverage_limit = 0;
+	parser.checkParameterArgumentDouble("-time", &time_limit);
+	parser.checkParameterArgumentDouble("-coverage", &coverage_limit);
+
+	ArSimpleConnector connector(&argc, argv);
+	start_robot(robot, connector, keyHandler, sonar, argc);
 	
-	//write global map to file
-	cout << "Writing .dat file " << endl;
-	for(index i = 0; i != 160; ++i)
+	//every map update also goes into the journal, journal_replay rebuilds the map at any cycle from it
+	MapJournal journal("robot_map", JOURNAL_SNAPSHOT_INTERVAL);
+	uint32_t journal_cycle = 0;
+	if(resume)
 	{
-		for(index j = 0; j != 160; ++j)
-			output << setw(4) << robot_map_global[i][j] << " ";
-		output << "\n";
-	}	
+		if(replay_journal("robot_map", JOURNAL_LAST_CYCLE, robot_map_global, journal_cycle))
+		{
+			cout << "Resuming the map after cycle " << journal_cycle << endl;
+			checkpointer.markAllDirty(robot_map_global);
+			pyramid.build(robot_map_global);
+			distance.build(robot_map_global);
+			frontiers.build(robot_map_global);
+			planes.build(robot_map_global);
+		}
+		else
+			cout << "No journal to resume from, starting a new map" << endl;
+	}
+	if(!journal.start(journal_cycle, robot_map_global))
+		cout << "Could not create the map journal" << endl;
+	mapper.setCycle(journal_cycle);
+	mapper.setJournal(&journal);
+
+	//whatever the map holds by now, unknown cells included, after that the task keeps it in sync
+	load_planner(planner, robot_map_global);
+
+	SensorLogWriter recorder;
+	if(record_path != NULL && !recorder.open(record_path))
+		cout << "Could not create sensor log " << record_path << endl;
+
+	//the robot cycle and the mapper thread run from here on, this one just waits for the end of the run
+	MappingTask mapping_task(robot, mapper, frontiers, planes, planner, matcher, recorder, time_limit,
+							 coverage_limit);
+
+	robot.runAsync(true);
+	msg("Robot connected successfully...continuing");
+
+	mapping_task.waitUntilDone();
+
+	//the task already stopped the robot, make sure with the robot locked
+	robot.lock();
+	robot.setVel(0);
+	robot.setRotVel(0);
+	robot.unlock();
+
+	//the mapper thread maps what is left in the queue before the map gets written
+	mapping_task.stop();
+
+	long mapping_cycles = mapping_task.getCycles();
+	double mapping_seconds = mapping_task.getMappingSeconds();
+	cout << "Mapping done: " << mapping_cycles << " cycles with new readings, " << mapping_task.getSkipped()
+		 << " without, " << mapping_task.getCoverage() << " m^2 seen" << endl;
+
+	//mapping_replay of the -record log prints the same, unless the run resumed a journal
+	cout << "Map checksum " << hex << setw(8) << setfill('0') << map_checksum(robot_map_global) << dec << setfill(' ') << endl;
+
+	if(mapping_task.getTasks() > 0)
+		cout << "Robot cycle task: " << (mapping_task.getTaskSeconds() / mapping_task.getTasks()) * 1e6 << " us on average, "
+			 << mapping_task.getTaskWorst() * 1e6 << " us worst, " << mapping_task.getDropped()
+			 << " cycles dropped behind the mapper thread" << endl;
+	if(mapping_cycles > 0)
+		cout << "Map update: " << (mapping_seconds / mapping_cycles) * 1e6 << " us per cycle over "
+			 << mapping_cycles << " cycles" << endl;
+	if(mapping_cycles > 0)
+		cout << "Scan matching: " << (mapping_task.getMatchSeconds() / mapping_cycles) * 1e3 << " ms per cycle, "
+			 << mapping_task.getMatched() << " of " << mapping_cycles << " cycles matched" << endl;
+	if(mapping_task.getSteered() > 0)
+		cout << "Obstacle avoidance: " << (mapping_task.getSteerSeconds() / mapping_task.getSteered()) * 1e6
+			 << " us per decision" << endl;
+
+	//last checkpoint, waits for the disk
+	checkpointer.finish(robot_map_global);
+	journal.close();
+	recorder.close();
+
+	//write global map to file, only the bounding box of the explored area gets written
+	cout << "Writing .dat file " << endl;
+	if(!write_map_dat(robot_map_global, "robot_map"))
+		cout << "Could not write robot_map.dat" << endl;
+
+	//the same map as an image for viewers and as log-odds for taking it off the robot
+	size_t image_bytes = 0, rle_bytes = 0;
+	double export_start = now_seconds();
+	if(!export_map_image(robot_map_global, "robot_map", MAP_IMAGE_PNG, &image_bytes))
+		cout << "Could not write robot_map.png" << endl;
+	if(!write_map_rle("robot_map.rle", robot_map_global, &rle_bytes))
+		cout << "Could not write robot_map.rle" << endl;
+	cout << "Map export: robot_map.png " << image_bytes / 1024 << " KB, robot_map.rle " << rle_bytes / 1024 << " KB in "
+		 << (now_seconds() - export_start) * 1e3 << " ms" << endl;
 
 	cout << "Writing complete. " << endl;
 
-	//close file
-	output.close();
 	Aria::shutdown();
 	Aria::exit(0);
 
@@ -0,0 +1,168 @@
+/********************************************************
+ *	Binary map layers, see bit_planes.h
+ ********************************************************/
+
+#include "bit_planes.h"
+
+#include <algorithm>
+
+//a word holds two tile rows, the low half the even one
+#define FIRST_COLUMNS	0x0000000100000001ULL
+#define LAST_COLUMNS	0x8000000080000000ULL
+
+static int count_bits(uint64_t v)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(v);
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+//slot of tile (tx, ty), -1 if the map doesn't have it
+static int tile_slot(const logodds_grid &grid, int tx, int ty)
+{
+	unsigned int index;
+	if(!grid.findCellIndex(tx << logodds_grid::TILE_SHIFT, ty << logodds_grid::TILE_SHIFT, index))
+		return -1;
+	return (int)(index >> logodds_grid::CELL_BITS);
+}
+
+void BitPlane::compose(const BitPlane &set, const BitPlane &minus)
+{
+	myWords.resize(set.myWords.size());
+	size_t common = std::min(set.myWords.size(), minus.myWords.size());
+	for(size_t i = 0; i < common; i++)
+		myWords[i] = set.myWords[i] & ~minus.myWords[i];
+	for(size_t i = common; i < set.myWords.size(); i++)
+		myWords[i] = set.myWords[i];
+}
+
+void BitPlane::merge(const BitPlane &other)
+{
+	if(other.myWords.size() > myWords.size())
+		myWords.resize(other.myWords.size(), 0);
+	for(size_t i = 0; i < other.myWords.size(); i++)
+		myWords[i] |= other.myWords[i];
+}
+
+void BitPlane::intersect(const BitPlane &other)
+{
+	size_t common = std::min(myWords.size(), other.myWords.size());
+	for(size_t i = 0; i < common; i++)
+		myWords[i] &= other.myWords[i];
+	for(size_t i = common; i < myWords.size(); i++)
+		myWords[i] = 0;
+}
+
+/*
+ *	One cell per step, radius steps. Each step dilates every word sideways
+ *	into rows, then every row of rows up and down into the words, so the
+ *	diagonal neighbors come along with the second pass.
+ */
+void BitPlane::dilate(const BitPlane &source, const logodds_grid &grid, int radius)
+{
+	int tiles = grid.getNumTiles();
+	std::vector<int> left(tiles), right(tiles), below(tiles), above(tiles);
+	for(int slot = 0; slot < tiles; slot++)
+	{
+		int tx = grid.getTileX(slot), ty = grid.getTileY(slot);
+		left[slot] = tile_slot(grid, tx - 1, ty);
+		right[slot] = tile_slot(grid, tx + 1, ty);
+		below[slot] = tile_slot(grid, tx, ty - 1);
+		above[slot] = tile_slot(grid, tx, ty + 1);
+	}
+
+	myWords = source.myWords;
+	myWords.resize((size_t)tiles * WORDS_PER_TILE, 0);
+	std::vector<uint64_t> rows(myWords.size());
+
+	for(int step = 0; step < radius; step++)
+	{
+		for(int slot = 0; slot < tiles; slot++)
+		{
+			const uint64_t* words = &myWords[(size_t)slot * WORDS_PER_TILE];
+			const uint64_t* west = left[slot] >= 0 ? &myWords[(size_t)left[slot] * WORDS_PER_TILE] : NULL;
+			const uint64_t* east = right[slot] >= 0 ? &myWords[(size_t)right[slot] * WORDS_PER_TILE] : NULL;
+			uint64_t* out = &rows[(size_t)slot * WORDS_PER_TILE];
+			for(int w = 0; w < WORDS_PER_TILE; w++)
+			{
+				uint64_t v = words[w];
+				uint64_t h = v | ((v << 1) & ~FIRST_COLUMNS) | ((v >> 1) & ~LAST_COLUMNS);
+				if(west)
+					h |= (west[w] >> 31) & FIRST_COLUMNS;
+				if(east)
+					h |= (east[w] << 31) & LAST_COLUMNS;
+				out[w] = h;
+			}
+		}
+
+		for(int slot = 0; slot < tiles; slot++)
+		{
+			const uint64_t* h = &rows[(size_t)slot * WORDS_PER_TILE];
+			uint64_t south = below[slot] >= 0 ? rows[(size_t)below[slot] * WORDS_PER_TILE + WORDS_PER_TILE - 1] : 0;
+			uint64_t north = above[slot] >= 0 ? rows[(size_t)above[slot] * WORDS_PER_TILE] : 0;
+			uint64_t* out = &myWords[(size_t)slot * WORDS_PER_TILE];
+			for(int w = 0; w < WORDS_PER_TILE; w++)
+			{
+				//the odd row before the even one and the even row after the odd one
+				uint64_t before = w > 0 ? h[w - 1] : south;
+				uint64_t after = w < WORDS_PER_TILE - 1 ? h[w + 1] : north;
+				out[w] = h[w] | (h[w] << 32) | (h[w] >> 32) | (before >> 32) | (after << 32);
+			}
+		}
+	}
+}
+
+size_t BitPlane::count() const
+{
+	size_t total = 0;
+	for(size_t i = 0; i < myWords.size(); i++)
+		total += count_bits(myWords[i]);
+	return total;
+}
+
+void OccupancyPlanes::resize(const logodds_grid &map)
+{
+	size_t cells = map.getIndexLimit();
+	myObstacle.resize(cells);
+	myEmpty.resize(cells);
+	mySeen.resize(cells);
+}
+
+void OccupancyPlanes::setCell(const logodds_grid &map, unsigned int index)
+{
+	float value = map[index];
+	myObstacle.set(index, value > LOGODDS_OBSTACLE);
+	myEmpty.set(index, value < LOGODDS_FREE_SPACE);
+}
+
+void OccupancyPlanes::build(const logodds_grid &map)
+{
+	resize(map);
+	myObstacle.clear();
+	myEmpty.clear();
+	mySeen.clear();
+	for(unsigned int index = 0; index < map.getIndexLimit(); index++)
+	{
+		setCell(map, index);
+		mySeen.set(index, map[index] != map.getFillValue());
+	}
+	myGlobal.compose(myObstacle, myEmpty);
+}
+
+void OccupancyPlanes::update(const logodds_grid &map, const DirtyCellSet &dirty)
+{
+	resize(map);
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		setCell(map, dirty[i]);
+		mySeen.set(dirty[i], true);
+	}
+
+	//the whole layer, every cycle, it is only a word per 64 cells
+	myGlobal.compose(myObstacle, myEmpty);
+}
@@ -0,0 +1,114 @@
+/********************************************************
+ *	Binary map layers, 64 cells to a word
+ *
+ *	The thesis kept the obstacle, empty and global maps
+ *	as int grids and composed them cell by cell once at
+ *	the end: global = obstacles & ~empty. A BitPlane
+ *	keeps one bit per cell, keyed on the global map's
+ *	flat cell index, so a 32x32 tile is 16 words, two
+ *	tile rows each, and composing, merging and counting
+ *	whole layers is a few word operations per tile. That
+ *	is 32 times less memory than an int per cell and
+ *	cheap enough to do every cycle.
+ *
+ *	Dilation shifts whole words too: sideways within the
+ *	rows, carrying the edge columns over from the tiles on
+ *	either side, then up and down between the rows. It
+ *	only grows into tiles the map has, cells past the
+ *	explored area are unknown anyway.
+ *
+ *	OccupancyPlanes keeps the obstacle, empty and seen
+ *	layers current with the cells the mapper touched and
+ *	recomposes the global layer every cycle.
+ ********************************************************/
+
+#ifndef BIT_PLANES_H
+#define BIT_PLANES_H
+
+#include "sonar_model.h"
+#include "dirty_cells.h"
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class BitPlane
+{
+public:
+	enum
+	{
+		WORDS_PER_TILE = logodds_grid::TILE_CELLS / 64
+	};
+
+	//makes room for cell indices below numCells, new cells are clear
+	void resize(size_t numCells) { myWords.resize((numCells + 63) >> 6, 0); }
+	void clear() { myWords.assign(myWords.size(), 0); }
+
+	bool test(unsigned int index) const
+	{
+		size_t word = index >> 6;
+		return word < myWords.size() && (myWords[word] >> (index & 63) & 1) != 0;
+	}
+
+	void set(unsigned int index, bool value)
+	{
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		if(value)
+			myWords[index >> 6] |= bit;
+		else
+			myWords[index >> 6] &= ~bit;
+	}
+
+	//this = set & ~minus, the thesis composition
+	void compose(const BitPlane &set, const BitPlane &minus);
+
+	//this |= other and this &= other, for merging layers of several runs
+	void merge(const BitPlane &other);
+	void intersect(const BitPlane &other);
+
+	//this = source grown by radius cells in every direction, a square
+	void dilate(const BitPlane &source, const logodds_grid &grid, int radius);
+
+	//cells set
+	size_t count() const;
+
+	//64 cells starting at flat index 64 * word, clear past the end
+	uint64_t getWord(size_t word) const { return word < myWords.size() ? myWords[word] : 0; }
+
+	size_t getWordCount() const { return myWords.size(); }
+	size_t getMemoryUsage() const { return myWords.size() * sizeof(uint64_t); }
+
+private:
+	std::vector<uint64_t> myWords;
+};
+
+class OccupancyPlanes
+{
+public:
+	//sets every layer from the map, for a map that was loaded instead of built
+	void build(const logodds_grid &map);
+
+	//brings the layers up to date with the cells that changed this cycle
+	void update(const logodds_grid &map, const DirtyCellSet &dirty);
+
+	const BitPlane& getObstacle() const { return myObstacle; }		//above LOGODDS_OBSTACLE
+	const BitPlane& getEmpty() const { return myEmpty; }			//below LOGODDS_FREE_SPACE
+	const BitPlane& getGlobal() const { return myGlobal; }			//obstacle & ~empty
+	const BitPlane& getSeen() const { return mySeen; }				//touched by a cone at least once
+
+	size_t getMemoryUsage() const
+	{
+		return myObstacle.getMemoryUsage() + myEmpty.getMemoryUsage() + myGlobal.getMemoryUsage() + mySeen.getMemoryUsage();
+	}
+
+private:
+	void resize(const logodds_grid &map);
+	void setCell(const logodds_grid &map, unsigned int index);
+
+	BitPlane myObstacle;
+	BitPlane myEmpty;
+	BitPlane myGlobal;
+	BitPlane mySeen;
+};
+
+#endif
@@ -0,0 +1,33 @@
+/********************************************************
+ *	High resolution wall clock for timing the mapper
+ *
+ *	ArTime only goes down to milliseconds and one map
+ *	update takes a few microseconds, so the per-cycle
+ *	numbers come from the performance counter instead.
+ ********************************************************/
+
+#ifndef CYCLE_TIMER_H
+#define CYCLE_TIMER_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+//seconds since some fixed point, only differences mean anything
+inline double now_seconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+#endif
@@ -0,0 +1,96 @@
+/********************************************************
+ *	Set of map cells touched during one robot cycle
+ *
+ *	Cells are stored by their flat index in the global
+ *	TiledGrid. A bitset with one generation stamp per 64
+ *	bit word drops duplicates, and clearing the set only
+ *	bumps the generation, so the per-cycle cost follows
+ *	the number of unique cells and not the map size.
+ *	The index list is reused between cycles, so after the
+ *	first few cycles a push never allocates.
+ ********************************************************/
+
+#ifndef DIRTY_CELLS_H
+#define DIRTY_CELLS_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class DirtyCellSet
+{
+public:
+	DirtyCellSet() : myGeneration(1)
+	{
+		myCells.reserve(1024);
+	}
+
+	/*
+	 *	Makes room for cell indices below numCells. Call it when the grid
+	 *	grows so insert() doesn't have to
+	 */
+	void reserveCells(size_t numCells)
+	{
+		size_t words = (numCells + 63) >> 6;
+		if(words > myBits.size())
+		{
+			myBits.resize(words, 0);
+			myStamps.resize(words, 0);
+		}
+	}
+
+	//returns false if the cell is already in the set this generation
+	bool insert(uint32_t cell)
+	{
+		size_t word = cell >> 6;
+		if(word >= myBits.size())
+			reserveCells(((size_t)cell + 1) * 2);
+
+		if(myStamps[word] != myGeneration)
+		{
+			myStamps[word] = myGeneration;
+			myBits[word] = 0;
+		}
+
+		uint64_t bit = (uint64_t)1 << (cell & 63);
+		if(myBits[word] & bit)
+			return false;
+
+		myBits[word] |= bit;
+		myCells.push_back(cell);
+		return true;
+	}
+
+	bool contains(uint32_t cell) const
+	{
+		size_t word = cell >> 6;
+		if(word >= myBits.size() || myStamps[word] != myGeneration)
+			return false;
+		return (myBits[word] & ((uint64_t)1 << (cell & 63))) != 0;
+	}
+
+	//empties the set in O(1), the index buffer keeps its capacity
+	void clear()
+	{
+		myCells.clear();
+		myGeneration++;
+		if(myGeneration == 0)
+		{
+			//stamps wrapped around, start over so old words can't look current
+			myStamps.assign(myStamps.size(), 0);
+			myGeneration = 1;
+		}
+	}
+
+	size_t size() const { return myCells.size(); }
+	bool empty() const { return myCells.empty(); }
+	uint32_t operator[](size_t i) const { return myCells[i]; }
+
+private:
+	std::vector<uint32_t> myCells;		//unique cells in insertion order
+	std::vector<uint64_t> myBits;		//one bit per cell
+	std::vector<uint32_t> myStamps;		//generation each bit word was last written in
+	uint32_t myGeneration;
+};
+
+#endif
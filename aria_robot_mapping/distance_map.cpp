@@ -0,0 +1,226 @@
+/********************************************************
+ *	Distance to the nearest obstacle, see distance_map.h
+ ********************************************************/
+
+#include "distance_map.h"
+
+#include <cmath>
+
+#ifndef PI
+#define PI	3.14159
+#endif
+
+static const int NEIGHBOR_DX[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const int NEIGHBOR_DY[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+static DistanceCell far_cell(int far)
+{
+	DistanceCell cell;
+	cell.obstX = cell.obstY = 0;
+	cell.dist2 = far;
+	cell.occupied = 0;
+	cell.raise = 0;
+	cell.pad[0] = cell.pad[1] = 0;
+	return cell;
+}
+
+DistanceMap::DistanceMap(int maxCells, float threshold)
+	: myMaxCells(maxCells), myThreshold(threshold), myMap(NULL), myCells(NULL),
+	  myLowestBucket(0), myQueued(0), myProcessed(0)
+{
+	if(myMaxCells < 1)
+		myMaxCells = 1;
+	myFar = myMaxCells * myMaxCells + 1;
+	myBuckets.resize(myFar + 1);
+}
+
+DistanceMap::~DistanceMap()
+{
+	delete myCells;
+}
+
+void DistanceMap::push(unsigned int index, int key)
+{
+	if(key > myFar)
+		key = myFar;
+	myBuckets[key].push_back(index);
+	if(key < myLowestBucket)
+		myLowestBucket = key;
+	myQueued++;
+}
+
+void DistanceMap::setObstacle(int cx, int cy)
+{
+	unsigned int index = myCells->cellIndex(cx, cy);
+	DistanceCell &cell = (*myCells)[index];
+	cell.occupied = 1;
+	cell.raise = 0;
+	cell.obstX = cx;
+	cell.obstY = cy;
+	cell.dist2 = 0;
+	push(index, 0);
+}
+
+void DistanceMap::removeObstacle(int cx, int cy)
+{
+	unsigned int index = myCells->cellIndex(cx, cy);
+	DistanceCell &cell = (*myCells)[index];
+	cell.occupied = 0;
+	cell.raise = 1;
+	cell.dist2 = myFar;
+	push(index, 0);
+}
+
+/*
+ *	A cleared cell clears every neighbor that got its distance from an
+ *	obstacle that is gone, and asks the rest to send their distance back
+ *	in, which refills the cleared area from the obstacles still there
+ */
+void DistanceMap::raise(int cx, int cy)
+{
+	for(int k = 0; k < 8; k++)
+	{
+		int nx = cx + NEIGHBOR_DX[k], ny = cy + NEIGHBOR_DY[k];
+		if(myCells->findTileData(nx, ny) == NULL)
+			continue;		//nothing ever reached it
+
+		unsigned int index = myCells->cellIndex(nx, ny);
+		DistanceCell &n = (*myCells)[index];
+		if(n.dist2 >= myFar || n.raise)
+			continue;
+
+		if(!myCells->get(n.obstX, n.obstY).occupied)
+		{
+			push(index, n.dist2);
+			n.dist2 = myFar;
+			n.raise = 1;
+		}
+		else
+			push(index, n.dist2);
+	}
+	myCells->at(cx, cy).raise = 0;
+}
+
+//offers this cell's obstacle to the neighbors, the ones it is closer to take it and pass it on
+void DistanceMap::lower(int cx, int cy, const DistanceCell &cell)
+{
+	int ox = cell.obstX, oy = cell.obstY;
+	for(int k = 0; k < 8; k++)
+	{
+		int nx = cx + NEIGHBOR_DX[k], ny = cy + NEIGHBOR_DY[k];
+		int d2 = (nx - ox) * (nx - ox) + (ny - oy) * (ny - oy);
+		if(d2 >= myFar)
+			continue;
+
+		unsigned int index = myCells->cellIndex(nx, ny);
+		DistanceCell &n = (*myCells)[index];
+		if(n.raise || d2 >= n.dist2)
+			continue;
+		n.dist2 = d2;
+		n.obstX = ox;
+		n.obstY = oy;
+		push(index, d2);
+	}
+}
+
+void DistanceMap::propagate()
+{
+	myProcessed = 0;
+	while(myQueued > 0)
+	{
+		while(myBuckets[myLowestBucket].empty())
+			myLowestBucket++;
+		unsigned int index = myBuckets[myLowestBucket].back();
+		myBuckets[myLowestBucket].pop_back();
+		myQueued--;
+		myProcessed++;
+
+		int cx, cy;
+		myCells->indexToCell(index, cx, cy);
+		DistanceCell cell = (*myCells)[index];
+		if(cell.raise)
+			raise(cx, cy);
+		else if(cell.dist2 < myFar && myCells->get(cell.obstX, cell.obstY).occupied)
+			lower(cx, cy, cell);
+	}
+	myLowestBucket = 0;
+}
+
+void DistanceMap::build(const logodds_grid &map)
+{
+	myMap = &map;
+	delete myCells;
+	myCells = new distance_grid(far_cell(myFar), map.getCellSize());
+	for(size_t b = 0; b < myBuckets.size(); b++)
+		myBuckets[b].clear();
+	myQueued = 0;
+	myLowestBucket = 0;
+
+	for(int slot = 0; slot < map.getNumTiles(); slot++)
+	{
+		const float* cells = map.getTileData(slot);
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+		{
+			if(cells[c] <= myThreshold)
+				continue;
+			setObstacle((map.getTileX(slot) << logodds_grid::TILE_SHIFT) + (c & logodds_grid::TILE_MASK),
+						(map.getTileY(slot) << logodds_grid::TILE_SHIFT) + (c >> logodds_grid::TILE_SHIFT));
+		}
+	}
+	propagate();
+}
+
+void DistanceMap::update(const logodds_grid &map, const DirtyCellSet &dirty)
+{
+	if(myMap != &map)
+	{
+		build(map);
+		return;
+	}
+
+	//only cells that crossed the threshold start a wave
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		bool occupied = map[dirty[i]] > myThreshold;
+		int cx, cy;
+		map.indexToCell(dirty[i], cx, cy);
+		if(occupied == (myCells->get(cx, cy).occupied != 0))
+			continue;
+		if(occupied)
+			setObstacle(cx, cy);
+		else
+			removeObstacle(cx, cy);
+	}
+	propagate();
+}
+
+double DistanceMap::getMaxClearance() const
+{
+	double cell = myMap ? myMap->getCellSize() : 100.0;
+	return myMaxCells * cell;
+}
+
+double DistanceMap::getClearance(double x, double y) const
+{
+	if(myCells == NULL)
+		return getMaxClearance();
+
+	int dist2 = myCells->get(myCells->worldToCell(x), myCells->worldToCell(y)).dist2;
+	if(dist2 >= myFar)
+		return getMaxClearance();
+	return sqrt((double)dist2) * myCells->getCellSize();
+}
+
+double DistanceMap::getClearanceAhead(double x, double y, double th, double lookahead) const
+{
+	double angle = th / 180 * PI;
+	return getClearance(x + lookahead * cos(angle), y + lookahead * sin(angle));
+}
+
+size_t DistanceMap::getMemoryUsage() const
+{
+	size_t bytes = myCells ? myCells->getMemoryUsage() : 0;
+	for(size_t b = 0; b < myBuckets.size(); b++)
+		bytes += myBuckets[b].capacity() * sizeof(unsigned int);
+	return bytes;
+}
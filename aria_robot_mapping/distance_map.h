@@ -0,0 +1,118 @@
+/********************************************************
+ *	Distance to the nearest obstacle, kept up to date
+ *
+ *	Every cell within reach of an obstacle cell (log-odds
+ *	above LOGODDS_OBSTACLE) remembers which obstacle is
+ *	closest and the squared distance to it in cells, so
+ *	the clearance at any point is one lookup.
+ *
+ *	Updates are a dynamic brushfire (Lau, Sprunk and
+ *	Burgard, "Improved updating of Euclidean distance
+ *	maps and Voronoi diagrams", 2010): a cell that turns
+ *	into an obstacle sends a lowering wave outwards, a
+ *	cell that stops being one sends a raising wave that
+ *	clears every cell that pointed at it, and the lowering
+ *	waves of the obstacles around refill the hole. Only
+ *	the changed cells of a cycle start waves and a wave
+ *	stops where distances don't change, so a cycle costs
+ *	about the cells around the handful of cells that
+ *	crossed the threshold, not the map.
+ *
+ *	The waves pass obstacles from neighbor to neighbor,
+ *	so the result isn't exact Euclidean: now and then a
+ *	cell's closest obstacle can't reach it because every
+ *	neighbor on the way is closer to another one, and the
+ *	cell keeps that other one. Its distance comes out a
+ *	little long then, by hundredths of a cell in the
+ *	benchmark worlds, which check it stays under 0.1.
+ *	Which cells that hits depends on the order the waves
+ *	ran in, so the incremental distances and a fresh
+ *	build() can differ on such a cell, by that much.
+ *
+ *	Distances are only kept up to maxCells, past that a
+ *	cell just reads as far. That bounds the waves and
+ *	keeps the layer from allocating tiles far from any
+ *	obstacle.
+ ********************************************************/
+
+#ifndef DISTANCE_MAP_H
+#define DISTANCE_MAP_H
+
+#include "sonar_model.h"
+#include "tiled_grid.h"
+#include "dirty_cells.h"
+
+#include <vector>
+
+#define DISTANCE_MAX_CELLS	20		//[cells] distances past this read as far, 2m at 100mm cells
+
+struct DistanceCell
+{
+	int obstX, obstY;		//closest obstacle cell, only meaningful while dist2 is below far
+	int dist2;				//squared distance to it [cells^2]
+	unsigned char occupied;	//obstacle as of the last update
+	unsigned char raise;	//cleared, waiting to pass the raise on to its neighbors
+	unsigned char pad[2];
+};
+
+class DistanceMap
+{
+public:
+	DistanceMap(int maxCells = DISTANCE_MAX_CELLS, float threshold = LOGODDS_OBSTACLE);
+	~DistanceMap();
+
+	//recomputes every distance from the map, for a map that was loaded instead of built
+	void build(const logodds_grid &map);
+
+	//brings the distances up to date with the cells that changed this cycle
+	void update(const logodds_grid &map, const DirtyCellSet &dirty);
+
+	//squared distance from cell (cx, cy) to the closest obstacle cell, getFar() if out of reach
+	int getDistance2(int cx, int cy) const
+	{
+		return myCells ? myCells->get(cx, cy).dist2 : myFar;
+	}
+
+	//distance from the world point to the closest obstacle cell, capped at the reach [mm]
+	double getClearance(double x, double y) const;
+
+	//clearance at the point lookahead mm out along heading th [deg]
+	double getClearanceAhead(double x, double y, double th, double lookahead) const;
+
+	int getFar() const { return myFar; }
+	bool isBuilt() const { return myCells != NULL; }
+	double getCellSize() const { return myCells ? myCells->getCellSize() : 0; }
+	double getMaxClearance() const;
+
+	//cells taken off the queue during the last update or build
+	long getLastProcessed() const { return myProcessed; }
+
+	size_t getMemoryUsage() const;
+
+private:
+	typedef TiledGrid<DistanceCell> distance_grid;
+
+	void setObstacle(int cx, int cy);
+	void removeObstacle(int cx, int cy);
+	void push(unsigned int index, int key);
+	void propagate();
+	void raise(int cx, int cy);
+	void lower(int cx, int cy, const DistanceCell &cell);
+
+	int myMaxCells;
+	int myFar;					//myMaxCells^2 + 1, stands for out of reach
+	float myThreshold;
+	const logodds_grid* myMap;
+	distance_grid* myCells;
+
+	//bucket queue on squared distance, keys only go up to myFar
+	std::vector< std::vector<unsigned int> > myBuckets;
+	int myLowestBucket;
+	size_t myQueued;
+	long myProcessed;
+
+	DistanceMap(const DistanceMap&);
+	DistanceMap& operator=(const DistanceMap&);
+};
+
+#endif
@@ -0,0 +1,231 @@
+/********************************************************
+ *	Frontiers between explored and unexplored space,
+ *	see frontier_map.h
+ ********************************************************/
+
+#include "frontier_map.h"
+
+#include <cmath>
+#include <algorithm>
+
+static const int SIDE_DX[4] = { -1, 1, 0, 0 };
+static const int SIDE_DY[4] = { 0, 0, -1, 1 };
+
+//what a cell is to the frontier test, a dirty cell whose state didn't change can't change any frontier
+enum
+{
+	CELL_KNOWN	= 1,
+	CELL_FREE	= 2
+};
+
+static unsigned char cell_state(const logodds_grid &map, float value)
+{
+	unsigned char state = 0;
+	if(value != map.getFillValue())
+		state |= CELL_KNOWN;
+	if(value < LOGODDS_FREE_SPACE)
+		state |= CELL_FREE;
+	return state;
+}
+
+bool FrontierMap::isFrontierCell(const logodds_grid &map, int cx, int cy)
+{
+	if(map.get(cx, cy) >= LOGODDS_FREE_SPACE)
+		return false;
+	for(int k = 0; k < 4; k++)
+		if(map.get(cx + SIDE_DX[k], cy + SIDE_DY[k]) == map.getFillValue())
+			return true;
+	return false;
+}
+
+bool FrontierMap::isFrontier(int cx, int cy) const
+{
+	unsigned int index;
+	if(myMap == NULL || !myMap->findCellIndex(cx, cy, index) || index >= myPosition.size())
+		return false;
+	return myPosition[index] >= 0;
+}
+
+void FrontierMap::add(unsigned int index)
+{
+	myPosition[index] = (int)myCells.size();
+	myCells.push_back(index);
+}
+
+//swaps the last cell into the hole, the list has no order to keep
+void FrontierMap::remove(unsigned int index)
+{
+	int pos = myPosition[index];
+	uint32_t last = myCells.back();
+	myCells[pos] = last;
+	myPosition[last] = pos;
+	myCells.pop_back();
+	myPosition[index] = -1;
+}
+
+//tests one cell and fixes its membership if it changed
+void FrontierMap::check(unsigned int index)
+{
+	if(!myChecked.insert(index))
+		return;
+
+	int cx, cy;
+	myMap->indexToCell(index, cx, cy);
+	bool frontier = isFrontierCell(*myMap, cx, cy);
+	bool member = myPosition[index] >= 0;
+	if(frontier && !member)
+		add(index);
+	else if(!frontier && member)
+		remove(index);
+}
+
+void FrontierMap::build(const logodds_grid &map)
+{
+	myMap = &map;
+	myCells.clear();
+	myPosition.assign(map.getIndexLimit(), -1);
+	myState.assign(map.getIndexLimit(), 0);
+	for(int slot = 0; slot < map.getNumTiles(); slot++)
+	{
+		int baseX = map.getTileX(slot) << logodds_grid::TILE_SHIFT;
+		int baseY = map.getTileY(slot) << logodds_grid::TILE_SHIFT;
+		const float* cells = map.getTileData(slot);
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+		{
+			unsigned int index = ((unsigned int)slot << logodds_grid::CELL_BITS) | (unsigned int)c;
+			myState[index] = cell_state(map, cells[c]);
+			if(isFrontierCell(map, baseX + (c & logodds_grid::TILE_MASK), baseY + (c >> logodds_grid::TILE_SHIFT)))
+				add(index);
+		}
+	}
+}
+
+void FrontierMap::update(const logodds_grid &map, const DirtyCellSet &dirty)
+{
+	if(myMap != &map)
+	{
+		build(map);
+		return;
+	}
+	if(myPosition.size() < map.getIndexLimit())
+	{
+		myPosition.resize(map.getIndexLimit(), -1);
+		myState.resize(map.getIndexLimit(), 0);
+	}
+
+	//most dirty cells were seen before and just got a bit more sure, they change nothing
+	myChecked.clear();
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		unsigned int index = dirty[i];
+		unsigned char state = cell_state(map, map[index]);
+		unsigned char changed = state ^ myState[index];
+		if(!changed)
+			continue;
+		myState[index] = state;
+		check(index);
+		if(!(changed & CELL_KNOWN))
+			continue;
+
+		//a cell that just became known can end the frontier of the four cells it borders on
+		int cx, cy;
+		map.indexToCell(index, cx, cy);
+		for(int k = 0; k < 4; k++)
+		{
+			unsigned int side;
+			if(map.findCellIndex(cx + SIDE_DX[k], cy + SIDE_DY[k], side))
+				check(side);		//cells in tiles that don't exist are unknown, never frontiers
+		}
+	}
+}
+
+static bool better_cluster(const FrontierCluster &a, const FrontierCluster &b)
+{
+	return a.score > b.score;
+}
+
+void FrontierMap::cluster(double x, double y, std::vector<FrontierCluster> &clusters)
+{
+	clusters.clear();
+	if(myMap == NULL)
+		return;
+
+	const double cell = myMap->getCellSize();
+	myVisited.clear();
+	for(size_t i = 0; i < myCells.size(); i++)
+	{
+		if(!myVisited.insert(myCells[i]))
+			continue;
+
+		//flood the 8-connected frontier cells from this one
+		myQueue.clear();
+		myQueue.push_back(myCells[i]);
+		double sum_x = 0, sum_y = 0;
+		for(size_t q = 0; q < myQueue.size(); q++)
+		{
+			int cx, cy;
+			myMap->indexToCell(myQueue[q], cx, cy);
+			sum_x += cx;
+			sum_y += cy;
+			for(int dy = -1; dy <= 1; dy++)
+			{
+				for(int dx = -1; dx <= 1; dx++)
+				{
+					unsigned int next;
+					if((dx == 0 && dy == 0) || !myMap->findCellIndex(cx + dx, cy + dy, next))
+						continue;
+					if(next < myPosition.size() && myPosition[next] >= 0 && myVisited.insert(next))
+						myQueue.push_back(next);
+				}
+			}
+		}
+
+		int size = (int)myQueue.size();
+		if(size < FRONTIER_MIN_CLUSTER)
+			continue;
+
+		FrontierCluster cluster;
+		cluster.size = size;
+		cluster.goalX = cluster.goalY = 0;
+		cluster.x = (sum_x / size + 0.5) * cell;
+		cluster.y = (sum_y / size + 0.5) * cell;
+
+		//the centroid of a curved frontier can be inside a wall, aim for the frontier cell closest to it
+		double best = -1;
+		for(size_t q = 0; q < myQueue.size(); q++)
+		{
+			int cx, cy;
+			myMap->indexToCell(myQueue[q], cx, cy);
+			double gx = (cx + 0.5) * cell, gy = (cy + 0.5) * cell;
+			double d = (gx - cluster.x) * (gx - cluster.x) + (gy - cluster.y) * (gy - cluster.y);
+			if(best < 0 || d < best)
+			{
+				best = d;
+				cluster.goalX = gx;
+				cluster.goalY = gy;
+			}
+		}
+
+		//more unknown border for fewer meters driven
+		cluster.distance = sqrt((cluster.goalX - x) * (cluster.goalX - x) + (cluster.goalY - y) * (cluster.goalY - y));
+		cluster.score = size / (1.0 + cluster.distance / 1000);
+		clusters.push_back(cluster);
+	}
+	std::sort(clusters.begin(), clusters.end(), better_cluster);
+}
+
+bool FrontierMap::selectGoal(double x, double y, FrontierCluster &goal)
+{
+	std::vector<FrontierCluster> clusters;
+	cluster(x, y, clusters);
+	if(clusters.empty())
+		return false;
+	goal = clusters[0];
+	return true;
+}
+
+size_t FrontierMap::getMemoryUsage() const
+{
+	return myPosition.capacity() * sizeof(int) + myState.capacity() + myCells.capacity() * sizeof(uint32_t)
+		 + myQueue.capacity() * sizeof(uint32_t);
+}
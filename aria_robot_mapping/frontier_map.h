@@ -0,0 +1,96 @@
+/********************************************************
+ *	Frontiers between explored and unexplored space
+ *
+ *	A frontier cell is a cell the sonars have seen free
+ *	with an unknown cell (never touched) right next to it.
+ *	Driving to one is the cheapest way to see something
+ *	new, so the frontiers decide where the robot goes
+ *	next while it maps.
+ *
+ *	The set is kept incrementally: a cell can only start
+ *	or stop being a frontier when it crossed into free
+ *	space or one of its four neighbors stopped being
+ *	unknown. Each cycle compares the dirty cells with the
+ *	state they had and only tests the few that changed
+ *	and the cells next to them. Membership is a flat
+ *	array keyed by map cell index plus a list of the
+ *	frontier cells, adding and removing are O(1).
+ *
+ *	Picking a goal groups the frontier cells into 8-
+ *	connected clusters and scores each one by its size
+ *	over its distance from the robot, which walks the
+ *	frontier cells only, never the whole map.
+ ********************************************************/
+
+#ifndef FRONTIER_MAP_H
+#define FRONTIER_MAP_H
+
+#include "sonar_model.h"
+#include "tiled_grid.h"
+#include "dirty_cells.h"
+
+#include <vector>
+#include <stdint.h>
+
+#define FRONTIER_MIN_CLUSTER	4		//[cells] smaller frontiers are mostly sonar noise
+
+struct FrontierCluster
+{
+	int size;				//frontier cells in it
+	double x, y;			//centroid [mm]
+	double goalX, goalY;	//frontier cell closest to the centroid, somewhere the robot can actually go [mm]
+	double distance;		//from the robot to the goal [mm]
+	double score;
+};
+
+class FrontierMap
+{
+public:
+	FrontierMap() : myMap(NULL) {}
+
+	//finds every frontier cell of the map, for a map that was loaded instead of built
+	void build(const logodds_grid &map);
+
+	//brings the set up to date with the cells that changed this cycle
+	void update(const logodds_grid &map, const DirtyCellSet &dirty);
+
+	size_t size() const { return myCells.size(); }
+	bool isFrontier(int cx, int cy) const;
+
+	//flat map cell index of the i-th frontier cell, in no particular order
+	uint32_t operator[](size_t i) const { return myCells[i]; }
+
+	/*
+	 *	Clusters the frontier cells and scores the ones with at least
+	 *	FRONTIER_MIN_CLUSTER cells for a robot at (x, y), best first
+	 */
+	void cluster(double x, double y, std::vector<FrontierCluster> &clusters);
+
+	//best cluster for a robot at (x, y), false if nothing is left to explore
+	bool selectGoal(double x, double y, FrontierCluster &goal);
+
+	//the frontier test on its own, straight from the map
+	static bool isFrontierCell(const logodds_grid &map, int cx, int cy);
+
+	size_t getMemoryUsage() const;
+
+private:
+	void check(unsigned int index);
+	void add(unsigned int index);
+	void remove(unsigned int index);
+
+	const logodds_grid* myMap;
+	std::vector<int> myPosition;		//per map cell index, where it is in myCells or -1
+	std::vector<unsigned char> myState;	//per map cell index, known/free as of the last update
+	std::vector<uint32_t> myCells;
+	DirtyCellSet myChecked;				//cells already looked at this update
+
+	//clustering scratch, kept to avoid allocating per goal
+	DirtyCellSet myVisited;
+	std::vector<uint32_t> myQueue;
+
+	FrontierMap(const FrontierMap&);
+	FrontierMap& operator=(const FrontierMap&);
+};
+
+#endif
@@ -0,0 +1,457 @@
+/********************************************************
+ *	Path planner over the occupancy grid, see
+ *	grid_planner.h
+ ********************************************************/
+
+#include "grid_planner.h"
+
+#include <cstdlib>
+#include <algorithm>
+
+static const int NEIGHBOR_DX[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const int NEIGHBOR_DY[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };	//neighbor 7 - k is the opposite of neighbor k
+
+static const int UNREACHED = 0x3fffffff;		//two of them still add up without overflowing
+
+GridPlanner::GridPlanner(int width, int height, int originX, int originY, int radius)
+	: myWidth(width), myHeight(height), myOriginX(originX), myOriginY(originY), myRadius(radius),
+	  myStart(-1), myGoal(-1), myLast(-1), myKm(0), myExpanded(0), myFinished(false)
+{
+	if(myWidth < 3)
+		myWidth = 3;
+	if(myHeight < 3)
+		myHeight = 3;
+	if(myRadius < 0)
+		myRadius = 0;
+
+	size_t cells = (size_t)myWidth * myHeight;
+	myG.assign(cells, UNREACHED);
+	myRhs.assign(cells, UNREACHED);
+	myHeapPos.assign(cells, -1);
+	myFlags.assign(cells, 0);
+	myBlockers.assign(cells, 0);
+	myPenalty.assign(cells, 0);
+	myChanged.reserveCells(cells);
+
+	//the border is blocked for good, so a cell the search reaches always has all 8 neighbors
+	for(int y = 0; y < myHeight; y++)
+	{
+		for(int x = 0; x < myWidth; x++)
+		{
+			if(x > 0 && y > 0 && x < myWidth - 1 && y < myHeight - 1)
+				continue;
+			myBlockers[y * myWidth + x] = 1;
+			myFlags[y * myWidth + x] = CELL_BORDER;
+		}
+	}
+
+	for(int dy = -myRadius; dy <= myRadius; dy++)
+	{
+		for(int dx = -myRadius; dx <= myRadius; dx++)
+		{
+			if(dx * dx + dy * dy > myRadius * myRadius)
+				continue;
+			myDiskX.push_back(dx);
+			myDiskY.push_back(dy);
+		}
+	}
+
+	for(int k = 0; k < 8; k++)
+	{
+		myNeighbor[k] = NEIGHBOR_DY[k] * myWidth + NEIGHBOR_DX[k];
+		myStep[k] = (NEIGHBOR_DX[k] != 0 && NEIGHBOR_DY[k] != 0) ? PLANNER_DIAGONAL : PLANNER_STEP;
+	}
+}
+
+//window index of a map cell, -1 outside the window or on its border
+int GridPlanner::cellAt(int cx, int cy) const
+{
+	cx -= myOriginX;
+	cy -= myOriginY;
+	if(cx < 1 || cy < 1 || cx >= myWidth - 1 || cy >= myHeight - 1)
+		return -1;
+	return cy * myWidth + cx;
+}
+
+bool GridPlanner::isBlocked(int cx, int cy) const
+{
+	if(!contains(cx, cy))
+		return true;
+	return myBlockers[(cy - myOriginY) * myWidth + (cx - myOriginX)] != 0;
+}
+
+//border cells never change, they can't be reached anyway
+void GridPlanner::markChanged(int cell)
+{
+	if(!(myFlags[cell] & CELL_BORDER))
+		myChanged.insert((uint32_t)cell);
+}
+
+void GridPlanner::setObstacle(int cx, int cy, bool obstacle)
+{
+	if(!contains(cx, cy))
+		return;
+	int x = cx - myOriginX, y = cy - myOriginY;
+	int cell = y * myWidth + x;
+	if(((myFlags[cell] & CELL_OBSTACLE) != 0) == obstacle)
+		return;
+	myFlags[cell] ^= CELL_OBSTACLE;
+
+	//only cells that go from free to blocked or back change any edge
+	for(size_t i = 0; i < myDiskX.size(); i++)
+	{
+		int nx = x + myDiskX[i], ny = y + myDiskY[i];
+		if(nx < 0 || ny < 0 || nx >= myWidth || ny >= myHeight)
+			continue;
+		int n = ny * myWidth + nx;
+		if(obstacle)
+		{
+			if(myBlockers[n]++ == 0)
+				markChanged(n);
+		}
+		else if(--myBlockers[n] == 0)
+			markChanged(n);
+	}
+}
+
+void GridPlanner::setPenalty(int cx, int cy, unsigned char penalty)
+{
+	if(!contains(cx, cy))
+		return;
+	int cell = (cy - myOriginY) * myWidth + (cx - myOriginX);
+	if(myPenalty[cell] == penalty)
+		return;
+	myPenalty[cell] = penalty;
+	markChanged(cell);
+}
+
+//octile distance, never more than the cheapest path
+int GridPlanner::heuristic(int a, int b) const
+{
+	if(a < 0 || b < 0)
+		return 0;
+	int dx = abs(a % myWidth - b % myWidth);
+	int dy = abs(a / myWidth - b / myWidth);
+	return dx > dy ? dx * PLANNER_STEP + (PLANNER_DIAGONAL - PLANNER_STEP) * dy
+				   : dy * PLANNER_STEP + (PLANNER_DIAGONAL - PLANNER_STEP) * dx;
+}
+
+int GridPlanner::cost(int from, int k) const
+{
+	int to = from + myNeighbor[k];
+	if(!passable(to))
+		return UNREACHED;
+
+	//no cutting corners past a blocked cell
+	if(myStep[k] != PLANNER_STEP && (!passable(from + NEIGHBOR_DX[k]) || !passable(from + NEIGHBOR_DY[k] * myWidth)))
+		return UNREACHED;
+	return myStep[k] + myStep[k] * myPenalty[to] / PLANNER_PENALTY_SCALE;
+}
+
+//the cheapest way to the goal through one of the neighbors
+int GridPlanner::bestSuccessor(int cell) const
+{
+	int best = UNREACHED;
+	for(int k = 0; k < 8; k++)
+	{
+		int c = cost(cell, k) + myG[cell + myNeighbor[k]];
+		if(c < best)
+			best = c;
+	}
+	return best;
+}
+
+void GridPlanner::calculateKey(int cell, int &k1, int &k2) const
+{
+	k2 = std::min(myG[cell], myRhs[cell]);
+	k1 = k2 + heuristic(myStart, cell) + myKm;
+}
+
+void GridPlanner::updateVertex(int cell)
+{
+	if(myG[cell] != myRhs[cell])
+	{
+		int k1, k2;
+		calculateKey(cell, k1, k2);
+		if(myHeapPos[cell] >= 0)
+			heapUpdate(cell, k1, k2);
+		else
+			heapInsert(cell, k1, k2);
+	}
+	else if(myHeapPos[cell] >= 0)
+		heapRemove(cell);
+}
+
+bool GridPlanner::setGoal(int cx, int cy)
+{
+	int goal = cellAt(cx, cy);
+	if(goal < 0)
+		return false;
+	if(goal == myGoal)
+		return true;
+
+	myGoal = goal;
+	reset();
+	return true;
+}
+
+void GridPlanner::reset()
+{
+	std::fill(myG.begin(), myG.end(), UNREACHED);
+	std::fill(myRhs.begin(), myRhs.end(), UNREACHED);
+	for(size_t i = 0; i < myHeap.size(); i++)
+		myHeapPos[myHeap[i].cell] = -1;
+	myHeap.clear();
+	myChanged.clear();		//the search will see every cost as it is now
+	myKm = 0;
+	myLast = myStart;
+	myFinished = false;
+
+	if(myGoal >= 0)
+	{
+		myRhs[myGoal] = 0;
+		updateVertex(myGoal);
+	}
+}
+
+bool GridPlanner::setStart(int cx, int cy)
+{
+	int start = cellAt(cx, cy);
+	if(start < 0)
+		return false;
+
+	//keys already queued were computed from the old start, raising the bound instead of requeueing keeps them valid
+	if(myLast >= 0 && start != myLast)
+		myKm += heuristic(myLast, start);
+	myLast = myStart = start;
+	return true;
+}
+
+bool GridPlanner::plan(long budget)
+{
+	myExpanded = 0;
+	myFinished = true;
+	if(myStart < 0 || myGoal < 0)
+		return false;
+
+	//a cell that changed changes the edges into it and the diagonals past it, all of them start at its neighbors
+	for(size_t i = 0; i < myChanged.size(); i++)
+	{
+		int cell = (int)myChanged[i];
+		for(int k = 0; k < 8; k++)
+		{
+			int n = cell + myNeighbor[k];
+			if(!searchable(n))
+				continue;
+			myRhs[n] = bestSuccessor(n);
+			updateVertex(n);
+		}
+	}
+	myChanged.clear();
+
+	int start1, start2;
+	calculateKey(myStart, start1, start2);
+	while(!myHeap.empty() && (keyLess(myHeap[0].k1, myHeap[0].k2, start1, start2) || myRhs[myStart] != myG[myStart]))
+	{
+		//the queue keeps its keys, the next call picks up from here
+		if(budget > 0 && myExpanded >= budget)
+		{
+			myFinished = false;
+			return false;
+		}
+
+		int cell = myHeap[0].cell;
+		int old1 = myHeap[0].k1, old2 = myHeap[0].k2;
+		int k1, k2;
+		calculateKey(cell, k1, k2);
+		myExpanded++;
+
+		if(keyLess(old1, old2, k1, k2))
+			heapUpdate(cell, k1, k2);		//queued before the robot moved, the key only went up
+		else if(myG[cell] > myRhs[cell])
+		{
+			//got cheaper, hand it on
+			myG[cell] = myRhs[cell];
+			heapRemove(cell);
+			for(int k = 0; k < 8; k++)
+			{
+				int n = cell + myNeighbor[k];
+				if(!searchable(n))
+					continue;
+				int c = cost(n, 7 - k) + myG[cell];
+				if(c < myRhs[n])
+				{
+					myRhs[n] = c;
+					updateVertex(n);
+				}
+			}
+		}
+		else
+		{
+			//got dearer, every neighbor that went through it has to look again
+			int old = myG[cell];
+			myG[cell] = UNREACHED;
+			for(int k = 0; k <= 8; k++)
+			{
+				int n = k < 8 ? cell + myNeighbor[k] : cell;
+				if(!searchable(n))
+					continue;
+				if(k == 8 || myRhs[n] == cost(n, 7 - k) + old)
+					myRhs[n] = bestSuccessor(n);
+				updateVertex(n);
+			}
+		}
+		calculateKey(myStart, start1, start2);
+	}
+	return myRhs[myStart] < UNREACHED;
+}
+
+bool GridPlanner::getPath(std::vector<int> &xs, std::vector<int> &ys) const
+{
+	xs.clear();
+	ys.clear();
+	if(!myFinished || myStart < 0 || myGoal < 0 || myRhs[myStart] >= UNREACHED)
+		return false;
+
+	//downhill on g, the path can't be longer than the window
+	int cell = myStart;
+	for(size_t steps = 0; steps <= myG.size(); steps++)
+	{
+		xs.push_back(cell % myWidth + myOriginX);
+		ys.push_back(cell / myWidth + myOriginY);
+		if(cell == myGoal)
+			return true;
+
+		int next = -1;
+		int best = UNREACHED;
+		for(int k = 0; k < 8; k++)
+		{
+			int n = cell + myNeighbor[k];
+			int c = cost(cell, k) + myG[n];
+			if(c < best)
+			{
+				best = c;
+				next = n;
+			}
+		}
+		if(next < 0)
+			break;
+		cell = next;
+	}
+	xs.clear();
+	ys.clear();
+	return false;
+}
+
+int GridPlanner::getPathCost() const
+{
+	if(!myFinished || myStart < 0 || myRhs[myStart] >= UNREACHED)
+		return -1;
+	return myRhs[myStart];
+}
+
+size_t GridPlanner::getMemoryUsage() const
+{
+	return myG.capacity() * sizeof(int) + myRhs.capacity() * sizeof(int) + myHeapPos.capacity() * sizeof(int)
+		 + myFlags.capacity() + myBlockers.capacity() * sizeof(unsigned short) + myPenalty.capacity()
+		 + myHeap.capacity() * sizeof(HeapEntry);
+}
+
+void GridPlanner::heapSwap(int a, int b)
+{
+	std::swap(myHeap[a], myHeap[b]);
+	myHeapPos[myHeap[a].cell] = a;
+	myHeapPos[myHeap[b].cell] = b;
+}
+
+void GridPlanner::siftUp(int pos)
+{
+	while(pos > 0)
+	{
+		int parent = (pos - 1) >> 1;
+		if(!keyLess(myHeap[pos].k1, myHeap[pos].k2, myHeap[parent].k1, myHeap[parent].k2))
+			break;
+		heapSwap(pos, parent);
+		pos = parent;
+	}
+}
+
+void GridPlanner::siftDown(int pos)
+{
+	int size = (int)myHeap.size();
+	for(;;)
+	{
+		int child = 2 * pos + 1;
+		if(child >= size)
+			break;
+		if(child + 1 < size && keyLess(myHeap[child + 1].k1, myHeap[child + 1].k2, myHeap[child].k1, myHeap[child].k2))
+			child++;
+		if(!keyLess(myHeap[child].k1, myHeap[child].k2, myHeap[pos].k1, myHeap[pos].k2))
+			break;
+		heapSwap(pos, child);
+		pos = child;
+	}
+}
+
+void GridPlanner::heapInsert(int cell, int k1, int k2)
+{
+	HeapEntry entry;
+	entry.k1 = k1;
+	entry.k2 = k2;
+	entry.cell = cell;
+	myHeap.push_back(entry);
+	myHeapPos[cell] = (int)myHeap.size() - 1;
+	siftUp((int)myHeap.size() - 1);
+}
+
+void GridPlanner::heapRemove(int cell)
+{
+	int pos = myHeapPos[cell];
+	int last = (int)myHeap.size() - 1;
+	if(pos != last)
+		heapSwap(pos, last);
+	myHeap.pop_back();
+	myHeapPos[cell] = -1;
+	if(pos != last)
+	{
+		siftUp(pos);
+		siftDown(myHeapPos[myHeap[pos].cell]);
+	}
+}
+
+void GridPlanner::heapUpdate(int cell, int k1, int k2)
+{
+	int pos = myHeapPos[cell];
+	myHeap[pos].k1 = k1;
+	myHeap[pos].k2 = k2;
+	siftUp(pos);
+	siftDown(myHeapPos[cell]);
+}
+
+void sync_planner( GridPlanner &planner, const logodds_grid &map, const DirtyCellSet &dirty )
+{
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		int cx, cy;
+		map.indexToCell(dirty[i], cx, cy);
+		if(!planner.contains(cx, cy))
+			continue;
+		float value = map[dirty[i]];
+		planner.setObstacle(cx, cy, value > LOGODDS_OBSTACLE);
+		planner.setPenalty(cx, cy, value == map.getFillValue() ? PLANNER_UNKNOWN_PENALTY : 0);
+	}
+}
+
+void load_planner( GridPlanner &planner, const logodds_grid &map )
+{
+	for(int y = 0; y < planner.getHeight(); y++)
+	{
+		for(int x = 0; x < planner.getWidth(); x++)
+		{
+			int cx = planner.getOriginX() + x, cy = planner.getOriginY() + y;
+			float value = map.get(cx, cy);
+			planner.setObstacle(cx, cy, value > LOGODDS_OBSTACLE);
+			planner.setPenalty(cx, cy, value == map.getFillValue() ? PLANNER_UNKNOWN_PENALTY : 0);
+		}
+	}
+}
@@ -0,0 +1,176 @@
+/********************************************************
+ *	Path planner over the occupancy grid, D* Lite
+ *
+ *	Plans 8-connected paths on a fixed window of the map
+ *	(Koenig and Likhachev, "D* Lite", 2002). The search
+ *	runs from the goal back to the robot, so when the
+ *	robot moves or some cells change only the part of the
+ *	old search those changes touch gets redone instead of
+ *	planning from scratch every cycle.
+ *
+ *	Everything per cell lives in flat arrays indexed by
+ *	y * width + x, costs are integers (PLANNER_STEP per
+ *	cell) so keys that should tie do, and the open list is a binary heap that
+ *	knows where each cell sits in it, so updating or
+ *	dropping a queued cell doesn't search the heap.
+ *
+ *	A cell is blocked when an obstacle is within the
+ *	robot's radius of it. Obstacles are counted into the
+ *	cells around them as they come and go, so the inflated
+ *	grid is never rebuilt either. Unblocked cells can also
+ *	carry a penalty (unknown space, say) that makes moving
+ *	into them more expensive.
+ ********************************************************/
+
+#ifndef GRID_PLANNER_H
+#define GRID_PLANNER_H
+
+#include "sonar_model.h"
+#include "dirty_cells.h"
+
+#include <vector>
+
+#define PLANNER_STEP			100		//cost of a step to a side neighbor
+#define PLANNER_DIAGONAL		141		//and to a corner one, integers so ties in the search are exact
+#define PLANNER_PENALTY_SCALE	16		//a penalty of this much doubles the cost of moving into the cell
+#define PLANNER_UNKNOWN_PENALTY	16		//unknown cells cost twice as much as seen free ones
+
+class GridPlanner
+{
+public:
+	/*
+	 *	width x height cells, (originX, originY) is the map cell of the
+	 *	lower left corner. Cells within radius cells of an obstacle are
+	 *	blocked. Every cell starts free with no penalty.
+	 */
+	GridPlanner(int width, int height, int originX = 0, int originY = 0, int radius = 0);
+
+	int getWidth() const { return myWidth; }
+	int getHeight() const { return myHeight; }
+	int getOriginX() const { return myOriginX; }
+	int getOriginY() const { return myOriginY; }
+
+	bool contains(int cx, int cy) const
+	{
+		cx -= myOriginX;
+		cy -= myOriginY;
+		return cx >= 0 && cy >= 0 && cx < myWidth && cy < myHeight;
+	}
+
+	//cells in map coordinates, changes take effect on the next plan()
+	void setObstacle(int cx, int cy, bool obstacle);
+	void setPenalty(int cx, int cy, unsigned char penalty);
+	bool isBlocked(int cx, int cy) const;
+
+	/*
+	 *	A new goal throws the old search away. The goal itself is never
+	 *	blocked, frontier goals are often right next to a wall
+	 */
+	bool setGoal(int cx, int cy);
+
+	//drops the search so the next plan() starts from scratch
+	void reset();
+
+	//the robot moved, the search so far stays good. False outside the window
+	bool setStart(int cx, int cy);
+
+	/*
+	 *	Repairs the search for whatever changed since the last call.
+	 *	Returns false if the start can't reach the goal. With a budget it
+	 *	stops after expanding that many cells and returns false too, then
+	 *	isFinished() is false and the next plan() carries on where this
+	 *	one stopped, changes and a moved start included. Proving there is
+	 *	no path at all expands everything the goal reaches, on a big
+	 *	window that is hundreds of milliseconds in one go.
+	 */
+	bool plan(long budget = 0);
+
+	//false while the last plan() ran out of budget before the search was done
+	bool isFinished() const { return myFinished; }
+
+	//cells from start to goal after a successful plan(), in map coordinates
+	bool getPath(std::vector<int> &xs, std::vector<int> &ys) const;
+
+	//cost to the goal from the start in PLANNER_STEP units, -1 if there is no path or the search isn't done
+	int getPathCost() const;
+
+	//cells expanded by the last plan()
+	long getExpanded() const { return myExpanded; }
+
+	size_t getMemoryUsage() const;
+
+private:
+	enum
+	{
+		CELL_OBSTACLE	= 1,
+		CELL_BORDER		= 2
+	};
+
+	struct HeapEntry
+	{
+		int k1, k2;
+		int cell;
+	};
+
+	static bool keyLess(int a1, int a2, int b1, int b2)
+	{
+		return a1 < b1 || (a1 == b1 && a2 < b2);
+	}
+
+	bool passable(int cell) const { return myBlockers[cell] == 0 || cell == myGoal; }
+
+	//the goal's rhs is pinned at 0 and the border is never searched
+	bool searchable(int cell) const { return cell != myGoal && !(myFlags[cell] & CELL_BORDER); }
+	int cellAt(int cx, int cy) const;
+	int heuristic(int a, int b) const;
+	int cost(int from, int k) const;		//moving from the cell to its k-th neighbor
+	int bestSuccessor(int cell) const;
+	void calculateKey(int cell, int &k1, int &k2) const;
+	void updateVertex(int cell);
+	void markChanged(int cell);
+
+	//indexed heap
+	void heapInsert(int cell, int k1, int k2);
+	void heapRemove(int cell);
+	void heapUpdate(int cell, int k1, int k2);
+	void siftUp(int pos);
+	void siftDown(int pos);
+	void heapSwap(int a, int b);
+
+	int myWidth, myHeight;
+	int myOriginX, myOriginY;
+	int myRadius;
+	std::vector<int> myDiskX, myDiskY;	//cell offsets within the radius
+
+	std::vector<int> myG;
+	std::vector<int> myRhs;
+	std::vector<int> myHeapPos;			//-1 when not queued
+	std::vector<unsigned char> myFlags;		//obstacle, border
+	std::vector<unsigned short> myBlockers;	//obstacles within the radius, the border counts as one
+	std::vector<unsigned char> myPenalty;
+
+	std::vector<HeapEntry> myHeap;
+	DirtyCellSet myChanged;				//cells whose cost changed since the last plan()
+
+	int myStart, myGoal, myLast;
+	int myKm;
+	long myExpanded;
+	bool myFinished;
+	int myNeighbor[8];					//index offsets of the 8 neighbors
+	int myStep[8];
+
+	GridPlanner(const GridPlanner&);
+	GridPlanner& operator=(const GridPlanner&);
+};
+
+/*
+ *	Copies the cells that changed this cycle from the map into the
+ *	planner: obstacles above LOGODDS_OBSTACLE, PLANNER_UNKNOWN_PENALTY
+ *	on cells the sonars never saw
+ */
+void sync_planner( GridPlanner &planner, const logodds_grid &map, const DirtyCellSet &dirty );
+
+//loads the whole map into a new planner, for a map that was loaded instead of built
+void load_planner( GridPlanner &planner, const logodds_grid &map );
+
+#endif
@@ -0,0 +1,56 @@
+/********************************************************
+ *	Likelihood field of a finished map, see
+ *	likelihood_field.h
+ ********************************************************/
+
+#include "likelihood_field.h"
+#include "distance_map.h"
+
+#include <cmath>
+
+LikelihoodField::LikelihoodField()
+	: myMinX(0), myMinY(0), myWidth(0), myHeight(0), myCellSize(100), myOutside(0)
+{
+}
+
+bool LikelihoodField::build(const logodds_grid &map, double sigma, double hit)
+{
+	myLog.clear();
+	myFree.clear();
+
+	int min_x, min_y, max_x, max_y;
+	if(!map.getCellBounds(min_x, min_y, max_x, max_y))
+		return false;
+
+	myCellSize = map.getCellSize();
+	myMinX = min_x - LIKELIHOOD_MARGIN;
+	myMinY = min_y - LIKELIHOOD_MARGIN;
+	myWidth = max_x - min_x + 1 + 2 * LIKELIHOOD_MARGIN;
+	myHeight = max_y - min_y + 1 + 2 * LIKELIHOOD_MARGIN;
+
+	//past 3 sigma the gaussian is nothing next to the floor
+	int reach = (int)ceil(3 * sigma / myCellSize) + 1;
+	DistanceMap distance(reach);
+	distance.build(map);
+
+	//one entry per squared distance, that is all a cell can differ in
+	double s = sigma / myCellSize;
+	std::vector<float> table(distance.getFar() + 1);
+	for(int d2 = 0; d2 < (int)table.size(); d2++)
+		table[d2] = (float)log(hit * exp(-d2 / (2 * s * s)) + (1 - hit));
+	myOutside = (float)log(1 - hit);
+	table[distance.getFar()] = myOutside;
+
+	myLog.resize((size_t)myWidth * myHeight);
+	for(int y = 0; y < myHeight; y++)
+	{
+		for(int x = 0; x < myWidth; x++)
+		{
+			int d2 = distance.getDistance2(myMinX + x, myMinY + y);
+			myLog[y * myWidth + x] = table[d2 < distance.getFar() ? d2 : distance.getFar()];
+			if(map.get(myMinX + x, myMinY + y) < 0 && d2 > 0)
+				myFree.push_back(y * myWidth + x);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+/********************************************************
+ *	Likelihood field of a finished map
+ *
+ *	For localizing on a map built earlier. Every cell
+ *	holds the log-likelihood of a sonar echo ending in
+ *	it: a gaussian in the distance to the closest
+ *	obstacle cell, mixed with a flat floor for echoes
+ *	the map can't explain (people, side lobes, stuff
+ *	that moved). The distances come from a DistanceMap
+ *	built once over the loaded map, after that it is a
+ *	flat array, so weighing an echo is one lookup.
+ *
+ *	It also keeps the cells the map has seen free, where
+ *	the robot can be when nobody says where it starts.
+ ********************************************************/
+
+#ifndef LIKELIHOOD_FIELD_H
+#define LIKELIHOOD_FIELD_H
+
+#include "sonar_model.h"
+
+#include <vector>
+#include <cmath>
+
+#define LIKELIHOOD_SIGMA	200.0	//[mm] spread of an echo around the wall it came from
+#define LIKELIHOOD_HIT		0.8		//share of echoes that come off a wall on the map
+#define LIKELIHOOD_MARGIN	30		//[cells] kept around the map, echoes can land past its edge
+
+class LikelihoodField
+{
+public:
+	LikelihoodField();
+
+	//computes the field over the whole map, returns false for an empty map
+	bool build(const logodds_grid &map, double sigma = LIKELIHOOD_SIGMA, double hit = LIKELIHOOD_HIT);
+
+	bool isBuilt() const { return !myLog.empty(); }
+
+	//log-likelihood of an echo ending at the world point [mm]
+	float get(double x, double y) const
+	{
+		int cx = (int)floor(x / myCellSize) - myMinX;
+		int cy = (int)floor(y / myCellSize) - myMinY;
+		if(cx < 0 || cy < 0 || cx >= myWidth || cy >= myHeight)
+			return myOutside;
+		return myLog[cy * myWidth + cx];
+	}
+
+	double getCellSize() const { return myCellSize; }
+
+	//cells the map has seen free, for spreading particles over, y * width + x from the corner
+	const std::vector<int>& getFreeCells() const { return myFree; }
+	int getMinX() const { return myMinX; }
+	int getMinY() const { return myMinY; }
+	int getWidth() const { return myWidth; }
+	int getHeight() const { return myHeight; }
+
+	size_t getMemoryUsage() const { return myLog.size() * sizeof(float) + myFree.size() * sizeof(int); }
+
+private:
+	std::vector<float> myLog;
+	std::vector<int> myFree;
+	int myMinX, myMinY;			//cell of the field's corner
+	int myWidth, myHeight;
+	double myCellSize;
+	float myOutside;			//off the field, only the floor is left
+
+	LikelihoodField(const LikelihoodField&);
+	LikelihoodField& operator=(const LikelihoodField&);
+};
+
+#endif
@@ -0,0 +1,512 @@
+/********************************************************
+ *	Map export, see map_export.h
+ ********************************************************/
+
+#include "map_export.h"
+
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#define PNG_CHUNK_BYTES		65536	//deflated bytes per IDAT chunk
+#define ADLER_BASE			65521
+#define ADLER_BLOCK			5552	//bytes the adler sums take before they need the modulo
+
+//occupancy probability of a log-odds value
+static double probability(double logodds)
+{
+	return 1 - 1 / (1 + exp(logodds));
+}
+
+/*
+ *	Grey levels for the cells, 255 * (1 - p) rounded, but never across a
+ *	threshold: p of a pixel is (255 - pixel) / 255, an obstacle has to
+ *	read above occupied_thresh and free space below free_thresh
+ */
+class PixelScale
+{
+public:
+	PixelScale()
+	{
+		myOccupied = probability(LOGODDS_OBSTACLE);
+		myFree = probability(LOGODDS_FREE_SPACE);
+		myDarkest = (int)ceil(255 * (1 - myOccupied)) - 1;		//last pixel above occupied_thresh
+		myLightest = (int)floor(255 * (1 - myFree)) + 1;		//first pixel below free_thresh
+	}
+
+	unsigned char operator()(float logodds) const
+	{
+		int pixel = (int)floor(255 * (1 - probability(logodds)) + 0.5);
+		if(logodds > LOGODDS_OBSTACLE)
+			pixel = std::min(pixel, myDarkest);
+		else if(logodds < LOGODDS_FREE_SPACE)
+			pixel = std::max(pixel, myLightest);
+		else
+			pixel = std::max(myDarkest + 1, std::min(pixel, myLightest - 1));
+		return (unsigned char)pixel;
+	}
+
+	double getOccupied() const { return myOccupied; }
+	double getFree() const { return myFree; }
+
+private:
+	double myOccupied, myFree;		//the YAML thresholds
+	int myDarkest, myLightest;
+};
+
+static void put_be32(unsigned char* p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t n)
+{
+	static uint32_t table[256];
+	static bool ready = false;
+	if(!ready)
+	{
+		for(uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for(int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		ready = true;
+	}
+	crc = ~crc;
+	for(size_t i = 0; i < n; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/*
+ *	zlib stream of one fixed Huffman deflate block, split into PNG IDAT
+ *	chunks as it fills up. The only matches are runs, a byte repeated at
+ *	distance 1, which is what map rows are made of.
+ */
+class PngDeflater
+{
+public:
+	PngDeflater(std::ofstream &out)
+		: myOut(out), myBits(0), myBitCount(0), myAdlerA(1), myAdlerB(0), myAdlerCount(0), myRunByte(0), myRunLength(0)
+	{
+		static const int base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+									  67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+									   4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		for(int code = 0; code < 29; code++)
+		{
+			int end = code < 28 ? base[code + 1] : 259;
+			for(int length = base[code]; length < end; length++)
+			{
+				myLengthCode[length] = (short)code;
+				myLengthExtra[length] = (short)extra[code];
+				myLengthBase[length] = (short)base[code];
+			}
+		}
+
+		//zlib header, no preset dictionary, then the only block: final, fixed codes
+		myChunk.push_back(0x78);
+		myChunk.push_back(0x01);
+		putBits(1, 1);
+		putBits(1, 2);
+	}
+
+	void write(const unsigned char* data, size_t n)
+	{
+		for(size_t i = 0; i < n; i++)
+		{
+			myAdlerA += data[i];
+			myAdlerB += myAdlerA;
+			if(++myAdlerCount == ADLER_BLOCK)
+			{
+				myAdlerA %= ADLER_BASE;
+				myAdlerB %= ADLER_BASE;
+				myAdlerCount = 0;
+			}
+
+			if(myRunLength > 0 && data[i] == myRunByte)
+				myRunLength++;
+			else
+			{
+				flushRun();
+				myRunByte = data[i];
+				myRunLength = 1;
+			}
+		}
+	}
+
+	//end of block, the adler checksum and the last chunk
+	void finish()
+	{
+		flushRun();
+		putSymbol(256);
+		if(myBitCount > 0)
+			putBits(0, 8 - myBitCount);
+
+		uint32_t adler = (myAdlerB % ADLER_BASE) << 16 | (myAdlerA % ADLER_BASE);
+		unsigned char tail[4];
+		put_be32(tail, adler);
+		myChunk.insert(myChunk.end(), tail, tail + 4);
+		writeChunk();
+	}
+
+private:
+	//deflate bits go in from the lowest bit of each byte up
+	void putBits(uint32_t value, int count)
+	{
+		myBits |= value << myBitCount;
+		myBitCount += count;
+		while(myBitCount >= 8)
+		{
+			myChunk.push_back((unsigned char)myBits);
+			myBits >>= 8;
+			myBitCount -= 8;
+		}
+		if(myChunk.size() >= PNG_CHUNK_BYTES)
+			writeChunk();
+	}
+
+	//Huffman codes go in from their highest bit down
+	void putCode(uint32_t code, int length)
+	{
+		uint32_t reversed = 0;
+		for(int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		putBits(reversed, length);
+	}
+
+	//literal, end of block or length symbol in the fixed code
+	void putSymbol(int symbol)
+	{
+		if(symbol < 144)
+			putCode(0x30 + symbol, 8);
+		else if(symbol < 256)
+			putCode(0x190 + symbol - 144, 9);
+		else if(symbol < 280)
+			putCode(symbol - 256, 7);
+		else
+			putCode(0xC0 + symbol - 280, 8);
+	}
+
+	//the first byte of a run as a literal, the rest as copies of the byte before
+	void flushRun()
+	{
+		if(myRunLength == 0)
+			return;
+		putSymbol(myRunByte);
+		size_t left = myRunLength - 1;
+		while(left >= 3)
+		{
+			int length = (int)std::min(left, (size_t)258);
+			putSymbol(257 + myLengthCode[length]);
+			if(myLengthExtra[length] > 0)
+				putBits(length - myLengthBase[length], myLengthExtra[length]);
+			putCode(0, 5);		//distance 1
+			left -= length;
+		}
+		for(; left > 0; left--)
+			putSymbol(myRunByte);
+		myRunLength = 0;
+	}
+
+	void writeChunk()
+	{
+		unsigned char head[8];
+		put_be32(head, (uint32_t)myChunk.size());
+		memcpy(head + 4, "IDAT", 4);
+		uint32_t crc = crc32(0, head + 4, 4);
+		if(!myChunk.empty())
+			crc = crc32(crc, &myChunk[0], myChunk.size());
+		unsigned char tail[4];
+		put_be32(tail, crc);
+
+		myOut.write((const char*)head, 8);
+		if(!myChunk.empty())
+			myOut.write((const char*)&myChunk[0], myChunk.size());
+		myOut.write((const char*)tail, 4);
+		myChunk.clear();
+	}
+
+	std::ofstream &myOut;
+	std::vector<unsigned char> myChunk;
+	uint32_t myBits;
+	int myBitCount;
+	uint32_t myAdlerA, myAdlerB;
+	int myAdlerCount;
+	unsigned char myRunByte;
+	size_t myRunLength;
+	short myLengthCode[259], myLengthExtra[259], myLengthBase[259];
+
+	PngDeflater(const PngDeflater&);
+	PngDeflater& operator=(const PngDeflater&);
+};
+
+static void write_png_chunk(std::ofstream &out, const char* type, const unsigned char* data, uint32_t n)
+{
+	unsigned char head[8];
+	put_be32(head, n);
+	memcpy(head + 4, type, 4);
+	uint32_t crc = crc32(crc32(0, head + 4, 4), data, n);
+	unsigned char tail[4];
+	put_be32(tail, crc);
+	out.write((const char*)head, 8);
+	out.write((const char*)data, n);
+	out.write((const char*)tail, 4);
+}
+
+/*
+ *	Fills rows with the tile row ty, the top image row first. Tiles the map
+ *	doesn't have come out as the fill value
+ */
+static void render_tile_row(const logodds_grid &map, const PixelScale &scale, int ty, int minTX, int maxTX,
+							std::vector<unsigned char> &rows)
+{
+	const int size = logodds_grid::TILE_SIZE;
+	int width = (maxTX - minTX + 1) * size;
+	unsigned char unknown = scale(map.getFillValue());
+	for(int tx = minTX; tx <= maxTX; tx++)
+	{
+		unsigned char* column = &rows[(tx - minTX) * size];
+		unsigned int index;
+		if(!map.findCellIndex(tx << logodds_grid::TILE_SHIFT, ty << logodds_grid::TILE_SHIFT, index))
+		{
+			for(int r = 0; r < size; r++)
+				memset(column + r * width, unknown, size);
+			continue;
+		}
+		const float* cells = map.getTileData((int)(index >> logodds_grid::CELL_BITS));
+		for(int r = 0; r < size; r++)
+		{
+			const float* row = cells + (size - 1 - r) * size;
+			unsigned char* out = column + r * width;
+			for(int c = 0; c < size; c++)
+				out[c] = scale(row[c]);
+		}
+	}
+}
+
+//the map_server YAML next to the image
+static bool write_yaml(const logodds_grid &map, const char* prefix, const std::string &image, const PixelScale &scale,
+					   int minX, int minY)
+{
+	std::ofstream out((std::string(prefix) + ".yaml").c_str(), std::ios::trunc);
+	if(!out)
+		return false;
+
+	//only the file name, the YAML sits next to the image
+	std::string name = image;
+	size_t slash = name.find_last_of("/\\");
+	if(slash != std::string::npos)
+		name = name.substr(slash + 1);
+
+	double cell = map.getCellSize() / 1000;
+	out.setf(std::ios::fixed);
+	out.precision(6);
+	out << "image: " << name << "\n"
+		<< "resolution: " << cell << "\n"
+		<< "origin: [" << minX * cell << ", " << minY * cell << ", 0.0]\n"
+		<< "negate: 0\n"
+		<< "occupied_thresh: " << scale.getOccupied() << "\n"
+		<< "free_thresh: " << scale.getFree() << "\n";
+	return out.good();
+}
+
+bool export_map_image(const logodds_grid &map, const char* prefix, MapImageFormat format, size_t* bytes)
+{
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	if(!map.getCellBounds(min_x, min_y, max_x, max_y))
+		return false;
+
+	const int size = logodds_grid::TILE_SIZE;
+	int min_tx = min_x >> logodds_grid::TILE_SHIFT, max_tx = max_x >> logodds_grid::TILE_SHIFT;
+	int min_ty = min_y >> logodds_grid::TILE_SHIFT, max_ty = max_y >> logodds_grid::TILE_SHIFT;
+	int width = max_x - min_x + 1, height = max_y - min_y + 1;
+
+	std::string path = std::string(prefix) + (format == MAP_IMAGE_PNG ? ".png" : ".pgm");
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+
+	PixelScale scale;
+	std::vector<unsigned char> rows((size_t)width * size);
+	if(format == MAP_IMAGE_PGM)
+	{
+		out << "P5\n# occupancy map, " << map.getCellSize() << " mm cells\n" << width << " " << height << "\n255\n";
+		for(int ty = max_ty; ty >= min_ty; ty--)
+		{
+			render_tile_row(map, scale, ty, min_tx, max_tx, rows);
+			out.write((const char*)&rows[0], rows.size());
+		}
+	}
+	else
+	{
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		out.write((const char*)signature, 8);
+
+		unsigned char header[13];
+		put_be32(header, (uint32_t)width);
+		put_be32(header + 4, (uint32_t)height);
+		header[8] = 8;		//bits per pixel
+		header[9] = 0;		//grey
+		header[10] = 0;		//deflate
+		header[11] = 0;		//per row filters
+		header[12] = 0;		//not interlaced
+		write_png_chunk(out, "IHDR", header, sizeof(header));
+
+		//every row as the difference to the one above, filter type 2, the top row against zeros
+		PngDeflater deflater(out);
+		std::vector<unsigned char> above(width, 0), filtered(width + 1);
+		filtered[0] = 2;
+		for(int ty = max_ty; ty >= min_ty; ty--)
+		{
+			render_tile_row(map, scale, ty, min_tx, max_tx, rows);
+			for(int r = 0; r < size; r++)
+			{
+				const unsigned char* row = &rows[(size_t)r * width];
+				for(int x = 0; x < width; x++)
+					filtered[x + 1] = (unsigned char)(row[x] - above[x]);
+				memcpy(&above[0], row, width);
+				deflater.write(&filtered[0], filtered.size());
+			}
+		}
+		deflater.finish();
+		write_png_chunk(out, "IEND", NULL, 0);
+	}
+
+	if(bytes)
+		*bytes = (size_t)out.tellp();
+	if(!out.good())
+		return false;
+	out.close();
+	return write_yaml(map, prefix, path, scale, min_x, min_y);
+}
+
+bool write_map_dat(const logodds_grid &map, const char* prefix, size_t* bytes)
+{
+	std::string name(prefix);
+	std::ofstream output((name + ".dat").c_str());
+	if(!output)
+		return false;
+
+	//bounds are whole tiles, a row is walked a tile at a time and a missing tile is all free
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	map.getCellBounds(min_x, min_y, max_x, max_y);
+	for(int i = min_x; i <= max_x; ++i)
+	{
+		for(int j = min_y; j <= max_y; j += logodds_grid::TILE_SIZE)
+		{
+			const float* tile = map.findTileData(i, j);
+			int end = std::min(j + logodds_grid::TILE_SIZE - 1, max_y);
+			for(int k = j; k <= end; ++k)
+			{
+				bool obstacle = tile != NULL && tile[logodds_grid::localIndex(i, k)] > LOGODDS_OBSTACLE;
+				output.write(obstacle ? "   1 " : "   0 ", 5);
+			}
+		}
+		output << "\n";
+	}
+	if(bytes)
+		*bytes = (size_t)output.tellp();
+	output.close();
+
+	//cell coordinate of the first row/column so MATLAB can place the map in the world frame
+	std::ofstream origin((name + "_origin.dat").c_str());
+	origin << min_x << " " << min_y << " " << map.getCellSize() << "\n";
+	origin.close();
+	return !output.fail() && !origin.fail();
+}
+
+bool write_map_rle(const char* path, const logodds_grid &map, size_t* bytes)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+
+	MapRleHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_RLE_MAGIC, sizeof(header.magic));
+	header.version = MAP_RLE_VERSION;
+	header.tileSize = logodds_grid::TILE_SIZE;
+	header.cellSize = (float)map.getCellSize();
+	header.fillValue = map.getFillValue();
+	header.numTiles = (uint32_t)map.getNumTiles();
+	out.write((const char*)&header, sizeof(header));
+
+	//count and value of each run, packed without padding
+	std::vector<unsigned char> runs;
+	for(int slot = 0; slot < map.getNumTiles(); slot++)
+	{
+		const float* cells = map.getTileData(slot);
+		runs.clear();
+		uint32_t count = 0;
+		for(int c = 0; c < logodds_grid::TILE_CELLS; )
+		{
+			int end = c + 1;
+			while(end < logodds_grid::TILE_CELLS && cells[end] == cells[c])
+				end++;
+			uint16_t length = (uint16_t)(end - c);
+			const unsigned char* l = (const unsigned char*)&length;
+			const unsigned char* v = (const unsigned char*)&cells[c];
+			runs.insert(runs.end(), l, l + sizeof(length));
+			runs.insert(runs.end(), v, v + sizeof(float));
+			count++;
+			c = end;
+		}
+
+		int32_t coords[2] = { map.getTileX(slot), map.getTileY(slot) };
+		out.write((const char*)coords, sizeof(coords));
+		out.write((const char*)&count, sizeof(count));
+		out.write((const char*)&runs[0], runs.size());
+	}
+
+	if(bytes)
+		*bytes = (size_t)out.tellp();
+	return out.good();
+}
+
+bool load_map_rle(const char* path, logodds_grid &map)
+{
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return false;
+
+	MapRleHeader header;
+	if(!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, MAP_RLE_MAGIC, sizeof(header.magic)) != 0 ||
+	   header.version != MAP_RLE_VERSION || header.tileSize != logodds_grid::TILE_SIZE)
+		return false;
+
+	for(uint32_t t = 0; t < header.numTiles; t++)
+	{
+		int32_t coords[2];
+		uint32_t count;
+		if(!in.read((char*)coords, sizeof(coords)) || !in.read((char*)&count, sizeof(count)))
+			return false;
+
+		//touching the corner cell allocates the tile, the top bits of its index are the slot
+		unsigned int index = map.cellIndex(coords[0] << logodds_grid::TILE_SHIFT, coords[1] << logodds_grid::TILE_SHIFT);
+		float* cells = map.getTileData((int)(index >> logodds_grid::CELL_BITS));
+		int filled = 0;
+		for(uint32_t r = 0; r < count; r++)
+		{
+			uint16_t length;
+			float value;
+			if(!in.read((char*)&length, sizeof(length)) || !in.read((char*)&value, sizeof(value)))
+				return false;
+			if(filled + length > logodds_grid::TILE_CELLS)
+				return false;
+			std::fill(cells + filled, cells + filled + length, value);
+			filled += length;
+		}
+		if(filled != logodds_grid::TILE_CELLS)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,92 @@
+/********************************************************
+ *	Map export for viewers and for taking maps off the robot
+ *
+ *	map.m draws one MATLAB rectangle per obstacle cell of
+ *	the .dat text, minutes on a big map. This writes the
+ *	map as an image any viewer opens, PGM or PNG, plus a
+ *	YAML file in the map_server layout (image, resolution,
+ *	origin, thresholds) so other tools can place it.
+ *
+ *	A pixel is 255 * (1 - p) of the cell's occupancy
+ *	probability, dark is occupied. The YAML thresholds are
+ *	the probabilities of LOGODDS_OBSTACLE and
+ *	LOGODDS_FREE_SPACE, and pixels next to them get
+ *	rounded so a reader going by the thresholds calls
+ *	exactly the cells obstacles the map does. Unknown
+ *	cells come out in between, grey.
+ *
+ *	Image rows go top down, so the map gets written one
+ *	row of tiles at a time from the top, 32 image rows
+ *	held in memory, missing tiles come out unknown. The
+ *	PNG is deflated with fixed Huffman codes, each row
+ *	stored as the difference to the one above (filter
+ *	"up") and runs of equal bytes sent as repeats, most
+ *	of a map is the same grey or white over and over.
+ *
+ *	The .dat text map.m reads is written here too, for
+ *	every program that makes one: "   1 " for a cell
+ *	above LOGODDS_OBSTACLE and "   0 " for everything
+ *	else, a line per column of the explored bounding
+ *	box, and the first cell's coordinates and the cell
+ *	size in <prefix>_origin.dat.
+ *
+ *	For copying a map off the robot the .rle file keeps
+ *	the log-odds themselves, tile by tile like the map
+ *	file, each tile as runs of equal values. Free and
+ *	occupied cells pile up at LOGODDS_MIN and LOGODDS_MAX
+ *	and unknown ones are all the fill value, so the runs
+ *	are long and nothing is lost.
+ *
+ *	RLE layout (little endian, version 1):
+ *		MapRleHeader				32 bytes
+ *		per tile, in slot order:
+ *			int32 tileX, int32 tileY, uint32 runs
+ *			runs x (uint16 count, float32 value)
+ ********************************************************/
+
+#ifndef MAP_EXPORT_H
+#define MAP_EXPORT_H
+
+#include "sonar_model.h"
+
+#include <stdint.h>
+
+#define MAP_RLE_MAGIC	"SRRLE\0\0"
+#define MAP_RLE_VERSION	1
+
+enum MapImageFormat
+{
+	MAP_IMAGE_PGM,
+	MAP_IMAGE_PNG
+};
+
+struct MapRleHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t tileSize;			//cells along one side of a tile
+	float cellSize;				//[mm]
+	float fillValue;			//log-odds of a cell no sonar touched
+	uint32_t numTiles;
+	uint32_t reserved;
+};
+
+/*
+ *	Writes <prefix>.pgm or <prefix>.png and <prefix>.yaml, returns false
+ *	if either can't be written. bytes gets the image file size
+ */
+bool export_map_image(const logodds_grid &map, const char* prefix, MapImageFormat format, size_t* bytes = NULL);
+
+/*
+ *	Writes <prefix>.dat and <prefix>_origin.dat for the MATLAB script,
+ *	returns false if either can't be written. bytes gets the .dat size
+ */
+bool write_map_dat(const logodds_grid &map, const char* prefix, size_t* bytes = NULL);
+
+//writes the run-length coded map, returns false if the file can't be written
+bool write_map_rle(const char* path, const logodds_grid &map, size_t* bytes = NULL);
+
+//reads a map written by write_map_rle into an empty grid, returns false if the file can't be read
+bool load_map_rle(const char* path, logodds_grid &map);
+
+#endif
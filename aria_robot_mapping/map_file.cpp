@@ -0,0 +1,402 @@
+/********************************************************
+ *	Binary map file with incremental checkpoints,
+ *	see map_file.h
+ ********************************************************/
+
+#include "map_file.h"
+#include "cycle_timer.h"
+
+#include <boost/version.hpp>
+
+#include <cstring>
+#include <fstream>
+
+using namespace boost::interprocess;
+
+#define MAP_FILE_MIN_TILES	64		//file grows by at least this many records at a time
+
+//waits until the range is on the disk, not just handed to the OS
+static void sync_range(mapped_region &region, size_t offset, size_t size)
+{
+#if BOOST_VERSION >= 105300
+	region.flush(offset, size, false);
+#else
+	region.flush(offset, size);
+#endif
+}
+
+static void init_header(MapFileHeader &header, double cellSize)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAP_FILE_MAGIC, sizeof(header.magic));
+	header.version = MAP_FILE_VERSION;
+	header.headerSize = sizeof(MapFileHeader);
+	header.recordSize = sizeof(MapTileRecord);
+	header.tileSize = map_file_grid::TILE_SIZE;
+	header.cellSize = (float)cellSize;
+	header.originX = 0;			//cell (0,0) starts at the world origin
+	header.originY = 0;
+	header.cellType = MAP_CELL_LOGODDS;
+}
+
+static bool check_header(const MapFileHeader* header, size_t fileSize)
+{
+	if(fileSize < sizeof(MapFileHeader))
+		return false;
+	if(memcmp(header->magic, MAP_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+	   header->version != MAP_FILE_VERSION ||
+	   header->recordSize != sizeof(MapTileRecord) ||
+	   header->tileSize != map_file_grid::TILE_SIZE ||
+	   header->cellType != MAP_CELL_LOGODDS)
+		return false;
+	return header->headerSize + (size_t)header->numTiles * header->recordSize <= fileSize;
+}
+
+bool MapFileView::open(const char* path)
+{
+	myHeader = NULL;
+	try
+	{
+		file_mapping file(path, read_only);
+		mapped_region region(file, read_only);
+		if(!check_header((const MapFileHeader*)region.get_address(), region.get_size()))
+			return false;
+
+		myFile.swap(file);
+		myRegion.swap(region);
+	}
+	catch(interprocess_exception&)
+	{
+		return false;
+	}
+
+	myHeader = (const MapFileHeader*)myRegion.get_address();
+	return true;
+}
+
+bool load_map_file(const char* path, map_file_grid &grid)
+{
+	MapFileView view;
+	if(!view.open(path))
+		return false;
+
+	for(int i = 0; i < view.getNumTiles(); i++)
+	{
+		const MapTileRecord* record = view.getTile(i);
+
+		//touching the corner cell allocates the tile, the top bits of its index are the slot
+		unsigned int index = grid.cellIndex(record->tileX << map_file_grid::TILE_SHIFT,
+											record->tileY << map_file_grid::TILE_SHIFT);
+		memcpy(grid.getTileData(index >> map_file_grid::CELL_BITS), record->cells, sizeof(record->cells));
+	}
+	return true;
+}
+
+bool write_map_file(const char* path, const map_file_grid &grid, uint32_t sequence)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+
+	MapFileHeader header;
+	init_header(header, grid.getCellSize());
+	header.numTiles = (uint32_t)grid.getNumTiles();
+	header.sequence = sequence;
+	out.write((const char*)&header, sizeof(header));
+
+	MapTileRecord record;
+	for(int slot = 0; slot < grid.getNumTiles(); slot++)
+	{
+		stage_map_tile(grid, slot, sequence, record);
+		out.write((const char*)&record, sizeof(record));
+	}
+	return out.good();
+}
+
+void stage_map_tile(const map_file_grid &grid, int slot, uint32_t sequence, MapTileRecord &record)
+{
+	record.tileX = grid.getTileX(slot);
+	record.tileY = grid.getTileY(slot);
+	record.sequence = sequence;
+	record.reserved = 0;
+	memcpy(record.cells, grid.getTileData(slot), sizeof(record.cells));
+}
+
+bool write_map_records(const char* path, double cellSize, const std::vector<MapTileRecord*> &records, size_t count,
+					   uint32_t sequence)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+
+	MapFileHeader header;
+	init_header(header, cellSize);
+	header.numTiles = (uint32_t)count;
+	header.sequence = sequence;
+	out.write((const char*)&header, sizeof(header));
+	for(size_t i = 0; i < count; i++)
+		out.write((const char*)records[i], sizeof(MapTileRecord));
+	return out.good();
+}
+
+uint32_t map_checksum(const map_file_grid &grid)
+{
+	uint32_t hash = 2166136261u;
+	for(int slot = 0; slot < grid.getNumTiles(); slot++)
+	{
+		int coords[2] = { grid.getTileX(slot), grid.getTileY(slot) };
+		const unsigned char* bytes[2] = { (const unsigned char*)coords, (const unsigned char*)grid.getTileData(slot) };
+		size_t sizes[2] = { sizeof(coords), map_file_grid::TILE_CELLS * sizeof(float) };
+		for(int part = 0; part < 2; part++)
+		{
+			for(size_t i = 0; i < sizes[part]; i++)
+			{
+				hash ^= bytes[part][i];
+				hash *= 16777619u;
+			}
+		}
+	}
+	return hash;
+}
+
+MapCheckpointer::MapCheckpointer(const char* path, double cellSize, double interval)
+	: myPath(path), myOpen(false), myInterval(interval), myLastCheckpoint(now_seconds()),
+	  mySequence(0), myNumStaged(0), myStagedTiles(0), myCapacity(0), myBusy(false), myFailed(false), myStop(false)
+{
+	init_header(myHeader, cellSize);
+
+	//start from an empty file holding just the header
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if(!out)
+			return;
+		out.write((const char*)&myHeader, sizeof(myHeader));
+		if(!out)
+			return;
+	}
+	if(!ensureCapacity(MAP_FILE_MIN_TILES))
+		return;
+
+	myOpen = true;
+	myThread = boost::thread(&MapCheckpointer::workerLoop, this);
+}
+
+MapCheckpointer::~MapCheckpointer()
+{
+	{
+		boost::mutex::scoped_lock lock(myMutex);
+		myStop = true;
+	}
+	myCond.notify_all();
+	if(myThread.joinable())
+		myThread.join();
+}
+
+void MapCheckpointer::update(const map_file_grid &grid, const DirtyCellSet &dirty)
+{
+	if(!myOpen)
+		return;
+
+	if(myTileDirty.size() < (size_t)grid.getNumTiles())
+		myTileDirty.resize(grid.getNumTiles(), 0);
+
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		int slot = dirty[i] >> map_file_grid::CELL_BITS;
+		if(!myTileDirty[slot])
+		{
+			myTileDirty[slot] = 1;
+			myDirtySlots.push_back(slot);
+		}
+	}
+
+	if(now_seconds() - myLastCheckpoint < myInterval)
+		return;
+
+	//worker still writing the last checkpoint, keep the tiles dirty and try next cycle
+	boost::mutex::scoped_lock lock(myMutex, boost::try_to_lock);
+	if(!lock.owns_lock() || myBusy)
+		return;
+
+	requeueFailed();
+	if(myDirtySlots.empty())
+		return;
+
+	stage(grid);
+	myBusy = true;
+	lock.unlock();
+	myCond.notify_one();
+	myLastCheckpoint = now_seconds();
+}
+
+void MapCheckpointer::markAllDirty(const map_file_grid &grid)
+{
+	if(myTileDirty.size() < (size_t)grid.getNumTiles())
+		myTileDirty.resize(grid.getNumTiles(), 0);
+
+	for(int slot = 0; slot < grid.getNumTiles(); slot++)
+	{
+		if(!myTileDirty[slot])
+		{
+			myTileDirty[slot] = 1;
+			myDirtySlots.push_back(slot);
+		}
+	}
+}
+
+void MapCheckpointer::finish(const map_file_grid &grid)
+{
+	if(!myOpen)
+		return;
+
+	boost::mutex::scoped_lock lock(myMutex);
+	while(myBusy)
+		myCond.wait(lock);
+
+	if(myTileDirty.size() < (size_t)grid.getNumTiles())
+		myTileDirty.resize(grid.getNumTiles(), 0);
+	requeueFailed();
+	if(myDirtySlots.empty())
+		return;
+
+	stage(grid);
+	myBusy = true;
+	myCond.notify_all();
+	while(myBusy)
+		myCond.wait(lock);
+
+	//still not on disk, a later finish() gets to try again
+	requeueFailed();
+}
+
+/*
+ *	Copies the dirty tiles into the staging buffers, the worker only ever
+ *	reads those so the grid is free to change while it writes.
+ *	Called with the mutex held and the worker idle.
+ */
+void MapCheckpointer::stage(const map_file_grid &grid)
+{
+	mySequence++;
+	if(myStaged.size() < myDirtySlots.size())
+		myStaged.resize(myDirtySlots.size());
+
+	for(size_t i = 0; i < myDirtySlots.size(); i++)
+	{
+		int slot = myDirtySlots[i];
+		StagedTile &staged = myStaged[i];
+		staged.slot = slot;
+		staged.record.tileX = grid.getTileX(slot);
+		staged.record.tileY = grid.getTileY(slot);
+		staged.record.sequence = mySequence;
+		staged.record.reserved = 0;
+		memcpy(staged.record.cells, grid.getTileData(slot), sizeof(staged.record.cells));
+		myTileDirty[slot] = 0;
+	}
+	myNumStaged = myDirtySlots.size();
+	myStagedTiles = (uint32_t)grid.getNumTiles();
+	myDirtySlots.clear();
+}
+
+/*
+ *	Marks the tiles of a checkpoint the worker couldn't write dirty again,
+ *	stage() cleared their flags. Called with the mutex held and the worker
+ *	idle.
+ */
+void MapCheckpointer::requeueFailed()
+{
+	if(!myFailed)
+		return;
+
+	for(size_t i = 0; i < myNumStaged; i++)
+	{
+		int slot = myStaged[i].slot;
+		if(!myTileDirty[slot])
+		{
+			myTileDirty[slot] = 1;
+			myDirtySlots.push_back(slot);
+		}
+	}
+	myNumStaged = 0;
+	myFailed = false;
+}
+
+void MapCheckpointer::workerLoop()
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	while(true)
+	{
+		while(!myBusy && !myStop)
+			myCond.wait(lock);
+		if(!myBusy)
+			return;
+
+		//the staging buffers belong to this thread until myBusy goes back down
+		lock.unlock();
+		bool written = writeStaged();
+		lock.lock();
+
+		myFailed = !written;
+		myBusy = false;
+		myCond.notify_all();
+	}
+}
+
+bool MapCheckpointer::writeStaged()
+{
+	if(!ensureCapacity(myStagedTiles))
+		return false;
+
+	char* base = (char*)myRegion.get_address();
+	for(size_t i = 0; i < myNumStaged; i++)
+	{
+		size_t offset = myHeader.headerSize + (size_t)myStaged[i].slot * myHeader.recordSize;
+		memcpy(base + offset, &myStaged[i].record, sizeof(MapTileRecord));
+		sync_range(myRegion, offset, sizeof(MapTileRecord));
+	}
+
+	//header goes last so a reader never sees a tile count ahead of the tiles
+	if(myStagedTiles > myHeader.numTiles)
+		myHeader.numTiles = myStagedTiles;
+	myHeader.sequence = myStaged[0].record.sequence;
+	memcpy(base, &myHeader, sizeof(myHeader));
+	sync_range(myRegion, 0, sizeof(myHeader));
+	return true;
+}
+
+/*
+ *	Grows the file so it has room for at least the given number of tiles
+ *	and maps it again. Capacity doubles so this happens rarely.
+ */
+bool MapCheckpointer::ensureCapacity(uint32_t tiles)
+{
+	if(tiles <= myCapacity)
+		return true;
+
+	uint32_t capacity = myCapacity < MAP_FILE_MIN_TILES ? MAP_FILE_MIN_TILES : myCapacity;
+	while(capacity < tiles)
+		capacity *= 2;
+
+	try
+	{
+		mapped_region().swap(myRegion);
+		{
+			std::filebuf buf;
+			if(!buf.open(myPath.c_str(), std::ios::in | std::ios::out | std::ios::binary))
+				return false;
+			buf.pubseekoff(myHeader.headerSize + (std::streamoff)capacity * myHeader.recordSize - 1, std::ios::beg);
+			buf.sputc(0);
+		}
+
+		file_mapping file(myPath.c_str(), read_write);
+		mapped_region region(file, read_write);
+		myFile.swap(file);
+		myRegion.swap(region);
+	}
+	catch(interprocess_exception&)
+	{
+		return false;
+	}
+
+	myCapacity = capacity;
+	return true;
+}
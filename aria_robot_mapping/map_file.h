@@ -0,0 +1,187 @@
+/********************************************************
+ *	Binary map file with incremental checkpoints
+ *
+ *	Layout (little endian, version 1):
+ *		MapFileHeader				64 bytes
+ *		MapTileRecord[numTiles]		one per grid tile, in the
+ *									grid's tile slot order
+ *
+ *	Records never move once written, the file only grows
+ *	at the end, so another program can map the file and
+ *	read any tile straight out of it without parsing.
+ *
+ *	While mapping, MapCheckpointer copies the tiles that
+ *	changed since the last checkpoint and a worker thread
+ *	writes them into the mapped file and syncs only those
+ *	records to disk. The control loop never waits on the
+ *	disk: if the worker is still busy the tiles just stay
+ *	dirty until the next interval. Tiles the worker fails
+ *	to write, because the file couldn't grow, go back to
+ *	being dirty and are tried again.
+ ********************************************************/
+
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include "tiled_grid.h"
+#include "dirty_cells.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#define MAP_FILE_MAGIC		"SRMAP\0\0"
+#define MAP_FILE_VERSION	1
+#define MAP_CELL_LOGODDS	1		//cells are float32 log-odds
+
+typedef TiledGrid<float> map_file_grid;
+
+struct MapFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;		//offset of the first tile record
+	uint32_t recordSize;		//bytes per tile record
+	uint32_t tileSize;			//cells along one side of a tile
+	float cellSize;				//[mm]
+	float originX;				//world position of the corner of cell (0,0), [mm]
+	float originY;
+	uint32_t cellType;
+	uint32_t numTiles;			//records in use
+	uint32_t sequence;			//bumped on every checkpoint
+	uint32_t reserved[4];
+};
+
+struct MapTileRecord
+{
+	int32_t tileX;				//tile coordinates, cell = tile * tileSize + offset
+	int32_t tileY;
+	uint32_t sequence;			//checkpoint this tile was last written in
+	uint32_t reserved;
+	float cells[map_file_grid::TILE_CELLS];		//row major, y rows of x cells
+};
+
+/*
+ *	Read-only view of a map file. Opening only maps the file and checks
+ *	the header, tiles are read in place.
+ */
+class MapFileView
+{
+public:
+	MapFileView() : myHeader(NULL) {}
+
+	bool open(const char* path);
+
+	const MapFileHeader* getHeader() const { return myHeader; }
+	int getNumTiles() const { return myHeader ? (int)myHeader->numTiles : 0; }
+	const MapTileRecord* getTile(int slot) const
+	{
+		return (const MapTileRecord*)((const char*)myHeader + myHeader->headerSize + (size_t)slot * myHeader->recordSize);
+	}
+
+private:
+	boost::interprocess::file_mapping myFile;
+	boost::interprocess::mapped_region myRegion;
+	const MapFileHeader* myHeader;
+};
+
+//copies a map file into a grid, returns false if the file can't be read
+bool load_map_file(const char* path, map_file_grid &grid);
+
+/*
+ *	Writes the whole grid as a map file in one go, sequence goes into the
+ *	header. For snapshots, the mapper itself uses MapCheckpointer.
+ */
+bool write_map_file(const char* path, const map_file_grid &grid, uint32_t sequence);
+
+/*
+ *	The same in two steps: copy tiles into records with stage_map_tile,
+ *	indexed by slot, then write the first count of them out. The grid is
+ *	free to change again once the copies are made, the write can go to
+ *	another thread.
+ */
+void stage_map_tile(const map_file_grid &grid, int slot, uint32_t sequence, MapTileRecord &record);
+bool write_map_records(const char* path, double cellSize, const std::vector<MapTileRecord*> &records, size_t count,
+					   uint32_t sequence);
+
+/*
+ *	FNV-1a over every tile, in slot order with its coordinates. Slots are
+ *	handed out in the order tiles get touched, so two maps only match if
+ *	they got the same updates in the same order.
+ */
+uint32_t map_checksum(const map_file_grid &grid);
+
+class MapCheckpointer
+{
+public:
+	/*
+	 *	Creates (or truncates) the map file. interval is the time between
+	 *	checkpoints in seconds
+	 */
+	MapCheckpointer(const char* path, double cellSize, double interval);
+	~MapCheckpointer();
+
+	bool isOpen() const { return myOpen; }
+
+	/*
+	 *	Call once per cycle after the map update. Remembers which tiles the
+	 *	dirty cells are in and hands them to the worker when the interval is
+	 *	up. Never blocks on the disk.
+	 */
+	void update(const map_file_grid &grid, const DirtyCellSet &dirty);
+
+	//marks every tile of the grid dirty, for a map that was loaded instead of built
+	void markAllDirty(const map_file_grid &grid);
+
+	//writes every remaining dirty tile and waits for it to hit the disk
+	void finish(const map_file_grid &grid);
+
+	uint32_t getSequence() const { return mySequence; }
+
+private:
+	struct StagedTile
+	{
+		int slot;
+		MapTileRecord record;
+	};
+
+	void stage(const map_file_grid &grid);
+	void workerLoop();
+	void requeueFailed();
+	bool writeStaged();
+	bool ensureCapacity(uint32_t tiles);
+
+	std::string myPath;
+	bool myOpen;
+	double myInterval;
+	double myLastCheckpoint;
+	uint32_t mySequence;
+
+	std::vector<unsigned char> myTileDirty;		//one flag per grid tile slot
+	std::vector<int> myDirtySlots;
+
+	//owned by the worker while it is busy
+	std::vector<StagedTile> myStaged;
+	size_t myNumStaged;
+	uint32_t myStagedTiles;
+	uint32_t myCapacity;
+	MapFileHeader myHeader;
+	boost::interprocess::file_mapping myFile;
+	boost::interprocess::mapped_region myRegion;
+
+	boost::mutex myMutex;
+	boost::condition_variable myCond;
+	bool myBusy;
+	bool myFailed;			//the last staged tiles didn't make it into the file
+	bool myStop;
+	boost::thread myThread;
+
+	MapCheckpointer(const MapCheckpointer&);
+	MapCheckpointer& operator=(const MapCheckpointer&);
+};
+
+#endif
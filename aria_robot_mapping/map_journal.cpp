@@ -0,0 +1,392 @@
+/********************************************************
+ *	Append-only journal of map updates, see map_journal.h
+ ********************************************************/
+
+#include "map_journal.h"
+#include "cycle_timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define JOURNAL_FLUSH_INTERVAL	1.0		//[s] between pushing buffered blocks to the OS
+#define JOURNAL_READ_ENTRIES	4096	//starting size of the replay read buffer
+#define JOURNAL_MAX_OFFSET		32767	//largest cell offset an entry can hold
+
+static std::string index_path(const char* prefix)
+{
+	return std::string(prefix) + ".idx";
+}
+
+std::string journal_segment_path(const char* prefix, uint32_t startCycle, const char* extension)
+{
+	char number[16];
+	sprintf(number, "_%08u", startCycle);
+	return std::string(prefix) + number + extension;
+}
+
+bool read_journal_index(const char* prefix, std::vector<uint32_t> &segments)
+{
+	segments.clear();
+	std::ifstream in(index_path(prefix).c_str());
+	if(!in)
+		return false;
+
+	uint32_t start;
+	while(in >> start)
+		segments.push_back(start);
+	return !segments.empty();
+}
+
+MapJournal::MapJournal(const char* prefix, uint32_t snapshotInterval, int keepSegments)
+	: myPrefix(prefix), mySnapshotInterval(snapshotInterval), myKeepSegments(keepSegments),
+	  mySegmentStart(0), myLastCycle(0), myPending(false), myLastFlush(0),
+	  mySnapshotTiles(0), mySnapshotCycle(0), myCellSize(0), myWritten(false), myBusy(false), myStop(false),
+	  myBaseX(0), myBaseY(0)
+{
+	myEntries.reserve(1024);
+	myThread = boost::thread(&MapJournal::workerLoop, this);
+}
+
+MapJournal::~MapJournal()
+{
+	close();
+	{
+		boost::mutex::scoped_lock lock(myMutex);
+		myStop = true;
+	}
+	myCond.notify_all();
+	if(myThread.joinable())
+		myThread.join();
+
+	for(size_t i = 0; i < mySnapshot.size(); i++)
+		delete mySnapshot[i];
+}
+
+bool MapJournal::start(uint32_t cycle, const logodds_grid &grid)
+{
+	close();
+	read_journal_index(myPrefix.c_str(), mySegments);
+
+	//a resumed run starts over at its own cycle, anything later in the index is stale
+	while(!mySegments.empty() && mySegments.back() >= cycle && cycle > 0)
+		mySegments.pop_back();
+	if(cycle == 0)
+		mySegments.clear();
+
+	//the copy starts over from the whole grid, written right here before the run starts
+	myTileDirty.clear();
+	myDirtySlots.clear();
+	mySnapshotTiles = 0;
+	stageSnapshot(cycle, grid);
+	if(!write_map_records(journal_segment_path(myPrefix.c_str(), cycle, ".snap").c_str(), grid.getCellSize(),
+						  mySnapshot, mySnapshotTiles, cycle))
+		return false;
+	if(!openSegment(myOut, cycle, grid.getCellSize()))
+		return false;
+	mySegmentStart = cycle;
+	myLastCycle = cycle;
+	addSegment(cycle);
+	return true;
+}
+
+void MapJournal::record(uint32_t cycle, const CycleEvidence &evidence, const logodds_grid &global)
+{
+	if(!myOut.is_open())
+		return;
+	if(myTileDirty.size() < (size_t)global.getNumTiles())
+		myTileDirty.resize(global.getNumTiles(), 0);
+
+	//global still holds the map after the previous cycle here
+	if(myPending)
+		endSnapshot(false);
+	else if(myLastCycle - mySegmentStart >= mySnapshotInterval)
+		beginSnapshot(myLastCycle, global);
+
+	for(size_t i = 0; i < evidence.dirty.size(); i++)
+	{
+		unsigned int cell = evidence.dirty[i];
+		float delta = evidence.obstacles[cell] + evidence.empty[cell];
+		if(delta == 0)
+			continue;
+
+		int slot = (int)(cell >> logodds_grid::CELL_BITS);
+		if(!myTileDirty[slot])
+		{
+			myTileDirty[slot] = 1;
+			myDirtySlots.push_back(slot);
+		}
+
+		int cx, cy;
+		global.indexToCell(cell, cx, cy);
+
+		//first cell of a block sets the base, a cell too far from it starts a new block
+		if(myEntries.empty())
+		{
+			myBaseX = cx;
+			myBaseY = cy;
+		}
+		else if(abs(cx - myBaseX) > JOURNAL_MAX_OFFSET || abs(cy - myBaseY) > JOURNAL_MAX_OFFSET)
+		{
+			writeBlock(cycle);
+			myBaseX = cx;
+			myBaseY = cy;
+		}
+
+		JournalEntry entry;
+		entry.dx = (int16_t)(cx - myBaseX);
+		entry.dy = (int16_t)(cy - myBaseY);
+		entry.delta = delta;
+		myEntries.push_back(entry);
+	}
+	writeBlock(cycle);
+	myLastCycle = cycle;
+
+	//the ofstream buffers the blocks, hand them to the OS now and then so a crash loses little
+	double now = now_seconds();
+	if(now - myLastFlush >= JOURNAL_FLUSH_INTERVAL)
+	{
+		myOut.flush();
+		if(myPending)
+			myNext.flush();
+		myLastFlush = now;
+	}
+}
+
+void MapJournal::close()
+{
+	if(myPending)
+		endSnapshot(true);
+	if(myOut.is_open())
+		myOut.close();
+}
+
+void MapJournal::writeBlock(uint32_t cycle)
+{
+	if(myEntries.empty())
+		return;
+
+	JournalBlock block;
+	block.cycle = cycle;
+	block.count = (uint32_t)myEntries.size();
+	block.baseX = myBaseX;
+	block.baseY = myBaseY;
+	myOut.write((const char*)&block, sizeof(block));
+	myOut.write((const char*)&myEntries[0], myEntries.size() * sizeof(JournalEntry));
+	if(myPending)
+	{
+		myNext.write((const char*)&block, sizeof(block));
+		myNext.write((const char*)&myEntries[0], myEntries.size() * sizeof(JournalEntry));
+	}
+	myEntries.clear();
+}
+
+//creates a segment's .jnl and writes its header
+bool MapJournal::openSegment(std::ofstream &out, uint32_t cycle, double cellSize)
+{
+	out.open(journal_segment_path(myPrefix.c_str(), cycle, ".jnl").c_str(), std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+
+	JournalHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.version = JOURNAL_VERSION;
+	header.startCycle = cycle;
+	header.cellSize = (float)cellSize;
+	out.write((const char*)&header, sizeof(header));
+	return out.good();
+}
+
+/*
+ *	The segment's snapshot is on the disk, puts it into the index. Drops
+ *	the oldest segments if we only keep a few.
+ */
+void MapJournal::addSegment(uint32_t cycle)
+{
+	mySegments.push_back(cycle);
+
+	//compact: the new snapshot makes the older segments unnecessary for resuming
+	if(myKeepSegments > 0)
+	{
+		while(mySegments.size() > (size_t)myKeepSegments)
+		{
+			remove(journal_segment_path(myPrefix.c_str(), mySegments[0], ".snap").c_str());
+			remove(journal_segment_path(myPrefix.c_str(), mySegments[0], ".jnl").c_str());
+			mySegments.erase(mySegments.begin());
+		}
+	}
+	writeIndex();
+}
+
+/*
+ *	Opens the next segment for the map after the given cycle and hands a
+ *	copy of the map to the worker. The current segment goes on until the
+ *	snapshot is written. Called with the worker idle.
+ */
+void MapJournal::beginSnapshot(uint32_t cycle, const logodds_grid &grid)
+{
+	//a failed try waits for the next interval, the current segment still has everything
+	mySegmentStart = cycle;
+	if(!openSegment(myNext, cycle, grid.getCellSize()))
+	{
+		myNext.close();
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(myMutex);
+	stageSnapshot(cycle, grid);
+	mySnapshotCycle = cycle;
+	myCellSize = grid.getCellSize();
+	myBusy = true;
+	myPending = true;
+	lock.unlock();
+	myCond.notify_all();
+}
+
+/*
+ *	Brings the snapshot copy up to the grid. Only the tiles that changed
+ *	since the last snapshot and the new ones get copied, not the whole map.
+ *	Called with the worker idle.
+ */
+void MapJournal::stageSnapshot(uint32_t cycle, const logodds_grid &grid)
+{
+	//a record each, the copy never moves when the map grows
+	size_t tiles = (size_t)grid.getNumTiles();
+	while(mySnapshot.size() < tiles)
+		mySnapshot.push_back(new MapTileRecord);
+
+	for(size_t i = 0; i < myDirtySlots.size(); i++)
+	{
+		int slot = myDirtySlots[i];
+		if((size_t)slot < mySnapshotTiles)
+			stage_map_tile(grid, slot, cycle, *mySnapshot[slot]);
+		myTileDirty[slot] = 0;
+	}
+	myDirtySlots.clear();
+
+	for(size_t slot = mySnapshotTiles; slot < tiles; slot++)
+		stage_map_tile(grid, (int)slot, cycle, *mySnapshot[slot]);
+	mySnapshotTiles = tiles;
+}
+
+/*
+ *	Switches to the new segment once the worker wrote its snapshot, or
+ *	drops it if that failed. Returns right away if the worker is still
+ *	at it, unless wait is set.
+ */
+void MapJournal::endSnapshot(bool wait)
+{
+	boost::mutex::scoped_lock lock(myMutex, boost::defer_lock);
+	if(wait)
+	{
+		lock.lock();
+		while(myBusy)
+			myCond.wait(lock);
+	}
+	else if(!lock.try_lock() || myBusy)
+		return;
+	bool written = myWritten;
+	uint32_t cycle = mySnapshotCycle;
+	lock.unlock();
+
+	myPending = false;
+	myNext.close();
+	std::string journal = journal_segment_path(myPrefix.c_str(), cycle, ".jnl");
+	if(!written)
+	{
+		remove(journal_segment_path(myPrefix.c_str(), cycle, ".snap").c_str());
+		remove(journal.c_str());
+		return;
+	}
+
+	//the new .jnl already holds every block since the snapshot, carry on at its end
+	myOut.close();
+	myOut.open(journal.c_str(), std::ios::binary | std::ios::app);
+	addSegment(cycle);
+}
+
+void MapJournal::workerLoop()
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	while(true)
+	{
+		while(!myBusy && !myStop)
+			myCond.wait(lock);
+		if(!myBusy)
+			return;
+
+		//the snapshot copy belongs to this thread until myBusy goes back down
+		lock.unlock();
+		bool written = write_map_records(journal_segment_path(myPrefix.c_str(), mySnapshotCycle, ".snap").c_str(),
+										 myCellSize, mySnapshot, mySnapshotTiles, mySnapshotCycle);
+		lock.lock();
+
+		myWritten = written;
+		myBusy = false;
+		myCond.notify_all();
+	}
+}
+
+void MapJournal::writeIndex()
+{
+	std::ofstream out(index_path(myPrefix.c_str()).c_str(), std::ios::trunc);
+	for(size_t i = 0; i < mySegments.size(); i++)
+		out << mySegments[i] << "\n";
+}
+
+bool replay_journal(const char* prefix, uint32_t cycle, logodds_grid &grid, uint32_t &reached)
+{
+	std::vector<uint32_t> segments;
+	if(!read_journal_index(prefix, segments))
+		return false;
+
+	//newest segment that starts at or before the cycle we want
+	size_t s = 0;
+	while(s + 1 < segments.size() && segments[s + 1] <= cycle)
+		s++;
+	if(segments[s] > cycle)
+		return false;
+
+	if(!load_map_file(journal_segment_path(prefix, segments[s], ".snap").c_str(), grid))
+		return false;
+	reached = segments[s];
+
+	std::ifstream in(journal_segment_path(prefix, segments[s], ".jnl").c_str(), std::ios::binary);
+	JournalHeader header;
+	if(!in.read((char*)&header, sizeof(header)) ||
+	   memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0 ||
+	   header.version != JOURNAL_VERSION)
+		return true;		//snapshot alone is still the map at its cycle
+
+	//a torn header can hold any count, nothing past the end of the file gets allocated for it
+	std::streamoff start = in.tellg();
+	in.seekg(0, std::ios::end);
+	std::streamoff end = in.tellg();
+	in.seekg(start);
+
+	std::vector<JournalEntry> entries(JOURNAL_READ_ENTRIES);
+	JournalBlock block;
+	while(in.read((char*)&block, sizeof(block)) && block.cycle <= cycle)
+	{
+		//a block has to be read to the end before it counts, the last one may be torn
+		std::streamoff left = end - (std::streamoff)in.tellg();
+		if((std::streamoff)block.count > left / (std::streamoff)sizeof(JournalEntry))
+			break;
+		if(block.count > entries.size())
+			entries.resize(block.count);
+		if(!in.read((char*)&entries[0], block.count * sizeof(JournalEntry)))
+			break;
+
+		for(uint32_t i = 0; i < block.count; i++)
+		{
+			//same arithmetic as merge_evidence so the replayed map matches bit for bit
+			float &g = grid.at(block.baseX + entries[i].dx, block.baseY + entries[i].dy);
+			g += entries[i].delta;
+			if(g > LOGODDS_MAX) g = LOGODDS_MAX;
+			if(g < LOGODDS_MIN) g = LOGODDS_MIN;
+		}
+		reached = block.cycle;
+	}
+	return true;
+}
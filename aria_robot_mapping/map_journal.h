@@ -0,0 +1,170 @@
+/********************************************************
+ *	Append-only journal of map updates
+ *
+ *	Every change the mapper makes to the global map gets
+ *	appended to a journal as (cycle, cell, log-odds delta)
+ *	so a run can be played back to any cycle afterwards,
+ *	or picked up again after the program restarts.
+ *
+ *	The journal is split into segments. Each segment
+ *	starts with a full snapshot of the map (a map file,
+ *	see map_file.h) and holds the updates that came after
+ *	it, so replaying to a cycle only reads one snapshot
+ *	and part of one segment. Files for prefix "robot_map":
+ *
+ *		robot_map.idx				start cycle of each segment, one per line
+ *		robot_map_00001200.snap		map after cycle 1200
+ *		robot_map_00001200.jnl		updates of cycles 1201 and on
+ *
+ *	Snapshots are written by a worker thread, so a big
+ *	map doesn't hold up the robot's sensor task for the
+ *	whole write. The journal keeps a copy of the map for
+ *	it and record() only copies the tiles that changed
+ *	since the last snapshot into it, which is why the map
+ *	may only change through recorded cycles. Until
+ *	the snapshot is on the disk the blocks go into both
+ *	the old and the new segment's .jnl, the new segment
+ *	only gets into the index once its snapshot is there.
+ *	If the snapshot can't be written the new segment is
+ *	dropped and the old one goes on.
+ *
+ *	A .jnl file is a JournalHeader followed by blocks,
+ *	one JournalBlock and then count JournalEntry each.
+ *	Cells in a block are stored relative to the block's
+ *	base cell, a sonar cone spans well under 2^15 cells.
+ *	A block cut short by a crash is ignored on replay,
+ *	so is one whose count runs past the end of the file.
+ ********************************************************/
+
+#ifndef MAP_JOURNAL_H
+#define MAP_JOURNAL_H
+
+#include "sonar_model.h"
+#include "map_file.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC		"SRJNL\0\0"
+#define JOURNAL_VERSION		1
+#define JOURNAL_LAST_CYCLE	0xffffffffu		//replay everything there is
+
+struct JournalHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t startCycle;		//the snapshot holds the map after this cycle
+	float cellSize;				//[mm]
+	uint32_t reserved[3];
+};
+
+struct JournalBlock
+{
+	uint32_t cycle;
+	uint32_t count;				//entries following this block
+	int32_t baseX;				//cell the entries are relative to
+	int32_t baseY;
+};
+
+struct JournalEntry
+{
+	int16_t dx;
+	int16_t dy;
+	float delta;				//added to the cell's log-odds, then clamped
+};
+
+class MapJournal
+{
+public:
+	/*
+	 *	prefix names the files (see above), a new snapshot is taken every
+	 *	snapshotInterval cycles. keepSegments > 0 deletes all but the newest
+	 *	segments when a new one starts, 0 keeps the whole history.
+	 */
+	MapJournal(const char* prefix, uint32_t snapshotInterval, int keepSegments = 0);
+	~MapJournal();
+
+	/*
+	 *	Starts a new journal with a snapshot of the grid as the map after
+	 *	the given cycle, 0 and an empty grid for a fresh run. An existing
+	 *	index gets added to, so a resumed run keeps its history.
+	 */
+	bool start(uint32_t cycle, const logodds_grid &grid);
+
+	bool isOpen() const { return myOut.is_open(); }
+
+	/*
+	 *	Records one cycle. Call it after apply_cone_batch and before
+	 *	merge_evidence, while the evidence still holds the cycle's deltas.
+	 *	Starts the periodic snapshot first when one is due, the map at that
+	 *	point is the map after the previous cycle. Never waits for the disk.
+	 */
+	void record(uint32_t cycle, const CycleEvidence &evidence, const logodds_grid &global);
+
+	//waits for a snapshot still being written
+	void close();
+
+private:
+	bool openSegment(std::ofstream &out, uint32_t cycle, double cellSize);
+	void addSegment(uint32_t cycle);
+	void beginSnapshot(uint32_t cycle, const logodds_grid &grid);
+	void stageSnapshot(uint32_t cycle, const logodds_grid &grid);
+	void endSnapshot(bool wait);
+	void workerLoop();
+	void writeBlock(uint32_t cycle);
+	void writeIndex();
+
+	std::string myPrefix;
+	uint32_t mySnapshotInterval;
+	int myKeepSegments;
+	std::vector<uint32_t> mySegments;
+	uint32_t mySegmentStart;		//cycle of the last snapshot, written or tried
+	uint32_t myLastCycle;
+
+	std::ofstream myOut;
+	std::ofstream myNext;			//the new segment's .jnl while its snapshot is written
+	bool myPending;
+	double myLastFlush;
+
+	//tiles changed since the last snapshot, one flag per grid tile slot
+	std::vector<unsigned char> myTileDirty;
+	std::vector<int> myDirtySlots;
+
+	//copy of the map as of the last snapshot, by slot, the worker owns it while myBusy is set
+	std::vector<MapTileRecord*> mySnapshot;
+	size_t mySnapshotTiles;
+	uint32_t mySnapshotCycle;
+	double myCellSize;
+	bool myWritten;				//the worker's last snapshot made it to the disk
+
+	boost::mutex myMutex;
+	boost::condition_variable myCond;
+	bool myBusy;
+	bool myStop;
+	boost::thread myThread;
+
+	//block being filled
+	std::vector<JournalEntry> myEntries;
+	int myBaseX, myBaseY;
+
+	MapJournal(const MapJournal&);
+	MapJournal& operator=(const MapJournal&);
+};
+
+//segment start cycles listed in the prefix's index, oldest first
+bool read_journal_index(const char* prefix, std::vector<uint32_t> &segments);
+
+//file name of a segment's snapshot or journal, extension is ".snap" or ".jnl"
+std::string journal_segment_path(const char* prefix, uint32_t startCycle, const char* extension);
+
+/*
+ *	Rebuilds the map as it was after the given cycle (JOURNAL_LAST_CYCLE
+ *	for the end of the journal) into an empty grid. reached is set to the
+ *	last cycle actually applied, which is earlier than asked for if the
+ *	journal ends first.
+ */
+bool replay_journal(const char* prefix, uint32_t cycle, logodds_grid &grid, uint32_t &reached);
+
+#endif
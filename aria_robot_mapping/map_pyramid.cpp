@@ -0,0 +1,212 @@
+/********************************************************
+ *	Max-pooled resolution pyramid, see map_pyramid.h
+ ********************************************************/
+
+#include "map_pyramid.h"
+
+#include <cfloat>
+
+MapPyramid::MapPyramid(int levels)
+	: myNumLevels(levels), myMap(NULL)
+{
+	if(myNumLevels < 1)
+		myNumLevels = 1;
+	if(myNumLevels > MAX_LEVELS)
+		myNumLevels = MAX_LEVELS;
+
+	myLevels.resize(myNumLevels, NULL);
+}
+
+MapPyramid::~MapPyramid()
+{
+	for(size_t i = 0; i < myLevels.size(); i++)
+		delete myLevels[i];
+}
+
+//max of the four children of (bx, by) on the level below
+float MapPyramid::childMax(int level, int bx, int by) const
+{
+	//the 2x2 children never straddle a tile edge, one lookup finds all four
+	const logodds_grid &below = level == 1 ? *myMap : *myLevels[level - 1];
+	int cx = bx << 1, cy = by << 1;
+	const float* tile = below.findTileData(cx, cy);
+	if(tile == NULL)
+		return below.getFillValue();
+
+	int i = logodds_grid::localIndex(cx, cy);
+	float a = tile[i];
+	float b = tile[i + 1];
+	float c = tile[i + logodds_grid::TILE_SIZE];
+	float d = tile[i + logodds_grid::TILE_SIZE + 1];
+	float ab = a > b ? a : b;
+	float cd = c > d ? c : d;
+	return ab > cd ? ab : cd;
+}
+
+void MapPyramid::build(const logodds_grid &map)
+{
+	myMap = &map;
+	for(int level = 1; level < myNumLevels; level++)
+	{
+		delete myLevels[level];
+		myLevels[level] = new logodds_grid(map.getFillValue(), map.getCellSize() * (1 << level));
+	}
+
+	//every block of every level that has anything under it, one level at a time
+	for(int level = 1; level < myNumLevels; level++)
+	{
+		const logodds_grid &below = level == 1 ? map : *myLevels[level - 1];
+		logodds_grid &grid = *myLevels[level];
+		for(int slot = 0; slot < below.getNumTiles(); slot++)
+		{
+			int baseX = below.getTileX(slot) << logodds_grid::TILE_SHIFT;
+			int baseY = below.getTileY(slot) << logodds_grid::TILE_SHIFT;
+			for(int y = 0; y < logodds_grid::TILE_SIZE; y += 2)
+				for(int x = 0; x < logodds_grid::TILE_SIZE; x += 2)
+					grid.at((baseX + x) >> 1, (baseY + y) >> 1) = childMax(level, (baseX + x) >> 1, (baseY + y) >> 1);
+		}
+	}
+}
+
+void MapPyramid::update(const logodds_grid &map, const DirtyCellSet &dirty)
+{
+	if(myMap != &map)
+	{
+		build(map);
+		return;
+	}
+
+	if(myNumLevels < 2)
+		return;
+
+	myQueued.clear();
+	myNextX.clear();
+	myNextY.clear();
+
+	//level 1 straight from the dirty indices: the 2x2 siblings of a cell sit in
+	//its own tile, so they are read by index without looking the tile up
+	logodds_grid &level1 = *myLevels[1];
+	for(size_t i = 0; i < dirty.size(); i++)
+	{
+		unsigned int first = dirty[i] & ~(1u | logodds_grid::TILE_SIZE);
+		float a = map[first], b = map[first + 1];
+		float c = map[first + logodds_grid::TILE_SIZE], d = map[first + logodds_grid::TILE_SIZE + 1];
+		float ab = a > b ? a : b;
+		float cd = c > d ? c : d;
+		float m = ab > cd ? ab : cd;
+
+		int cx, cy;
+		map.indexToCell(first, cx, cy);
+		float &block = level1.at(cx >> 1, cy >> 1);
+		if(block == m)
+			continue;
+		block = m;
+		if(myNumLevels > 2)
+			queueParent(2, cx >> 2, cy >> 2);
+	}
+	myQueueX.swap(myNextX);
+	myQueueY.swap(myNextY);
+
+	//a block that comes out unchanged leaves everything above it right as well
+	for(int level = 2; level < myNumLevels && !myQueueX.empty(); level++)
+	{
+		myQueued.clear();
+		myNextX.clear();
+		myNextY.clear();
+		for(size_t i = 0; i < myQueueX.size(); i++)
+		{
+			int bx = myQueueX[i], by = myQueueY[i];
+			float m = childMax(level, bx, by);
+			float &block = myLevels[level]->at(bx, by);
+			if(block == m)
+				continue;
+			block = m;
+			if(level + 1 < myNumLevels)
+				queueParent(level + 1, bx >> 1, by >> 1);
+		}
+		myQueueX.swap(myNextX);
+		myQueueY.swap(myNextY);
+	}
+}
+
+//adds a block to the next level's list, unless it is on it already
+void MapPyramid::queueParent(int level, int bx, int by)
+{
+	if(!myQueued.insert(myLevels[level]->cellIndex(bx, by)))
+		return;
+	myNextX.push_back(bx);
+	myNextY.push_back(by);
+}
+
+/*
+ *	Largest value in the part of block (bx, by) that overlaps the region.
+ *	best is the largest value found so far, a block whose max can't beat
+ *	it is skipped. Gives up as soon as something is above stopAbove.
+ */
+float MapPyramid::search(int level, int bx, int by, int x0, int y0, int x1, int y1, float best, float stopAbove) const
+{
+	float m = getMax(level, bx, by);
+	if(m <= best)
+		return best;
+
+	int size = 1 << level;
+	int left = bx << level, bottom = by << level;
+	int right = left + size - 1, top = bottom + size - 1;
+
+	//whole block inside the region, its max is the answer for it
+	if(left >= x0 && right <= x1 && bottom >= y0 && top <= y1)
+		return m;
+
+	for(int dy = 0; dy < 2; dy++)
+	{
+		for(int dx = 0; dx < 2; dx++)
+		{
+			int cx = (bx << 1) + dx, cy = (by << 1) + dy;
+			int half = size >> 1;
+			if((cx + 1) * half - 1 < x0 || cx * half > x1 || (cy + 1) * half - 1 < y0 || cy * half > y1)
+				continue;
+			best = search(level - 1, cx, cy, x0, y0, x1, y1, best, stopAbove);
+			if(best > stopAbove)
+				return best;
+		}
+	}
+	return best;
+}
+
+float MapPyramid::query(int x0, int y0, int x1, int y1, float best, float stopAbove) const
+{
+	if(myMap == NULL)
+		return best;
+
+	int top = myNumLevels - 1;
+	for(int by = y0 >> top; by <= (y1 >> top); by++)
+	{
+		for(int bx = x0 >> top; bx <= (x1 >> top); bx++)
+		{
+			best = search(top, bx, by, x0, y0, x1, y1, best, stopAbove);
+			if(best > stopAbove)
+				return best;
+		}
+	}
+	return best;
+}
+
+float MapPyramid::regionMax(int x0, int y0, int x1, int y1) const
+{
+	return query(x0, y0, x1, y1, -FLT_MAX, FLT_MAX);
+}
+
+bool MapPyramid::isRegionFree(int x0, int y0, int x1, int y1, float threshold) const
+{
+	//starting at threshold skips every block that is free as a whole
+	return query(x0, y0, x1, y1, threshold, threshold) <= threshold;
+}
+
+size_t MapPyramid::getMemoryUsage() const
+{
+	size_t bytes = 0;
+	for(int level = 1; level < myNumLevels; level++)
+		if(myLevels[level])
+			bytes += myLevels[level]->getMemoryUsage();
+	return bytes;
+}
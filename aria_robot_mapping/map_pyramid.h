@@ -0,0 +1,91 @@
+/********************************************************
+ *	Max-pooled resolution pyramid over the global map
+ *
+ *	Level 0 is the map itself. A cell at level k holds
+ *	the largest log-odds of the 2^k x 2^k map cells under
+ *	it, so one look at a coarse cell tells whether there
+ *	could be an obstacle anywhere in that block.
+ *
+ *		level 2		 ___________
+ *					|			|
+ *		level 1		|_____|_____|
+ *					|  |  |  |  |
+ *		level 0		|__|__|__|__|
+ *
+ *	After each cycle the parents of the dirty cells get
+ *	recomputed once each, from their four children, one
+ *	level at a time. Only parents that came out different
+ *	send their own parent up to the next level, so keeping
+ *	it current costs a few reads per dirty cell.
+ *
+ *	Region queries walk down from the top level and only
+ *	open blocks that straddle the region edge or could
+ *	still change the answer.
+ ********************************************************/
+
+#ifndef MAP_PYRAMID_H
+#define MAP_PYRAMID_H
+
+#include "sonar_model.h"
+#include "tiled_grid.h"
+#include "dirty_cells.h"
+
+#include <vector>
+
+class MapPyramid
+{
+public:
+	enum { MAX_LEVELS = 16 };
+
+	/*
+	 *	levels counts level 0, the default tops out at 128 x 128 cell
+	 *	blocks (12.8m at 100mm cells)
+	 */
+	MapPyramid(int levels = 8);
+	~MapPyramid();
+
+	//rebuilds every level from the map, for a map that was loaded instead of built
+	void build(const logodds_grid &map);
+
+	//brings the pyramid up to date with the cells that changed this cycle
+	void update(const logodds_grid &map, const DirtyCellSet &dirty);
+
+	int getNumLevels() const { return myNumLevels; }
+
+	//largest log-odds in block (bx, by) of a level, cells of level 0 are map cells
+	float getMax(int level, int bx, int by) const
+	{
+		return level == 0 ? myMap->get(bx, by) : myLevels[level]->get(bx, by);
+	}
+
+	//level 1 and up, for drawing the map coarse to fine
+	const logodds_grid& getLevel(int level) const { return *myLevels[level]; }
+
+	//largest log-odds inside the cell rectangle, corners inclusive
+	float regionMax(int x0, int y0, int x1, int y1) const;
+
+	//true if no cell in the rectangle is above threshold, stops at the first one that is
+	bool isRegionFree(int x0, int y0, int x1, int y1, float threshold = LOGODDS_OBSTACLE) const;
+
+	size_t getMemoryUsage() const;
+
+private:
+	float childMax(int level, int bx, int by) const;
+	void queueParent(int level, int bx, int by);
+	float search(int level, int bx, int by, int x0, int y0, int x1, int y1, float best, float stopAbove) const;
+	float query(int x0, int y0, int x1, int y1, float best, float stopAbove) const;
+
+	int myNumLevels;
+	const logodds_grid* myMap;
+	std::vector<logodds_grid*> myLevels;		//[0] is unused, level 0 is the map
+
+	//blocks to recompute on the next level, once each
+	std::vector<int> myQueueX, myQueueY;
+	std::vector<int> myNextX, myNextY;
+	DirtyCellSet myQueued;
+
+	MapPyramid(const MapPyramid&);
+	MapPyramid& operator=(const MapPyramid&);
+};
+
+#endif
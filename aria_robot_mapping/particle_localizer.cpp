@@ -0,0 +1,330 @@
+/********************************************************
+ *	Monte Carlo localization, see particle_localizer.h
+ ********************************************************/
+
+#include "particle_localizer.h"
+#include "cycle_timer.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifndef PI
+#define PI	3.14159265358979
+#endif
+
+//wraps an angle into [-180, 180) [deg]
+static double wrap_degrees(double a)
+{
+	return a - 360 * floor((a + 180) / 360);
+}
+
+ParticleLocalizer::ParticleLocalizer(const LikelihoodField &field, const LocalizerParams &params)
+	: myField(field), myParams(params), myHasOdometry(false), myLastX(0), myLastY(0), myLastTh(0),
+	  myMoved(0), myTurned(0), myForceUpdate(false), mySlowFit(0), myFastFit(0), mySeed(params.seed),
+	  myPool(params.threads)
+{
+	if(myParams.minParticles < 1)
+		myParams.minParticles = 1;
+	if(myParams.maxParticles < myParams.minParticles)
+		myParams.maxParticles = myParams.minParticles;
+}
+
+//small LCG, the same seed gives the same run
+double ParticleLocalizer::random()
+{
+	mySeed = mySeed * 1664525u + 1013904223u;
+	return ((mySeed >> 8) + 0.5) / 16777216.0;
+}
+
+double ParticleLocalizer::gauss()
+{
+	double u = random();
+	double v = random();
+	return sqrt(-2 * log(u)) * cos(2 * PI * v);
+}
+
+//anywhere the map has seen free, any heading
+void ParticleLocalizer::randomPose(Particle &p)
+{
+	const std::vector<int> &free = myField.getFreeCells();
+	int index = free[std::min((size_t)(random() * free.size()), free.size() - 1)];
+	p.x = (myField.getMinX() + index % myField.getWidth() + random()) * myField.getCellSize();
+	p.y = (myField.getMinY() + index / myField.getWidth() + random()) * myField.getCellSize();
+	p.th = random() * 360 - 180;
+}
+
+void ParticleLocalizer::initGlobal()
+{
+	myParticles.resize(myField.getFreeCells().empty() ? 0 : myParams.maxParticles);
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		randomPose(myParticles[i]);
+		myParticles[i].weight = 1.0 / myParticles.size();
+	}
+	myHasOdometry = false;
+	myMoved = myTurned = 0;
+	myForceUpdate = true;
+	mySlowFit = myFastFit = 0;
+}
+
+void ParticleLocalizer::initPose(double x, double y, double th, double spread, double spreadTh)
+{
+	myParticles.resize(myParams.maxParticles);
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		myParticles[i].x = x + gauss() * spread;
+		myParticles[i].y = y + gauss() * spread;
+		myParticles[i].th = wrap_degrees(th + gauss() * spreadTh);
+		myParticles[i].weight = 1.0 / myParticles.size();
+	}
+	myHasOdometry = false;
+	myMoved = myTurned = 0;
+	myForceUpdate = true;
+	mySlowFit = myFastFit = 0;
+}
+
+/*
+ *	Odometry motion model: turn, drive straight, turn again, each step
+ *	with its own noise that grows with how far the robot turned and drove
+ */
+void ParticleLocalizer::predict(double forward, double turn1, double turn2)
+{
+	double turn_sigma1 = myParams.turnNoise * fabs(turn1) + myParams.turnDrift * fabs(forward) / 1000;
+	double turn_sigma2 = myParams.turnNoise * fabs(turn2) + myParams.turnDrift * fabs(forward) / 1000;
+	double move_sigma = myParams.moveNoise * fabs(forward) + myParams.moveSlip * (fabs(turn1) + fabs(turn2));
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		Particle &p = myParticles[i];
+		double t1 = turn1 + gauss() * turn_sigma1;
+		double d = forward + gauss() * move_sigma;
+		double t2 = turn2 + gauss() * turn_sigma2;
+		double a = (p.th + t1) / 180 * PI;
+		p.x += d * cos(a);
+		p.y += d * sin(a);
+		p.th = wrap_degrees(p.th + t1 + t2);
+	}
+}
+
+//sum of the echoes' log-likelihoods, for the particles in [begin, end)
+void ParticleLocalizer::weigh(size_t begin, size_t end)
+{
+	for(size_t i = begin; i < end; i++)
+	{
+		const Particle &p = myParticles[i];
+		double a = p.th / 180 * PI;
+		double c = cos(a), s = sin(a);
+		float sum = 0;
+		for(size_t e = 0; e < myEchoes.size(); e++)
+		{
+			//sonar angle on the robot plus the particle's heading
+			double ec = c * myEchoes[e].c - s * myEchoes[e].s;
+			double es = s * myEchoes[e].c + c * myEchoes[e].s;
+			sum += myField.get(p.x + myEchoes[e].range * ec, p.y + myEchoes[e].range * es);
+		}
+		myLogWeights[i] = sum;
+	}
+}
+
+void ParticleLocalizer::WeighPart::operator()(int part) const
+{
+	size_t count = localizer->myParticles.size();
+	localizer->weigh(count * part / parts, count * (part + 1) / parts);
+}
+
+/*
+ *	Particles a draw needs for bins occupied bins so that, with
+ *	kldQuantile confidence, the drawn set is within kldError of the
+ *	weighted one (the Wilson-Hilferty approximation of chi square)
+ */
+int ParticleLocalizer::kldTarget(int bins) const
+{
+	if(bins <= 1)
+		return myParams.minParticles;
+	double k = bins - 1;
+	double b = 2 / (9 * k);
+	double c = 1 - b + sqrt(b) * myParams.kldQuantile;
+	return (int)ceil(k / (2 * myParams.kldError) * c * c * c);
+}
+
+/*
+ *	KLD bin of a particle, x, y and heading over the field. Particles off
+ *	the field share its edge bins, there is nothing there to tell apart.
+ */
+uint32_t ParticleLocalizer::binIndex(const Particle &p) const
+{
+	int width = (int)ceil(myField.getWidth() * myField.getCellSize() / myParams.binSize);
+	int height = (int)ceil(myField.getHeight() * myField.getCellSize() / myParams.binSize);
+	int turns = (int)ceil(360 / myParams.binAngle);
+	int bx = (int)floor((p.x - myField.getMinX() * myField.getCellSize()) / myParams.binSize);
+	int by = (int)floor((p.y - myField.getMinY() * myField.getCellSize()) / myParams.binSize);
+	int bt = (int)floor((p.th + 180) / myParams.binAngle);
+	bx = std::max(0, std::min(bx, width - 1));
+	by = std::max(0, std::min(by, height - 1));
+	bt = std::max(0, std::min(bt, turns - 1));
+	return ((uint32_t)bt * height + by) * width + bx;
+}
+
+/*
+ *	Draws particles in proportion to the weights until the KLD bound is
+ *	met, inject is the chance of a draw being a random pose instead
+ */
+void ParticleLocalizer::resample(double inject, int &injected)
+{
+	injected = 0;
+	if(myField.getFreeCells().empty())
+		inject = 0;
+
+	std::vector<double> cumulative(myParticles.size());
+	double total = 0;
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		total += myParticles[i].weight;
+		cumulative[i] = total;
+	}
+
+	myBins.clear();
+	myDrawn.clear();
+	while((int)myDrawn.size() < myParams.maxParticles)
+	{
+		Particle p;
+		if(inject > 0 && random() < inject)
+		{
+			randomPose(p);
+			injected++;
+		}
+		else
+		{
+			size_t pick = std::upper_bound(cumulative.begin(), cumulative.end(), random() * total) - cumulative.begin();
+			p = myParticles[std::min(pick, myParticles.size() - 1)];
+		}
+		myDrawn.push_back(p);
+
+		myBins.insert(binIndex(p));
+
+		if((int)myDrawn.size() >= myParams.minParticles && (int)myDrawn.size() >= kldTarget((int)myBins.size()))
+			break;
+	}
+
+	for(size_t i = 0; i < myDrawn.size(); i++)
+		myDrawn[i].weight = 1.0 / myDrawn.size();
+	myParticles.swap(myDrawn);
+}
+
+void ParticleLocalizer::estimate(LocalizerResult &result) const
+{
+	double x = 0, y = 0, c = 0, s = 0, total = 0;
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		const Particle &p = myParticles[i];
+		x += p.weight * p.x;
+		y += p.weight * p.y;
+		c += p.weight * cos(p.th / 180 * PI);
+		s += p.weight * sin(p.th / 180 * PI);
+		total += p.weight;
+	}
+	if(total <= 0)
+		return;
+	result.x = x / total;
+	result.y = y / total;
+	result.th = atan2(s, c) * 180 / PI;
+
+	double spread = 0, spread_th = 0;
+	for(size_t i = 0; i < myParticles.size(); i++)
+	{
+		const Particle &p = myParticles[i];
+		double dth = wrap_degrees(p.th - result.th);
+		spread += p.weight * ((p.x - result.x) * (p.x - result.x) + (p.y - result.y) * (p.y - result.y));
+		spread_th += p.weight * dth * dth;
+	}
+	result.spread = sqrt(spread / total);
+	result.spreadTh = sqrt(spread_th / total);
+}
+
+LocalizerResult ParticleLocalizer::update(const SensorLogRecord &record)
+{
+	double start = now_seconds();
+
+	LocalizerResult result;
+	result.updated = false;
+	result.x = result.y = result.th = 0;
+	result.spread = result.spreadTh = 0;
+	result.injected = 0;
+	result.echoes = 0;
+
+	//odometry since the last record as turn, drive, turn, driving backwards counts as forward the other way
+	if(myHasOdometry)
+	{
+		double dx = record.x - myLastX, dy = record.y - myLastY;
+		double forward = sqrt(dx * dx + dy * dy);
+		double turn1 = 0;
+		if(forward > 1)
+		{
+			turn1 = wrap_degrees(atan2(dy, dx) * 180 / PI - myLastTh);
+			if(fabs(turn1) > 90)
+			{
+				forward = -forward;
+				turn1 = wrap_degrees(turn1 + 180);
+			}
+		}
+		double turn2 = wrap_degrees(record.th - myLastTh - turn1);
+		predict(forward, turn1, turn2);
+		myMoved += fabs(forward);
+		myTurned += fabs(turn1) + fabs(turn2);
+	}
+	myHasOdometry = true;
+	myLastX = record.x;
+	myLastY = record.y;
+	myLastTh = record.th;
+
+	myEchoes.clear();
+	for(int i = 0; i < SONAR_COUNT; i++)
+	{
+		if(record.range[i] <= SONAR_MIN_RANGE || record.range[i] >= LOCALIZE_MAX_RANGE)
+			continue;
+		Echo echo;
+		echo.range = record.range[i];
+		echo.c = cos(record.sensorTh[i] / 180 * PI);
+		echo.s = sin(record.sensorTh[i] / 180 * PI);
+		myEchoes.push_back(echo);
+	}
+	result.echoes = (int)myEchoes.size();
+
+	//standing still the same echoes would count again and again, the cloud would pull together on nothing
+	bool due = myForceUpdate || myMoved >= myParams.updateDistance || myTurned >= myParams.updateAngle;
+	if(due && !myEchoes.empty() && !myParticles.empty())
+	{
+		myLogWeights.resize(myParticles.size());
+		int parts = (int)std::min((size_t)myPool.size(), myParticles.size());
+		WeighPart job = { this, parts };
+		myPool.run(job, parts);
+
+		//relative to the best particle, so the exp doesn't underflow to all zeros
+		float best = *std::max_element(myLogWeights.begin(), myLogWeights.end());
+		double fit = 0;
+		for(size_t i = 0; i < myParticles.size(); i++)
+		{
+			myParticles[i].weight = exp(myParams.echoWeight * (myLogWeights[i] - best));
+			fit += exp(myLogWeights[i] / myEchoes.size());
+		}
+		fit /= myParticles.size();
+
+		//how much worse the echoes fit lately than they used to
+		if(mySlowFit == 0)
+			mySlowFit = myFastFit = fit;
+		mySlowFit += myParams.slowRate * (fit - mySlowFit);
+		myFastFit += myParams.fastRate * (fit - myFastFit);
+		double inject = std::max(0.0, 1 - myFastFit / mySlowFit);
+
+		estimate(result);
+		resample(inject, result.injected);
+		result.updated = true;
+		myMoved = myTurned = 0;
+		myForceUpdate = false;
+	}
+	else
+		estimate(result);
+
+	result.particles = (int)myParticles.size();
+	result.seconds = now_seconds() - start;
+	return result;
+}
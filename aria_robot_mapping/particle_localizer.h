@@ -0,0 +1,159 @@
+/********************************************************
+ *	Monte Carlo localization on a saved map
+ *
+ *	Finds the robot on a map built on an earlier run,
+ *	nobody has to type in where it starts. A cloud of
+ *	particles, each a guess at the pose, moves with the
+ *	odometry plus noise every cycle. Once the robot has
+ *	moved far enough the particles are weighed by how
+ *	well the sonar echoes fit the map from their pose,
+ *	one LikelihoodField lookup per echo, and drawn again
+ *	in proportion to the weights (Thrun, Burgard and Fox,
+ *	Probabilistic Robotics, ch. 8).
+ *
+ *	Weighing is the expensive part, every particle times
+ *	every echo, and the particles don't depend on each
+ *	other, so they are split into one slice per core on
+ *	threads started once with the localizer.
+ *
+ *	Resampling draws only as many particles as it takes
+ *	to cover the bins the drawn ones fall into (KLD
+ *	sampling, Fox 2003): thousands while the robot could
+ *	be anywhere, a few hundred once the cloud has pulled
+ *	together, so the CPU per update follows how lost the
+ *	robot is. The bins are a bitset over the field with a
+ *	generation stamp, like DirtyCellSet, so a draw doesn't
+ *	allocate and starting over costs nothing.
+ *
+ *	A cloud that settled on the wrong spot (a long
+ *	corridor looks the same all along) would never get
+ *	away from it, so when the echoes suddenly fit worse
+ *	than they used to, some of the draws are replaced by
+ *	random poses on the map (augmented MCL, same book).
+ ********************************************************/
+
+#ifndef PARTICLE_LOCALIZER_H
+#define PARTICLE_LOCALIZER_H
+
+#include "likelihood_field.h"
+#include "sensor_log.h"
+#include "dirty_cells.h"
+#include "worker_pool.h"
+
+#include <vector>
+
+#define LOCALIZE_MAX_RANGE	3000	//[mm] longer echoes are mostly side lobes and multipath
+
+struct LocalizerParams
+{
+	int minParticles;
+	int maxParticles;		//also how many get spread over the map at the start
+	double kldError;		//bound on the error of the drawn set against the weighted one, KL divergence
+	double kldQuantile;		//upper quantile of the normal for the confidence in that, 2.33 for 99%
+	double binSize;			//[mm] KLD bins
+	double binAngle;		//[deg]
+	double turnNoise;		//[deg/deg] heading noise per degree turned
+	double turnDrift;		//[deg/m] heading noise per meter driven
+	double moveNoise;		//[mm/mm] distance noise per mm driven
+	double moveSlip;		//[mm/deg] distance noise per degree turned
+	double updateDistance;	//[mm] the particles get weighed after the robot moved this far
+	double updateAngle;		//[deg] or turned this much
+	double echoWeight;		//exponent on each echo's likelihood, sonar echoes are far from independent
+	double slowRate;		//smoothing of the long and short term average fit, when the short one
+	double fastRate;		//drops below the long one random particles get mixed in
+	int threads;			//0 for one per core
+	unsigned int seed;
+
+	LocalizerParams()
+		: minParticles(300), maxParticles(20000), kldError(0.05), kldQuantile(2.33), binSize(250), binAngle(15),
+		  turnNoise(0.2), turnDrift(5), moveNoise(0.1), moveSlip(2), updateDistance(100), updateAngle(5),
+		  echoWeight(0.5), slowRate(0.001), fastRate(0.02), threads(0), seed(1) {}
+};
+
+struct LocalizerResult
+{
+	bool updated;			//the particles were weighed and drawn again this cycle
+	double x, y, th;		//mean pose of the particles, [mm] and [deg]
+	double spread;			//[mm] rms distance of the particles from it
+	double spreadTh;		//[deg]
+	int particles;
+	int injected;			//random ones among them
+	int echoes;				//echoes the weights went by
+	double seconds;			//the whole update
+};
+
+class ParticleLocalizer
+{
+public:
+	//the field has to outlive the localizer
+	ParticleLocalizer(const LikelihoodField &field, const LocalizerParams &params = LocalizerParams());
+
+	//robot could be anywhere the map has seen free, maxParticles of them
+	void initGlobal();
+
+	//robot is about at (x, y, th) [mm] [deg], give or take spread and spreadTh
+	void initPose(double x, double y, double th, double spread, double spreadTh);
+
+	/*
+	 *	Moves the particles by the odometry since the last record and, once
+	 *	the robot moved far enough, weighs and redraws them by the record's
+	 *	echoes. Ranges at or below SONAR_MIN_RANGE are skipped, so a sonar
+	 *	without a new reading can be left at 0.
+	 */
+	LocalizerResult update(const SensorLogRecord &record);
+
+	int getParticleCount() const { return (int)myParticles.size(); }
+
+private:
+	struct Particle
+	{
+		double x, y, th;	//[mm] [deg]
+		double weight;
+	};
+
+	struct Echo
+	{
+		double range;		//[mm]
+		double c, s;		//of the sonar angle on the robot
+	};
+
+	//one thread's slice of the particles
+	struct WeighPart
+	{
+		ParticleLocalizer* localizer;
+		int parts;
+		void operator()(int part) const;
+	};
+
+	void predict(double forward, double turn1, double turn2);
+	void weigh(size_t begin, size_t end);
+	void resample(double inject, int &injected);
+	void randomPose(Particle &p);
+	void estimate(LocalizerResult &result) const;
+	int kldTarget(int bins) const;
+	uint32_t binIndex(const Particle &p) const;
+	double random();
+	double gauss();
+
+	const LikelihoodField &myField;
+	LocalizerParams myParams;
+	std::vector<Particle> myParticles;
+	std::vector<Particle> myDrawn;		//resampling target, kept to save the allocation
+	std::vector<double> myLogWeights;
+	std::vector<Echo> myEchoes;			//of the record being weighed
+	DirtyCellSet myBins;				//KLD bins the drawn particles fell into
+
+	bool myHasOdometry;
+	double myLastX, myLastY, myLastTh;	//odometry of the last record
+	double myMoved, myTurned;			//since the last weighing
+	bool myForceUpdate;					//weigh on the first record after an init
+	double mySlowFit, myFastFit;		//averages of the mean per echo likelihood, 0 until the first weighing
+	unsigned int mySeed;
+
+	WorkerPool myPool;
+
+	ParticleLocalizer(const ParticleLocalizer&);
+	ParticleLocalizer& operator=(const ParticleLocalizer&);
+};
+
+#endif
@@ -0,0 +1,467 @@
+/********************************************************
+ *	Correlative scan matching against the map, see
+ *	scan_matcher.h
+ ********************************************************/
+
+#include "scan_matcher.h"
+#include "cycle_timer.h"
+
+#include <cmath>
+#include <algorithm>
+#include <queue>
+
+#ifndef PI
+#define PI	3.14159265358979
+#endif
+
+//state shared by the worker threads of one match
+struct ScanMatcher::Search
+{
+	std::vector<unsigned short> window;	//squared distances around the robot, copied out of the distance map
+	int windowX, windowY;			//cell of its lower left corner
+	int windowSize;					//[cells] per side
+	std::vector<double> lx, ly;		//echoes relative to the robot, robot frame [mm]
+	std::vector<double> angles;		//[deg] added to the predicted heading, in the order they get tried
+	double x, y, th;				//predicted pose
+	int steps;						//translations per axis
+	int top;						//coarsest level
+
+	boost::mutex mutex;
+	float best;
+	int bestRotation;
+	int bestX, bestY;
+	long evaluated;
+};
+
+ScanMatcher::ScanMatcher(const ScanMatchParams &params)
+	: myParams(params), myTableCellSize(0), myTableFar(0), myNextCycle(0), myPool(params.threads)
+{
+	if(myParams.cycles < 1)
+		myParams.cycles = 1;
+	if(myParams.levels < 1)
+		myParams.levels = 1;
+	if(myParams.shiftStep <= 0)
+		myParams.shiftStep = 50;
+	if(myParams.rotationStep <= 0)
+		myParams.rotationStep = 1;
+	myCycles.resize(myParams.cycles);
+	reset();
+}
+
+void ScanMatcher::reset()
+{
+	for(size_t c = 0; c < myCycles.size(); c++)
+		myCycles[c].clear();
+	myNextCycle = 0;
+	myCorrX = myCorrY = myCorrTh = 0;
+	myHasLast = false;
+	myTurnVariance = 0;
+}
+
+void ScanMatcher::getCorrection(double &x, double &y, double &th) const
+{
+	x = myCorrX;
+	y = myCorrY;
+	th = myCorrTh;
+}
+
+/*
+ *	Level 0 is the score itself. A block of level k reaches (2^k - 1) / 2
+ *	steps from its center in x and y, and the cell an echo lands in can be
+ *	another half cell diagonal off, so level k scores every echo as if it
+ *	were that much closer to its obstacle.
+ */
+void ScanMatcher::buildTables(const DistanceMap &distance)
+{
+	myTableCellSize = distance.getCellSize();
+	myTableFar = distance.getFar();
+	myTables.assign(myParams.levels, std::vector<float>(myTableFar + 1, 0.0f));
+
+	double sigma = myParams.sigma / myTableCellSize;
+	for(int level = 0; level < myParams.levels; level++)
+	{
+		double reach = 0;
+		if(level > 0)
+			reach = ((1 << level) - 1) * 0.5 * myParams.shiftStep * sqrt(2.0) / myTableCellSize + sqrt(2.0);
+		for(int d2 = 0; d2 < myTableFar; d2++)
+		{
+			double d = sqrt((double)d2) - reach;
+			if(d < 0)
+				d = 0;
+			myTables[level][d2] = (float)exp(-d * d / (2 * sigma * sigma));
+		}
+		//out of the distance map's reach, nothing to match, even for a bound
+		myTables[level][myTableFar] = 0;
+	}
+}
+
+//echoes in range, kept in the odometry frame
+void ScanMatcher::addEchoes(const SensorLogRecord &record)
+{
+	std::vector<Echo> &echoes = myCycles[myNextCycle];
+	myNextCycle = (myNextCycle + 1) % (int)myCycles.size();
+	echoes.clear();
+	for(int i = 0; i < SONAR_COUNT; i++)
+	{
+		if(record.range[i] <= SONAR_MIN_RANGE || record.range[i] >= SCAN_MATCH_MAX_RANGE)
+			continue;
+		double a = (record.sensorTh[i] + record.th) / 180 * PI;
+		Echo echo;
+		echo.x = record.x + record.range[i] * cos(a);
+		echo.y = record.y + record.range[i] * sin(a);
+		echoes.push_back(echo);
+	}
+}
+
+float ScanMatcher::score(const Search &search, int level, const std::vector<double> &px, const std::vector<double> &py,
+						 double shiftX, double shiftY) const
+{
+	const std::vector<float> &table = myTables[level];
+	double sx = shiftX / myTableCellSize, sy = shiftY / myTableCellSize;
+	float sum = 0;
+	for(size_t i = 0; i < px.size(); i++)
+	{
+		double fx = px[i] + sx, fy = py[i] + sy;
+		if(fx < 0 || fy < 0)
+			continue;
+		int cx = (int)fx, cy = (int)fy;
+		if(cx >= search.windowSize || cy >= search.windowSize)
+			continue;
+		sum += table[search.window[cy * search.windowSize + cx]];
+	}
+	return sum;
+}
+
+//the echoes with the robot at the search pose turned by angle [deg], in window cells
+void ScanMatcher::place(const Search &search, double angle, std::vector<double> &px, std::vector<double> &py) const
+{
+	double a = (search.th + angle) / 180 * PI;
+	double c = cos(a), s = sin(a);
+	double ox = search.x / myTableCellSize - search.windowX, oy = search.y / myTableCellSize - search.windowY;
+	px.resize(search.lx.size());
+	py.resize(search.ly.size());
+	for(size_t i = 0; i < px.size(); i++)
+	{
+		px[i] = ox + (c * search.lx[i] - s * search.ly[i]) / myTableCellSize;
+		py[i] = oy + (s * search.lx[i] + c * search.ly[i]) / myTableCellSize;
+	}
+}
+
+/*
+ *	Branch and bound over the translations of every stride-th rotation,
+ *	the same way MapCorrelator does it for whole maps. Ties go to the
+ *	rotation tried first, so the answer doesn't depend on the threads.
+ */
+void ScanMatcher::searchRotations(Search &search, int first, int stride) const
+{
+	std::vector<double> px, py;
+	double origin = -(search.steps / 2) * myParams.shiftStep;
+	long evaluated = 0;
+
+	for(int r = first; r < (int)search.angles.size(); r += stride)
+	{
+		place(search, search.angles[r], px, py);
+
+		search.mutex.lock();
+		float best = search.best;
+		search.mutex.unlock();
+
+		std::priority_queue<Candidate> queue;
+		int size = 1 << search.top;
+		for(int ty = 0; ty < search.steps; ty += size)
+		{
+			for(int tx = 0; tx < search.steps; tx += size)
+			{
+				double center = (size - 1) * 0.5;
+				Candidate cand = { score(search, search.top, px, py, origin + (tx + center) * myParams.shiftStep,
+										 origin + (ty + center) * myParams.shiftStep), search.top, tx, ty };
+				evaluated++;
+				if(cand.bound >= best)
+					queue.push(cand);
+			}
+		}
+
+		while(!queue.empty())
+		{
+			Candidate cand = queue.top();
+			queue.pop();
+			if(cand.bound < best)
+				break;
+
+			if(cand.level == 0)
+			{
+				search.mutex.lock();
+				if(cand.bound > search.best || (cand.bound == search.best && r < search.bestRotation))
+				{
+					search.best = cand.bound;
+					search.bestRotation = r;
+					search.bestX = cand.tx;
+					search.bestY = cand.ty;
+				}
+				best = search.best;
+				search.mutex.unlock();
+				break;
+			}
+
+			int h = 1 << (cand.level - 1);
+			double center = (h - 1) * 0.5;
+			for(int dy = 0; dy <= h; dy += h)
+			{
+				for(int dx = 0; dx <= h; dx += h)
+				{
+					int tx = cand.tx + dx, ty = cand.ty + dy;
+					if(tx >= search.steps || ty >= search.steps)
+						continue;
+					Candidate child = { score(search, cand.level - 1, px, py, origin + (tx + center) * myParams.shiftStep,
+											  origin + (ty + center) * myParams.shiftStep), cand.level - 1, tx, ty };
+					evaluated++;
+					if(child.bound >= best)
+						queue.push(child);
+				}
+			}
+		}
+	}
+
+	search.mutex.lock();
+	search.evaluated += evaluated;
+	search.mutex.unlock();
+}
+
+void ScanMatcher::SearchPart::operator()(int part) const
+{
+	matcher->searchRotations(*search, part, parts);
+}
+
+/*
+ *	Covariance of the translations around the best fit at the placed
+ *	rotation, each weighted by how likely its score makes it (Olson 2009).
+ *	The score is a sum over echoes that are far from independent, 30
+ *	cycles of the same walls, so a pose scoreScale per echo below the best
+ *	counts as e times less likely rather than a point below. A direction
+ *	the echoes pin gets a small variance, along a corridor the weights stay
+ *	flat and the variance grows to that of the whole window.
+ */
+ScanMatcher::Spread ScanMatcher::spreadAround(const Search &search, const std::vector<double> &px,
+											  const std::vector<double> &py, float best) const
+{
+	double origin = -(search.steps / 2) * myParams.shiftStep;
+	double scale = myParams.scoreScale * px.size();
+	double sum = 0, mx = 0, my = 0, sxx = 0, sxy = 0, syy = 0;
+	for(int ty = 0; ty < search.steps; ty++)
+	{
+		for(int tx = 0; tx < search.steps; tx++)
+		{
+			double x = origin + tx * myParams.shiftStep, y = origin + ty * myParams.shiftStep;
+			double w = exp((score(search, 0, px, py, x, y) - best) / scale);
+			sum += w;
+			mx += w * x;
+			my += w * y;
+			sxx += w * x * x;
+			sxy += w * x * y;
+			syy += w * y * y;
+		}
+	}
+	mx /= sum;
+	my /= sum;
+	double cxx = sxx / sum - mx * mx, cxy = sxy / sum - mx * my, cyy = syy / sum - my * my;
+
+	//eigenvalues and the direction of the larger one, of the 2x2 covariance
+	Spread spread;
+	double mean = (cxx + cyy) / 2, diff = sqrt((cxx - cyy) * (cxx - cyy) / 4 + cxy * cxy);
+	spread.major = mean + diff;
+	spread.minor = std::max(0.0, mean - diff);
+	double angle = 0.5 * atan2(2 * cxy, cxx - cyy);
+	spread.ex = cos(angle);
+	spread.ey = sin(angle);
+	return spread;
+}
+
+/*
+ *	Variance [deg^2] of the rotations at the best fit's translation,
+ *	weighted the same way. Never below that of the rotation step, the
+ *	search can't tell the heading any closer than that.
+ */
+double ScanMatcher::turnVariance(const Search &search, double shiftX, double shiftY, float best) const
+{
+	std::vector<double> px, py;
+	double scale = myParams.scoreScale * search.lx.size();
+	double sum = 0, mean = 0, square = 0;
+	for(size_t r = 0; r < search.angles.size(); r++)
+	{
+		place(search, search.angles[r], px, py);
+		double w = exp((score(search, 0, px, py, shiftX, shiftY) - best) / scale);
+		sum += w;
+		mean += w * search.angles[r];
+		square += w * search.angles[r] * search.angles[r];
+	}
+	mean /= sum;
+	return std::max(square / sum - mean * mean, myParams.rotationStep * myParams.rotationStep / 12);
+}
+
+ScanMatchResult ScanMatcher::correct(SensorLogRecord &record, const DistanceMap &distance)
+{
+	double start = now_seconds();
+	addEchoes(record);
+
+	//where the last correction puts the robot
+	double a = myCorrTh / 180 * PI;
+	double odom_x = record.x, odom_y = record.y, odom_th = record.th;
+
+	//the heading gets less certain with every meter driven since the last match
+	if(myHasLast)
+	{
+		double dx = odom_x - myLastX, dy = odom_y - myLastY;
+		myTurnVariance += myParams.turnDrift * sqrt(dx * dx + dy * dy) / 1000;
+	}
+	myHasLast = true;
+	myLastX = odom_x;
+	myLastY = odom_y;
+
+	record.x = cos(a) * odom_x - sin(a) * odom_y + myCorrX;
+	record.y = sin(a) * odom_x + cos(a) * odom_y + myCorrY;
+	record.th = odom_th + myCorrTh;
+
+	ScanMatchResult result;
+	result.matched = false;
+	result.x = record.x;
+	result.y = record.y;
+	result.th = record.th;
+	result.score = 0;
+	result.predicted = 0;
+	result.points = 0;
+	result.evaluated = 0;
+	result.spreadMajor = result.spreadMinor = result.spreadTurn = 0;
+
+	if(!distance.isBuilt())
+	{
+		result.seconds = now_seconds() - start;
+		return result;
+	}
+	if(distance.getCellSize() != myTableCellSize || distance.getFar() != myTableFar)
+		buildTables(distance);
+
+	//every kept echo relative to the robot, odometry is good enough over a few cycles for that
+	Search search;
+	double c = cos(-odom_th / 180 * PI), s = sin(-odom_th / 180 * PI);
+	for(size_t k = 0; k < myCycles.size(); k++)
+	{
+		for(size_t i = 0; i < myCycles[k].size(); i++)
+		{
+			double dx = myCycles[k][i].x - odom_x, dy = myCycles[k][i].y - odom_y;
+			search.lx.push_back(c * dx - s * dy);
+			search.ly.push_back(s * dx + c * dy);
+		}
+	}
+	result.points = (int)search.lx.size();
+	if(result.points < myParams.minPoints)
+	{
+		result.seconds = now_seconds() - start;
+		return result;
+	}
+
+	//rotations from 0 outwards, alternating sides, so a good score turns up early and prunes the rest
+	int count = (int)(myParams.maxRotation / myParams.rotationStep);
+	search.angles.push_back(0);
+	for(int k = 1; k <= count; k++)
+	{
+		search.angles.push_back(k * myParams.rotationStep);
+		search.angles.push_back(-k * myParams.rotationStep);
+	}
+
+	//every lookup of the search lands within reach of the farthest echo, copy that square out
+	//once so the scoring doesn't go through the tiles
+	double reach = 0;
+	for(size_t i = 0; i < search.lx.size(); i++)
+		reach = std::max(reach, sqrt(search.lx[i] * search.lx[i] + search.ly[i] * search.ly[i]));
+	int half = (int)ceil((reach + myParams.maxShift * sqrt(2.0)) / myTableCellSize) + 1;
+	search.windowSize = 2 * half + 1;
+	search.windowX = (int)floor(record.x / myTableCellSize) - half;
+	search.windowY = (int)floor(record.y / myTableCellSize) - half;
+	search.window.resize(search.windowSize * search.windowSize);
+	for(int y = 0; y < search.windowSize; y++)
+	{
+		for(int x = 0; x < search.windowSize; x++)
+		{
+			int d2 = distance.getDistance2(search.windowX + x, search.windowY + y);
+			search.window[y * search.windowSize + x] = (unsigned short)(d2 < myTableFar ? d2 : myTableFar);
+		}
+	}
+
+	search.x = record.x;
+	search.y = record.y;
+	search.th = record.th;
+	search.steps = 2 * (int)(myParams.maxShift / myParams.shiftStep) + 1;
+	search.top = myParams.levels - 1;
+	search.best = 0;
+	search.bestRotation = -1;
+	search.bestX = search.bestY = 0;
+	search.evaluated = 0;
+
+	int parts = std::min(myPool.size(), (int)search.angles.size());
+	SearchPart job = { this, &search, parts };
+	myPool.run(job, parts);
+	result.evaluated = search.evaluated;
+
+	//a sonar map fits a lot of poses about as well, only move for a clearly better one
+	std::vector<double> px, py;
+	place(search, 0, px, py);
+	result.predicted = score(search, 0, px, py, 0, 0) / result.points;
+	double origin = -(search.steps / 2) * myParams.shiftStep;
+	bool clear = false;
+	if(search.bestRotation >= 0)
+	{
+		result.score = search.best / result.points;
+		clear = result.score >= myParams.minScore && result.score - result.predicted >= myParams.minGain;
+	}
+
+	//a best rotation on the edge of the search may only be the slope up to a better one outside it
+	if(clear && count > 0 && search.bestRotation >= 2 * count - 1)
+		clear = false;
+
+	//only as much of the turn as the odometry is less sure of its heading than the fit is
+	double shiftX = 0, shiftY = 0, turn = 0, gain = 0;
+	double bx = origin + search.bestX * myParams.shiftStep, by = origin + search.bestY * myParams.shiftStep;
+	if(clear)
+	{
+		double variance = turnVariance(search, bx, by, search.best);
+		gain = myTurnVariance / (myTurnVariance + variance);
+		turn = gain * search.angles[search.bestRotation];
+		result.spreadTurn = sqrt(variance);
+	}
+
+	//how tightly the fit pins the pose along each direction at that heading. A corridor fits about as
+	//well anywhere along it, and moving across it or turning on such a fit walked the pose further off
+	//than the odometry had drifted, so a fit loose along any direction moves nothing
+	if(clear)
+	{
+		place(search, turn, px, py);
+		Spread spread = spreadAround(search, px, py, search.best);
+		result.spreadMajor = sqrt(spread.major);
+		result.spreadMinor = sqrt(spread.minor);
+		shiftX = bx;
+		shiftY = by;
+		clear = result.spreadMajor <= myParams.maxSpread;
+	}
+
+	if(clear)
+	{
+		result.matched = true;
+		result.x = record.x + shiftX;
+		result.y = record.y + shiftY;
+		result.th = record.th + turn;
+		myTurnVariance *= 1 - gain;
+
+		//the correction that takes the odometry pose there
+		myCorrTh = result.th - odom_th;
+		a = myCorrTh / 180 * PI;
+		myCorrX = result.x - (cos(a) * odom_x - sin(a) * odom_y);
+		myCorrY = result.y - (sin(a) * odom_x + cos(a) * odom_y);
+
+		record.x = result.x;
+		record.y = result.y;
+		record.th = result.th;
+	}
+
+	result.seconds = now_seconds() - start;
+	return result;
+}
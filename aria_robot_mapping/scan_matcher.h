@@ -0,0 +1,199 @@
+/********************************************************
+ *	Correlative scan matching against the map
+ *
+ *	Wheel slip makes the odometry drift, and a map built
+ *	on drifting poses gets smeared walls. ScanMatcher
+ *	lays the sonar echoes of the last few cycles over the
+ *	map at every pose in a small window around where the
+ *	odometry says the robot is, and moves the robot to
+ *	the pose where they fit best (Olson, "Real-time
+ *	correlative scan matching", 2009).
+ *
+ *	A pose scores the sum of exp(-d^2 / 2 sigma^2) over
+ *	the echoes, d being the distance from where the echo
+ *	lands to the closest obstacle cell. The DistanceMap
+ *	already keeps d for every cell, so that is one lookup
+ *	into a table indexed by d^2 per echo. The cells around
+ *	the robot are copied into a flat square first, the
+ *	tile lookups would take most of the time otherwise.
+ *
+ *	The search is coarse to fine. Translations are tried
+ *	in blocks, and a block is scored with a second table
+ *	that pretends every echo is as close to an obstacle as
+ *	any translation in the block could bring it, which
+ *	bounds every pose in the block from above. Blocks are
+ *	split best first and dropped once their bound can't
+ *	beat the best full resolution pose found, so the
+ *	result is the same as trying every pose. Rotations are
+ *	spread over worker threads, one per core by default,
+ *	started once with the matcher.
+ *
+ *	A sonar cycle only has 16 echoes, too few to pin a
+ *	pose, so the echoes of the last few cycles are kept
+ *	in the odometry frame, where they are still right to
+ *	each other, and matched together.
+ *
+ *	A sonar map fits a lot of poses about as well, and a
+ *	corridor fits anywhere along it. A match has to fit
+ *	clearly better than the predicted pose, and the poses
+ *	around it, weighted by how likely their scores make
+ *	them, give the spread of the fit along each direction.
+ *	The pose only moves when the echoes pin it down along
+ *	every direction: down a long hall a partial fix across
+ *	it, or a turn to the walls' bend, did worse than the
+ *	odometry it was meant to fix. A best rotation on the
+ *	edge of the search is no match, the real one may be
+ *	outside it. The turn is weighed against how far the
+ *	heading could have drifted since the last match, like
+ *	a Kalman filter would: a map built on a drifting
+ *	heading bends along with it, and turning all the way
+ *	to fit it every time walked the heading off further
+ *	than the odometry did.
+ *
+ *	The fix is kept as a correction from the odometry
+ *	frame to the map frame and applied to every pose,
+ *	cycles that don't match well enough just keep the
+ *	last correction.
+ ********************************************************/
+
+#ifndef SCAN_MATCHER_H
+#define SCAN_MATCHER_H
+
+#include "sensor_log.h"
+#include "distance_map.h"
+#include "worker_pool.h"
+
+#include <vector>
+
+#define SCAN_MATCH_MAX_RANGE	3000	//[mm] longer echoes are mostly side lobes and multipath
+
+struct ScanMatchParams
+{
+	double maxShift;		//[mm] translations searched +- this much
+	double shiftStep;		//[mm] finest translation step
+	double maxRotation;		//[deg] rotations searched +- this much, a best fit on the edge is no match
+	double rotationStep;	//[deg]
+	double sigma;			//[mm] spread of an echo around the obstacle it came from
+	int cycles;				//sonar cycles matched together
+	int levels;				//translation block levels, including full resolution
+	int minPoints;			//fewer echoes than this don't get matched
+	double minScore;		//mean score per echo a match needs to be trusted, 1 is a perfect fit
+	double minGain;			//and how much better than the predicted pose it has to fit, per echo
+	double scoreScale;		//score per echo below the best that makes a pose e times less likely
+	double maxSpread;		//[mm] the pose isn't moved if the fit is spread wider than this along any direction
+	double turnDrift;		//[deg^2] the heading's variance grows by this per meter driven
+	int threads;			//0 for one per core
+
+	ScanMatchParams()
+		: maxShift(300), shiftStep(50), maxRotation(3), rotationStep(1), sigma(150),
+		  cycles(30), levels(4), minPoints(24), minScore(0.4), minGain(0.02), scoreScale(0.01), maxSpread(100),
+		  turnDrift(2), threads(0) {}
+};
+
+struct ScanMatchResult
+{
+	bool matched;			//the pose was moved to the best fit
+	double x, y, th;		//corrected pose, [mm] and [deg]
+	double score;			//mean score per echo at that pose
+	double predicted;		//and at the pose the odometry gave
+	double spreadMajor;		//[mm] standard deviation of the fit along its loosest direction
+	double spreadMinor;		//and its tightest
+	double spreadTurn;		//[deg] over the rotations
+	int points;				//echoes matched
+	long evaluated;			//poses and blocks scored
+	double seconds;
+};
+
+class ScanMatcher
+{
+public:
+	ScanMatcher(const ScanMatchParams &params = ScanMatchParams());
+
+	/*
+	 *	Moves the record's odometry pose into the map frame: matches the
+	 *	echoes of the last cycles including this one against the distance
+	 *	map if there is enough to go on, and applies the correction. The
+	 *	distance map has to be of the map the corrected poses build, and
+	 *	must not be updated while this runs.
+	 */
+	ScanMatchResult correct(SensorLogRecord &record, const DistanceMap &distance);
+
+	//current odometry to map frame correction: map = R(th) odometry + (x, y)
+	void getCorrection(double &x, double &y, double &th) const;
+
+	//starts over with no correction and no echoes, for a new map
+	void reset();
+
+private:
+	struct Echo
+	{
+		double x, y;		//odometry frame [mm]
+	};
+
+	struct Candidate
+	{
+		float bound;
+		int level;
+		int tx, ty;			//lower left translation of the block, in shiftStep units
+
+		//equal bounds in a fixed order, so which ones another thread's best pruned doesn't change the pick
+		bool operator<(const Candidate &other) const
+		{
+			if(bound != other.bound)
+				return bound < other.bound;
+			if(level != other.level)
+				return level > other.level;
+			if(ty != other.ty)
+				return ty > other.ty;
+			return tx > other.tx;
+		}
+	};
+
+	struct Search;
+
+	//one thread's share of the rotations
+	struct SearchPart
+	{
+		const ScanMatcher* matcher;
+		Search* search;
+		int parts;
+		void operator()(int part) const;
+	};
+
+	//covariance of the fit, major and minor variance [mm^2] and the direction of the major one
+	struct Spread
+	{
+		double major, minor;
+		double ex, ey;
+	};
+
+	void addEchoes(const SensorLogRecord &record);
+	float score(const Search &search, int level, const std::vector<double> &px, const std::vector<double> &py,
+				double shiftX, double shiftY) const;
+	void place(const Search &search, double angle, std::vector<double> &px, std::vector<double> &py) const;
+	Spread spreadAround(const Search &search, const std::vector<double> &px, const std::vector<double> &py,
+						float best) const;
+	double turnVariance(const Search &search, double shiftX, double shiftY, float best) const;
+	void buildTables(const DistanceMap &distance);
+	void searchRotations(Search &search, int first, int stride) const;
+
+	ScanMatchParams myParams;
+	std::vector< std::vector<float> > myTables;		//per level, score by squared distance in cells
+	double myTableCellSize;
+	int myTableFar;
+
+	std::vector< std::vector<Echo> > myCycles;		//ring of the last cycles
+	int myNextCycle;
+
+	double myCorrX, myCorrY, myCorrTh;
+	double myLastX, myLastY;		//odometry position of the last cycle [mm]
+	bool myHasLast;
+	double myTurnVariance;			//[deg^2] of the heading correction
+
+	WorkerPool myPool;
+
+	ScanMatcher(const ScanMatcher&);
+	ScanMatcher& operator=(const ScanMatcher&);
+};
+
+#endif
@@ -0,0 +1,74 @@
+/********************************************************
+ *	Binary log of raw sonar and odometry readings,
+ *	see sensor_log.h
+ ********************************************************/
+
+#include "sensor_log.h"
+#include "cycle_timer.h"
+
+#include <cstring>
+
+#define SENSOR_LOG_FLUSH_INTERVAL	1.0		//[s]
+
+bool SensorLogWriter::open(const char* path)
+{
+	close();
+	myOut.open(path, std::ios::binary | std::ios::trunc);
+	if(!myOut)
+		return false;
+
+	SensorLogHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SENSOR_LOG_MAGIC, sizeof(header.magic));
+	header.version = SENSOR_LOG_VERSION;
+	header.numSonars = SONAR_COUNT;
+	header.recordSize = sizeof(SensorLogRecord);
+	myOut.write((const char*)&header, sizeof(header));
+	myLastFlush = now_seconds();
+	return myOut.good();
+}
+
+void SensorLogWriter::write(const SensorLogRecord &record)
+{
+	if(!myOut.is_open())
+		return;
+
+	myOut.write((const char*)&record, sizeof(record));
+
+	double now = now_seconds();
+	if(now - myLastFlush >= SENSOR_LOG_FLUSH_INTERVAL)
+	{
+		myOut.flush();
+		myLastFlush = now;
+	}
+}
+
+void SensorLogWriter::close()
+{
+	if(myOut.is_open())
+		myOut.close();
+}
+
+bool read_sensor_log(const char* path, std::vector<SensorLogRecord> &records)
+{
+	records.clear();
+	std::ifstream in(path, std::ios::binary);
+	SensorLogHeader header;
+	if(!in.read((char*)&header, sizeof(header)) ||
+	   memcmp(header.magic, SENSOR_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+	   header.version != SENSOR_LOG_VERSION ||
+	   header.numSonars != SONAR_COUNT ||
+	   header.recordSize != sizeof(SensorLogRecord))
+		return false;
+
+	//size the vector from the file length so reading is one pass
+	std::streampos start = in.tellg();
+	in.seekg(0, std::ios::end);
+	size_t count = (size_t)(in.tellg() - start) / sizeof(SensorLogRecord);
+	in.seekg(start);
+
+	records.resize(count);
+	if(count > 0)
+		in.read((char*)&records[0], count * sizeof(SensorLogRecord));
+	return true;
+}
@@ -0,0 +1,71 @@
+/********************************************************
+ *	Binary log of raw sonar and odometry readings
+ *
+ *	The mapper can record what it reads off the robot
+ *	each cycle: a timestamp, the pose and the range and
+ *	mounting angle of all 16 sonars. mapping_replay feeds
+ *	such a log back through SonarMapper without a robot,
+ *	so a run can be mapped again as often as we like.
+ *
+ *	Layout (little endian, version 1): SensorLogHeader,
+ *	then one fixed-size SensorLogRecord per cycle. A
+ *	record cut short by a crash is dropped on reading.
+ ********************************************************/
+
+#ifndef SENSOR_LOG_H
+#define SENSOR_LOG_H
+
+#include "sonar_snapshot.h"
+
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+
+#define SENSOR_LOG_MAGIC	"SRLOG\0\0"
+#define SENSOR_LOG_VERSION	1
+
+struct SensorLogHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numSonars;
+	uint32_t recordSize;
+	uint32_t reserved[3];
+};
+
+struct SensorLogRecord
+{
+	double time;					//[s] since the recording started
+	double x, y, th;				//robot pose, [mm] and [deg]
+	float range[SONAR_COUNT];		//[mm]
+	float sensorTh[SONAR_COUNT];	//mounting angle relative to the robot, [deg]
+};
+
+inline SonarSnapshot snapshot_from_record(const SensorLogRecord &record)
+{
+	return make_sonar_snapshot(record.x, record.y, record.th, record.range, record.sensorTh, SONAR_COUNT);
+}
+
+class SensorLogWriter
+{
+public:
+	SensorLogWriter() : myLastFlush(0) {}
+	~SensorLogWriter() { close(); }
+
+	bool open(const char* path);
+	bool isOpen() const { return myOut.is_open(); }
+
+	//appends one cycle, buffered and pushed to the OS about once a second
+	void write(const SensorLogRecord &record);
+
+	void close();
+
+private:
+	std::ofstream myOut;
+	double myLastFlush;
+};
+
+//reads a whole log into memory, returns false if it isn't a sensor log
+bool read_sensor_log(const char* path, std::vector<SensorLogRecord> &records);
+
+#endif
@@ -0,0 +1,57 @@
+/********************************************************
+ *	One robot cycle of map building, see sonar_mapper.h
+ ********************************************************/
+
+#include "sonar_mapper.h"
+#include "map_journal.h"
+#include "map_file.h"
+#include "map_pyramid.h"
+#include "distance_map.h"
+#include "frontier_map.h"
+#include "bit_planes.h"
+#include "scan_matcher.h"
+#include "sensor_log.h"
+
+int SonarMapper::update(const SonarSnapshot &snapshot)
+{
+	myEvidence.dirty.clear();
+	myCycle++;
+
+	//rasterize every cone in one pass and carve the beams in front of the echoes,
+	//out of range readings carry no evidence
+	build_cone_batch( snapshot, CONE_DISTANCE_THRESHOLD, myMap.getCellSize(), myBatch );
+	int updates = apply_cone_batch( myBatch, myMap, myEvidence );
+	updates += carve_free_space( myBatch, myMap, myEvidence );
+
+	//journal the deltas while the evidence still holds them
+	if(myJournal)
+		myJournal->record( myCycle, myEvidence, myMap );
+
+	//fold this cycle's evidence into the global map, once per touched cell
+	merge_evidence( myEvidence, myMap );
+
+	if(myPyramid)
+		myPyramid->update( myMap, myEvidence.dirty );
+	if(myDistance)
+		myDistance->update( myMap, myEvidence.dirty );
+	if(myFrontiers)
+		myFrontiers->update( myMap, myEvidence.dirty );
+	if(myPlanes)
+		myPlanes->update( myMap, myEvidence.dirty );
+	if(myCheckpointer)
+		myCheckpointer->update( myMap, myEvidence.dirty );
+
+	return updates;
+}
+
+int SonarMapper::update(SensorLogRecord &record, ScanMatchResult* match)
+{
+	//the distance map isn't touched again until the update below
+	if(myMatcher && myDistance)
+	{
+		ScanMatchResult result = myMatcher->correct(record, *myDistance);
+		if(match)
+			*match = result;
+	}
+	return update(snapshot_from_record(record));
+}
@@ -0,0 +1,96 @@
+/********************************************************
+ *	One robot cycle of map building
+ *
+ *	SonarMapper owns the global log-odds map and runs the
+ *	whole per-cycle update on a SonarSnapshot: rasterize
+ *	the 16 cones, carve the free space in front of them,
+ *	journal the evidence, merge it into the map, then
+ *	hand the touched cells to the pyramid, the distance
+ *	map, the frontiers, the bit planes and the
+ *	checkpointer.
+ *	aria_robot_mapping feeds it live data, mapping_replay
+ *	feeds it a sensor log, both go through exactly this
+ *	code. With a scan matcher set the logged odometry pose
+ *	is matched onto the map first, here too, so a log of
+ *	the raw readings maps again into the map the robot
+ *	built.
+ ********************************************************/
+
+#ifndef SONAR_MAPPER_H
+#define SONAR_MAPPER_H
+
+#include "sonar_model.h"
+#include "sonar_snapshot.h"
+
+#include <stdint.h>
+
+#define CONE_DISTANCE_THRESHOLD	10.0	//[mm] d in the nine cell cone, see sonar_model.h
+
+class MapJournal;
+class MapCheckpointer;
+class MapPyramid;
+class DistanceMap;
+class FrontierMap;
+class OccupancyPlanes;
+class ScanMatcher;
+struct ScanMatchResult;
+struct SensorLogRecord;
+
+class SonarMapper
+{
+public:
+	SonarMapper(double cellSize = 100.0)
+		: myMap(0, cellSize), myJournal(NULL), myCheckpointer(NULL), myPyramid(NULL), myDistance(NULL), myFrontiers(NULL),
+		  myPlanes(NULL), myMatcher(NULL), myCycle(0) {}
+
+	//all optional, the mapper doesn't own them
+	void setJournal(MapJournal* journal) { myJournal = journal; }
+	void setCheckpointer(MapCheckpointer* checkpointer) { myCheckpointer = checkpointer; }
+	void setPyramid(MapPyramid* pyramid) { myPyramid = pyramid; }
+	void setDistanceMap(DistanceMap* distance) { myDistance = distance; }
+	void setFrontiers(FrontierMap* frontiers) { myFrontiers = frontiers; }
+	void setPlanes(OccupancyPlanes* planes) { myPlanes = planes; }
+
+	//matches against the distance map, so only does anything with one set too
+	void setMatcher(ScanMatcher* matcher) { myMatcher = matcher; }
+
+	/*
+	 *	Folds one cycle into the map and returns the number of cell updates.
+	 *	The cells it touched stay in getDirty() until the next update.
+	 */
+	int update(const SonarSnapshot &snapshot);
+
+	/*
+	 *	The same for one logged cycle. With a matcher the record's pose is
+	 *	moved onto the map first, against the distance map as the cycles
+	 *	before left it, and the record keeps the corrected pose. The match
+	 *	goes to *match if given, which is left alone without a matcher.
+	 */
+	int update(SensorLogRecord &record, ScanMatchResult* match = NULL);
+
+	logodds_grid& getMap() { return myMap; }
+	const logodds_grid& getMap() const { return myMap; }
+	const DirtyCellSet& getDirty() const { return myEvidence.dirty; }
+
+	//cycles are numbered from 1, set it when continuing an earlier map
+	uint32_t getCycle() const { return myCycle; }
+	void setCycle(uint32_t cycle) { myCycle = cycle; }
+
+private:
+	logodds_grid myMap;
+	CycleEvidence myEvidence;
+	ConeBatch myBatch;
+	MapJournal* myJournal;
+	MapCheckpointer* myCheckpointer;
+	MapPyramid* myPyramid;
+	DistanceMap* myDistance;
+	FrontierMap* myFrontiers;
+	OccupancyPlanes* myPlanes;
+	ScanMatcher* myMatcher;
+	uint32_t myCycle;
+
+	SonarMapper(const SonarMapper&);
+	SonarMapper& operator=(const SonarMapper&);
+};
+
+#endif
@@ -0,0 +1,234 @@
+/********************************************************
+ *	Log-odds sonar model, see sonar_model.h
+ ********************************************************/
+
+#include "sonar_model.h"
+
+#include <cmath>
+
+#ifndef PI
+#define PI	3.14159
+#endif
+
+/*
+ *	sin/cos of the center and the two edge ray offsets (0, +12, -12 deg).
+ *	Edge rays get rotated from the sonar direction with these:
+ *		cos(a + o) = cos(a)cos(o) - sin(a)sin(o)
+ *		sin(a + o) = sin(a)cos(o) + cos(a)sin(o)
+ */
+static const float RAY_OFFSET_COS[ConeBatch::RAYS_PER_SONAR] =
+	{ 1.0f, (float)cos((SONAR_HALF_BEAM / 180) * PI), (float)cos((SONAR_HALF_BEAM / 180) * PI) };
+static const float RAY_OFFSET_SIN[ConeBatch::RAYS_PER_SONAR] =
+	{ 0.0f, (float)sin((SONAR_HALF_BEAM / 180) * PI), (float)-sin((SONAR_HALF_BEAM / 180) * PI) };
+
+/*
+ *	Fuzzy membership of the nine cells (thesis section on map building),
+ *	[sample][ray]. Edge rays get 0.8 * cos(12 deg) = 0.78, the center ray
+ *	gets 0.8 in front of and behind the echo and 1 right at it.
+ */
+static const float MEMBERSHIP[3][ConeBatch::RAYS_PER_SONAR] =
+{
+	{ 0.8f, 0.7825f, 0.7825f },		//r - d
+	{ 1.0f, 0.7825f, 0.7825f },		//r
+	{ 0.8f, 0.7825f, 0.7825f }		//r + d
+};
+
+//weight of the free cell in front of the echo, cos(12 deg) on the edges
+static const float FREE_MEMBERSHIP[ConeBatch::RAYS_PER_SONAR] = { 1.0f, 0.9781f, 0.9781f };
+
+SonarSnapshot make_sonar_snapshot( double x, double y, double th,
+								   const float* range, const float* sensorTh, int numSonars )
+{
+	SonarSnapshot snapshot;
+	if(numSonars > SONAR_COUNT)
+		numSonars = SONAR_COUNT;
+
+	snapshot.x = x;
+	snapshot.y = y;
+	snapshot.th = th;
+	snapshot.numSonars = numSonars;
+	for(int k = 0; k < numSonars; k++)
+	{
+		double a = sensorTh[k] + th;
+		snapshot.range[k] = range[k];
+		snapshot.angle[k] = (float)a;
+		snapshot.cosAngle[k] = (float)cos((a / 180) * PI);
+		snapshot.sinAngle[k] = (float)sin((a / 180) * PI);
+	}
+	return snapshot;
+}
+
+void build_cone_batch( const SonarSnapshot &snapshot, double distanceThreshold,
+					   double cellSize, ConeBatch &batch )
+{
+	const int numSonars = snapshot.numSonars;
+	const int rays = numSonars * ConeBatch::RAYS_PER_SONAR;
+	batch.numRays = rays;
+	batch.numSamples = rays * ConeBatch::SAMPLES_PER_RAY;
+
+	//rotate each sonar direction by the three ray offsets, no trig in here
+	for(int k = 0; k < numSonars; k++)
+	{
+		const float range = snapshot.range[k];
+		const float c = snapshot.cosAngle[k];
+		const float s = snapshot.sinAngle[k];
+		float valid = (range > SONAR_MIN_RANGE && range < SONAR_MAX_RANGE) ? 1.0f : 0.0f;
+		for(int j = 0; j < ConeBatch::RAYS_PER_SONAR; j++)
+		{
+			int r = k * ConeBatch::RAYS_PER_SONAR + j;
+			batch.rayCos[r] = c * RAY_OFFSET_COS[j] - s * RAY_OFFSET_SIN[j];
+			batch.raySin[r] = s * RAY_OFFSET_COS[j] + c * RAY_OFFSET_SIN[j];
+			batch.rayRange[r] = range;
+			batch.rayValid[r] = valid;
+
+			//evidence of the four samples along this ray, 0 when the reading is unusable
+			batch.logodds[r]			= valid * LOGODDS_OCCUPIED * MEMBERSHIP[0][j];
+			batch.logodds[rays + r]		= valid * LOGODDS_OCCUPIED * MEMBERSHIP[1][j];
+			batch.logodds[2 * rays + r]	= valid * LOGODDS_OCCUPIED * MEMBERSHIP[2][j];
+			batch.logodds[3 * rays + r]	= valid * LOGODDS_FREE * FREE_MEMBERSHIP[j];
+		}
+	}
+
+	const float rx = (float)snapshot.x;
+	const float ry = (float)snapshot.y;
+	const float d = (float)distanceThreshold;
+	const float radial[ConeBatch::SAMPLES_PER_RAY] = { -d, 0.0f, d, -d - (float)cellSize };
+
+	//sample positions, straight loops over flat arrays
+	for(int t = 0; t < ConeBatch::SAMPLES_PER_RAY; t++)
+	{
+		float* sx = batch.x + t * rays;
+		float* sy = batch.y + t * rays;
+		const float off = radial[t];
+		for(int r = 0; r < rays; r++)
+		{
+			float dist = batch.rayRange[r] + off;
+			sx[r] = rx + dist * batch.rayCos[r];
+			sy[r] = ry + dist * batch.raySin[r];
+		}
+	}
+
+	const float inv = (float)(1.0 / cellSize);
+	for(int i = 0; i < batch.numSamples; i++)
+	{
+		batch.cellX[i] = (int)floor(batch.x[i] * inv);
+		batch.cellY[i] = (int)floor(batch.y[i] * inv);
+	}
+	batch.originX = (int)floor(rx * inv);
+	batch.originY = (int)floor(ry * inv);
+}
+
+//the global map grew a tile, grow the layers with it
+static void grow_layers( const logodds_grid &global, CycleEvidence &evidence )
+{
+	size_t limit = global.getIndexLimit();
+	evidence.obstacles.resize(limit, 0);
+	evidence.empty.resize(limit, 0);
+	evidence.dirty.reserveCells(limit);
+}
+
+int apply_cone_batch( const ConeBatch &batch, logodds_grid &global, CycleEvidence &evidence )
+{
+	int updates = 0;
+	for(int i = 0; i < batch.numSamples; i++)
+	{
+		float w = batch.logodds[i];
+		if(w == 0)
+			continue;
+
+		unsigned int cell = global.cellIndex(batch.cellX[i], batch.cellY[i]);
+		if(cell >= evidence.obstacles.size())
+			grow_layers(global, evidence);
+
+		if(w > 0)
+		{
+			if(w > evidence.obstacles[cell])
+				evidence.obstacles[cell] = w;
+		}
+		else
+		{
+			if(w < evidence.empty[cell])
+				evidence.empty[cell] = w;
+		}
+		evidence.dirty.insert(cell);
+		updates++;
+	}
+	return updates;
+}
+
+int carve_free_space( const ConeBatch &batch, logodds_grid &global, CycleEvidence &evidence )
+{
+	const int rays = batch.numRays;
+	const float* free = batch.logodds + 3 * rays;
+	const int* endX = batch.cellX + 3 * rays;
+	const int* endY = batch.cellY + 3 * rays;
+	const int x0 = batch.originX;
+	const int y0 = batch.originY;
+	int updates = 0;
+
+	for(int r = 0; r < rays; r++)
+	{
+		const float w = free[r];
+		if(w == 0)
+			continue;
+
+		//Bresenham from the robot up to, not including, the free sample's own cell
+		const int x1 = endX[r], y1 = endY[r];
+		const int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+		const int dy = y1 > y0 ? y1 - y0 : y0 - y1;
+		const int sx = x1 > x0 ? 1 : -1;
+		const int sy = y1 > y0 ? 1 : -1;
+		int err = dx - dy;
+		int x = x0, y = y0;
+
+		//a ray crosses only a few tiles, look each one up once and index the cells inside it directly
+		int tileX = (x >> logodds_grid::TILE_SHIFT) + 1, tileY = 0;
+		unsigned int base = 0;
+		while(x != x1 || y != y1)
+		{
+			if((x >> logodds_grid::TILE_SHIFT) != tileX || (y >> logodds_grid::TILE_SHIFT) != tileY)
+			{
+				tileX = x >> logodds_grid::TILE_SHIFT;
+				tileY = y >> logodds_grid::TILE_SHIFT;
+				base = global.cellIndex(x, y) & ~(unsigned int)(logodds_grid::TILE_CELLS - 1);
+				if(base >= evidence.empty.size())
+					grow_layers(global, evidence);
+			}
+
+			unsigned int cell = base | (unsigned int)logodds_grid::localIndex(x, y);
+			if(w < evidence.empty[cell])
+				evidence.empty[cell] = w;
+			evidence.dirty.insert(cell);
+			updates++;
+
+			int e2 = 2 * err;
+			if(e2 > -dy)
+			{
+				err -= dy;
+				x += sx;
+			}
+			if(e2 < dx)
+			{
+				err += dx;
+				y += sy;
+			}
+		}
+	}
+	return updates;
+}
+
+void merge_evidence( CycleEvidence &evidence, logodds_grid &global )
+{
+	for(size_t i = 0; i < evidence.dirty.size(); i++)
+	{
+		unsigned int cell = evidence.dirty[i];
+
+		float &g = global[cell];
+		g += evidence.obstacles[cell] + evidence.empty[cell];
+		if(g > LOGODDS_MAX) g = LOGODDS_MAX;
+		if(g < LOGODDS_MIN) g = LOGODDS_MIN;
+
+		evidence.obstacles[cell] = 0;
+		evidence.empty[cell] = 0;
+	}
+}
@@ -0,0 +1,128 @@
+/********************************************************
+ *	Log-odds sonar model for the mapper
+ *
+ *	Each cell of the global map holds the log-odds of it
+ *	being occupied. A sonar return adds evidence to the
+ *	nine fuzzy cells around the echo and takes some away
+ *	from the cell just in front of it.
+ *	_____________
+ *	|	|	|	|
+ *	|C2_|C5_|C8_|		columns: R - d, R, R + d
+ *	|	|	|	|		rows: +12 deg, center, -12 deg
+ *	|C1_|C4_|C7_|
+ *	|	|	|	|
+ *	|C3_|C6_|C9_|
+ *
+ *	Refer to thesis for more information on the fuzzy values
+ *
+ *	All 16 cones of one robot cycle are turned into one
+ *	batch of sample points first, using flat float arrays
+ *	so the compiler can vectorize the ray and the cell
+ *	math, and only then scattered into the grid. The edge
+ *	rays are rotated from the sonar's sin/cos with a fixed
+ *	table, so a cycle costs no trig beyond the snapshot.
+ *
+ *	Besides the cells at the echo, every cell a ray passes
+ *	through on its way out is free: carve_free_space walks
+ *	each ray from the robot's cell to the free cell in
+ *	front of the echo with integer Bresenham steps and
+ *	gives every cell on the way the free evidence.
+ ********************************************************/
+
+#ifndef SONAR_MODEL_H
+#define SONAR_MODEL_H
+
+#include "tiled_grid.h"
+#include "sonar_snapshot.h"
+#include "dirty_cells.h"
+#include <vector>
+
+#define SONAR_HALF_BEAM		12.0	//[deg] edge rays of the fuzzy cone
+
+//log-odds increments, log(0.7/0.3) for a hit and log(0.4/0.6) for a miss
+#define LOGODDS_OCCUPIED	0.85f
+#define LOGODDS_FREE		-0.41f
+#define LOGODDS_MIN			-4.0f
+#define LOGODDS_MAX			4.0f
+//cells above this are written out as obstacles
+#define LOGODDS_OBSTACLE	1.5f
+//cells below this count as seen free
+#define LOGODDS_FREE_SPACE	-1.0f
+
+typedef TiledGrid<float> logodds_grid;
+
+/*
+ *	Sample points of one robot cycle, structure of arrays.
+ *	Sample i belongs to ray (i % numRays), rays are laid out
+ *	as [sonar * 3 + {center, +12, -12}]
+ */
+struct ConeBatch
+{
+	enum
+	{
+		RAYS_PER_SONAR	= 3,
+		SAMPLES_PER_RAY	= 4,	//r - d, r, r + d and one free cell in front
+		MAX_RAYS		= SONAR_COUNT * RAYS_PER_SONAR,
+		MAX_SAMPLES		= MAX_RAYS * SAMPLES_PER_RAY
+	};
+
+	int numRays;
+	int numSamples;
+	int originX, originY;		//cell the robot is in, where the rays start
+
+	//per ray
+	float rayCos[MAX_RAYS];
+	float raySin[MAX_RAYS];
+	float rayRange[MAX_RAYS];
+	float rayValid[MAX_RAYS];	//1 for a usable reading, 0 otherwise
+
+	//per sample
+	float x[MAX_SAMPLES];
+	float y[MAX_SAMPLES];
+	float logodds[MAX_SAMPLES];	//> 0 obstacle evidence, < 0 free evidence, 0 skip
+	int cellX[MAX_SAMPLES];
+	int cellY[MAX_SAMPLES];
+};
+
+/*
+ *	Rasterizes the cones of every sonar in the snapshot into sample points
+ */
+void build_cone_batch( const SonarSnapshot &snapshot, double distanceThreshold,
+					   double cellSize, ConeBatch &batch );
+
+/*
+ *	Evidence gathered during one robot cycle. The layers are flat arrays
+ *	keyed by the global map's cell index, the dirty set holds each touched
+ *	cell once.
+ */
+struct CycleEvidence
+{
+	std::vector<float> obstacles;	//strongest obstacle evidence per cell (log-odds > 0)
+	std::vector<float> empty;		//strongest empty evidence per cell (log-odds < 0)
+	DirtyCellSet dirty;
+};
+
+/*
+ *	Writes a batch into the cycle's evidence. A cell keeps the strongest
+ *	evidence it got this cycle, so several samples landing in the same cell
+ *	only count once. Returns the number of cell updates done.
+ */
+int apply_cone_batch( const ConeBatch &batch, logodds_grid &global, CycleEvidence &evidence );
+
+/*
+ *	Gives free evidence to every cell between the robot and the free cell
+ *	in front of each echo, for all rays of the batch in one pass. Out of
+ *	range readings carve nothing, the sonar can't tell where its ping
+ *	went. Returns the number of cell updates done.
+ */
+int carve_free_space( const ConeBatch &batch, logodds_grid &global, CycleEvidence &evidence );
+
+/*
+ *	Adds the evidence of every dirty cell to the global log-odds map and
+ *	zeroes it. Costs one pass over the unique cells touched this cycle.
+ *	The dirty set is left alone so anything else that follows the map can
+ *	see what changed, clear it before the next cycle.
+ */
+void merge_evidence( CycleEvidence &evidence, logodds_grid &global );
+
+#endif
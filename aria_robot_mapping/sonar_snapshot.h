@@ -0,0 +1,37 @@
+/********************************************************
+ *	One robot cycle worth of sonar data
+ *
+ *	Everything the mapper needs from ArRobot gets read
+ *	once per cycle into a SonarSnapshot: the pose and,
+ *	for each of the 16 sonars, the range and the world
+ *	frame angle with its sin/cos. The map update only
+ *	looks at the snapshot, never at the robot, so the
+ *	same code runs on recorded or simulated data.
+ ********************************************************/
+
+#ifndef SONAR_SNAPSHOT_H
+#define SONAR_SNAPSHOT_H
+
+#define SONAR_COUNT			16
+#define SONAR_MIN_RANGE		200		//[mm] readings at or below this are ignored
+#define SONAR_MAX_RANGE		4500	//[mm] readings at or above this are ignored
+
+struct SonarSnapshot
+{
+	double x, y, th;				//robot pose, [mm] and [deg]
+	int numSonars;
+	float range[SONAR_COUNT];		//[mm]
+	float angle[SONAR_COUNT];		//sensor angle + robot heading, [deg]
+	float cosAngle[SONAR_COUNT];
+	float sinAngle[SONAR_COUNT];
+};
+
+/*
+ *	Builds a snapshot from raw values, sensorTh[] is the mounting angle of
+ *	each sonar relative to the robot in degrees. This is the only place the
+ *	per-sonar trig gets done, one sin/cos per sonar.
+ */
+SonarSnapshot make_sonar_snapshot( double x, double y, double th,
+								   const float* range, const float* sensorTh, int numSonars );
+
+#endif
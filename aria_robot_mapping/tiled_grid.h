@@ -0,0 +1,303 @@
+/********************************************************
+ *	Sparse, unbounded occupancy grid
+ *
+ *	The map is split into 32x32 cell tiles. A tile only
+ *	gets allocated the first time something writes into
+ *	it, so memory grows with the area the sonars have
+ *	actually seen instead of the bounding box of the run.
+ *
+ *	Tiles are found through a small open addressing hash
+ *	keyed on the tile coordinates, so negative world
+ *	coordinates work without offsetting the robot pose.
+ *	The bucket is the top bits of the Fibonacci product
+ *	of the key, the low bits would only depend on the y
+ *	half of it and a long row of tiles would all start
+ *	probing at the same bucket.
+ ********************************************************/
+
+#ifndef TILED_GRID_H
+#define TILED_GRID_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+template <typename T>
+class TiledGrid
+{
+public:
+	enum
+	{
+		TILE_SHIFT = 5,
+		TILE_SIZE  = 1 << TILE_SHIFT,		//cells along one side of a tile
+		TILE_MASK  = TILE_SIZE - 1,
+		TILE_CELLS = TILE_SIZE * TILE_SIZE,
+		CELL_BITS  = 2 * TILE_SHIFT			//bits of a flat index that pick the cell inside a tile
+	};
+
+	/*
+	 *	fillValue is what every cell reads as before a sonar touches it,
+	 *	cellSize is the length of one cell side in millimeters
+	 */
+	TiledGrid(T fillValue, double cellSize = 100.0)
+		: myFill(fillValue), myCellSize(cellSize), myDirBits(6),
+		  myMinTileX(0), myMinTileY(0), myMaxTileX(-1), myMaxTileY(-1),
+		  myLastKey(0), myLastSlot(-1)
+	{
+		myDirKeys.assign(1 << myDirBits, 0);
+		myDirSlots.assign(1 << myDirBits, -1);
+	}
+
+	~TiledGrid()
+	{
+		for(size_t i = 0; i < myTiles.size(); i++)
+			delete [] myTiles[i];
+	}
+
+	double getCellSize() const { return myCellSize; }
+	T getFillValue() const { return myFill; }
+
+	//world position in millimeters to cell coordinate
+	int worldToCell(double mm) const { return (int)floor(mm / myCellSize); }
+
+	//read a cell, untouched cells read as the fill value and nothing gets allocated
+	T get(int cx, int cy) const
+	{
+		int slot = findTile(cx >> TILE_SHIFT, cy >> TILE_SHIFT);
+		if(slot < 0)
+			return myFill;
+		return myTiles[slot][localIndex(cx, cy)];
+	}
+
+	//write access to a cell, allocates the tile if this is the first touch
+	T& at(int cx, int cy)
+	{
+		int slot = getTile(cx >> TILE_SHIFT, cy >> TILE_SHIFT);
+		return myTiles[slot][localIndex(cx, cy)];
+	}
+
+	bool hasTile(int tx, int ty) const { return findTile(tx, ty) >= 0; }
+
+	//cells of the tile holding (cx, cy), NULL if nothing has been written there
+	const T* findTileData(int cx, int cy) const
+	{
+		int slot = findTile(cx >> TILE_SHIFT, cy >> TILE_SHIFT);
+		return slot < 0 ? NULL : myTiles[slot];
+	}
+
+	/*
+	 *	Flat index of a cell: tile slot in the upper bits, position inside
+	 *	the tile in the lower CELL_BITS. Allocates the tile on first touch.
+	 *	Indices stay valid for the life of the grid and are all below
+	 *	getIndexLimit(), so they can key flat per-cell arrays
+	 */
+	unsigned int cellIndex(int cx, int cy)
+	{
+		unsigned int slot = (unsigned int)getTile(cx >> TILE_SHIFT, cy >> TILE_SHIFT);
+		return (slot << CELL_BITS) | (unsigned int)localIndex(cx, cy);
+	}
+
+	//flat index of a cell without allocating, false if its tile doesn't exist yet
+	bool findCellIndex(int cx, int cy, unsigned int &index) const
+	{
+		int slot = findTile(cx >> TILE_SHIFT, cy >> TILE_SHIFT);
+		if(slot < 0)
+			return false;
+		index = ((unsigned int)slot << CELL_BITS) | (unsigned int)localIndex(cx, cy);
+		return true;
+	}
+
+	T& operator[](unsigned int index) { return myTiles[index >> CELL_BITS][index & (TILE_CELLS - 1)]; }
+	const T& operator[](unsigned int index) const { return myTiles[index >> CELL_BITS][index & (TILE_CELLS - 1)]; }
+
+	void indexToCell(unsigned int index, int &cx, int &cy) const
+	{
+		int slot = (int)(index >> CELL_BITS);
+		int local = (int)(index & (TILE_CELLS - 1));
+		cx = (myTileX[slot] << TILE_SHIFT) + (local & TILE_MASK);
+		cy = (myTileY[slot] << TILE_SHIFT) + (local >> TILE_SHIFT);
+	}
+
+	size_t getIndexLimit() const { return myTiles.size() * TILE_CELLS; }
+
+	/*
+	 *	Tiles are numbered in the order they were allocated. The slot number
+	 *	never changes, so it can be used to walk over everything explored
+	 */
+	int getNumTiles() const { return (int)myTiles.size(); }
+	int getTileX(int slot) const { return myTileX[slot]; }
+	int getTileY(int slot) const { return myTileY[slot]; }
+	T* getTileData(int slot) { return myTiles[slot]; }
+	const T* getTileData(int slot) const { return myTiles[slot]; }
+
+	/*
+	 *	Cell bounds of the explored area (inclusive). Returns false while the
+	 *	grid is still empty
+	 */
+	bool getCellBounds(int &minX, int &minY, int &maxX, int &maxY) const
+	{
+		if(myTiles.empty())
+			return false;
+		minX = myMinTileX << TILE_SHIFT;
+		minY = myMinTileY << TILE_SHIFT;
+		maxX = ((myMaxTileX + 1) << TILE_SHIFT) - 1;
+		maxY = ((myMaxTileY + 1) << TILE_SHIFT) - 1;
+		return true;
+	}
+
+	//bytes held by tiles and the tile directory
+	size_t getMemoryUsage() const
+	{
+		return myTiles.size() * (TILE_CELLS * sizeof(T) + 2 * sizeof(int) + sizeof(T*))
+			 + myDirKeys.size() * (sizeof(unsigned int) + sizeof(int));
+	}
+
+	/*
+	 *	How far tiles sit from the bucket their key hashes to, 0 for a tile
+	 *	in its own bucket. A lookup probes one more bucket than that
+	 */
+	void getProbeLengths(double &mean, int &worst) const
+	{
+		mean = 0;
+		worst = 0;
+		size_t size = myDirKeys.size();
+		for(size_t i = 0; i < size; i++)
+		{
+			if(myDirSlots[i] < 0)
+				continue;
+			int length = (int)((i - bucket(myDirKeys[i])) & (size - 1));
+			mean += length;
+			if(length > worst)
+				worst = length;
+		}
+		if(!myTiles.empty())
+			mean /= myTiles.size();
+	}
+
+	static int localIndex(int cx, int cy)
+	{
+		return ((cy & TILE_MASK) << TILE_SHIFT) | (cx & TILE_MASK);
+	}
+
+protected:
+	static unsigned int tileKey(int tx, int ty)
+	{
+		return ((unsigned int)(tx & 0xffff) << 16) | (unsigned int)(ty & 0xffff);
+	}
+
+	//top myDirBits bits of the product, they depend on all bits of the key
+	size_t bucket(unsigned int key) const
+	{
+		return (size_t)((key * 2654435761u) >> (32 - myDirBits));
+	}
+
+	int findTile(int tx, int ty) const
+	{
+		unsigned int key = tileKey(tx, ty);
+		size_t mask = myDirKeys.size() - 1;
+		size_t i = bucket(key);
+		while(myDirSlots[i] >= 0)
+		{
+			if(myDirKeys[i] == key)
+				return myDirSlots[i];
+			i = (i + 1) & mask;
+		}
+		return -1;
+	}
+
+	int getTile(int tx, int ty)
+	{
+		//sonar updates come in runs that hit the same tile, skip the probe for those
+		unsigned int key = tileKey(tx, ty);
+		if(key == myLastKey && myLastSlot >= 0)
+			return myLastSlot;
+
+		size_t mask = myDirKeys.size() - 1;
+		size_t i = bucket(key);
+		while(myDirSlots[i] >= 0)
+		{
+			if(myDirKeys[i] == key)
+			{
+				myLastKey = key;
+				myLastSlot = myDirSlots[i];
+				return myLastSlot;
+			}
+			i = (i + 1) & mask;
+		}
+
+		//first touch, allocate and fill a new tile
+		int slot = (int)myTiles.size();
+		T* tile = new T[TILE_CELLS];
+		for(int c = 0; c < TILE_CELLS; c++)
+			tile[c] = myFill;
+		myTiles.push_back(tile);
+		myTileX.push_back(tx);
+		myTileY.push_back(ty);
+
+		myDirKeys[i] = key;
+		myDirSlots[i] = slot;
+
+		if(slot == 0)
+		{
+			myMinTileX = myMaxTileX = tx;
+			myMinTileY = myMaxTileY = ty;
+		}
+		else
+		{
+			if(tx < myMinTileX) myMinTileX = tx;
+			if(tx > myMaxTileX) myMaxTileX = tx;
+			if(ty < myMinTileY) myMinTileY = ty;
+			if(ty > myMaxTileY) myMaxTileY = ty;
+		}
+
+		//keep the directory at most half full so probes stay short
+		if(myTiles.size() * 2 > myDirKeys.size())
+			growDirectory();
+
+		myLastKey = key;
+		myLastSlot = slot;
+		return slot;
+	}
+
+	void growDirectory()
+	{
+		myDirBits++;
+		size_t size = (size_t)1 << myDirBits;
+		myDirKeys.assign(size, 0);
+		myDirSlots.assign(size, -1);
+		for(size_t s = 0; s < myTiles.size(); s++)
+		{
+			unsigned int key = tileKey(myTileX[s], myTileY[s]);
+			size_t i = bucket(key);
+			while(myDirSlots[i] >= 0)
+				i = (i + 1) & (size - 1);
+			myDirKeys[i] = key;
+			myDirSlots[i] = (int)s;
+		}
+	}
+
+	T myFill;
+	double myCellSize;
+
+	std::vector<T*> myTiles;
+	std::vector<int> myTileX;
+	std::vector<int> myTileY;
+
+	//tile directory: key -> slot, slot of -1 marks an empty bucket
+	std::vector<unsigned int> myDirKeys;
+	std::vector<int> myDirSlots;
+	int myDirBits;				//log2 of the directory size
+
+	int myMinTileX, myMinTileY, myMaxTileX, myMaxTileY;
+
+	//last tile handed out by at()
+	unsigned int myLastKey;
+	int myLastSlot;
+
+private:
+	//tiles are owned by the grid, no copying
+	TiledGrid(const TiledGrid&);
+	TiledGrid& operator=(const TiledGrid&);
+};
+
+#endif
@@ -0,0 +1,300 @@
+/********************************************************
+ *	Vector Field Histogram, see vector_field_histogram.h
+ ********************************************************/
+
+#include "vector_field_histogram.h"
+#include "cycle_timer.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifndef PI
+#define PI	3.14159265358979
+#endif
+
+#define SECTOR_ANGLE	(360.0 / VFH_SECTORS)
+
+//wraps an angle into [-180, 180) [deg]
+static double wrap_degrees(double a)
+{
+	return a - 360 * floor((a + 180) / 360);
+}
+
+//bin of a map frame direction [deg]
+static int sector_of(double a)
+{
+	int k = (int)floor(a / SECTOR_ANGLE) % VFH_SECTORS;
+	return k < 0 ? k + VFH_SECTORS : k;
+}
+
+//index of the lowest set bit, v can't be 0
+static int lowest_bit(uint64_t v)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(v);
+#else
+	static const int debruijn[64] =
+	{
+		 0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+		62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+		63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+		46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+	};
+	return debruijn[((v & (0 - v)) * 0x03F79D71B4CB0A89ULL) >> 58];
+#endif
+}
+
+VectorFieldHistogram::VectorFieldHistogram(double cellSize, const VfhParams &params)
+	: myParams(params), myCellSize(cellSize), myMap(NULL), myObstacles(NULL), myPrevious(0), myHasPrevious(false),
+	  myLastTurn(1)
+{
+	if(myParams.clearDistance < myParams.blockDistance)
+		myParams.clearDistance = myParams.blockDistance;
+	myHigh = (float)weight(myParams.blockDistance);
+	myLow = (float)weight(myParams.clearDistance);
+	for(int k = 0; k < VFH_SECTORS; k++)
+	{
+		mySmoothed[k] = 0;
+		myBlocked[k] = 0;
+	}
+	buildTables();
+}
+
+//an obstacle d mm out, 1 right at the robot down to 0 at the edge of the window
+double VectorFieldHistogram::weight(double d) const
+{
+	double w = std::max(0.0, 1 - d / myParams.windowRadius);
+	return w * w;
+}
+
+/*
+ *	An obstacle blocks the bins within asin(robotRadius / d) of its
+ *	direction, the ones where the robot's edge would touch it. Closer
+ *	than robotRadius it blocks the whole half facing it.
+ */
+void VectorFieldHistogram::buildTables()
+{
+	myRadius = (int)ceil(myParams.windowRadius / myCellSize);
+	myWidth = 2 * myRadius + 1;
+	myCells.resize(myWidth * myWidth);
+	for(int dy = -myRadius; dy <= myRadius; dy++)
+	{
+		for(int dx = -myRadius; dx <= myRadius; dx++)
+		{
+			CellEntry &entry = myCells[(dy + myRadius) * myWidth + dx + myRadius];
+			double d = sqrt((double)(dx * dx + dy * dy)) * myCellSize;
+			if((dx == 0 && dy == 0) || d > myParams.windowRadius)
+			{
+				entry.weight = 0;
+				entry.first = 0;
+				entry.count = 0;
+				continue;
+			}
+
+			double a = atan2((double)dy, (double)dx) * 180 / PI;
+			double grow = d > myParams.robotRadius ? asin(myParams.robotRadius / d) * 180 / PI : 90;
+			int first = (int)floor((a - grow) / SECTOR_ANGLE);
+			int last = (int)floor((a + grow) / SECTOR_ANGLE);
+			entry.weight = (float)weight(d);
+			entry.first = (short)sector_of(first * SECTOR_ANGLE);
+			entry.count = (short)std::min(last - first + 1, VFH_SECTORS);
+		}
+	}
+
+	myRanges.resize((int)(myParams.windowRadius / VFH_RANGE_STEP) + 1);
+	for(size_t i = 0; i < myRanges.size(); i++)
+	{
+		double d = std::max((double)i * VFH_RANGE_STEP, 1.0);
+		double grow = d > myParams.robotRadius ? asin(myParams.robotRadius / d) * 180 / PI : 90;
+		myRanges[i].weight = (float)weight(d);
+		myRanges[i].spread = (short)std::min((int)ceil(grow / SECTOR_ANGLE), VFH_SECTORS / 2 - 1);
+	}
+}
+
+/*
+ *	Adds the obstacle cell at (dx, dy) from the robot's cell, certainty
+ *	0 to 1 from the threshold up to the most the log-odds go
+ */
+void VectorFieldHistogram::addCell(int dx, int dy, float certainty)
+{
+	if(dx < -myRadius || dx > myRadius || dy < -myRadius || dy > myRadius)
+		return;
+	const CellEntry &entry = myCells[(dy + myRadius) * myWidth + dx + myRadius];
+	float weight = certainty * certainty * entry.weight;
+	float* bins = myDoubled + entry.first;
+	for(int k = 0; k < entry.count; k++)
+		bins[k] = std::max(bins[k], weight);
+}
+
+/*
+ *	Every obstacle cell of the tiles the window touches, 64 cells per
+ *	word, two tile rows of 32 each
+ */
+void VectorFieldHistogram::addCells(double x, double y)
+{
+	int cx = myMap->worldToCell(x), cy = myMap->worldToCell(y);
+	int tx0 = (cx - myRadius) >> logodds_grid::TILE_SHIFT, tx1 = (cx + myRadius) >> logodds_grid::TILE_SHIFT;
+	int ty0 = (cy - myRadius) >> logodds_grid::TILE_SHIFT, ty1 = (cy + myRadius) >> logodds_grid::TILE_SHIFT;
+	for(int ty = ty0; ty <= ty1; ty++)
+	{
+		for(int tx = tx0; tx <= tx1; tx++)
+		{
+			unsigned int index;
+			if(!myMap->findCellIndex(tx << logodds_grid::TILE_SHIFT, ty << logodds_grid::TILE_SHIFT, index))
+				continue;
+			size_t word = index >> 6;
+			int dx = (tx << logodds_grid::TILE_SHIFT) - cx, dy = (ty << logodds_grid::TILE_SHIFT) - cy;
+			for(int w = 0; w < BitPlane::WORDS_PER_TILE; w++)
+			{
+				uint64_t bits = myObstacles->getWord(word + w);
+				while(bits != 0)
+				{
+					int bit = lowest_bit(bits);
+					bits &= bits - 1;
+					float certainty = ((*myMap)[(unsigned int)((word + w) << 6) + bit] - LOGODDS_OBSTACLE) / (LOGODDS_MAX - LOGODDS_OBSTACLE);
+					addCell(dx + (bit & logodds_grid::TILE_MASK), dy + 2 * w + (bit >> logodds_grid::TILE_SHIFT), certainty);
+				}
+			}
+		}
+	}
+}
+
+double VectorFieldHistogram::cost(double direction, double target, double th) const
+{
+	double c = myParams.targetCost * fabs(wrap_degrees(direction - target))
+			 + myParams.headingCost * fabs(wrap_degrees(direction - th));
+	if(myHasPrevious)
+		c += myParams.previousCost * fabs(wrap_degrees(direction - myPrevious));
+	return c;
+}
+
+SteeringCommand VectorFieldHistogram::decide(double x, double y, double th, const float* range, const float* sensorTh,
+											 double target, bool hasTarget)
+{
+	double start = now_seconds();
+	if(!hasTarget)
+		target = th;
+
+	for(int k = 0; k < 2 * VFH_SECTORS; k++)
+		myDoubled[k] = 0;
+
+	//a sonar echo counts on the sonar's axis, the map's cone arcs take care of the width
+	for(int i = 0; i < SONAR_COUNT; i++)
+	{
+		if(range[i] <= SONAR_MIN_RANGE || range[i] >= myParams.windowRadius)
+			continue;
+		const RangeEntry &entry = myRanges[(int)(range[i] / VFH_RANGE_STEP)];
+		float* bins = myDoubled + sector_of(th + sensorTh[i] - entry.spread * SECTOR_ANGLE);
+		for(int k = 0; k <= 2 * entry.spread; k++)
+			bins[k] = std::max(bins[k], entry.weight);
+	}
+
+	if(myMap != NULL && myObstacles != NULL)
+		addCells(x, y);
+
+	//fold the doubled histogram, then smooth with weights 1 2 3 2 1
+	float folded[VFH_SECTORS];
+	for(int k = 0; k < VFH_SECTORS; k++)
+		folded[k] = std::max(myDoubled[k], myDoubled[k + VFH_SECTORS]);
+	for(int k = 0; k < VFH_SECTORS; k++)
+	{
+		int l2 = (k + VFH_SECTORS - 2) % VFH_SECTORS, l1 = (k + VFH_SECTORS - 1) % VFH_SECTORS;
+		int r1 = (k + 1) % VFH_SECTORS, r2 = (k + 2) % VFH_SECTORS;
+		mySmoothed[k] = (folded[l2] + 2 * folded[l1] + 3 * folded[k] + 2 * folded[r1] + folded[r2]) / 9;
+		if(mySmoothed[k] > myHigh)
+			myBlocked[k] = 1;
+		else if(mySmoothed[k] < myLow)
+			myBlocked[k] = 0;
+	}
+
+	SteeringCommand command;
+	command.blocked = false;
+	command.valleys = 0;
+
+	//valleys start right after a blocked bin, walking once around from one
+	int origin = -1;
+	for(int k = 0; k < VFH_SECTORS && origin < 0; k++)
+		if(myBlocked[k])
+			origin = k;
+
+	double best = target, best_cost = 0;
+	if(origin < 0)
+	{
+		//nothing anywhere near
+		command.valleys = 1;
+	}
+	else
+	{
+		bool found = false;
+		int k = origin + 1;
+		while(k <= origin + VFH_SECTORS)
+		{
+			if(myBlocked[k % VFH_SECTORS])
+			{
+				k++;
+				continue;
+			}
+			int first = k;
+			while(k < origin + VFH_SECTORS && !myBlocked[k % VFH_SECTORS])
+				k++;
+			int last = k - 1;
+			command.valleys++;
+
+			//the middle of a narrow valley, or half a wide one in from either side, and the target if it is in there
+			double candidates[3];
+			int count = 0;
+			if(last - first + 1 <= myParams.wideValley)
+				candidates[count++] = (first + last + 1) / 2.0 * SECTOR_ANGLE;
+			else
+			{
+				candidates[count++] = (first + myParams.wideValley / 2.0) * SECTOR_ANGLE;
+				candidates[count++] = (last + 1 - myParams.wideValley / 2.0) * SECTOR_ANGLE;
+				double offset = wrap_degrees(target - first * SECTOR_ANGLE);
+				if(offset < 0)
+					offset += 360;
+				if(offset <= (last + 1 - first) * SECTOR_ANGLE)
+					candidates[count++] = target;
+			}
+
+			for(int c = 0; c < count; c++)
+			{
+				double value = cost(candidates[c], target, th);
+				if(!found || value < best_cost)
+				{
+					found = true;
+					best = candidates[c];
+					best_cost = value;
+				}
+			}
+		}
+
+		if(!found)
+		{
+			//boxed in, turn on the spot the way it turned last until a valley opens up
+			command.blocked = true;
+			command.speed = 0;
+			command.turn = myLastTurn > 0 ? myParams.maxTurn : -myParams.maxTurn;
+			command.heading = wrap_degrees(th + command.turn);
+			myHasPrevious = false;
+			command.seconds = now_seconds() - start;
+			return command;
+		}
+	}
+
+	double error = wrap_degrees(best - th);
+	command.heading = wrap_degrees(best);
+	command.turn = std::max(-myParams.maxTurn, std::min(myParams.maxTurn, error));
+
+	//slower the closer the robot's edge gets to something straight ahead, and the sharper the turn
+	double ahead = myParams.windowRadius * (1 - sqrt(std::min(1.0f, mySmoothed[sector_of(th)])));
+	double room = std::max(0.0, std::min(1.0, (ahead - myParams.stopDistance) / (myParams.blockDistance - myParams.stopDistance)));
+	double turning = std::max(0.0, 1 - fabs(error) / myParams.stopTurn);
+	command.speed = myParams.maxSpeed * room * turning;
+
+	myPrevious = best;
+	myHasPrevious = true;
+	if(command.turn != 0)
+		myLastTurn = command.turn;
+	command.seconds = now_seconds() - start;
+	return command;
+}
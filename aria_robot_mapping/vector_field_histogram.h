@@ -0,0 +1,165 @@
+/********************************************************
+ *	Vector Field Histogram obstacle avoidance
+ *
+ *	Replaces the if/else ladder over the front sonars.
+ *	Every cycle all 16 sonars and the obstacle cells of
+ *	the map within a couple of meters go into a polar
+ *	histogram around the robot, one bin per 5 deg. An
+ *	obstacle weighs more the closer it is and lands in
+ *	every bin the robot's width would hit it from
+ *	(Borenstein and Koren 1991, Ulrich and Borenstein's
+ *	VFH+ 1998). The gaps between the blocked bins are the
+ *	valleys the robot can go through, it takes the one
+ *	closest to where it wants to go and slows down for
+ *	whatever is ahead and for sharp turns.
+ *
+ *	A bin keeps the weight of the closest obstacle in it
+ *	rather than the sum, the sonar cone arcs leave ghost
+ *	cells along the walls that would otherwise add up to
+ *	block a corridor the robot fits through. A map cell
+ *	also counts by how sure the map is of it, squared,
+ *	an arc painted once or twice hardly counts, a wall
+ *	seen over and over does. Echoes count on the sonar's
+ *	axis, they are this cycle's news.
+ *
+ *	Everything that depends on where an obstacle is
+ *	relative to the robot (its weight, the bins it
+ *	blocks) is worked out once into tables, one entry per
+ *	cell offset in the window and per range step of a
+ *	sonar, so a cycle is a few table lookups per
+ *	obstacle. The obstacle cells come word by word off
+ *	the global bit plane, empty words are skipped.
+ *
+ *	Corridors made the ladder swing from wall to wall.
+ *	Here a bin turns blocked with an obstacle within
+ *	blockDistance but only turns free again once it is
+ *	past clearDistance, and the direction picked last
+ *	cycle costs less to keep, so the robot doesn't hop
+ *	between two valleys that are about as good.
+ *
+ *	A map cell only drops out once the sonars carved it
+ *	below LOGODDS_OBSTACLE, a reading without an echo says
+ *	nothing about it: glass or a panel at a slant bounces
+ *	the ping away and is still there. The robot only slows
+ *	down for what is within blockDistance ahead, not for
+ *	anything in the window.
+ ********************************************************/
+
+#ifndef VECTOR_FIELD_HISTOGRAM_H
+#define VECTOR_FIELD_HISTOGRAM_H
+
+#include "sonar_model.h"
+#include "bit_planes.h"
+
+#include <vector>
+
+#define VFH_SECTORS		72		//bins around the robot, 5 deg each
+#define VFH_RANGE_STEP	25		//[mm] sonar ranges in the weight table
+
+struct VfhParams
+{
+	double windowRadius;	//[mm] obstacles farther out don't count
+	double robotRadius;		//[mm] half the robot's width plus a safety margin, obstacles are grown by it
+	double blockDistance;	//[mm] a bin turns blocked with an obstacle this close in it
+	double clearDistance;	//[mm] and free again once the closest is this far
+	double stopDistance;	//[mm] the robot stops for an obstacle this close straight ahead
+	int wideValley;			//[bins] valleys this wide get a candidate along each side instead of the middle
+	double targetCost;		//cost per degree off the target direction
+	double headingCost;		//off the robot's heading
+	double previousCost;	//off the direction picked last cycle
+	double maxSpeed;		//[mm/s]
+	double maxTurn;			//[deg] heading change per cycle
+	double stopTurn;		//[deg] turns this sharp are done standing
+
+	VfhParams()
+		: windowRadius(2000), robotRadius(350), blockDistance(1000), clearDistance(1200), stopDistance(400),
+		  wideValley(8), targetCost(5), headingCost(2), previousCost(2), maxSpeed(300), maxTurn(20), stopTurn(180) {}
+};
+
+struct SteeringCommand
+{
+	double speed;		//[mm/s]
+	double turn;		//[deg] heading change, at most maxTurn either way
+	double heading;		//[deg] direction picked, map frame
+	bool blocked;		//no valley at all, turning in place
+	int valleys;
+	double seconds;		//the whole decision
+};
+
+class VectorFieldHistogram
+{
+public:
+	VectorFieldHistogram(double cellSize = 100, const VfhParams &params = VfhParams());
+
+	/*
+	 *	Obstacle cells of the map to go by besides the sonars, map and
+	 *	obstacles have to stay alive while they are set. NULL for the
+	 *	sonars alone, while the robot doesn't know where on the map it is
+	 */
+	void setMap(const logodds_grid* map, const BitPlane* obstacles) { myMap = map; myObstacles = obstacles; }
+
+	/*
+	 *	Picks the direction and speed for this cycle from the robot at
+	 *	(x, y, th) on the map [mm] [deg], the latest range of each sonar
+	 *	and their angles on the robot. target [deg] is where the robot
+	 *	wants to go, hasTarget false keeps the current heading.
+	 */
+	SteeringCommand decide(double x, double y, double th, const float* range, const float* sensorTh,
+						   double target, bool hasTarget);
+
+	/*
+	 *	Smoothed obstacle weight of the last decision, (1 - d / windowRadius)^2
+	 *	of the closest obstacle in the bin, bin k covers [5k, 5k + 5) deg in the map frame
+	 */
+	const float* getHistogram() const { return mySmoothed; }
+
+	size_t getMemoryUsage() const
+	{
+		return myCells.size() * sizeof(CellEntry) + myRanges.size() * sizeof(RangeEntry);
+	}
+
+private:
+	//bins [first, first + count) of the doubled histogram, weight in each
+	struct CellEntry
+	{
+		float weight;
+		short first;
+		short count;
+	};
+
+	//bins either side of the echo's own
+	struct RangeEntry
+	{
+		float weight;
+		short spread;
+	};
+
+	double weight(double d) const;
+	void buildTables();
+	void addCells(double x, double y);
+	void addCell(int dx, int dy, float certainty);
+	double cost(double direction, double target, double th) const;
+
+	VfhParams myParams;
+	double myCellSize;
+	int myRadius;						//[cells] of the window
+	int myWidth;						//2 * myRadius + 1
+	std::vector<CellEntry> myCells;		//per cell offset in the window, row by row from (-r, -r)
+	std::vector<RangeEntry> myRanges;	//per VFH_RANGE_STEP of sonar range
+
+	const logodds_grid* myMap;
+	const BitPlane* myObstacles;
+
+	float myHigh, myLow;				//weights of blockDistance and clearDistance
+	float myDoubled[2 * VFH_SECTORS];	//a bin and the one 360 deg on, so a spread never wraps
+	float mySmoothed[VFH_SECTORS];
+	unsigned char myBlocked[VFH_SECTORS];
+	double myPrevious;					//[deg] direction picked last cycle
+	bool myHasPrevious;
+	double myLastTurn;					//turning in place keeps going the same way
+
+	VectorFieldHistogram(const VectorFieldHistogram&);
+	VectorFieldHistogram& operator=(const VectorFieldHistogram&);
+};
+
+#endif
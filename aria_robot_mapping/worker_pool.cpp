@@ -0,0 +1,80 @@
+/********************************************************
+ *	Worker threads kept for the life of their owner, see
+ *	worker_pool.h
+ ********************************************************/
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(int threads)
+	: myParts(0), myNext(0), myPending(0), myStop(false)
+{
+	if(threads <= 0)
+		threads = (int)boost::thread::hardware_concurrency();
+	for(int t = 1; t < threads; t++)
+		myThreads.push_back(new boost::thread(&WorkerPool::workerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		boost::mutex::scoped_lock lock(myMutex);
+		myStop = true;
+	}
+	myWake.notify_all();
+	for(size_t t = 0; t < myThreads.size(); t++)
+	{
+		myThreads[t]->join();
+		delete myThreads[t];
+	}
+}
+
+void WorkerPool::run(const boost::function<void (int)> &job, int parts)
+{
+	//nothing to split, or nobody to split it with
+	if(parts <= 1 || myThreads.empty())
+	{
+		for(int part = 0; part < parts; part++)
+			job(part);
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(myMutex);
+	myJob = job;
+	myParts = parts;
+	myNext = 0;
+	myPending = parts;
+	myWake.notify_all();
+
+	//this thread takes parts like any worker, then waits for the ones still running
+	while(myNext < myParts)
+	{
+		int part = myNext++;
+		lock.unlock();
+		job(part);
+		lock.lock();
+		myPending--;
+	}
+	while(myPending > 0)
+		myDone.wait(lock);
+	myJob.clear();
+}
+
+void WorkerPool::workerLoop()
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	while(true)
+	{
+		while(myNext >= myParts && !myStop)
+			myWake.wait(lock);
+		if(myStop)
+			return;
+
+		//myJob stays put until the last part is done
+		int part = myNext++;
+		lock.unlock();
+		myJob(part);
+		lock.lock();
+		if(--myPending == 0)
+			myDone.notify_all();
+	}
+}
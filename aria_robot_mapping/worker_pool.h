@@ -0,0 +1,54 @@
+/********************************************************
+ *	Worker threads kept for the life of their owner
+ *
+ *	The scan matcher and the particle filter split every
+ *	cycle's work over the cores. Starting and joining a
+ *	thread per core each cycle costs about as much as the
+ *	work itself at 16 echoes or a few hundred particles,
+ *	so WorkerPool starts its threads once and hands them
+ *	the parts of each job. The calling thread takes parts
+ *	too and run() returns once every part is done, the
+ *	job's state is the caller's again after that.
+ *
+ *	One run() at a time, it is meant for one owner.
+ ********************************************************/
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include <vector>
+
+class WorkerPool
+{
+public:
+	//threads including the caller's, 0 for one per core
+	WorkerPool(int threads = 0);
+	~WorkerPool();
+
+	int size() const { return (int)myThreads.size() + 1; }
+
+	//calls job(part) for every part in [0, parts), spread over the threads, and waits for all of them
+	void run(const boost::function<void (int)> &job, int parts);
+
+private:
+	void workerLoop();
+
+	std::vector<boost::thread*> myThreads;
+
+	boost::mutex myMutex;
+	boost::condition_variable myWake;	//a job came in, or stop
+	boost::condition_variable myDone;	//its last part finished
+	boost::function<void (int)> myJob;
+	int myParts;
+	int myNext;				//next part nobody took yet
+	int myPending;			//parts not finished yet
+	bool myStop;
+
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif
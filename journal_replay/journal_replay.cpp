@@ -0,0 +1,108 @@
+/********************************************************
+ *	Journal replay
+ *
+ *	Rebuilds the map of a mapping run as it was after any
+ *	cycle from the journal aria_robot_mapping writes, no
+ *	robot or ARIA needed. Writes the result as a map file
+ *	plus robot_map.dat/robot_map_origin.dat for the MATLAB
+ *	script and robot_map_replay.png/.yaml for viewers, and
+ *	prints how fast the replay went.
+ *
+ *	usage: journal_replay [prefix] [cycle] [step]
+ *		prefix	journal file prefix, robot_map by default
+ *		cycle	cycle to stop at, the end of the journal if left out
+ *		step	also replay from the start every step cycles and
+ *				print the map size, to see how the map grew
+ ********************************************************/
+
+#include "../aria_robot_mapping/tiled_grid.h"
+#include "../aria_robot_mapping/sonar_model.h"
+#include "../aria_robot_mapping/map_file.h"
+#include "../aria_robot_mapping/map_journal.h"
+#include "../aria_robot_mapping/map_export.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+//number of cells the map calls obstacles
+static int count_obstacles(const logodds_grid &grid)
+{
+	int count = 0;
+	for(int slot = 0; slot < grid.getNumTiles(); slot++)
+	{
+		const float* cells = grid.getTileData(slot);
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+			if(cells[c] > LOGODDS_OBSTACLE)
+				count++;
+	}
+	return count;
+}
+
+int main(int argc, char** argv)
+{
+	const char* prefix = argc > 1 ? argv[1] : "robot_map";
+	uint32_t cycle = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : JOURNAL_LAST_CYCLE;
+	uint32_t step = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : 0;
+
+	vector<uint32_t> segments;
+	if(!read_journal_index(prefix, segments))
+	{
+		cout << "No journal index " << prefix << ".idx" << endl;
+		return 1;
+	}
+	cout << segments.size() << " segments, first starts after cycle " << segments[0] << endl;
+
+	if(step > 0)
+	{
+		uint32_t last = JOURNAL_LAST_CYCLE;
+		for(uint32_t c = segments[0] + step; c <= cycle; c += step)
+		{
+			logodds_grid grid(0);
+			uint32_t reached;
+			if(!replay_journal(prefix, c, grid, reached) || reached == last)
+				break;
+			last = reached;
+			cout << "cycle " << setw(8) << reached << ": " << setw(6) << grid.getNumTiles() << " tiles, "
+				 << setw(8) << count_obstacles(grid) << " obstacle cells" << endl;
+		}
+	}
+
+	double start = now_seconds();
+	logodds_grid grid(0);
+	uint32_t reached = 0;
+	if(!replay_journal(prefix, cycle, grid, reached))
+	{
+		cout << "Could not replay " << prefix << " to cycle " << cycle << endl;
+		return 1;
+	}
+	double seconds = now_seconds() - start;
+
+	//cycles since the snapshot replay started from, that's what the time was spent on
+	size_t s = 0;
+	while(s + 1 < segments.size() && segments[s + 1] <= reached)
+		s++;
+	uint32_t replayed = reached - segments[s];
+
+	cout << "Map after cycle " << reached << ": " << grid.getNumTiles() << " tiles, "
+		 << count_obstacles(grid) << " obstacle cells" << endl;
+	cout << "Replayed " << replayed << " cycles from the snapshot after cycle " << segments[s]
+		 << " in " << fixed << setprecision(3) << seconds * 1e3 << " ms";
+	if(seconds > 0)
+		cout << ", " << setprecision(0) << replayed / seconds << " cycles/s";
+	cout << endl;
+
+	if(!write_map_file("robot_map_replay.bin", grid, reached))
+		cout << "Could not write robot_map_replay.bin" << endl;
+	if(!export_map_image(grid, "robot_map_replay", MAP_IMAGE_PNG))
+		cout << "Could not write robot_map_replay.png" << endl;
+	if(!write_map_dat(grid, "robot_map"))
+		cout << "Could not write robot_map.dat" << endl;
+	cout << "Wrote robot_map_replay.bin, robot_map_replay.png, robot_map.dat and robot_map_origin.dat" << endl;
+	return 0;
+}
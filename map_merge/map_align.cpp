@@ -0,0 +1,280 @@
+/********************************************************
+ *	Rigid alignment of two sonar maps, see map_align.h
+ ********************************************************/
+
+#include "map_align.h"
+
+#include <cmath>
+#include <queue>
+#include <boost/thread.hpp>
+
+#ifndef PI
+#define PI	3.14159265358979
+#endif
+
+//state shared by the worker threads of one align()
+struct MapCorrelator::Search
+{
+	std::vector<double> qx, qy;		//obstacle cell centers of the aligned map, about their centroid [cells]
+	std::vector<double> angles;		//[rad] in the order they get tried
+
+	boost::mutex mutex;
+	float best;
+	int bestRotation;
+	int bestX, bestY;
+};
+
+MapCorrelator::MapCorrelator(const logodds_grid &reference, int levels)
+	: myMinX(0), myMinY(0), myWidth(0), myHeight(0), myCellSize(reference.getCellSize())
+{
+	if(levels < 1)
+		levels = 1;
+
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	reference.getCellBounds(min_x, min_y, max_x, max_y);
+
+	//padding below the map, so a block that starts left of it still gets the cells it reaches into
+	int pad = 1 << (levels - 1);
+	myMinX = min_x - pad;
+	myMinY = min_y - pad;
+	myWidth = max_x - min_x + 1 + pad;
+	myHeight = max_y - min_y + 1 + pad;
+	if(max_x < min_x)
+		myWidth = myHeight = 0;
+
+	myLevels.resize(levels);
+	std::vector<float> raw((size_t)myWidth * myHeight, 0);
+	for(int y = 0; y < myHeight; y++)
+	{
+		for(int x = 0; x < myWidth; x++)
+		{
+			float v = reference.get(x + myMinX, y + myMinY);
+			raw[(size_t)y * myWidth + x] = v > 0 ? v : 0;
+		}
+	}
+
+	//sonar walls are a cell or two off between runs, half credit for landing next to one
+	std::vector<float> &level0 = myLevels[0];
+	level0.assign(raw.size(), 0);
+	for(int y = 0; y < myHeight; y++)
+	{
+		for(int x = 0; x < myWidth; x++)
+		{
+			float m = raw[(size_t)y * myWidth + x];
+			for(int dy = -1; dy <= 1; dy++)
+			{
+				for(int dx = -1; dx <= 1; dx++)
+				{
+					int nx = x + dx, ny = y + dy;
+					if(nx < 0 || ny < 0 || nx >= myWidth || ny >= myHeight)
+						continue;
+					float half = 0.5f * raw[(size_t)ny * myWidth + nx];
+					if(half > m)
+						m = half;
+				}
+			}
+			level0[(size_t)y * myWidth + x] = m;
+		}
+	}
+
+	//level k at (x, y) is the max of the 2^k x 2^k cells from (x, y) up, four lookups into level k - 1
+	for(int level = 1; level < levels; level++)
+	{
+		const std::vector<float> &below = myLevels[level - 1];
+		std::vector<float> &grid = myLevels[level];
+		grid.assign(raw.size(), 0);
+		int h = 1 << (level - 1);
+		for(int y = 0; y < myHeight; y++)
+		{
+			for(int x = 0; x < myWidth; x++)
+			{
+				float m = below[(size_t)y * myWidth + x];
+				if(x + h < myWidth && below[(size_t)y * myWidth + x + h] > m)
+					m = below[(size_t)y * myWidth + x + h];
+				if(y + h < myHeight)
+				{
+					if(below[(size_t)(y + h) * myWidth + x] > m)
+						m = below[(size_t)(y + h) * myWidth + x];
+					if(x + h < myWidth && below[(size_t)(y + h) * myWidth + x + h] > m)
+						m = below[(size_t)(y + h) * myWidth + x + h];
+				}
+				grid[(size_t)y * myWidth + x] = m;
+			}
+		}
+	}
+}
+
+float MapCorrelator::score(int level, const std::vector<int> &px, const std::vector<int> &py, int tx, int ty) const
+{
+	const float* grid = &myLevels[level][0];
+	float sum = 0;
+	for(size_t i = 0; i < px.size(); i++)
+	{
+		int x = px[i] + tx;
+		int y = py[i] + ty;
+		if((unsigned int)x >= (unsigned int)myWidth || (unsigned int)y >= (unsigned int)myHeight)
+			continue;
+		sum += grid[(size_t)y * myWidth + x];
+	}
+	return sum;
+}
+
+/*
+ *	Branch and bound over the translations of every stride-th rotation.
+ *	The first full resolution candidate off the queue beats every block
+ *	still on it, so it is the best translation for that rotation.
+ */
+void MapCorrelator::searchRotations(Search &search, int first, int stride) const
+{
+	int top = (int)myLevels.size() - 1;
+	int step = 1 << top;
+	std::vector<int> px(search.qx.size()), py(search.qy.size());
+
+	for(int r = first; r < (int)search.angles.size(); r += stride)
+	{
+		double c = cos(search.angles[r]), s = sin(search.angles[r]);
+		int lo_x = 0, hi_x = 0, lo_y = 0, hi_y = 0;
+		for(size_t i = 0; i < px.size(); i++)
+		{
+			px[i] = (int)floor(c * search.qx[i] - s * search.qy[i]);
+			py[i] = (int)floor(s * search.qx[i] + c * search.qy[i]);
+			if(i == 0 || px[i] < lo_x) lo_x = px[i];
+			if(i == 0 || px[i] > hi_x) hi_x = px[i];
+			if(i == 0 || py[i] < lo_y) lo_y = py[i];
+			if(i == 0 || py[i] > hi_y) hi_y = py[i];
+		}
+
+		search.mutex.lock();
+		float best = search.best;
+		search.mutex.unlock();
+
+		//every translation that puts at least one point on the reference
+		std::priority_queue<Candidate> queue;
+		for(int ty = -hi_y; ty <= myHeight - 1 - lo_y; ty += step)
+		{
+			for(int tx = -hi_x; tx <= myWidth - 1 - lo_x; tx += step)
+			{
+				Candidate cand = { score(top, px, py, tx, ty), top, tx, ty };
+				if(cand.bound > best)
+					queue.push(cand);
+			}
+		}
+
+		while(!queue.empty())
+		{
+			Candidate cand = queue.top();
+			queue.pop();
+			if(cand.bound <= best)
+				break;
+
+			if(cand.level == 0)
+			{
+				search.mutex.lock();
+				if(cand.bound > search.best)
+				{
+					search.best = cand.bound;
+					search.bestRotation = r;
+					search.bestX = cand.tx;
+					search.bestY = cand.ty;
+				}
+				search.mutex.unlock();
+				break;
+			}
+
+			int h = 1 << (cand.level - 1);
+			for(int dy = 0; dy <= h; dy += h)
+			{
+				for(int dx = 0; dx <= h; dx += h)
+				{
+					Candidate child = { score(cand.level - 1, px, py, cand.tx + dx, cand.ty + dy), cand.level - 1, cand.tx + dx, cand.ty + dy };
+					if(child.bound > best)
+						queue.push(child);
+				}
+			}
+		}
+	}
+}
+
+MapAlignment MapCorrelator::align(const logodds_grid &map, const AlignParams &params) const
+{
+	MapAlignment result = { 0, 0, 0, 0, 0, 0 };
+
+	//obstacle cells of the map, centered on their centroid so rotations don't swing them off
+	Search search;
+	double sum_x = 0, sum_y = 0;
+	for(int slot = 0; slot < map.getNumTiles(); slot++)
+	{
+		const float* cells = map.getTileData(slot);
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+		{
+			if(cells[c] <= LOGODDS_OBSTACLE)
+				continue;
+			double x = (map.getTileX(slot) << logodds_grid::TILE_SHIFT) + (c & logodds_grid::TILE_MASK) + 0.5;
+			double y = (map.getTileY(slot) << logodds_grid::TILE_SHIFT) + (c >> logodds_grid::TILE_SHIFT) + 0.5;
+			search.qx.push_back(x);
+			search.qy.push_back(y);
+			sum_x += x;
+			sum_y += y;
+		}
+	}
+	result.points = (int)search.qx.size();
+	if(search.qx.empty() || myWidth == 0)
+		return result;
+
+	double center_x = sum_x / search.qx.size();
+	double center_y = sum_y / search.qy.size();
+	double radius = 1;
+	for(size_t i = 0; i < search.qx.size(); i++)
+	{
+		search.qx[i] -= center_x;
+		search.qy[i] -= center_y;
+		double r = sqrt(search.qx[i] * search.qx[i] + search.qy[i] * search.qy[i]);
+		if(r > radius)
+			radius = r;
+	}
+
+	//rotations from 0 outwards, alternating sides, so a good score turns up early and prunes the rest
+	double step = params.rotationStep > 0 ? params.rotationStep : atan2(1.0, radius) * 180 / PI;
+	int count = (int)(params.maxRotation / step);
+	search.angles.push_back(0);
+	for(int k = 1; k <= count; k++)
+	{
+		search.angles.push_back(k * step * PI / 180);
+		if(k * step < 180)
+			search.angles.push_back(-k * step * PI / 180);
+	}
+
+	search.best = 0;
+	search.bestRotation = -1;
+	search.bestX = search.bestY = 0;
+
+	int threads = params.threads > 0 ? params.threads : (int)boost::thread::hardware_concurrency();
+	if(threads < 1)
+		threads = 1;
+	boost::thread_group workers;
+	for(int t = 0; t < threads; t++)
+		workers.add_thread(new boost::thread(&MapCorrelator::searchRotations, this, boost::ref(search), t, threads));
+	workers.join_all();
+
+	if(search.bestRotation < 0)
+		return result;
+
+	//a point lands on cell floor(R q) + t of the arrays, that is R (p - center) + t + min in map cells
+	double th = search.angles[search.bestRotation];
+	double c = cos(th), s = sin(th);
+	result.th = th * 180 / PI;
+	result.x = (search.bestX + myMinX - (c * center_x - s * center_y)) * myCellSize;
+	result.y = (search.bestY + myMinY - (s * center_x + c * center_y)) * myCellSize;
+	result.score = search.best;
+
+	const std::vector<float> &level0 = myLevels[0];
+	for(size_t i = 0; i < search.qx.size(); i++)
+	{
+		int x = (int)floor(c * search.qx[i] - s * search.qy[i]) + search.bestX;
+		int y = (int)floor(s * search.qx[i] + c * search.qy[i]) + search.bestY;
+		if((unsigned int)x < (unsigned int)myWidth && (unsigned int)y < (unsigned int)myHeight
+		   && level0[(size_t)y * myWidth + x] > LOGODDS_OBSTACLE)
+			result.matched++;
+	}
+	return result;
+}
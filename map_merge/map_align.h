@@ -0,0 +1,81 @@
+/********************************************************
+ *	Rigid alignment of two sonar maps
+ *
+ *	Every run starts its odometry frame wherever the robot
+ *	was put down, so the same room comes out shifted and
+ *	turned from one run to the next. MapCorrelator finds
+ *	the rotation and translation that lays the obstacle
+ *	cells of one map over the occupancy of another.
+ *
+ *	For each rotation the translations are searched with
+ *	branch and bound over a stack of max filtered copies
+ *	of the reference: a cell of level k holds the largest
+ *	value in the 2^k x 2^k block starting at it, so scoring
+ *	a translation on level k gives an upper bound for all
+ *	2^k x 2^k translations next to it. Blocks are opened
+ *	best first and a whole block gets dropped as soon as
+ *	its bound can't beat the best full resolution score,
+ *	which makes the result the same as trying every
+ *	translation at every rotation, just much faster.
+ *
+ *	Rotations are split between worker threads, which
+ *	share the best score so far for pruning.
+ ********************************************************/
+
+#ifndef MAP_ALIGN_H
+#define MAP_ALIGN_H
+
+#include "../aria_robot_mapping/sonar_model.h"
+
+#include <vector>
+
+//rigid transform taking a point of the aligned map into the reference: p' = R(th) p + (x, y)
+struct MapAlignment
+{
+	double x, y;		//[mm]
+	double th;			//[deg]
+	double score;		//sum of reference occupancy under the aligned obstacle cells
+	int points;			//obstacle cells in the aligned map
+	int matched;		//of those, landing on a reference obstacle
+};
+
+struct AlignParams
+{
+	double maxRotation;		//[deg] search +- this much, 180 for any heading
+	double rotationStep;	//[deg] 0 picks a step that moves the outermost cell by about one cell
+	int levels;				//max filter levels, including full resolution
+	int threads;			//0 for one per core
+
+	AlignParams() : maxRotation(180), rotationStep(0), levels(7), threads(0) {}
+};
+
+class MapCorrelator
+{
+public:
+	//the reference is copied into flat arrays, it can change after this
+	MapCorrelator(const logodds_grid &reference, int levels);
+
+	//best transform of map onto the reference, map must use the same cell size
+	MapAlignment align(const logodds_grid &map, const AlignParams &params) const;
+
+private:
+	struct Candidate
+	{
+		float bound;
+		int level;
+		int tx, ty;
+		bool operator<(const Candidate &other) const { return bound < other.bound; }
+	};
+
+	struct Search;
+
+	float score(int level, const std::vector<int> &px, const std::vector<int> &py, int tx, int ty) const;
+	void searchRotations(Search &search, int first, int stride) const;
+
+	int myMinX, myMinY;				//reference cell of array element 0
+	int myWidth, myHeight;
+	double myCellSize;
+	std::vector< std::vector<float> > myLevels;		//row major, y * myWidth + x
+};
+
+#endif
@@ -0,0 +1,242 @@
+/********************************************************
+ *	Map merge
+ *
+ *	Lines up the maps of several mapping runs of the same
+ *	place and fuses them into one. Each run has its own
+ *	odometry frame, so every map after the first is
+ *	aligned (MapCorrelator, see map_align.h) against
+ *	everything merged so far and then added in, log-odds
+ *	adding up like they would have if one run had seen it
+ *	all. Maps can be the robot_map.bin checkpoint of a run,
+ *	the robot_map.rle export or the robot_map.dat the
+ *	MATLAB script reads, a .dat only has obstacles in it
+ *	but lines up all the same.
+ *
+ *	usage: map_merge <map> <map> [map...] [-out prefix]
+ *				[-rotation deg] [-threads n]
+ *		-out		output file prefix, map_merged by default.
+ *					Writes <prefix>.bin, <prefix>.dat,
+ *					<prefix>_origin.dat and <prefix>.png/.yaml
+ *		-rotation	search headings within +- deg of the first
+ *					map, 180 (any heading) by default
+ *		-threads	worker threads, one per core by default
+ ********************************************************/
+
+#include "map_align.h"
+#include "../aria_robot_mapping/map_file.h"
+#include "../aria_robot_mapping/map_export.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+#ifndef PI
+#define PI	3.14159265358979
+#endif
+
+/*
+ *	Reads a .dat map, rows are x and columns are y like aria_robot_mapping
+ *	writes them. The cell of the first row and column comes from the
+ *	matching _origin.dat if there is one, obstacles come in at full
+ *	log-odds since the .dat doesn't keep how sure the map was.
+ */
+static bool load_dat(const string &path, logodds_grid &grid)
+{
+	ifstream input(path.c_str());
+	if(!input)
+		return false;
+
+	int min_x = 0, min_y = 0;
+	string origin_path = path.substr(0, path.size() - 4) + "_origin.dat";
+	ifstream origin(origin_path.c_str());
+	if(origin)
+		origin >> min_x >> min_y;
+
+	string line;
+	for(int i = min_x; getline(input, line); i++)
+	{
+		istringstream row(line);
+		int value;
+		for(int j = min_y; row >> value; j++)
+			if(value)
+				grid.at(i, j) = LOGODDS_MAX;
+	}
+	return true;
+}
+
+static bool is_dat(const string &path)
+{
+	return path.size() > 4 && path.compare(path.size() - 4, 4, ".dat") == 0;
+}
+
+static bool is_rle(const string &path)
+{
+	return path.size() > 4 && path.compare(path.size() - 4, 4, ".rle") == 0;
+}
+
+//cell size a map was made with, from the map or .rle file header or the _origin.dat, 100mm if none says
+static double map_cell_size(const string &path)
+{
+	double cell_size = 100;
+	if(is_dat(path))
+	{
+		int min_x, min_y;
+		ifstream origin((path.substr(0, path.size() - 4) + "_origin.dat").c_str());
+		if(origin)
+			origin >> min_x >> min_y >> cell_size;
+	}
+	else if(is_rle(path))
+	{
+		MapRleHeader header;
+		ifstream input(path.c_str(), ios::binary);
+		if(input.read((char*)&header, sizeof(header)) && memcmp(header.magic, MAP_RLE_MAGIC, sizeof(header.magic)) == 0)
+			cell_size = header.cellSize;
+	}
+	else
+	{
+		MapFileView view;
+		if(view.open(path.c_str()))
+			cell_size = view.getHeader()->cellSize;
+	}
+	return cell_size;
+}
+
+static bool load_map(const string &path, logodds_grid &grid)
+{
+	if(is_rle(path))
+		return load_map_rle(path.c_str(), grid);
+	return is_dat(path) ? load_dat(path, grid) : load_map_file(path.c_str(), grid);
+}
+
+/*
+ *	Adds map into merged under the alignment. Each merged cell the map
+ *	could land on looks up the map cell under it, so a turned map leaves
+ *	no holes, and cells the map never saw add nothing.
+ */
+static void fuse_map(logodds_grid &merged, const logodds_grid &map, const MapAlignment &align)
+{
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	map.getCellBounds(min_x, min_y, max_x, max_y);
+	if(max_x < min_x)
+		return;
+
+	double cell = map.getCellSize();
+	double c = cos(align.th * PI / 180), s = sin(align.th * PI / 180);
+	double tx = align.x / cell, ty = align.y / cell;
+
+	//bounding box of the turned map, in merged cells
+	double lo_x = 1e30, lo_y = 1e30, hi_x = -1e30, hi_y = -1e30;
+	for(int corner = 0; corner < 4; corner++)
+	{
+		double x = (corner & 1) ? max_x + 1 : min_x;
+		double y = (corner & 2) ? max_y + 1 : min_y;
+		double mx = c * x - s * y + tx;
+		double my = s * x + c * y + ty;
+		lo_x = min(lo_x, mx);
+		hi_x = max(hi_x, mx);
+		lo_y = min(lo_y, my);
+		hi_y = max(hi_y, my);
+	}
+
+	for(int y = (int)floor(lo_y); y <= (int)floor(hi_y); y++)
+	{
+		for(int x = (int)floor(lo_x); x <= (int)floor(hi_x); x++)
+		{
+			//merged cell center back into the map's frame
+			double dx = x + 0.5 - tx, dy = y + 0.5 - ty;
+			int sx = (int)floor(c * dx + s * dy);
+			int sy = (int)floor(-s * dx + c * dy);
+			if(map.findTileData(sx, sy) == NULL)
+				continue;
+			float v = map.get(sx, sy);
+			if(v == 0)
+				continue;
+
+			float &cell_value = merged.at(x, y);
+			cell_value += v;
+			if(cell_value > LOGODDS_MAX)
+				cell_value = LOGODDS_MAX;
+			if(cell_value < LOGODDS_MIN)
+				cell_value = LOGODDS_MIN;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> paths;
+	string prefix = "map_merged";
+	AlignParams params;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+			prefix = argv[++i];
+		else if(strcmp(argv[i], "-rotation") == 0 && i + 1 < argc)
+			params.maxRotation = atof(argv[++i]);
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			params.threads = atoi(argv[++i]);
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if(paths.size() < 2)
+	{
+		cout << "usage: map_merge <map> <map> [map...] [-out prefix] [-rotation deg] [-threads n]" << endl;
+		return 1;
+	}
+
+	//the first map sets the frame and the cell size
+	double cell_size = map_cell_size(paths[0]);
+	logodds_grid merged(0, cell_size);
+	if(!load_map(paths[0], merged))
+	{
+		cout << "Could not read " << paths[0] << endl;
+		return 1;
+	}
+
+	double start = now_seconds();
+	for(size_t m = 1; m < paths.size(); m++)
+	{
+		if(map_cell_size(paths[m]) != cell_size)
+		{
+			cout << paths[m] << " has " << map_cell_size(paths[m]) << "mm cells, not " << cell_size << ", skipping it" << endl;
+			continue;
+		}
+		logodds_grid map(0, cell_size);
+		if(!load_map(paths[m], map))
+		{
+			cout << "Could not read " << paths[m] << ", skipping it" << endl;
+			continue;
+		}
+
+		double align_start = now_seconds();
+		MapCorrelator correlator(merged, params.levels);
+		MapAlignment align = correlator.align(map, params);
+		double align_seconds = now_seconds() - align_start;
+
+		cout << paths[m] << ": x " << align.x << "mm, y " << align.y << "mm, heading " << align.th << " deg, "
+			 << align.matched << " of " << align.points << " obstacle cells on the merged map ("
+			 << align_seconds << " s)" << endl;
+		if(align.points > 0 && align.matched * 4 < align.points)
+			cout << "  less than a quarter lines up, the runs may not overlap enough" << endl;
+
+		fuse_map(merged, map, align);
+	}
+	cout << "Merged " << paths.size() << " maps in " << now_seconds() - start << " s" << endl;
+
+	if(!write_map_file((prefix + ".bin").c_str(), merged, 0))
+		cout << "Could not write " << prefix << ".bin" << endl;
+	if(!write_map_dat(merged, prefix.c_str()))
+		cout << "Could not write " << prefix << ".dat" << endl;
+	if(!export_map_image(merged, prefix.c_str(), MAP_IMAGE_PNG))
+		cout << "Could not write " << prefix << ".png" << endl;
+	return 0;
+}
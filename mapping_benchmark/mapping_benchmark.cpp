@@ -0,0 +1,1540 @@
+/********************************************************
+ *	Mapping benchmark
+ *
+ *	Runs the mapping kernels on synthetic sonar cycles
+ *	without a robot and reports how many cell updates
+ *	per second each one manages. The "legacy" kernel is
+ *	the original fuzzy_map_obstacles/fuzzy_map_empty pair
+ *	(int grid, 18 sin/cos per cone) with the robot calls
+ *	replaced by plain values.
+ *
+ *	Then the tile directory of the grid is filled as one
+ *	long row of tiles, a column and a block, with the
+ *	probe lengths and the cost of a cell read for each.
+ *
+ *	After that a simulated P3-AT drives through the lab,
+ *	the hall and the long hall (sonar_world.h) and the
+ *	whole mapper runs on what its sonars see. Besides the
+ *	speed that reports the memory the map took and the
+ *	precision and recall of its obstacle cells against
+ *	the real walls, then what the pyramid, the distance
+ *	map, the frontiers and the bit planes add to a
+ *	cycle, what whole-map bit plane operations cost
+ *	against the old int layers, how much scan
+ *	matching takes out of odometry drift and how fast
+ *	the particle filter finds the robot on the map of
+ *	an earlier run and how long writing the map out
+ *	takes as .dat text, PNG and run-length file. Then the robot drives the world
+ *	again, steered by the old sonar if/else ladder and
+ *	by the vector field histogram, with the sonars
+ *	simulated each cycle from wherever it got to.
+ *
+ *	Last the path planner replans on random grids from
+ *	160x160 up to 2000x2000 cells while the robot walks
+ *	its path and cells near it flip, against planning
+ *	each time from scratch, with a budget per step and
+ *	the robot boxed in once on the way.
+ *
+ *	usage: mapping_benchmark [cycles] [-logs]
+ *		-logs	also write each simulated run as a sensor log
+ *				(lab.srl, ...) for mapping_replay
+ ********************************************************/
+
+#include "../aria_robot_mapping/tiled_grid.h"
+#include "../aria_robot_mapping/sonar_model.h"
+#include "../aria_robot_mapping/sonar_snapshot.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+#include "../aria_robot_mapping/sonar_mapper.h"
+#include "../aria_robot_mapping/sensor_log.h"
+#include "../aria_robot_mapping/map_pyramid.h"
+#include "../aria_robot_mapping/distance_map.h"
+#include "../aria_robot_mapping/frontier_map.h"
+#include "../aria_robot_mapping/grid_planner.h"
+#include "../aria_robot_mapping/scan_matcher.h"
+#include "../aria_robot_mapping/likelihood_field.h"
+#include "../aria_robot_mapping/particle_localizer.h"
+#include "../aria_robot_mapping/bit_planes.h"
+#include "../aria_robot_mapping/vector_field_histogram.h"
+#include "../aria_robot_mapping/map_export.h"
+#include "../aria_robot_mapping/map_file.h"
+#include "sonar_world.h"
+
+#include <boost/multi_array.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <stack>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#define PI	3.14159
+#define WORLD_RUNS	5		//each world is mapped this many times, the fastest counts
+#define SCORE_TOLERANCE	1	//[cells] how far off an obstacle cell may be and still count
+#define PYRAMID_QUERIES	20000	//random region queries per world
+#define REBUILD_EVERY	100		//cycles between timed full distance map rebuilds
+#define DISTANCE_TOLERANCE	0.1	//[cells] the brushfire may be off the exact distance by this much
+#define PLANNER_STEPS	200		//robot steps along the path per planner grid
+#define PLANNER_CHANGES	4		//cells that flip near the robot each step
+#define PLANNER_SENSED	10		//[cells] how far from the robot they flip
+#define SCRATCH_EVERY	20		//steps between timed plans from scratch
+#define PLANNER_BUDGET	20000	//cells a repair may expand per step, the rest waits for the next
+#define LOCALIZE_FOUND	500		//[mm] particles this close together and to the truth have found the robot
+#define PLANES_DILATE	3		//[cells] obstacle growth timed on the bit planes
+#define PLANES_REPEAT	50		//times each whole-map operation runs for the timing
+#define DRIVE_TIME		600.0	//[s] a controller that hasn't made the round by then is stuck
+#define DRIVE_REACHED	400.0	//[mm] a waypoint this close is done
+#define DRIVE_TURN_RATE	100.0	//[deg/s] the P3-AT's top turning speed
+#define DRIVE_RADIUS	250.0	//[mm] half the P3-AT's width, closer to a wall is a bump
+#define DRIVE_WIGGLE	5.0		//[deg] turns at least this big count for the swings
+#define DIRECTORY_TILES	4096	//tiles each tile directory shape gets
+#define DIRECTORY_READS	1000000	//random cell reads timed per shape
+#define REPLAY_LOG		"scan_matching.srl"	//the scan matched run's log, replayed and removed again
+
+using namespace std;
+
+typedef boost::multi_array<int, 2> array_type;
+
+/*
+ *	One robot cycle worth of sonar data: pose plus 16 ranges and the
+ *	mounting angle of each sonar (P3-AT ring)
+ */
+struct SyntheticCycle
+{
+	double x, y, th;
+	float range[SONAR_COUNT];
+	float sensorTh[SONAR_COUNT];
+};
+
+//small LCG so every run sees the same readings
+static unsigned int bench_seed = 12345;
+double bench_rand()
+{
+	bench_seed = bench_seed * 1664525u + 1013904223u;
+	return (bench_seed >> 8) / 16777216.0;
+}
+
+void make_cycles(SyntheticCycle* cycles, int n)
+{
+	for(int c = 0; c < n; c++)
+	{
+		//robot wanders around the middle of an 8m x 8m room
+		cycles[c].x = 8000 + (bench_rand() - 0.5) * 2000;
+		cycles[c].y = 8000 + (bench_rand() - 0.5) * 2000;
+		cycles[c].th = (bench_rand() - 0.5) * 360;
+		for(int i = 0; i < SONAR_COUNT; i++)
+		{
+			//about one in eight readings is out of range, like in the lab
+			cycles[c].range[i] = (float)(bench_rand() < 0.125 ? 5000 : 300 + bench_rand() * 3700);
+			cycles[c].sensorTh[i] = P3AT_SONAR_TH[i];
+		}
+	}
+}
+
+//robot parked in the room, the sonars see the same walls every cycle give or take a few mm
+void make_stationary_cycles(SyntheticCycle* cycles, int n)
+{
+	float walls[SONAR_COUNT];
+	for(int i = 0; i < SONAR_COUNT; i++)
+		walls[i] = (float)(500 + bench_rand() * 3000);
+
+	for(int c = 0; c < n; c++)
+	{
+		cycles[c].x = 8000;
+		cycles[c].y = 8000;
+		cycles[c].th = 0;
+		for(int i = 0; i < SONAR_COUNT; i++)
+		{
+			cycles[c].range[i] = walls[i] + (float)((bench_rand() - 0.5) * 10);
+			cycles[c].sensorTh[i] = P3AT_SONAR_TH[i];
+		}
+	}
+}
+
+/*
+ *	Original kernel, cell math exactly as aria_robot_mapping used to do it
+ */
+void legacy_fuzzy_map( array_type &map, double value_center, double value_edge_near, double value_edge_far,
+					   double sonarReading, double sensorTh, double robotTh, double distanceThreshold,
+					   double robot_x_pos, double robot_y_pos,
+					   std::stack<double>* stack_x, std::stack<double>* stack_y )
+{
+	const double radial[3] = { -distanceThreshold, 0, distanceThreshold };
+	const double offset[3] = { 0, 12, -12 };
+	for(int r = 0; r < 3; r++)
+	{
+		for(int k = 0; k < 3; k++)
+		{
+			double cell_x = floor( (robot_x_pos + (sonarReading + radial[r]) * cos( ( (sensorTh + robotTh + offset[k]) / 180) * PI )) / 100) + 1;
+			double cell_y = floor( (robot_y_pos + (sonarReading + radial[r]) * sin( ( (sensorTh + robotTh + offset[k]) / 180) * PI )) / 100) + 1;
+			stack_x->push(cell_x);
+			stack_y->push(cell_y);
+			if(k == 0)
+				map[(int)cell_x][(int)cell_y] = (int)(r == 1 ? value_center : value_edge_near);
+			else
+				map[(int)cell_x][(int)cell_y] = (int)(value_edge_far * cos( (12/180) * PI));
+		}
+	}
+}
+
+//returns cell updates done
+double run_legacy(const SyntheticCycle* cycles, int n, double &seconds)
+{
+	array_type obstacles(boost::extents[160][160]);
+	array_type obstacles_new(boost::extents[160][160]);
+	array_type empty(boost::extents[160][160]);
+	array_type empty_new(boost::extents[160][160]);
+	std::stack<double> obstacle_x, obstacle_y, empty_x, empty_y;
+	double updates = 0;
+
+	double start = now_seconds();
+	for(int c = 0; c < n; c++)
+	{
+		for(int i = 0; i < SONAR_COUNT; i++)
+		{
+			double range = cycles[c].range[i];
+			if(range < SONAR_MAX_RANGE && range > SONAR_MIN_RANGE)
+			{
+				legacy_fuzzy_map( obstacles, 1, 0.8, 0.8, range, cycles[c].sensorTh[i], cycles[c].th, 10.0,
+								  cycles[c].x, cycles[c].y, &obstacle_x, &obstacle_y );
+				legacy_fuzzy_map( empty, 0, 0.5, 0.5, range, cycles[c].sensorTh[i], cycles[c].th, 10.0,
+								  cycles[c].x, cycles[c].y, &empty_x, &empty_y );
+				updates += 18;
+			}
+		}
+		while(!obstacle_x.empty())
+		{
+			obstacles_new[(int)obstacle_x.top()][(int)obstacle_y.top()] |= obstacles[(int)obstacle_x.top()][(int)obstacle_y.top()];
+			obstacle_x.pop();
+			obstacle_y.pop();
+		}
+		while(!empty_x.empty())
+		{
+			empty_new[(int)empty_x.top()][(int)empty_y.top()] &= empty[(int)empty_x.top()][(int)empty_y.top()];
+			empty_x.pop();
+			empty_y.pop();
+		}
+	}
+	seconds = now_seconds() - start;
+	return updates;
+}
+
+double run_batched(const SyntheticCycle* cycles, int n, double &seconds, double &unique)
+{
+	logodds_grid global(0);
+	CycleEvidence evidence;
+	ConeBatch batch;
+	double updates = 0;
+	unique = 0;
+
+	double start = now_seconds();
+	for(int c = 0; c < n; c++)
+	{
+		const SonarSnapshot snapshot = make_sonar_snapshot( cycles[c].x, cycles[c].y, cycles[c].th,
+															 cycles[c].range, cycles[c].sensorTh, SONAR_COUNT );
+		build_cone_batch( snapshot, 10.0, global.getCellSize(), batch );
+		updates += apply_cone_batch( batch, global, evidence );
+		merge_evidence( evidence, global );
+		unique += evidence.dirty.size();
+		evidence.dirty.clear();
+	}
+	seconds = now_seconds() - start;
+	return updates;
+}
+
+//batched plus carving the free space along every beam, what SonarMapper runs
+double run_carved(const SyntheticCycle* cycles, int n, double &seconds, double &carved)
+{
+	logodds_grid global(0);
+	CycleEvidence evidence;
+	ConeBatch batch;
+	double updates = 0;
+	carved = 0;
+
+	double start = now_seconds();
+	for(int c = 0; c < n; c++)
+	{
+		const SonarSnapshot snapshot = make_sonar_snapshot( cycles[c].x, cycles[c].y, cycles[c].th,
+															 cycles[c].range, cycles[c].sensorTh, SONAR_COUNT );
+		build_cone_batch( snapshot, 10.0, global.getCellSize(), batch );
+		updates += apply_cone_batch( batch, global, evidence );
+		int beam = carve_free_space( batch, global, evidence );
+		updates += beam;
+		carved += beam;
+		merge_evidence( evidence, global );
+		evidence.dirty.clear();
+	}
+	seconds = now_seconds() - start;
+	return updates;
+}
+
+//snapshot + cone rasterization only, no grid access
+double run_rasterize(const SyntheticCycle* cycles, int n, double &seconds)
+{
+	ConeBatch batch;
+	double samples = 0;
+
+	double start = now_seconds();
+	for(int c = 0; c < n; c++)
+	{
+		const SonarSnapshot snapshot = make_sonar_snapshot( cycles[c].x, cycles[c].y, cycles[c].th,
+															 cycles[c].range, cycles[c].sensorTh, SONAR_COUNT );
+		build_cone_batch( snapshot, 10.0, 100.0, batch );
+		samples += batch.numSamples;
+	}
+	seconds = now_seconds() - start;
+	return samples;
+}
+
+/*
+ *	Fills a grid with DIRECTORY_TILES tiles in one row, one column and a
+ *	square block and reports how far the tiles sit from their home bucket
+ *	in the tile directory and what a cell read costs. A corridor mapped
+ *	along x is the row, its tiles differ in x only.
+ */
+void run_tile_directory(const char* name, int columns)
+{
+	logodds_grid grid(0);
+	int rows = (DIRECTORY_TILES + columns - 1) / columns;
+	for(int t = 0; t < DIRECTORY_TILES; t++)
+		grid.at((t % columns - columns / 2) * logodds_grid::TILE_SIZE, (t / columns - rows / 2) * logodds_grid::TILE_SIZE) = 1;
+
+	double mean;
+	int worst;
+	grid.getProbeLengths(mean, worst);
+
+	//reads jump from tile to tile, so every one goes through the directory
+	float sum = 0;
+	double start = now_seconds();
+	for(int r = 0; r < DIRECTORY_READS; r++)
+	{
+		int t = (int)(bench_rand() * DIRECTORY_TILES);
+		sum += grid.get((t % columns - columns / 2) * logodds_grid::TILE_SIZE, (t / columns - rows / 2) * logodds_grid::TILE_SIZE);
+	}
+	double seconds = now_seconds() - start;
+
+	cout << setw(10) << name << ": " << grid.getNumTiles() << " tiles, probe length " << setprecision(2) << mean
+		 << " on average, " << worst << " worst, " << seconds / DIRECTORY_READS * 1e9 << " ns per read"
+		 << (sum == DIRECTORY_READS ? "" : " (wrong cells read!)") << endl;
+}
+
+void report(const char* name, double updates, double seconds, int cycles)
+{
+	cout << setw(10) << name
+		 << setw(14) << (long)updates << " cells"
+		 << setw(10) << fixed << setprecision(3) << seconds << " s"
+		 << setw(14) << (long)(updates / seconds) << " cells/s"
+		 << setw(12) << (long)(cycles / seconds) << " cycles/s"
+		 << setw(10) << setprecision(2) << (seconds / cycles) * 1e6 << " us/cycle" << endl;
+}
+
+//peak memory the process has used so far, [KB]
+long peak_process_memory_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#endif
+}
+
+/*
+ *	Maps the run again with a MapPyramid attached and checks it against a
+ *	rebuilt one, then times random region queries against scanning the
+ *	cells. Prints the extra time per cycle and the time per query.
+ */
+void run_pyramid(const vector<SensorLogRecord> &records, double plainSeconds)
+{
+	//fastest of WORLD_RUNS like the plain runs, the last one is kept for the checks
+	SonarMapper* mapper = NULL;
+	MapPyramid* pyramid = NULL;
+	double seconds = 0;
+	for(int run = 0; run < WORLD_RUNS; run++)
+	{
+		delete mapper;
+		delete pyramid;
+		mapper = new SonarMapper;
+		pyramid = new MapPyramid;
+		mapper->setPyramid(pyramid);
+
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+			mapper->update(snapshot_from_record(records[i]));
+		double run_seconds = now_seconds() - start;
+		if(run == 0 || run_seconds < seconds)
+			seconds = run_seconds;
+	}
+
+	const logodds_grid &map = mapper->getMap();
+	MapPyramid rebuilt;
+	rebuilt.build(map);
+	int stale = 0;
+	for(int level = 1; level < pyramid->getNumLevels(); level++)
+	{
+		const logodds_grid &grid = rebuilt.getLevel(level);
+		for(int slot = 0; slot < grid.getNumTiles(); slot++)
+		{
+			for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+			{
+				int bx = (grid.getTileX(slot) << logodds_grid::TILE_SHIFT) + (c & logodds_grid::TILE_MASK);
+				int by = (grid.getTileY(slot) << logodds_grid::TILE_SHIFT) + (c >> logodds_grid::TILE_SHIFT);
+				if(pyramid->getMax(level, bx, by) != grid.getTileData(slot)[c])
+					stale++;
+			}
+		}
+	}
+
+	//random boxes up to 64 x 64 cells inside the explored area
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	map.getCellBounds(min_x, min_y, max_x, max_y);
+	vector<int> boxes(PYRAMID_QUERIES * 4);
+	for(int q = 0; q < PYRAMID_QUERIES; q++)
+	{
+		boxes[q * 4] = min_x + (int)(bench_rand() * (max_x - min_x));
+		boxes[q * 4 + 1] = min_y + (int)(bench_rand() * (max_y - min_y));
+		boxes[q * 4 + 2] = boxes[q * 4] + (int)(bench_rand() * 64);
+		boxes[q * 4 + 3] = boxes[q * 4 + 1] + (int)(bench_rand() * 64);
+	}
+
+	int occupied = 0;
+	double start = now_seconds();
+	for(int q = 0; q < PYRAMID_QUERIES; q++)
+		occupied += pyramid->isRegionFree(boxes[q * 4], boxes[q * 4 + 1], boxes[q * 4 + 2], boxes[q * 4 + 3]) ? 0 : 1;
+	double query_seconds = now_seconds() - start;
+
+	int scanned = 0;
+	start = now_seconds();
+	for(int q = 0; q < PYRAMID_QUERIES; q++)
+	{
+		bool hit = false;
+		for(int x = boxes[q * 4]; x <= boxes[q * 4 + 2] && !hit; x++)
+			for(int y = boxes[q * 4 + 1]; y <= boxes[q * 4 + 3] && !hit; y++)
+				hit = map.get(x, y) > LOGODDS_OBSTACLE;
+		scanned += hit ? 1 : 0;
+	}
+	double scan_seconds = now_seconds() - start;
+
+	cout << setw(10) << "" << "pyramid: +" << setprecision(2) << (seconds - plainSeconds) / records.size() * 1e6
+		 << " us/cycle, " << pyramid->getMemoryUsage() / 1024 << " KB, " << stale << " stale blocks; region query "
+		 << query_seconds / PYRAMID_QUERIES * 1e6 << " us vs scan " << scan_seconds / PYRAMID_QUERIES * 1e6 << " us"
+		 << (occupied == scanned ? "" : " (ANSWERS DIFFER)") << endl;
+
+	delete mapper;
+	delete pyramid;
+}
+
+/*
+ *	Squared distance to the closest obstacle cell for every cell of the
+ *	box, by looking at every cell within reach, far past it. Row major.
+ */
+void exact_distances(const logodds_grid &map, int minX, int minY, int maxX, int maxY, int far, vector<int> &dist2)
+{
+	int reach = (int)sqrt((double)far);
+	int width = maxX - minX + 1, height = maxY - minY + 1;
+
+	//obstacles of the box and the reach around it
+	int ow = width + 2 * reach, oh = height + 2 * reach;
+	vector<unsigned char> obstacle((size_t)ow * oh, 0);
+	for(int y = 0; y < oh; y++)
+		for(int x = 0; x < ow; x++)
+			obstacle[(size_t)y * ow + x] = map.get(minX - reach + x, minY - reach + y) > LOGODDS_OBSTACLE;
+
+	dist2.assign((size_t)width * height, far);
+	for(int y = 0; y < height; y++)
+	{
+		for(int x = 0; x < width; x++)
+		{
+			int &best = dist2[(size_t)y * width + x];
+			for(int dy = -reach; dy <= reach; dy++)
+			{
+				const unsigned char* row = &obstacle[(size_t)(y + reach + dy) * ow + x + reach];
+				for(int dx = -reach; dx <= reach; dx++)
+				{
+					int d2 = dx * dx + dy * dy;
+					if(row[dx] && d2 < best)
+						best = d2;
+				}
+			}
+		}
+	}
+}
+
+/*
+ *	Maps the run with the distance map attached and compares what keeping
+ *	it current costs per cycle with recomputing it from the whole map,
+ *	which is timed every REBUILD_EVERY cycles of a separate run. At the
+ *	end both the incremental distances and a fresh build get compared
+ *	with the exact distances. The 8-neighbor brushfire isn't exact
+ *	Euclidean (distance_map.h), either may be off on a stray cell and
+ *	not always the same one, but by more than DISTANCE_TOLERANCE is a
+ *	bug.
+ */
+void run_distance(const vector<SensorLogRecord> &records, double plainSeconds)
+{
+	SonarMapper* mapper = NULL;
+	DistanceMap* distance = NULL;
+	double seconds = 0, worst = 0;
+	for(int run = 0; run < WORLD_RUNS; run++)
+	{
+		delete mapper;
+		delete distance;
+		mapper = new SonarMapper;
+		distance = new DistanceMap;
+		mapper->setDistanceMap(distance);
+
+		double run_worst = 0;
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+		{
+			double cycle_start = now_seconds();
+			mapper->update(snapshot_from_record(records[i]));
+			double cycle = now_seconds() - cycle_start;
+			if(cycle > run_worst)
+				run_worst = cycle;
+		}
+		double run_seconds = now_seconds() - start;
+		if(run == 0 || run_seconds < seconds)
+		{
+			seconds = run_seconds;
+			worst = run_worst;
+		}
+	}
+
+	//full recompute from the map as it was every REBUILD_EVERY cycles
+	SonarMapper plain;
+	DistanceMap rebuilt;
+	double rebuild_seconds = 0;
+	int rebuilds = 0;
+	for(size_t i = 0; i < records.size(); i++)
+	{
+		plain.update(snapshot_from_record(records[i]));
+		if((i + 1) % REBUILD_EVERY != 0 && i + 1 != records.size())
+			continue;
+		double start = now_seconds();
+		rebuilt.build(plain.getMap());
+		rebuild_seconds += now_seconds() - start;
+		rebuilds++;
+	}
+
+	//both against the exact distances, over the map plus the reach around it
+	const logodds_grid &map = mapper->getMap();
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	map.getCellBounds(min_x, min_y, max_x, max_y);
+	min_x -= DISTANCE_MAX_CELLS;
+	min_y -= DISTANCE_MAX_CELLS;
+	max_x += DISTANCE_MAX_CELLS;
+	max_y += DISTANCE_MAX_CELLS;
+	vector<int> exact;
+	exact_distances(map, min_x, min_y, max_x, max_y, distance->getFar(), exact);
+
+	int width = max_x - min_x + 1, differ = 0, off = 0, beyond = 0;
+	double error = 0;
+	for(int y = min_y; y <= max_y; y++)
+	{
+		for(int x = min_x; x <= max_x; x++)
+		{
+			int right = exact[(y - min_y) * width + x - min_x];
+			int incremental = distance->getDistance2(x, y), fresh = rebuilt.getDistance2(x, y);
+			if(incremental != fresh)
+				differ++;
+			for(int i = 0; i < 2; i++)
+			{
+				int dist2 = i == 0 ? incremental : fresh;
+				if(dist2 == right)
+					continue;
+				off++;
+				double e = fabs(sqrt((double)dist2) - sqrt((double)right));
+				if(e > error)
+					error = e;
+				if(e > DISTANCE_TOLERANCE)
+					beyond++;
+			}
+		}
+	}
+
+	cout << setw(10) << "" << "distance map: +" << setprecision(2) << (seconds - plainSeconds) / records.size() * 1e6
+		 << " us/cycle (worst cycle " << worst * 1e6 << " us), full recompute " << rebuild_seconds / rebuilds * 1e6
+		 << " us, " << distance->getMemoryUsage() / 1024 << " KB" << endl;
+	cout << setw(10) << "" << "distances: " << differ << " cells differ from the rebuild, " << off
+		 << " off the exact ones by at most " << setprecision(3) << error << " cells, " << beyond << " by more than "
+		 << setprecision(1) << DISTANCE_TOLERANCE << endl;
+
+	delete mapper;
+	delete distance;
+}
+
+/*
+ *	Maps the run with the frontiers attached, times a goal pick every
+ *	REBUILD_EVERY cycles and compares the incremental set with a full
+ *	scan of the final map, which is also timed.
+ */
+void run_frontiers(const vector<SensorLogRecord> &records, double plainSeconds)
+{
+	SonarMapper* mapper = NULL;
+	FrontierMap* frontiers = NULL;
+	double seconds = 0;
+	for(int run = 0; run < WORLD_RUNS; run++)
+	{
+		delete mapper;
+		delete frontiers;
+		mapper = new SonarMapper;
+		frontiers = new FrontierMap;
+		mapper->setFrontiers(frontiers);
+
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+			mapper->update(snapshot_from_record(records[i]));
+		double run_seconds = now_seconds() - start;
+		if(run == 0 || run_seconds < seconds)
+			seconds = run_seconds;
+	}
+
+	//goal picks along a separate run, with the frontier as big as it gets
+	SonarMapper picking;
+	FrontierMap picked;
+	picking.setFrontiers(&picked);
+	double goal_seconds = 0;
+	int goals = 0, clusters = 0;
+	vector<FrontierCluster> found;
+	for(size_t i = 0; i < records.size(); i++)
+	{
+		picking.update(snapshot_from_record(records[i]));
+		if((i + 1) % REBUILD_EVERY != 0)
+			continue;
+		double start = now_seconds();
+		picked.cluster(records[i].x, records[i].y, found);
+		goal_seconds += now_seconds() - start;
+		goals++;
+		clusters += (int)found.size();
+	}
+
+	const logodds_grid &map = mapper->getMap();
+	FrontierMap scanned;
+	double start = now_seconds();
+	scanned.build(map);
+	double scan_seconds = now_seconds() - start;
+
+	int wrong = 0;
+	for(size_t i = 0; i < scanned.size(); i++)
+	{
+		int cx, cy;
+		map.indexToCell(scanned[i], cx, cy);
+		if(!frontiers->isFrontier(cx, cy))
+			wrong++;
+	}
+	wrong += (int)(frontiers->size() > scanned.size() ? frontiers->size() - scanned.size() : scanned.size() - frontiers->size());
+
+	cout << setw(10) << "" << "frontiers: +" << setprecision(2) << (seconds - plainSeconds) / records.size() * 1e6
+		 << " us/cycle vs full scan " << scan_seconds * 1e6 << " us, " << frontiers->size() << " cells at the end, "
+		 << wrong << " wrong; goal pick " << (goals ? goal_seconds / goals * 1e6 : 0) << " us for "
+		 << setprecision(1) << (goals ? (double)clusters / goals : 0) << " clusters" << endl;
+
+	delete mapper;
+	delete frontiers;
+}
+
+/*
+ *	Times keeping the bit planes current while mapping, then composes,
+ *	merges, counts and dilates the finished map word by word on the planes
+ *	and cell by cell on int layers over the bounding box, the way the
+ *	thesis stored them, and checks both agree.
+ */
+void run_planes(const vector<SensorLogRecord> &records, double plainSeconds)
+{
+	SonarMapper* mapper = NULL;
+	OccupancyPlanes* planes = NULL;
+	double seconds = 0;
+	for(int run = 0; run < WORLD_RUNS; run++)
+	{
+		delete mapper;
+		delete planes;
+		mapper = new SonarMapper;
+		planes = new OccupancyPlanes;
+		mapper->setPlanes(planes);
+
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+			mapper->update(snapshot_from_record(records[i]));
+		double run_seconds = now_seconds() - start;
+		if(run == 0 || run_seconds < seconds)
+			seconds = run_seconds;
+	}
+
+	const logodds_grid &map = mapper->getMap();
+	int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+	map.getCellBounds(min_x, min_y, max_x, max_y);
+	int width = max_x - min_x + 1, height = max_y - min_y + 1;
+	vector<int> obstacles(width * height, 0), empty(width * height, 0), global(width * height, 0);
+	vector<int> grown(width * height, 0), seen(width * height, 0);
+	for(int y = 0; y < height; y++)
+	{
+		for(int x = 0; x < width; x++)
+		{
+			float value = map.get(min_x + x, min_y + y);
+			obstacles[y * width + x] = value > LOGODDS_OBSTACLE;
+			empty[y * width + x] = value < LOGODDS_FREE_SPACE;
+		}
+	}
+
+	//cell by cell
+	double start = now_seconds();
+	int cell_count = 0;
+	for(int repeat = 0; repeat < PLANES_REPEAT; repeat++)
+	{
+		cell_count = 0;
+		for(int i = 0; i < width * height; i++)
+		{
+			global[i] = obstacles[i] & ~empty[i];
+			seen[i] |= obstacles[i];
+			seen[i] |= empty[i];
+			cell_count += global[i];
+		}
+	}
+	double cell_compose = (now_seconds() - start) / PLANES_REPEAT;
+
+	//once is plenty slow
+	start = now_seconds();
+	for(int y = 0; y < height; y++)
+		for(int x = 0; x < width; x++)
+			for(int dy = -PLANES_DILATE; dy <= PLANES_DILATE && !grown[y * width + x]; dy++)
+				for(int dx = -PLANES_DILATE; dx <= PLANES_DILATE; dx++)
+					if(x + dx >= 0 && y + dy >= 0 && x + dx < width && y + dy < height && global[(y + dy) * width + x + dx])
+					{
+						grown[y * width + x] = 1;
+						break;
+					}
+	double cell_dilate = now_seconds() - start;
+
+	//word by word
+	BitPlane composed, merged, dilated;
+	size_t word_count = 0;
+	start = now_seconds();
+	for(int repeat = 0; repeat < PLANES_REPEAT; repeat++)
+	{
+		composed.compose(planes->getObstacle(), planes->getEmpty());
+		merged.merge(planes->getObstacle());
+		merged.merge(planes->getEmpty());
+		word_count = composed.count();
+	}
+	double word_compose = (now_seconds() - start) / PLANES_REPEAT;
+
+	start = now_seconds();
+	for(int repeat = 0; repeat < PLANES_REPEAT; repeat++)
+		dilated.dilate(composed, map, PLANES_DILATE);
+	double word_dilate = (now_seconds() - start) / PLANES_REPEAT;
+
+	//only cells in the map's tiles, the planes don't grow past them
+	int wrong = 0;
+	for(int y = 0; y < height; y++)
+	{
+		for(int x = 0; x < width; x++)
+		{
+			unsigned int index;
+			if(!map.findCellIndex(min_x + x, min_y + y, index))
+				continue;
+			if(composed.test(index) != (global[y * width + x] != 0) || dilated.test(index) != (grown[y * width + x] != 0)
+			   || planes->getGlobal().test(index) != composed.test(index))
+				wrong++;
+		}
+	}
+	if((int)word_count != cell_count)
+		wrong++;
+
+	size_t int_bytes = 3 * (size_t)width * height * sizeof(int);
+	size_t plane_bytes = planes->getObstacle().getMemoryUsage() + planes->getEmpty().getMemoryUsage() + planes->getGlobal().getMemoryUsage();
+	cout << setw(10) << "" << "bit planes: +" << setprecision(2) << (seconds - plainSeconds) / records.size() * 1e6
+		 << " us/cycle; compose+merge+count " << word_compose * 1e6 << " us vs " << cell_compose * 1e6
+		 << " us cell by cell, dilate by " << PLANES_DILATE << " " << word_dilate * 1e6 << " us vs " << cell_dilate * 1e6
+		 << " us; " << plane_bytes / 1024 << " KB vs " << int_bytes / 1024 << " KB, " << wrong << " wrong" << endl;
+
+	delete mapper;
+	delete planes;
+}
+
+/*
+ *	Writes the map of the run the way aria_robot_mapping does, one
+ *	"   0 " per cell of text, then as PNG and YAML and as the .rle file,
+ *	and reads the .rle back to check it gives the same map
+ */
+void run_export(const SonarWorld &world, const vector<SensorLogRecord> &records)
+{
+	SonarMapper mapper;
+	for(size_t i = 0; i < records.size(); i++)
+		mapper.update(snapshot_from_record(records[i]));
+	const logodds_grid &map = mapper.getMap();
+	string prefix = string(world.getName()) + "_export";
+
+	double start = now_seconds();
+	size_t dat_bytes = 0;
+	bool written = write_map_dat(map, prefix.c_str(), &dat_bytes);
+	double dat_seconds = now_seconds() - start;
+
+	size_t png_bytes = 0, rle_bytes = 0;
+	start = now_seconds();
+	written = export_map_image(map, prefix.c_str(), MAP_IMAGE_PNG, &png_bytes) && written;
+	double png_seconds = now_seconds() - start;
+	start = now_seconds();
+	written = write_map_rle((prefix + ".rle").c_str(), map, &rle_bytes) && written;
+	double rle_seconds = now_seconds() - start;
+
+	//every cell of every tile has to come back as it went out
+	logodds_grid loaded(map.getFillValue(), map.getCellSize());
+	int wrong = 0;
+	if(!written || !load_map_rle((prefix + ".rle").c_str(), loaded) || loaded.getNumTiles() != map.getNumTiles())
+		wrong = -1;
+	for(int slot = 0; slot < map.getNumTiles() && wrong >= 0; slot++)
+	{
+		unsigned int index;
+		if(!loaded.findCellIndex(map.getTileX(slot) << logodds_grid::TILE_SHIFT, map.getTileY(slot) << logodds_grid::TILE_SHIFT, index))
+		{
+			wrong++;
+			continue;
+		}
+		const float* cells = map.getTileData(slot);
+		const float* back = loaded.getTileData((int)(index >> logodds_grid::CELL_BITS));
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+			if(cells[c] != back[c])
+				wrong++;
+	}
+
+	cout << setw(10) << "" << "export: .dat " << setprecision(2) << dat_seconds * 1e3 << " ms " << dat_bytes / 1024
+		 << " KB, png " << png_seconds * 1e3 << " ms " << png_bytes / 1024 << " KB, rle " << rle_seconds * 1e3 << " ms "
+		 << rle_bytes / 1024 << " KB of " << map.getNumTiles() * logodds_grid::TILE_CELLS * sizeof(float) / 1024 << " KB, ";
+	if(wrong < 0)
+		cout << "rle didn't load" << endl;
+	else
+		cout << wrong << " cells wrong after loading" << endl;
+
+	const char* suffixes[] = { ".dat", "_origin.dat", ".png", ".yaml", ".rle" };
+	for(int i = 0; i < 5; i++)
+		remove((prefix + suffixes[i]).c_str());
+}
+
+/*
+ *	Scatters 3x3 blocks over a size x size planner grid, walks the robot
+ *	along its path to the far corner while PLANNER_CHANGES cells around
+ *	it flip each step, and times the repair. Each step gets one plan()
+ *	of at most PLANNER_BUDGET expansions like a robot cycle does, the
+ *	robot waits where it is while a repair takes more steps than that.
+ *	Halfway the cells around the robot close in for a while, as sonar
+ *	ghosts do, and the planner has to search everything the goal reaches
+ *	to find there is no way out, the worst a repair gets. Every
+ *	SCRATCH_EVERY steps a second planner with the same cells plans from
+ *	scratch for comparison, and the two costs have to agree.
+ */
+void run_planner(int size)
+{
+	GridPlanner planner(size, size), scratch(size, size);
+	for(int b = 0; b < size * size / 60; b++)
+	{
+		int bx = 1 + (int)(bench_rand() * (size - 4)), by = 1 + (int)(bench_rand() * (size - 4));
+		for(int y = by; y < by + 3; y++)
+		{
+			for(int x = bx; x < bx + 3; x++)
+			{
+				if(x + y < 10 || x + y > 2 * size - 12)
+					continue;		//keep start and goal open
+				planner.setObstacle(x, y, true);
+				scratch.setObstacle(x, y, true);
+			}
+		}
+	}
+
+	int sx = 2, sy = 2;
+	planner.setStart(sx, sy);
+	scratch.setStart(sx, sy);
+	planner.setGoal(size - 3, size - 3);
+	scratch.setGoal(size - 3, size - 3);
+
+	double start = now_seconds();
+	bool found = planner.plan();
+	double initial_seconds = now_seconds() - start;
+	long initial_expanded = planner.getExpanded();
+	if(!found)
+	{
+		cout << setw(10) << size << "x" << size << ": no path" << endl;
+		return;
+	}
+
+	double repair_seconds = 0, scratch_seconds = 0, worst = 0, longest = 0, pending = 0;
+	long repair_expanded = 0, scratch_expanded = 0, worst_expanded = 0;
+	int calls = 0, walked = 0, scratches = 0, mismatches = 0, carried = 0, most_calls = 0, pending_calls = 0;
+	int lost = -1;
+	vector<int> xs, ys, box;
+	for(int step = 0; step < PLANNER_STEPS; step++)
+	{
+		//no path yet, the robot waits for the repair to finish or the box to open
+		if(found && planner.isFinished())
+		{
+			if(!planner.getPath(xs, ys) || xs.size() < 2)
+				break;
+			sx = xs[1];
+			sy = ys[1];
+			planner.setStart(sx, sy);
+			scratch.setStart(sx, sy);
+			walked++;
+		}
+
+		//what the sonars would see change around the robot, never the cell it stands on
+		for(int c = 0; c < PLANNER_CHANGES; c++)
+		{
+			int x = sx + (int)((bench_rand() - 0.5) * 2 * PLANNER_SENSED);
+			int y = sy + (int)((bench_rand() - 0.5) * 2 * PLANNER_SENSED);
+			if(x == sx && y == sy)
+				continue;
+			bool obstacle = !planner.isBlocked(x, y);
+			planner.setObstacle(x, y, obstacle);
+			scratch.setObstacle(x, y, obstacle);
+		}
+		if(step == PLANNER_STEPS / 2)
+		{
+			for(int d = -2; d <= 2; d++)
+			{
+				int ring[8] = { sx + d, sy - 2, sx + d, sy + 2, sx - 2, sy + d, sx + 2, sy + d };
+				for(int r = 0; r < 8; r += 2)
+				{
+					if(planner.isBlocked(ring[r], ring[r + 1]))
+						continue;
+					planner.setObstacle(ring[r], ring[r + 1], true);
+					scratch.setObstacle(ring[r], ring[r + 1], true);
+					box.push_back(ring[r]);
+					box.push_back(ring[r + 1]);
+				}
+			}
+		}
+
+		start = now_seconds();
+		found = planner.plan(PLANNER_BUDGET);
+		double seconds = now_seconds() - start;
+		repair_seconds += seconds;
+		repair_expanded += planner.getExpanded();
+		worst = max(worst, seconds);
+		worst_expanded = max(worst_expanded, planner.getExpanded());
+		calls++;
+
+		//a repair spread over several steps, what it would have taken in one
+		pending += seconds;
+		pending_calls++;
+		if(!planner.isFinished())
+			continue;
+		if(pending_calls > 1)
+			carried++;
+		longest = max(longest, pending);
+		most_calls = max(most_calls, pending_calls);
+		pending = 0;
+		pending_calls = 0;
+
+		if(step % SCRATCH_EVERY == 0 || !found)
+		{
+			start = now_seconds();
+			scratch.reset();
+			bool scratch_found = scratch.plan();
+			scratch_seconds += now_seconds() - start;
+			scratch_expanded += scratch.getExpanded();
+			scratches++;
+			if(scratch_found != found || scratch.getPathCost() != planner.getPathCost())
+				mismatches++;
+		}
+
+		//boxed in, the ghosts go away again once the planner knows
+		if(!found && !box.empty())
+		{
+			for(size_t i = 0; i < box.size(); i += 2)
+			{
+				planner.setObstacle(box[i], box[i + 1], false);
+				scratch.setObstacle(box[i], box[i + 1], false);
+			}
+			box.clear();
+		}
+		else if(!found)
+		{
+			lost = step;
+			break;
+		}
+	}
+
+	cout << setw(10) << size << "x" << size << ": first plan " << setprecision(2) << initial_seconds * 1e3 << " ms ("
+		 << initial_expanded << " expanded), " << planner.getMemoryUsage() / 1024 << " KB" << endl;
+	if(calls == 0 || scratches == 0)
+		return;
+	cout << setw(10) << "" << "repair " << setprecision(3) << repair_seconds / calls * 1e3 << " ms/step (worst "
+		 << worst * 1e3 << ", " << repair_expanded / calls << " expanded, at most " << worst_expanded
+		 << ") vs from scratch " << scratch_seconds / scratches * 1e3 << " ms (" << scratch_expanded / scratches
+		 << " expanded), " << mismatches << " cost mismatches" << endl;
+	cout << setw(10) << "" << "walked " << walked << " of " << PLANNER_STEPS << " steps, " << carried
+		 << " repairs took more than one step, the longest " << longest * 1e3 << " ms over " << most_calls << " steps";
+	if(lost >= 0)
+		cout << ", no path left after step " << lost;
+	cout << endl;
+}
+
+/*
+ *	Puts odometry drift on the run and maps it twice, once on the drifted
+ *	poses and once with every pose scan matched first. Reports how far off
+ *	the poses end up against the simulated truth, what that does to the
+ *	map score and what a match costs. The matched run is logged raw like
+ *	the robot does it and mapped again from the log, which has to give the
+ *	same map.
+ */
+void run_scan_matching(const vector<SensorLogRecord> &records, const truth_grid &truth, const truth_grid &seen)
+{
+	vector<SensorLogRecord> drifted;
+	drift_odometry(records, OdometryDrift(), 7, drifted);
+
+	SonarMapper plain;
+	double drift_sum = 0, drift_worst = 0;
+	for(size_t i = 0; i < drifted.size(); i++)
+	{
+		plain.update(snapshot_from_record(drifted[i]));
+		double e = sqrt((drifted[i].x - records[i].x) * (drifted[i].x - records[i].x) + (drifted[i].y - records[i].y) * (drifted[i].y - records[i].y));
+		drift_sum += e;
+		if(e > drift_worst)
+			drift_worst = e;
+	}
+	MapScore plain_score = score_map(plain.getMap(), truth, seen, SCORE_TOLERANCE);
+
+	//what the robot does: log the raw cycle, then match and map it
+	SonarMapper mapper;
+	DistanceMap distance;
+	mapper.setDistanceMap(&distance);
+	ScanMatcher matcher;
+	mapper.setMatcher(&matcher);
+	SensorLogWriter log;
+	log.open(REPLAY_LOG);
+	double error_sum = 0, error_worst = 0, seconds = 0, slowest = 0;
+	long evaluated = 0;
+	int matched = 0;
+	for(size_t i = 0; i < drifted.size(); i++)
+	{
+		SensorLogRecord record = drifted[i];
+		log.write(record);
+		ScanMatchResult match;
+		mapper.update(record, &match);
+
+		double e = sqrt((record.x - records[i].x) * (record.x - records[i].x) + (record.y - records[i].y) * (record.y - records[i].y));
+		error_sum += e;
+		if(e > error_worst)
+			error_worst = e;
+		seconds += match.seconds;
+		if(match.seconds > slowest)
+			slowest = match.seconds;
+		evaluated += match.evaluated;
+		if(match.matched)
+			matched++;
+	}
+	MapScore score = score_map(mapper.getMap(), truth, seen, SCORE_TOLERANCE);
+	log.close();
+
+	//and what mapping_replay does with the log, on one thread, has to come out the same map
+	vector<SensorLogRecord> logged;
+	uint32_t replayed = 0;
+	if(read_sensor_log(REPLAY_LOG, logged))
+	{
+		SonarMapper replay;
+		DistanceMap replay_distance;
+		replay.setDistanceMap(&replay_distance);
+		ScanMatchParams params;
+		params.threads = 1;
+		ScanMatcher replay_matcher(params);
+		replay.setMatcher(&replay_matcher);
+		for(size_t i = 0; i < logged.size(); i++)
+			replay.update(logged[i]);
+		replayed = map_checksum(replay.getMap());
+	}
+	remove(REPLAY_LOG);
+	uint32_t live = map_checksum(mapper.getMap());
+
+	size_t n = drifted.size();
+	cout << setw(10) << "" << "odometry drift: pose off by " << setprecision(0) << drift_sum / n << " mm on average, "
+		 << drift_worst << " worst, map precision " << setprecision(3) << plain_score.precision << " recall " << plain_score.recall << endl;
+	cout << setw(10) << "" << "scan matched:   pose off by " << setprecision(0) << error_sum / n << " mm on average, "
+		 << error_worst << " worst, map precision " << setprecision(3) << score.precision << " recall " << score.recall << endl;
+	cout << setw(10) << "" << "match " << setprecision(3) << seconds / n * 1e3 << " ms/cycle (worst " << slowest * 1e3
+		 << "), " << evaluated / n << " poses and blocks scored, " << setprecision(1) << 100.0 * matched / n << "% of cycles matched, "
+		 << boost::thread::hardware_concurrency() << " cores" << endl;
+	cout << setw(10) << "" << "map checksum " << hex << setw(8) << setfill('0') << live << ", replayed from the log "
+		 << setw(8) << replayed << dec << setfill(' ') << (live == replayed ? "" : " (MAPS DIFFER)") << endl;
+}
+
+/*
+ *	Tracks the first half of the run from a tight cloud on the right pose,
+ *	then carries the robot back to the start without the odometry
+ *	noticing, so the cloud is tight and wrong. The echoes fitting worse
+ *	than they used to has to mix random particles in, spread the cloud
+ *	out and find the robot again.
+ */
+void run_kidnapping(const LikelihoodField &field, const vector<SensorLogRecord> &truth, const vector<SensorLogRecord> &drifted)
+{
+	size_t half = drifted.size() / 2;
+	ParticleLocalizer localizer(field);
+	localizer.initPose(truth[0].x, truth[0].y, truth[0].th, 100, 5);
+	for(size_t i = 0; i < half; i++)
+		localizer.update(drifted[i]);
+
+	//the start of the run again, its odometry turned and shifted to go on from the pose the robot was carried off
+	const SensorLogRecord &from = drifted[0], &to = drifted[half];
+	double a = (to.th - from.th) / 180 * PI;
+	int noticed = -1, spread = -1, found = -1;
+	for(size_t i = 0; i < half && found < 0; i++)
+	{
+		SensorLogRecord record = drifted[i];
+		double dx = record.x - from.x, dy = record.y - from.y;
+		record.x = to.x + cos(a) * dx - sin(a) * dy;
+		record.y = to.y + sin(a) * dx + cos(a) * dy;
+		record.th += to.th - from.th;
+
+		LocalizerResult result = localizer.update(record);
+		if(noticed < 0 && result.injected > 0)
+			noticed = (int)i;
+		if(spread < 0 && result.spread >= LOCALIZE_FOUND)
+			spread = (int)i;
+		double e = sqrt((result.x - truth[i].x) * (result.x - truth[i].x) + (result.y - truth[i].y) * (result.y - truth[i].y));
+		if(spread >= 0 && e < LOCALIZE_FOUND && result.spread < LOCALIZE_FOUND)
+			found = (int)i;
+	}
+
+	double carried = sqrt((truth[half].x - truth[0].x) * (truth[half].x - truth[0].x) +
+						  (truth[half].y - truth[0].y) * (truth[half].y - truth[0].y));
+	cout << setw(10) << "" << "kidnapped " << setprecision(1) << carried / 1000 << " m: ";
+	if(noticed >= 0)
+		cout << "random particles after " << truth[noticed].time - truth[0].time << " s, ";
+	else
+		cout << "no random particles (NOT NOTICED), ";
+	if(spread >= 0)
+		cout << "spread out after " << truth[spread].time - truth[0].time << " s, ";
+	else
+		cout << "stayed together (NOT RE-SPREAD), ";
+	if(found >= 0)
+		cout << "found again after " << truth[found].time - truth[0].time << " s" << endl;
+	else
+		cout << "never found again" << endl;
+}
+
+/*
+ *	Maps the run on its true poses, as the map of an earlier run, then
+ *	drives the world again with other sensor noise and drifting odometry
+ *	and localizes on that map from nowhere. Reports how long it takes for
+ *	the particles to find the robot, how far off it stays after that and
+ *	what an update costs as the particle count comes down. Then kidnaps
+ *	it, see run_kidnapping.
+ */
+void run_localization(const SonarWorld &world, const vector<SensorLogRecord> &records)
+{
+	SonarMapper mapper;
+	for(size_t i = 0; i < records.size(); i++)
+		mapper.update(snapshot_from_record(records[i]));
+	LikelihoodField field;
+	field.build(mapper.getMap());
+
+	SonarSimParams params;
+	truth_grid seen(0);
+	vector<SensorLogRecord> truth, drifted;
+	simulate_run(world, params, 2, truth, seen);
+	drift_odometry(truth, OdometryDrift(), 11, drifted);
+
+	ParticleLocalizer localizer(field);
+	localizer.initGlobal();
+	int first_particles = localizer.getParticleCount();
+
+	int found = -1, updates = 0;
+	double seconds = 0, slowest = 0, error_sum = 0, error_worst = 0, heading_sum = 0;
+	long particles = 0;
+	int tracked = 0;
+	for(size_t i = 0; i < drifted.size(); i++)
+	{
+		LocalizerResult result = localizer.update(drifted[i]);
+		if(result.updated)
+		{
+			updates++;
+			seconds += result.seconds;
+			particles += result.particles;
+			if(result.seconds > slowest)
+				slowest = result.seconds;
+		}
+
+		double e = sqrt((result.x - truth[i].x) * (result.x - truth[i].x) + (result.y - truth[i].y) * (result.y - truth[i].y));
+		if(found < 0 && e < LOCALIZE_FOUND && result.spread < LOCALIZE_FOUND)
+			found = (int)i;
+		if(found >= 0)
+		{
+			error_sum += e;
+			if(e > error_worst)
+				error_worst = e;
+			double h = fmod(fabs(result.th - truth[i].th), 360.0);
+			heading_sum += min(h, 360 - h);
+			tracked++;
+		}
+	}
+
+	cout << setw(10) << "" << "localization: ";
+	if(found >= 0)
+		cout << "found after " << setprecision(1) << truth[found].time << " s, then off by " << setprecision(0)
+			 << error_sum / tracked << " mm and " << setprecision(1) << heading_sum / tracked << " deg on average, "
+			 << setprecision(0) << error_worst << " mm worst" << endl;
+	else
+		cout << "never found the robot" << endl;
+	if(updates > 0)
+		cout << setw(10) << "" << "update " << setprecision(3) << seconds / updates * 1e3 << " ms (worst " << slowest * 1e3
+			 << "), " << first_particles << " particles at the start, " << particles / updates << " on average, "
+			 << updates << " updates, " << boost::thread::hardware_concurrency() << " cores, "
+			 << (field.getMemoryUsage() + 512) / 1024 << " KB field" << endl;
+
+	run_kidnapping(field, truth, drifted);
+}
+
+/*
+ *	avoid_obstacles as it was before the vector field histogram: the
+ *	front sonars against 800mm, fixed 20 deg turns
+ */
+void ladder_command(const SensorLogRecord &pose, const DistanceMap &distance, const Waypoint &target,
+					double &vel, double &turn)
+{
+	const float* range = pose.range;
+	if(range[3] < 800 || range[4] < 800)
+	{
+		if(range[1] < 800 || range[2] < 800 || range[0] < 800)
+		{
+			vel = (min(range[1], range[2]) - 200) / 6;
+			turn = -20;
+		}
+		else if(range[5] < 800 || range[6] < 800 || range[7] < 800)
+		{
+			vel = (min(range[5], range[6]) - 200) / 6;
+			turn = 20;
+		}
+		else
+		{
+			double left = distance.getClearanceAhead(pose.x, pose.y, pose.th + 45, 600);
+			double right = distance.getClearanceAhead(pose.x, pose.y, pose.th - 45, 600);
+			vel = -100;
+			turn = right > left ? -20 : 20;
+		}
+	}
+	else if(range[1] < 800 || range[2] < 800 || range[0] < 800)
+	{
+		vel = (min(range[1], range[2]) - 200) / 6;
+		turn = -20;
+	}
+	else if(range[5] < 800 || range[6] < 800 || range[7] < 800)
+	{
+		vel = (min(range[5], range[6]) - 200) / 6;
+		turn = 20;
+	}
+	else
+	{
+		double heading = atan2(target.y - pose.y, target.x - pose.x) * 180 / PI;
+		double error = fmod(heading - pose.th + 540.0, 360.0) - 180;
+		vel = 300;
+		turn = max(-20.0, min(20.0, error));
+	}
+}
+
+/*
+ *	Drops the readings whose closest echo would have come off one of
+ *	hidden's walls, the ping bounced away like off glass
+ */
+void hide_echoes(const SonarWorld &hidden, SensorLogRecord &record, truth_grid &seen)
+{
+	SonarSimParams exact;
+	exact.noise = 0;
+	exact.specularAngle = 90;
+	unsigned int seed = 0;
+	SensorLogRecord behind = record;
+	fire_sonars(hidden, exact, seed, behind, seen);
+	for(int i = 0; i < SONAR_COUNT; i++)
+		if(behind.range[i] < record.range[i])
+			record.range[i] = (float)SIM_OUT_OF_RANGE;
+}
+
+/*
+ *	Drives the world's waypoints once with the sonars fired from the true
+ *	pose every cycle and the mapper running, steered by the histogram or
+ *	by the ladder. Reports how long the round took, the cycles the robot
+ *	would have run into a wall (it stays put instead), how often the turn
+ *	swung from one side to the other and what a decision costs.
+ *	hidden's walls are on the map from the start and the robot bumps into
+ *	them, but they give no echo.
+ */
+void run_avoidance(const SonarWorld &world, bool histogram, const SonarWorld* hidden)
+{
+	const vector<Waypoint> &points = world.getWaypoints();
+	SonarSimParams params;
+	truth_grid seen(0);
+	unsigned int seed = 3;
+
+	SonarMapper mapper;
+	DistanceMap distance;
+	OccupancyPlanes planes;
+	mapper.setDistanceMap(&distance);
+	mapper.setPlanes(&planes);
+	if(hidden)
+	{
+		//an earlier run mapped them for sure
+		logodds_grid &map = mapper.getMap();
+		const vector<WallSegment> &walls = hidden->getWalls();
+		for(size_t i = 0; i < walls.size(); i++)
+		{
+			const WallSegment &w = walls[i];
+			double length = sqrt((w.x1 - w.x0) * (w.x1 - w.x0) + (w.y1 - w.y0) * (w.y1 - w.y0));
+			int steps = (int)(length / (map.getCellSize() / 4)) + 1;
+			for(int k = 0; k <= steps; k++)
+			{
+				double u = (double)k / steps;
+				map.at(map.worldToCell(w.x0 + u * (w.x1 - w.x0)), map.worldToCell(w.y0 + u * (w.y1 - w.y0))) = LOGODDS_MAX;
+			}
+		}
+		distance.build(map);
+		planes.build(map);
+	}
+	VectorFieldHistogram vfh(mapper.getMap().getCellSize());
+	vfh.setMap(&mapper.getMap(), &planes.getGlobal());
+
+	SensorLogRecord record;
+	record.time = 0;
+	record.x = points[0].x;
+	record.y = points[0].y;
+	record.th = atan2(points[1].y - points[0].y, points[1].x - points[0].x) * 180 / PI;
+
+	size_t next = 1;
+	int bumps = 0, swings = 0, last_side = 0, cycles = 0;
+	double seconds = 0, slowest = 0, driven = 0;
+	while(next < points.size() && record.time < DRIVE_TIME)
+	{
+		fire_sonars(world, params, seed, record, seen);
+		if(hidden)
+			hide_echoes(*hidden, record, seen);
+		mapper.update(snapshot_from_record(record));
+
+		const Waypoint &target = points[next];
+		double vel, turn;
+		double start = now_seconds();
+		if(histogram)
+		{
+			double heading = atan2(target.y - record.y, target.x - record.x) * 180 / PI;
+			SteeringCommand command = vfh.decide(record.x, record.y, record.th, record.range, record.sensorTh, heading, true);
+			vel = command.speed;
+			turn = command.turn;
+		}
+		else
+			ladder_command(record, distance, target, vel, turn);
+		double took = now_seconds() - start;
+		seconds += took;
+		slowest = max(slowest, took);
+		cycles++;
+
+		int side = turn >= DRIVE_WIGGLE ? 1 : (turn <= -DRIVE_WIGGLE ? -1 : 0);
+		if(side != 0 && last_side != 0 && side != last_side)
+			swings++;
+		if(side != 0)
+			last_side = side;
+
+		//setDeltaHeading gets there at the robot's turning speed, the next command comes a cycle later
+		double step = DRIVE_TURN_RATE * params.cycleTime;
+		record.th += max(-step, min(step, turn));
+		double a = record.th / 180 * PI;
+		double x = record.x + vel * params.cycleTime * cos(a);
+		double y = record.y + vel * params.cycleTime * sin(a);
+		if(world.getClearance(x, y) < DRIVE_RADIUS || (hidden && hidden->getClearance(x, y) < DRIVE_RADIUS))
+			bumps++;
+		else
+		{
+			driven += fabs(vel) * params.cycleTime;
+			record.x = x;
+			record.y = y;
+		}
+		record.time += params.cycleTime;
+
+		if((target.x - record.x) * (target.x - record.x) + (target.y - record.y) * (target.y - record.y) < DRIVE_REACHED * DRIVE_REACHED)
+			next++;
+	}
+
+	cout << setw(10) << "" << (histogram ? "histogram: " : "ladder:    ");
+	if(next < points.size())
+		cout << "stuck before waypoint " << next << " of " << points.size() - 1;
+	else
+		cout << "round in " << setprecision(1) << record.time << " s";
+	cout << ", " << setprecision(1) << driven / 1000 << " m driven, " << bumps << " bumps, " << swings << " swings, "
+		 << setprecision(2) << seconds / cycles * 1e6 << " us per decision (worst " << slowest * 1e6 << ")" << endl;
+}
+
+/*
+ *	A 10m x 4m room crossed down the middle, with a bench in the way that
+ *	is on the map but gives the sonars no echo. Only the map knows it is
+ *	there, so the ladder runs into it and the histogram has to go around.
+ */
+void run_hidden_obstacle()
+{
+	SonarWorld room("room"), bench("bench");
+	room.addBox(0, 0, 10000, 4000);
+	room.addWaypoint(1000, 2000);
+	room.addWaypoint(9000, 2000);
+	bench.addBox(4500, 1500, 500, 1000);
+
+	cout << endl << "Room with a bench on the map that gives no echo" << endl;
+	run_avoidance(room, false, &bench);
+	run_avoidance(room, true, &bench);
+}
+
+/*
+ *	Simulates one run through a world and maps it WORLD_RUNS times with a
+ *	fresh SonarMapper, reports the fastest run and scores the map
+ */
+void run_world(SonarWorld &world, bool writeLog)
+{
+	SonarSimParams params;
+	truth_grid truth(0), seen(0);
+	world.rasterize(truth);
+
+	vector<SensorLogRecord> records;
+	simulate_run(world, params, 1, records, seen);
+
+	if(writeLog)
+	{
+		string path = string(world.getName()) + ".srl";
+		SensorLogWriter writer;
+		if(writer.open(path.c_str()))
+			for(size_t i = 0; i < records.size(); i++)
+				writer.write(records[i]);
+		else
+			cout << "Could not write " << path << endl;
+	}
+
+	double best = 0, updates = 0;
+	size_t map_bytes = 0;
+	MapScore score;
+	for(int run = 0; run < WORLD_RUNS; run++)
+	{
+		SonarMapper mapper;
+		double run_updates = 0;
+
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+			run_updates += mapper.update(snapshot_from_record(records[i]));
+		double seconds = now_seconds() - start;
+
+		if(run == 0 || seconds < best)
+			best = seconds;
+		updates = run_updates;
+
+		//tiles never get freed, so the final size is the peak
+		if(run == WORLD_RUNS - 1)
+		{
+			map_bytes = mapper.getMap().getMemoryUsage();
+			score = score_map(mapper.getMap(), truth, seen, SCORE_TOLERANCE);
+		}
+	}
+
+	report(world.getName(), updates, best, (int)records.size());
+	cout << setw(10) << "" << setw(14) << records.size() << " cycles"
+		 << setw(10) << setprecision(1) << records.back().time << " s driven"
+		 << setw(10) << map_bytes / 1024 << " KB map" << endl;
+	cout << setw(10) << "" << "precision " << setprecision(3) << score.precision
+		 << " (" << score.correct << " of " << score.predicted << " obstacle cells on a wall), recall "
+		 << score.recall << " (" << score.found << " of " << score.observable << " seen wall cells)" << endl;
+
+	run_pyramid(records, best);
+	run_distance(records, best);
+	run_frontiers(records, best);
+	run_planes(records, best);
+	run_scan_matching(records, truth, seen);
+	run_localization(world, records);
+	run_export(world, records);
+	run_avoidance(world, false, NULL);
+	run_avoidance(world, true, NULL);
+}
+
+int main(int argc, char** argv)
+{
+	int cycles = 200000;
+	bool write_logs = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-logs") == 0)
+			write_logs = true;
+		else
+			cycles = atoi(argv[i]);
+	}
+	if(cycles <= 0)
+		cycles = 1;
+
+	SyntheticCycle* data = new SyntheticCycle[cycles];
+	make_cycles(data, cycles);
+
+	cout << "Mapping kernels, " << cycles << " cycles of 16 sonars" << endl;
+
+	double legacy_seconds, batched_seconds, batched_unique;
+	double legacy_updates = run_legacy(data, cycles, legacy_seconds);
+	double batched_updates = run_batched(data, cycles, batched_seconds, batched_unique);
+
+	double raster_seconds;
+	double raster_samples = run_rasterize(data, cycles, raster_seconds);
+
+	double carved_seconds, carved_cells;
+	double carved_updates = run_carved(data, cycles, carved_seconds, carved_cells);
+
+	report("legacy", legacy_updates, legacy_seconds, cycles);
+	report("batched", batched_updates, batched_seconds, cycles);
+	report("carved", carved_updates, carved_seconds, cycles);
+	report("rasterize", raster_samples, raster_seconds, cycles);
+	cout << "batched / legacy cells per second: " << setprecision(2)
+		 << (batched_updates / batched_seconds) / (legacy_updates / legacy_seconds) << "x" << endl;
+	cout << "unique cells merged per cycle: " << setprecision(1) << batched_unique / cycles
+		 << " of " << batched_updates / cycles << " updates" << endl;
+	cout << "beam cells carved per cycle: " << setprecision(1) << carved_cells / cycles << ", "
+		 << setprecision(0) << carved_cells / (carved_seconds - batched_seconds) << " cells/s on top of batched" << endl;
+
+	//parked robot, nearly every update of a cycle lands on a cell that is already dirty
+	make_stationary_cycles(data, cycles);
+	cout << endl << "Robot standing still, " << cycles << " cycles" << endl;
+	legacy_updates = run_legacy(data, cycles, legacy_seconds);
+	batched_updates = run_batched(data, cycles, batched_seconds, batched_unique);
+	report("legacy", legacy_updates, legacy_seconds, cycles);
+	report("batched", batched_updates, batched_seconds, cycles);
+	cout << "unique cells merged per cycle: " << setprecision(1) << batched_unique / cycles
+		 << " of " << batched_updates / cycles << " updates" << endl;
+
+	delete [] data;
+
+	cout << endl << "Tile directory, " << DIRECTORY_TILES << " tiles" << endl;
+	run_tile_directory("row", DIRECTORY_TILES);
+	run_tile_directory("column", 1);
+	run_tile_directory("block", 64);
+
+	//simulated runs through the places the thesis mapped
+	cout << endl << "Simulated worlds, fastest of " << WORLD_RUNS << " runs" << endl;
+	SonarWorld lab("lab"), hall("hall"), long_hall("long_hall");
+	make_lab_world(lab);
+	make_hall_world(hall);
+	make_long_hall_world(long_hall);
+	run_world(lab, write_logs);
+	run_world(hall, write_logs);
+	run_world(long_hall, write_logs);
+	run_hidden_obstacle();
+
+	cout << endl << "Path planning, " << PLANNER_STEPS << " steps with " << PLANNER_CHANGES << " cells changing each" << endl;
+	run_planner(160);
+	run_planner(500);
+	run_planner(1000);
+	run_planner(2000);
+
+	cout << endl << "peak process memory: " << peak_process_memory_kb() << " KB" << endl;
+	return 0;
+}
@@ -0,0 +1,374 @@
+/********************************************************
+ *	Synthetic sonar worlds, see sonar_world.h
+ ********************************************************/
+
+#include "sonar_world.h"
+
+#include <cmath>
+
+#ifndef PI
+#define PI	3.14159
+#endif
+
+const float P3AT_SONAR_TH[SONAR_COUNT] =
+{
+	90, 50, 30, 10, -10, -30, -50, -90,
+	-90, -130, -150, -170, 170, 150, 130, 90
+};
+
+void SonarWorld::addWall(double x0, double y0, double x1, double y1)
+{
+	WallSegment wall = { x0, y0, x1, y1 };
+	myWalls.push_back(wall);
+}
+
+void SonarWorld::addBox(double x, double y, double w, double h)
+{
+	addWall(x, y, x + w, y);
+	addWall(x + w, y, x + w, y + h);
+	addWall(x + w, y + h, x, y + h);
+	addWall(x, y + h, x, y);
+}
+
+void SonarWorld::addWaypoint(double x, double y)
+{
+	Waypoint point = { x, y };
+	myWaypoints.push_back(point);
+}
+
+double SonarWorld::castRay(double x, double y, double c, double s, double maxRange, double &incidence) const
+{
+	double best = -1;
+	for(size_t i = 0; i < myWalls.size(); i++)
+	{
+		const WallSegment &w = myWalls[i];
+		double ex = w.x1 - w.x0;
+		double ey = w.y1 - w.y0;
+		double denom = c * ey - s * ex;
+		if(fabs(denom) < 1e-9)
+			continue;		//parallel
+
+		//ray p + t * d meets wall a + u * e
+		double ax = w.x0 - x;
+		double ay = w.y0 - y;
+		double t = (ax * ey - ay * ex) / denom;
+		double u = (ax * s - ay * c) / denom;
+		if(t <= 0 || u < 0 || u > 1 || t > maxRange || (best >= 0 && t >= best))
+			continue;
+
+		best = t;
+		double length = sqrt(ex * ex + ey * ey);
+		incidence = acos(fabs(c * ey - s * ex) / length) * 180 / PI;
+	}
+	return best;
+}
+
+double SonarWorld::getClearance(double x, double y) const
+{
+	double best = -1;
+	for(size_t i = 0; i < myWalls.size(); i++)
+	{
+		const WallSegment &w = myWalls[i];
+		double ex = w.x1 - w.x0;
+		double ey = w.y1 - w.y0;
+		double length2 = ex * ex + ey * ey;
+		double u = length2 > 0 ? ((x - w.x0) * ex + (y - w.y0) * ey) / length2 : 0;
+		u = u < 0 ? 0 : (u > 1 ? 1 : u);
+		double dx = w.x0 + u * ex - x, dy = w.y0 + u * ey - y;
+		double d = sqrt(dx * dx + dy * dy);
+		if(best < 0 || d < best)
+			best = d;
+	}
+	return best;
+}
+
+void SonarWorld::rasterize(truth_grid &truth) const
+{
+	double step = truth.getCellSize() / 4;
+	for(size_t i = 0; i < myWalls.size(); i++)
+	{
+		const WallSegment &w = myWalls[i];
+		double length = sqrt((w.x1 - w.x0) * (w.x1 - w.x0) + (w.y1 - w.y0) * (w.y1 - w.y0));
+		int steps = (int)(length / step) + 1;
+		for(int k = 0; k <= steps; k++)
+		{
+			double u = (double)k / steps;
+			truth.at(truth.worldToCell(w.x0 + u * (w.x1 - w.x0)), truth.worldToCell(w.y0 + u * (w.y1 - w.y0))) = 1;
+		}
+	}
+}
+
+/*
+ *	Lab, MapOfLab.png: an 11m x 5.5m room with two rows of benches down
+ *	the middle, the robot drives a loop around them
+ */
+void make_lab_world(SonarWorld &world)
+{
+	world.addBox(0, 1500, 11000, 5500);
+	world.addBox(2500, 3000, 6000, 400);
+	world.addBox(3000, 4500, 5500, 400);
+	world.addBox(9500, 6200, 1000, 600);		//cabinet in the corner
+
+	world.addWaypoint(1000, 2300);
+	world.addWaypoint(10000, 2300);
+	world.addWaypoint(10000, 3950);
+	world.addWaypoint(1500, 3950);
+	world.addWaypoint(1500, 6000);
+	world.addWaypoint(9000, 6000);
+}
+
+/*
+ *	Hall, Hall.png: a 2m wide corridor with a side corridor branching off
+ *	to the south, the robot goes to the end, comes back and turns into
+ *	the side corridor
+ */
+void make_hall_world(SonarWorld &world)
+{
+	//north wall, in two parts around a doorway
+	world.addWall(4000, 5300, 8000, 5300);
+	world.addWall(9000, 5300, 16000, 5300);
+	world.addBox(8000, 5300, 1000, 800);		//doorway alcove
+	//south wall, open where the side corridor starts
+	world.addWall(4000, 3300, 9000, 3300);
+	world.addWall(10500, 3300, 16000, 3300);
+	world.addWall(4000, 3300, 4000, 5300);
+	world.addWall(16000, 3300, 16000, 5300);
+	//side corridor
+	world.addWall(9000, 3300, 9000, 500);
+	world.addWall(10500, 3300, 10500, 500);
+	world.addWall(9000, 500, 10500, 500);
+
+	world.addWaypoint(5000, 4300);
+	world.addWaypoint(15000, 4300);
+	world.addWaypoint(9750, 4300);
+	world.addWaypoint(9750, 1200);
+}
+
+/*
+ *	Long hall, LongHall.png: 50m of 3m wide corridor with an angled window
+ *	at the start, a stairwell halfway down and benches along one side
+ */
+void make_long_hall_world(SonarWorld &world)
+{
+	world.addWall(0, 14000, 50000, 14000);
+	//north wall with the window angled out at the start and the stairwell opening
+	world.addWall(0, 17000, 4000, 17000);
+	world.addWall(4000, 17000, 6500, 19500);
+	world.addWall(6500, 19500, 7500, 17000);
+	world.addWall(7500, 17000, 20000, 17000);
+	world.addWall(20000, 17000, 20000, 20000);
+	world.addWall(20000, 20000, 23000, 20000);
+	world.addWall(23000, 20000, 23000, 17000);
+	world.addWall(23000, 17000, 50000, 17000);
+	world.addWall(0, 14000, 0, 17000);
+	world.addWall(50000, 14000, 50000, 17000);
+
+	for(double x = 10000; x < 48000; x += 8000)
+		world.addBox(x, 14000, 1500, 450);		//benches
+
+	world.addWaypoint(1000, 15600);
+	world.addWaypoint(21500, 15600);
+	world.addWaypoint(21500, 18500);
+	world.addWaypoint(21500, 15600);
+	world.addWaypoint(49000, 15600);
+}
+
+//small LCG so every run sees the same noise
+static double sim_rand(unsigned int &seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return ((seed >> 8) + 0.5) / 16777216.0;
+}
+
+static double sim_gauss(unsigned int &seed)
+{
+	double u = sim_rand(seed);
+	double v = sim_rand(seed);
+	return sqrt(-2 * log(u)) * cos(2 * PI * v);
+}
+
+//each reading is the closest ray echo in the cone
+void fire_sonars( const SonarWorld &world, const SonarSimParams &params, unsigned int &seed,
+				  SensorLogRecord &record, truth_grid &seen )
+{
+	for(int i = 0; i < SONAR_COUNT; i++)
+	{
+		record.sensorTh[i] = P3AT_SONAR_TH[i];
+
+		double closest = -1, hitX = 0, hitY = 0;
+		for(int r = 0; r < params.raysPerCone; r++)
+		{
+			double offset = params.raysPerCone > 1 ? params.coneWidth * ((double)r / (params.raysPerCone - 1) - 0.5) : 0;
+			double angle = (record.th + P3AT_SONAR_TH[i] + offset) / 180 * PI;
+			double c = cos(angle), s = sin(angle);
+
+			double incidence;
+			double d = world.castRay(record.x, record.y, c, s, SIM_OUT_OF_RANGE, incidence);
+			if(d < 0 || incidence > params.specularAngle)
+				continue;		//nothing there, or the ping bounced away
+			if(closest < 0 || d < closest)
+			{
+				closest = d;
+				hitX = record.x + d * c;
+				hitY = record.y + d * s;
+			}
+		}
+
+		if(closest < 0)
+		{
+			record.range[i] = (float)SIM_OUT_OF_RANGE;
+			continue;
+		}
+
+		record.range[i] = (float)(closest + sim_gauss(seed) * params.noise);
+		if(record.range[i] > SONAR_MIN_RANGE && record.range[i] < SONAR_MAX_RANGE)
+			seen.at(seen.worldToCell(hitX), seen.worldToCell(hitY)) = 1;
+	}
+}
+
+void simulate_run( const SonarWorld &world, const SonarSimParams &params, unsigned int seed,
+				   std::vector<SensorLogRecord> &records, truth_grid &seen )
+{
+	records.clear();
+	const std::vector<Waypoint> &points = world.getWaypoints();
+	if(points.empty())
+		return;
+
+	//waypoint order for all laps, every other lap drives back
+	std::vector<Waypoint> route;
+	for(int lap = 0; lap < params.laps; lap++)
+	{
+		for(size_t k = 0; k < points.size(); k++)
+		{
+			const Waypoint &p = (lap % 2 == 0) ? points[k] : points[points.size() - 1 - k];
+			if(route.empty() || route.back().x != p.x || route.back().y != p.y)
+				route.push_back(p);
+		}
+	}
+
+	SensorLogRecord record;
+	record.time = 0;
+	record.x = route[0].x;
+	record.y = route[0].y;
+	record.th = 0;
+
+	double move = params.speed * params.cycleTime;
+	double turn = params.turnRate * params.cycleTime;
+	for(size_t k = 1; k < route.size(); k++)
+	{
+		double tx = route[k].x, ty = route[k].y;
+		double heading = atan2(ty - record.y, tx - record.x) * 180 / PI;
+
+		//turn in place, then drive straight
+		while(true)
+		{
+			double error = fmod(heading - record.th + 540.0, 360.0) - 180;
+			if(fabs(error) <= turn)
+			{
+				record.th = heading;
+				break;
+			}
+			record.th += error > 0 ? turn : -turn;
+			fire_sonars(world, params, seed, record, seen);
+			records.push_back(record);
+			record.time += params.cycleTime;
+		}
+		while(true)
+		{
+			double dx = tx - record.x, dy = ty - record.y;
+			double left = sqrt(dx * dx + dy * dy);
+			if(left <= move)
+			{
+				record.x = tx;
+				record.y = ty;
+				break;
+			}
+			record.x += dx / left * move;
+			record.y += dy / left * move;
+			fire_sonars(world, params, seed, record, seen);
+			records.push_back(record);
+			record.time += params.cycleTime;
+		}
+	}
+}
+
+void drift_odometry( const std::vector<SensorLogRecord> &truth, const OdometryDrift &drift, unsigned int seed,
+					 std::vector<SensorLogRecord> &drifted )
+{
+	drifted = truth;
+	for(size_t k = 1; k < truth.size(); k++)
+	{
+		//true motion of the cycle in the robot frame
+		double dx = truth[k].x - truth[k - 1].x, dy = truth[k].y - truth[k - 1].y;
+		double a = truth[k - 1].th / 180 * PI;
+		double forward = cos(a) * dx + sin(a) * dy;
+		double side = -sin(a) * dx + cos(a) * dy;
+		double turn = fmod(truth[k].th - truth[k - 1].th + 540.0, 360.0) - 180;
+
+		forward *= 1 + drift.scaleError + sim_gauss(seed) * drift.noise;
+		side *= 1 + drift.scaleError;
+		turn = turn * (1 + drift.turnError + sim_gauss(seed) * drift.noise) + drift.curve * fabs(forward) / 1000;
+
+		double b = drifted[k - 1].th / 180 * PI;
+		drifted[k].x = drifted[k - 1].x + cos(b) * forward - sin(b) * side;
+		drifted[k].y = drifted[k - 1].y + sin(b) * forward + cos(b) * side;
+		drifted[k].th = drifted[k - 1].th + turn;
+	}
+}
+
+static bool near_truth(const truth_grid &grid, int cx, int cy, int tolerance)
+{
+	for(int dx = -tolerance; dx <= tolerance; dx++)
+		for(int dy = -tolerance; dy <= tolerance; dy++)
+			if(grid.get(cx + dx, cy + dy))
+				return true;
+	return false;
+}
+
+static bool near_obstacle(const logodds_grid &map, int cx, int cy, int tolerance)
+{
+	for(int dx = -tolerance; dx <= tolerance; dx++)
+		for(int dy = -tolerance; dy <= tolerance; dy++)
+			if(map.get(cx + dx, cy + dy) > LOGODDS_OBSTACLE)
+				return true;
+	return false;
+}
+
+MapScore score_map( const logodds_grid &map, const truth_grid &truth, const truth_grid &seen, int tolerance )
+{
+	MapScore score = { 0, 0, 0, 0, 0, 0 };
+
+	for(int slot = 0; slot < map.getNumTiles(); slot++)
+	{
+		const float* cells = map.getTileData(slot);
+		for(int c = 0; c < logodds_grid::TILE_CELLS; c++)
+		{
+			if(cells[c] <= LOGODDS_OBSTACLE)
+				continue;
+			int cx = (map.getTileX(slot) << logodds_grid::TILE_SHIFT) + (c & logodds_grid::TILE_MASK);
+			int cy = (map.getTileY(slot) << logodds_grid::TILE_SHIFT) + (c >> logodds_grid::TILE_SHIFT);
+			score.predicted++;
+			if(near_truth(truth, cx, cy, tolerance))
+				score.correct++;
+		}
+	}
+
+	for(int slot = 0; slot < seen.getNumTiles(); slot++)
+	{
+		const unsigned char* cells = seen.getTileData(slot);
+		for(int c = 0; c < truth_grid::TILE_CELLS; c++)
+		{
+			if(!cells[c])
+				continue;
+			int cx = (seen.getTileX(slot) << truth_grid::TILE_SHIFT) + (c & truth_grid::TILE_MASK);
+			int cy = (seen.getTileY(slot) << truth_grid::TILE_SHIFT) + (c >> truth_grid::TILE_SHIFT);
+			score.observable++;
+			if(near_obstacle(map, cx, cy, tolerance))
+				score.found++;
+		}
+	}
+
+	score.precision = score.predicted ? (double)score.correct / score.predicted : 0;
+	score.recall = score.observable ? (double)score.found / score.observable : 0;
+	return score;
+}
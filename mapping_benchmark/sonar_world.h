@@ -0,0 +1,157 @@
+/********************************************************
+ *	Synthetic sonar worlds for the mapping benchmark
+ *
+ *	A world is a set of wall segments plus a list of
+ *	waypoints. simulate_run drives a P3-AT along the
+ *	waypoints and ray-casts its 16 sonars against the
+ *	walls every robot cycle, giving the same records
+ *	aria_robot_mapping -record writes, so the mapper can't
+ *	tell the difference.
+ *
+ *	Each sonar is a cone (thesis: 20 to 40 deg wide) made
+ *	of several rays and reports the closest echo in it.
+ *	A ray hitting a wall at a shallow angle bounces off
+ *	and returns nothing, a cone where every ray bounced
+ *	reads out of range, like the angled window in the
+ *	long hall run.
+ *
+ *	The walls are also rasterized into a ground truth
+ *	grid, and the cells the sonars actually got echoes
+ *	from are tracked, so a map can be scored with
+ *	precision and recall.
+ ********************************************************/
+
+#ifndef SONAR_WORLD_H
+#define SONAR_WORLD_H
+
+#include "../aria_robot_mapping/tiled_grid.h"
+#include "../aria_robot_mapping/sonar_model.h"
+#include "../aria_robot_mapping/sensor_log.h"
+
+#include <vector>
+#include <string>
+
+#define SIM_OUT_OF_RANGE	5000.0	//[mm] what ARIA reports when a sonar hears nothing
+
+typedef TiledGrid<unsigned char> truth_grid;
+
+//mounting angle of each sonar on the P3-AT ring, [deg]
+extern const float P3AT_SONAR_TH[SONAR_COUNT];
+
+struct WallSegment
+{
+	double x0, y0, x1, y1;		//[mm]
+};
+
+struct Waypoint
+{
+	double x, y;				//[mm]
+};
+
+class SonarWorld
+{
+public:
+	SonarWorld(const char* name) : myName(name) {}
+
+	const char* getName() const { return myName.c_str(); }
+
+	void addWall(double x0, double y0, double x1, double y1);
+	//four walls around a w x h rectangle with its lower left corner at (x, y)
+	void addBox(double x, double y, double w, double h);
+	void addWaypoint(double x, double y);
+
+	const std::vector<WallSegment>& getWalls() const { return myWalls; }
+	const std::vector<Waypoint>& getWaypoints() const { return myWaypoints; }
+
+	/*
+	 *	Distance from (x, y) along the unit direction (c, s) to the closest
+	 *	wall, or -1 if nothing is within maxRange. incidence gets the angle
+	 *	between the ray and the wall's normal in degrees.
+	 */
+	double castRay(double x, double y, double c, double s, double maxRange, double &incidence) const;
+
+	//distance from (x, y) to the closest point of any wall [mm]
+	double getClearance(double x, double y) const;
+
+	//marks every cell a wall passes through
+	void rasterize(truth_grid &truth) const;
+
+private:
+	std::string myName;
+	std::vector<WallSegment> myWalls;
+	std::vector<Waypoint> myWaypoints;
+};
+
+//rough copies of the places in the MATLAB folder pictures
+void make_lab_world(SonarWorld &world);
+void make_hall_world(SonarWorld &world);
+void make_long_hall_world(SonarWorld &world);
+
+struct SonarSimParams
+{
+	double coneWidth;		//[deg] full width of a sonar cone
+	int raysPerCone;
+	double noise;			//[mm] standard deviation of the range error
+	double specularAngle;	//[deg] incidence above which a ray bounces away
+	double speed;			//[mm/s]
+	double turnRate;		//[deg/s] turning in place at a waypoint
+	double cycleTime;		//[s] one robot cycle
+	int laps;				//times the waypoint list is driven, every other lap backwards
+
+	SonarSimParams()
+		: coneWidth(30), raysPerCone(7), noise(15), specularAngle(60),
+		  speed(400), turnRate(60), cycleTime(0.1), laps(2) {}
+};
+
+/*
+ *	Fires all 16 sonars from the record's pose, filling in its ranges and
+ *	sonar angles. The wall cells the echoes came from go into seen.
+ */
+void fire_sonars( const SonarWorld &world, const SonarSimParams &params, unsigned int &seed,
+				  SensorLogRecord &record, truth_grid &seen );
+
+/*
+ *	Drives the world's waypoints and fills one record per robot cycle.
+ *	seen gets the cells that echoed back to a sonar reading that was in
+ *	range, that is the part of the world the mapper could have found.
+ *	seed makes the noise repeatable.
+ */
+void simulate_run( const SonarWorld &world, const SonarSimParams &params, unsigned int seed,
+				   std::vector<SensorLogRecord> &records, truth_grid &seen );
+
+struct OdometryDrift
+{
+	double scaleError;		//fraction the wheels over or under count the distance driven
+	double turnError;		//fraction they over or under count turns
+	double curve;			//[deg/m] heading creep while driving straight, unequal wheels
+	double noise;			//fraction of each step's motion that is random
+
+	OdometryDrift() : scaleError(0.01), turnError(0.01), curve(0.5), noise(0.01) {}
+};
+
+/*
+ *	Copies the records with the pose the odometry would have reported:
+ *	each cycle's motion gets the drift errors and is summed up again from
+ *	the first pose, so the error grows the way wheel slip does.
+ */
+void drift_odometry( const std::vector<SensorLogRecord> &truth, const OdometryDrift &drift, unsigned int seed,
+					 std::vector<SensorLogRecord> &drifted );
+
+struct MapScore
+{
+	int predicted;			//obstacle cells in the map
+	int correct;			//of those, within tolerance of a wall
+	int observable;			//wall cells the sonars saw
+	int found;				//of those, within tolerance of an obstacle cell in the map
+	double precision;
+	double recall;
+};
+
+/*
+ *	Scores the obstacle cells of a map (log-odds above LOGODDS_OBSTACLE)
+ *	against the walls. A cell counts if it is within tolerance cells of
+ *	the other side, sonar maps are never sharper than a cell or so.
+ */
+MapScore score_map( const logodds_grid &map, const truth_grid &truth, const truth_grid &seen, int tolerance );
+
+#endif
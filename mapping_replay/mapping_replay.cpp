@@ -0,0 +1,118 @@
+/********************************************************
+ *	Mapping replay
+ *
+ *	Maps a sensor log recorded with
+ *	aria_robot_mapping -record <file> again, with no robot
+ *	and no ARIA. Cycles are fed through SonarMapper as
+ *	fast as the CPU goes, so the same log always gives the
+ *	same map and the timing is a repeatable benchmark. The
+ *	log holds the raw odometry, so the poses get scan
+ *	matched onto the map here the way the robot did it,
+ *	and the map comes out the same as the robot's. The
+ *	map checksum printed at the end is there to compare
+ *	runs and builds.
+ *
+ *	usage: mapping_replay <log> [runs]
+ *		runs	map the log this many times and report the
+ *				fastest, 1 by default
+ ********************************************************/
+
+#include "../aria_robot_mapping/sonar_mapper.h"
+#include "../aria_robot_mapping/sensor_log.h"
+#include "../aria_robot_mapping/map_file.h"
+#include "../aria_robot_mapping/map_export.h"
+#include "../aria_robot_mapping/distance_map.h"
+#include "../aria_robot_mapping/scan_matcher.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		cout << "usage: mapping_replay <log> [runs]" << endl;
+		return 1;
+	}
+	int runs = argc > 2 ? atoi(argv[2]) : 1;
+	if(runs < 1)
+		runs = 1;
+
+	vector<SensorLogRecord> records;
+	if(!read_sensor_log(argv[1], records))
+	{
+		cout << "Could not read sensor log " << argv[1] << endl;
+		return 1;
+	}
+	if(records.empty())
+	{
+		cout << "Sensor log is empty" << endl;
+		return 1;
+	}
+	double recorded = records.back().time - records.front().time;
+	cout << records.size() << " cycles, " << fixed << setprecision(1) << recorded << " s of recording" << endl;
+
+	double best = 0;
+	double updates = 0;
+	uint32_t checksum = 0;
+	int matched = 0;
+	for(int run = 0; run < runs; run++)
+	{
+		SonarMapper mapper;
+		DistanceMap distance;
+		mapper.setDistanceMap(&distance);
+		ScanMatcher matcher;
+		mapper.setMatcher(&matcher);
+		updates = 0;
+		matched = 0;
+
+		double start = now_seconds();
+		for(size_t i = 0; i < records.size(); i++)
+		{
+			SensorLogRecord record = records[i];
+			ScanMatchResult match;
+			updates += mapper.update(record, &match);
+			if(match.matched)
+				matched++;
+		}
+		double seconds = now_seconds() - start;
+
+		uint32_t sum = map_checksum(mapper.getMap());
+		if(run > 0 && sum != checksum)
+			cout << "run " << run + 1 << " gave a different map!" << endl;
+		checksum = sum;
+		if(run == 0 || seconds < best)
+			best = seconds;
+
+		if(run == runs - 1)
+		{
+			const logodds_grid &map = mapper.getMap();
+			cout << "map: " << map.getNumTiles() << " tiles, " << map.getMemoryUsage() / 1024 << " KB, checksum "
+				 << hex << setw(8) << setfill('0') << checksum << dec << setfill(' ') << ", " << matched << " of "
+				 << records.size() << " cycles scan matched" << endl;
+
+			if(!write_map_file("robot_map_replay.bin", map, mapper.getCycle()))
+				cout << "Could not write robot_map_replay.bin" << endl;
+			if(!export_map_image(map, "robot_map_replay", MAP_IMAGE_PNG))
+				cout << "Could not write robot_map_replay.png" << endl;
+			if(!write_map_dat(map, "robot_map"))
+				cout << "Could not write robot_map.dat" << endl;
+		}
+	}
+
+	cout << "fastest of " << runs << " runs: " << setprecision(3) << best * 1e3 << " ms, "
+		 << setprecision(2) << best / records.size() * 1e6 << " us/cycle, "
+		 << setprecision(0) << records.size() / best << " cycles/s, "
+		 << updates / best << " cells/s";
+	if(best > 0 && recorded > 0)
+		cout << ", " << setprecision(0) << recorded / best << "x real time";
+	cout << endl;
+	return 0;
+}
@@ -0,0 +1,57 @@
+/********************************************************
+ *	Circle detection, see circle_detection.h
+ ********************************************************/
+
+#include "circle_detection.h"
+
+int detect_circles(IplImage* image, int &x)
+{
+	//smooth image to prevent false detection of circles
+	cvSmooth(image, image);
+
+	//allocate memory for gray, the "1" parameter at the end states how many channels it has
+	//aka, how many colors. 1 channel = gray scale, 3 channels = RGB
+	IplImage* gray = cvCreateImage(cvSize(image->width, image->height), IPL_DEPTH_8U, 1);
+
+	//convert to gray scale, the mono camera's frames already are
+	if(image->nChannels == 1)
+		cvCopy(image, gray);
+	else
+		cvCvtColor(image, gray, CV_BGR2GRAY);
+
+	//Allocates memory to store the locations of circles detected
+	CvMemStorage* storage = cvCreateMemStorage(0);
+
+	//magic happens here! Apply the Hough Transform algorithm to detect circles, any circles detected gets
+	//stored in the storage CvMemStorage variable
+	CvSeq* circles = cvHoughCircles(gray, storage, CV_HOUGH_GRADIENT, 2, 20);
+
+	/*
+		The line below might be a "what the crap is this" for you as it was for me
+		This is called a Ternary Operator.
+			Binary = consisting of two
+			Ternary = consisting of three
+
+		Essentially, if 'circles' == true
+			then the expression evalutes to circles->total
+		If false
+			it evalutes to 0
+
+		To break it down some more...
+		If "circles" has values inside of it, find out how many values it contains, in this case, circles detected
+		If "circles" has no values inside of it, then there are no circles detected. Don't go in for-loop.
+	*/
+	int found = circles ? circles->total : 0;
+	for(int i = 0; i < found; i++)
+	{
+		float* p = (float *)cvGetSeqElem(circles, i);
+		cvCircle(image, cvPoint(cvRound(p[0]), cvRound(p[1])), 3, CV_RGB(0, 255, 0), -1, 8, 0);
+		x = cvRound(p[0]);
+	}
+
+	/* ===== RELEASE THINGS ONCE DONE WITH IT!!!! =====*/
+	// Unless you want crap loads of memory leaks and programs that crash on you
+	cvReleaseImage(&gray);
+	cvReleaseMemStorage(&storage);
+	return found;
+}
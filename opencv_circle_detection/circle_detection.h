@@ -0,0 +1,21 @@
+/********************************************************
+ *	Circle detection on one eye's frame
+ *
+ *	The Hough search opencv_circle_detection runs on each
+ *	eye, out of main so vision_replay can time it on
+ *	recorded frames.
+ ********************************************************/
+
+#ifndef CIRCLE_DETECTION_H
+#define CIRCLE_DETECTION_H
+
+#include <opencv/cv.h>
+
+/*
+ *	Finds circles in image with the Hough transform and marks their
+ *	centers in it. x gets the center of the last circle found and keeps
+ *	its value if there was none. Returns how many were found.
+ */
+int detect_circles(IplImage* image, int &x);
+
+#endif
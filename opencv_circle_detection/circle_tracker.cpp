@@ -0,0 +1,172 @@
+/********************************************************
+ *	Circle tracking, see circle_tracker.h
+ ********************************************************/
+
+#include "circle_tracker.h"
+
+#include <cmath>
+#include <algorithm>
+
+void AlphaBetaFilter::reset(double position)
+{
+	myPosition = position;
+	myVelocity = 0;
+}
+
+void AlphaBetaFilter::update(double measured, double dt)
+{
+	double predicted = predict(dt);
+	double error = measured - predicted;
+	myPosition = predicted + myAlpha * error;
+	if(dt > 0)
+		myVelocity += myBeta * error / dt;
+}
+
+CircleTracker::CircleTracker()
+	: myRadius(0), myTime(0), myTracking(false), myMisses(0), mySinceFull(0),
+	  myFullSearch(false), myFullSearches(0), myWindowSearches(0), myLosses(0), myStorage(cvCreateMemStorage(0)),
+	  myGray(NULL)
+{
+}
+
+CircleTracker::~CircleTracker()
+{
+	cvReleaseMemStorage(&myStorage);
+	cvReleaseImage(&myGray);
+}
+
+void CircleTracker::reset()
+{
+	myTracking = false;
+	myMisses = 0;
+}
+
+int CircleTracker::windowHalf(double dt) const
+{
+	//room for the ball, for how far it might go off its predicted path and more after every miss
+	double speed = sqrt(myX.getVelocity() * myX.getVelocity() + myY.getVelocity() * myY.getVelocity());
+	double half = std::max((double)TRACK_WINDOW_MIN, TRACK_WINDOW_RADII * (double)myRadius) + 0.5 * speed * dt;
+	return (int)(half * (1 + myMisses));
+}
+
+bool CircleTracker::search(IplImage* image, CvRect window, int minRadius, int maxRadius, bool nearest, float x, float y,
+						   TrackedCircle &found)
+{
+	//every window fits the frame, so the scratch image is only made again when the frame size changes
+	if(!myGray || myGray->width != image->width || myGray->height != image->height)
+	{
+		cvReleaseImage(&myGray);
+		myGray = cvCreateImage(cvGetSize(image), IPL_DEPTH_8U, 1);
+	}
+	cvSetImageROI(myGray, cvRect(0, 0, window.width, window.height));
+
+	cvSetImageROI(image, window);
+	if(image->nChannels == 1)
+		cvCopy(image, myGray);
+	else
+		cvCvtColor(image, myGray, CV_BGR2GRAY);
+	cvResetImageROI(image);
+
+	//smooth to prevent false detection of circles, only the gray window though
+	cvSmooth(myGray, myGray);
+
+	cvClearMemStorage(myStorage);
+	CvSeq* circles = cvHoughCircles(myGray, myStorage, CV_HOUGH_GRADIENT, 2, 20, 100, 100, minRadius, maxRadius);
+	cvResetImageROI(myGray);
+
+	//strongest first
+	int best = -1;
+	float bestDistance = 0;
+	for(int i = 0; i < (circles ? circles->total : 0); i++)
+	{
+		float* p = (float *)cvGetSeqElem(circles, i);
+		float dx = window.x + p[0] - x, dy = window.y + p[1] - y;
+		float distance = dx * dx + dy * dy;
+		if(best < 0 || (nearest && distance < bestDistance))
+		{
+			best = i;
+			bestDistance = distance;
+		}
+		if(!nearest)
+			break;
+	}
+	if(best < 0)
+		return false;
+
+	float* p = (float *)cvGetSeqElem(circles, best);
+	found.x = window.x + p[0];
+	found.y = window.y + p[1];
+	found.radius = p[2];
+	return true;
+}
+
+bool CircleTracker::track(IplImage* image, double time, TrackedCircle &circle)
+{
+	double dt = myTracking ? time - myTime : 0;
+	float x = (float)myX.predict(dt), y = (float)myY.predict(dt);
+	int half = myTracking ? windowHalf(dt) : 0;
+
+	myFullSearch = !myTracking || ++mySinceFull >= TRACK_FULL_INTERVAL;
+	TrackedCircle found;
+	bool got;
+	if(myFullSearch)
+	{
+		myFullSearches++;
+		mySinceFull = 0;
+		got = search(image, cvRect(0, 0, image->width, image->height), 0, 0, myTracking, x, y, found);
+	}
+	else
+	{
+		myWindowSearches++;
+		int left = std::max(0, cvRound(x) - half), top = std::max(0, cvRound(y) - half);
+		int right = std::min(image->width, cvRound(x) + half), bottom = std::min(image->height, cvRound(y) + half);
+		int minRadius = (int)(myRadius * (1 - TRACK_RADIUS_SLACK));
+		int maxRadius = (int)(myRadius * (1 + TRACK_RADIUS_SLACK)) + 1;
+
+		//a prediction off the image finds nothing
+		got = right > left && bottom > top &&
+			  search(image, cvRect(left, top, right - left, bottom - top), minRadius, maxRadius, true, x, y, found);
+	}
+
+	//while tracking a full search counts only inside the window, another circle elsewhere isn't the ball
+	if(got && myTracking && (fabs(found.x - x) > half || fabs(found.y - y) > half))
+		got = false;
+
+	if(got)
+	{
+		if(myTracking)
+		{
+			myX.update(found.x, dt);
+			myY.update(found.y, dt);
+		}
+		else
+		{
+			myX.reset(found.x);
+			myY.reset(found.y);
+		}
+		myRadius = found.radius;
+		myTracking = true;
+		myMisses = 0;
+		myTime = time;
+
+		cvCircle(image, cvPoint(cvRound(found.x), cvRound(found.y)), 3, CV_RGB(0, 255, 0), -1, 8, 0);
+		circle = found;
+		return true;
+	}
+
+	if(myTracking)
+	{
+		myX.coast(dt);
+		myY.coast(dt);
+		myTime = time;
+		circle.x = (float)myX.getPosition();
+		circle.y = (float)myY.getPosition();
+		circle.radius = myRadius;
+		if(++myMisses >= TRACK_MISSES)
+		{
+			myTracking = false;
+			myLosses++;
+		}
+	}
+	return false;
+}
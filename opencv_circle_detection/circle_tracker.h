@@ -0,0 +1,137 @@
+/********************************************************
+ *	Following the ball from frame to frame
+ *
+ *	detect_circles runs the Hough transform over the whole
+ *	frame of each eye, every frame. That is most of the
+ *	time a pair takes, and with clutter in the picture
+ *	the thesis saw it drop to a frame every 5 seconds.
+ *	The ball can't go far between two frames though.
+ *
+ *	CircleTracker keeps an alpha-beta filter on the ball's
+ *	center, a constant velocity model: the prediction is
+ *	the last position moved on by the velocity, the
+ *	measurement corrects the position by alpha of the
+ *	difference and the velocity by beta of it. Only a
+ *	window around the prediction is searched, a few radii
+ *	across and wider the faster the ball goes, and only
+ *	for circles within TRACK_RADIUS_SLACK of the last
+ *	radius. The circle nearest the prediction is taken.
+ *	Each miss widens the window, after TRACK_MISSES in a
+ *	row the track is lost and the next frame gets the
+ *	whole image searched again.
+ *
+ *	Without a track the strongest circle in the frame is
+ *	taken. Every TRACK_FULL_INTERVAL-th frame is searched
+ *	whole even while tracking, with no radius bounds, so
+ *	a ball that grew or shrank faster than the window
+ *	search allows isn't lost for good. It takes the circle
+ *	nearest the prediction, and only if that's inside the
+ *	window, a circle elsewhere isn't the ball.
+ *
+ *	Times can be in any unit as long as it's the same
+ *	throughout, the camera program gives seconds and
+ *	vision_replay frame numbers, so the replay speed
+ *	doesn't matter. AlphaBetaFilter is plain arithmetic,
+ *	no OpenCV in it.
+ ********************************************************/
+
+#ifndef CIRCLE_TRACKER_H
+#define CIRCLE_TRACKER_H
+
+#include <opencv/cv.h>
+
+#define TRACK_ALPHA				0.6		//share of the position error taken per measurement
+#define TRACK_BETA				0.2		//share of the position error taken into the velocity
+#define TRACK_WINDOW_RADII		3		//window half width [radii] around the prediction
+#define TRACK_WINDOW_MIN		24		//[pixels] window half width at the least
+#define TRACK_RADIUS_SLACK		0.3		//radius may change this much between frames [fraction]
+#define TRACK_MISSES			5		//frames without the ball before the track is lost
+#define TRACK_FULL_INTERVAL		30		//[frames] between full frame searches while tracking
+
+//one axis, position and velocity
+class AlphaBetaFilter
+{
+public:
+	AlphaBetaFilter(double alpha = TRACK_ALPHA, double beta = TRACK_BETA)
+		: myAlpha(alpha), myBeta(beta), myPosition(0), myVelocity(0) {}
+
+	//starts over at position, standing still
+	void reset(double position);
+
+	//where it'll be dt from the last update
+	double predict(double dt) const { return myPosition + myVelocity * dt; }
+
+	//moves on by dt and corrects with the measured position
+	void update(double measured, double dt);
+
+	//no measurement, moves on by dt at the same velocity
+	void coast(double dt) { myPosition = predict(dt); }
+
+	double getPosition() const { return myPosition; }
+	double getVelocity() const { return myVelocity; }
+
+private:
+	double myAlpha;
+	double myBeta;
+	double myPosition;
+	double myVelocity;		//per unit of time
+};
+
+struct TrackedCircle
+{
+	float x;
+	float y;
+	float radius;
+};
+
+class CircleTracker
+{
+public:
+	CircleTracker();
+	~CircleTracker();
+
+	/*
+	 *	Looks for the ball in image (BGR or grey) taken at time and
+	 *	marks it. Returns false if it isn't there, circle is then the
+	 *	predicted position if there still is a track.
+	 */
+	bool track(IplImage* image, double time, TrackedCircle &circle);
+
+	//drops the track, the next frame is searched whole
+	void reset();
+
+	bool isTracking() const { return myTracking; }
+	bool wasFullSearch() const { return myFullSearch; }		//how the last frame was searched
+	int getFullSearches() const { return myFullSearches; }
+	int getWindowSearches() const { return myWindowSearches; }
+	int getLosses() const { return myLosses; }
+
+private:
+	//window half width [pixels] dt on from the last update
+	int windowHalf(double dt) const;
+
+	//circles in image inside window, nearest to (x, y), or the strongest if nearest is false
+	bool search(IplImage* image, CvRect window, int minRadius, int maxRadius, bool nearest, float x, float y,
+				TrackedCircle &found);
+
+	AlphaBetaFilter myX;
+	AlphaBetaFilter myY;
+	float myRadius;
+	double myTime;			//of the last update
+	bool myTracking;
+	int myMisses;			//window searches in a row without the ball
+	int mySinceFull;		//frames since the last full search
+
+	bool myFullSearch;
+	int myFullSearches;
+	int myWindowSearches;
+	int myLosses;
+
+	CvMemStorage* myStorage;
+	IplImage* myGray;		//gray copy of the window, frame sized and cut down to each window by its ROI
+
+	CircleTracker(const CircleTracker&);
+	CircleTracker& operator=(const CircleTracker&);
+};
+
+#endif
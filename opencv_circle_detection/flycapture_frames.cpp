@@ -0,0 +1,153 @@
+/********************************************************
+ *	FlyCapture frames, see flycapture_frames.h
+ *
+ *	Pixel format switch based on Point-Grey's sample code
+ ********************************************************/
+
+#include "flycapture_frames.h"
+
+#include <stdio.h>
+
+using namespace FlyCapture2;
+
+bool ConvertImageToOpenCV(Image* pImage, FramePool &pool, FrameHandle &frame)
+{
+	PixelFormat format;
+	int type;
+
+	//switch used in the event that a different camera is being used
+	switch(pImage->GetPixelFormat())
+	{
+		case PIXEL_FORMAT_MONO8:		format = PIXEL_FORMAT_MONO8;
+										type = CV_8UC1;
+										break;
+
+		case PIXEL_FORMAT_MONO16:
+		case PIXEL_FORMAT_S_MONO16:		format = PIXEL_FORMAT_MONO16;
+										type = CV_16UC1;
+										break;
+
+		case PIXEL_FORMAT_411YUV8:
+		case PIXEL_FORMAT_422YUV8:
+		case PIXEL_FORMAT_444YUV8:
+		case PIXEL_FORMAT_RGB8:
+		case PIXEL_FORMAT_RGB16:
+		case PIXEL_FORMAT_S_RGB16:
+		case PIXEL_FORMAT_RAW8:
+		case PIXEL_FORMAT_RAW16:
+		case PIXEL_FORMAT_BGR:			format = PIXEL_FORMAT_BGR;		//needs to be BGR format for opencv
+										type = CV_8UC3;
+										break;
+
+		case PIXEL_FORMAT_BGRU:
+		case PIXEL_FORMAT_RGBU:			format = PIXEL_FORMAT_BGRU;
+										type = CV_8UC4;
+										break;
+
+		case PIXEL_FORMAT_MONO12:
+		case PIXEL_FORMAT_RAW12:		printf("Not supported by OpenCV\n");
+										return false;
+
+		default:						printf("Some error occured...\n");
+										return false;
+	}
+
+	//buffers come from the camera's real size, not 640x480
+	int rows = (int)pImage->GetRows(), cols = (int)pImage->GetCols();
+	if(!pool.reserve(rows, cols, type))
+	{
+		printf("Frame size changed to %dx%d while frames were still held\n", cols, rows);
+		return false;
+	}
+	if(!pool.acquire(frame))
+		return false;
+
+	//FlyCapture writes the converted image into the pooled buffer
+	cv::Mat &image = frame.image();
+	Image converted;
+	converted.SetData(image.data, (unsigned int)(image.step[0] * image.rows));
+	Error error = pImage->Convert(format, &converted);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		frame.release();
+		return false;
+	}
+
+	//it only reallocates if the buffer was too small, which the pool sizing rules out
+	if(converted.GetData() != image.data || converted.GetStride() != image.step[0])
+	{
+		printf("FlyCapture didn't convert into the frame buffer\n");
+		frame.release();
+		return false;
+	}
+	return true;
+}
+
+bool StartInterleavedStereo(Camera &cam)
+{
+	Format7Info info;
+	bool supported = false;
+	info.mode = MODE_3;
+	Error error = cam.GetFormat7Info(&info, &supported);
+	if(error != PGRERROR_OK || !supported)
+		return false;
+
+	//RAW16 on the color camera, MONO16 on the mono one
+	PixelFormat formats[2] = { PIXEL_FORMAT_RAW16, PIXEL_FORMAT_MONO16 };
+	for(int i = 0; i < 2; i++)
+	{
+		Format7ImageSettings settings;
+		settings.mode = MODE_3;
+		settings.offsetX = 0;
+		settings.offsetY = 0;
+		settings.width = info.maxWidth;
+		settings.height = info.maxHeight;
+		settings.pixelFormat = formats[i];
+
+		bool valid = false;
+		Format7PacketInfo packet;
+		error = cam.ValidateFormat7Settings(&settings, &valid, &packet);
+		if(error != PGRERROR_OK || !valid)
+			continue;
+
+		error = cam.SetFormat7Configuration(&settings, packet.recommendedBytesPerPacket);
+		if(error != PGRERROR_OK)
+		{
+			error.PrintErrorTrace();
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+StereoBayer GetStereoBayer(const Image* pImage)
+{
+	//the mono camera sends MONO16, nothing to de-Bayer
+	if(pImage->GetPixelFormat() != PIXEL_FORMAT_RAW16)
+		return STEREO_BAYER_NONE;
+
+	switch(pImage->GetBayerTileFormat())
+	{
+		case RGGB:		return STEREO_BAYER_RGGB;
+		case GRBG:		return STEREO_BAYER_GRBG;
+		case GBRG:		return STEREO_BAYER_GBRG;
+		case BGGR:		return STEREO_BAYER_BGGR;
+		default:		return STEREO_BAYER_NONE;
+	}
+}
+
+bool ConvertStereoToOpenCV(Image* pImage, StereoSplitter &splitter, FramePool &pool,
+						   FrameHandle &left, FrameHandle &right)
+{
+	PixelFormat format = pImage->GetPixelFormat();
+	if(format != PIXEL_FORMAT_RAW16 && format != PIXEL_FORMAT_MONO16)
+	{
+		printf("Not an interleaved stereo image\n");
+		return false;
+	}
+
+	return splitter.split(pImage->GetData(), pImage->GetStride(), (int)pImage->GetRows(), (int)pImage->GetCols(),
+						  GetStereoBayer(pImage), pool, left, right);
+}
@@ -0,0 +1,46 @@
+/********************************************************
+ *	FlyCapture images into pooled OpenCV frames
+ *
+ *	The one ConvertImageToOpenCV both vision programs
+ *	share. FlyCapture converts the camera's image
+ *	straight into a buffer of the frame pool, the cv::Mat
+ *	of the frame is the only header there is and nothing
+ *	gets copied after the conversion. The frame stays
+ *	valid until its last handle lets go, the next
+ *	RetrieveBuffer doesn't touch it.
+ ********************************************************/
+
+#ifndef FLYCAPTURE_FRAMES_H
+#define FLYCAPTURE_FRAMES_H
+
+#include "frame_pool.h"
+#include "stereo_deinterleave.h"
+
+#include "FlyCapture2.h"
+
+/*
+ *	Converts pImage into a frame from pool, BGR for color formats and
+ *	8 or 16 bit grey for mono ones. Sizes the pool by the image. Returns
+ *	false if the format can't be shown in OpenCV, the conversion failed
+ *	or no frame was free, pool.getExhausted() counts the last.
+ */
+bool ConvertImageToOpenCV(FlyCapture2::Image* pImage, FramePool &pool, FrameHandle &frame);
+
+/*
+ *	Switches the Bumblebee2 to Format7 mode 3, both eyes interleaved in
+ *	every frame at full size. Call before StartCapture. Returns false if
+ *	the camera doesn't have the mode, it's then left as it was.
+ */
+bool StartInterleavedStereo(FlyCapture2::Camera &cam);
+
+//the sensor's color filter in StereoSplitter's terms
+StereoBayer GetStereoBayer(const FlyCapture2::Image* pImage);
+
+/*
+ *	Splits an interleaved mode 3 image into a left and a right frame
+ *	from pool. false if it isn't 16 bits per pixel or no frame was free
+ */
+bool ConvertStereoToOpenCV(FlyCapture2::Image* pImage, StereoSplitter &splitter, FramePool &pool,
+						   FrameHandle &left, FrameHandle &right);
+
+#endif
@@ -0,0 +1,207 @@
+/********************************************************
+ *	The Bumblebee2 as a FrameSource, see flycapture_source.h
+ *
+ *	Camera setup based on Point-Grey's sample code
+ ********************************************************/
+
+#include "flycapture_source.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <stdio.h>
+
+using namespace FlyCapture2;
+
+#define LEFT_EYE	0x82000000		//register 0x884 values
+#define RIGHT_EYE	0x82000001
+
+FlyCaptureSource::FlyCaptureSource(FramePool &pool, FlyCaptureMode mode)
+	: myPool(pool), myMode(mode), myStarted(false), myFailed(false), mySequence(0), myRecordPath(NULL), myRecordStart(0)
+{
+}
+
+FlyCaptureSource::~FlyCaptureSource()
+{
+	myRecording.close();
+	if(myStarted)
+	{
+		Error error = myCam.StopCapture();
+		if(error != PGRERROR_OK)
+			error.PrintErrorTrace();
+	}
+	if(myCam.IsConnected())
+	{
+		Error error = myCam.Disconnect();
+		if(error != PGRERROR_OK)
+			error.PrintErrorTrace();
+	}
+}
+
+bool FlyCaptureSource::open()
+{
+	BusManager busMgr;
+	unsigned int numCameras;
+
+	Error error = busMgr.GetNumOfCameras(&numCameras);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		return false;
+	}
+
+	printf("Number of cameras detected: %u\n", numCameras);
+	PGRGuid guid;
+	for(unsigned int i = 0; i < numCameras; i++)
+	{
+		error = busMgr.GetCameraFromIndex(i, &guid);
+		if(error != PGRERROR_OK)
+		{
+			error.PrintErrorTrace();
+			return false;
+		}
+	}
+
+	//Connect, get info, start getting images
+	error = myCam.Connect(&guid);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		return false;
+	}
+
+	CameraInfo camInfo;
+	error = myCam.GetCameraInfo(&camInfo);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		return false;
+	}
+
+	if(myMode == FLYCAPTURE_INTERLEAVED && !StartInterleavedStereo(myCam))
+	{
+		printf("Camera has no interleaved stereo mode, toggling between the eyes\n");
+		myMode = FLYCAPTURE_TOGGLE;
+	}
+
+	error = myCam.StartCapture();
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		return false;
+	}
+	myStarted = true;
+	return true;
+}
+
+void FlyCaptureSource::record(const char* path)
+{
+	if(myMode != FLYCAPTURE_INTERLEAVED)
+	{
+		printf("-record needs the interleaved mode, not recording\n");
+		return;
+	}
+	myRecordPath = path;
+}
+
+bool FlyCaptureSource::retrieve()
+{
+	Error error = myCam.RetrieveBuffer(&myRawImage);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		myFailed = true;
+		return false;
+	}
+	return true;
+}
+
+//one eye into a pooled frame, register 0x884 picks the eye the camera sends
+bool FlyCaptureSource::captureEye(unsigned int eye, FrameHandle &frame)
+{
+	//WriteRegister(Register to write too, value to write to register, broadcast this image)
+	Error error = myCam.WriteRegister(0x884, eye, true);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		myFailed = true;
+		return false;
+	}
+
+	//get source image, straight into a pooled frame
+	bool got = retrieve() && ConvertImageToOpenCV(&myRawImage, myPool, frame);
+
+	//Set to false...or else things get weird
+	error = myCam.WriteRegister(0x884, eye, false);
+	if(error != PGRERROR_OK)
+	{
+		error.PrintErrorTrace();
+		myFailed = true;
+		return false;
+	}
+
+	if(!got && !myFailed)
+		printf("No %s frame, %d times out of frame buffers\n", eye == LEFT_EYE ? "left" : "right", myPool.getExhausted());
+	return got;
+}
+
+//both eyes out of one mode 3 frame, saved first if recording
+bool FlyCaptureSource::captureInterleaved(StereoFrame &pair)
+{
+	if(!retrieve())
+		return false;
+	pair.captured = now_seconds();
+
+	if(myRecordPath)
+	{
+		if(!myRecording.open(myRecordPath, (int)myRawImage.GetRows(), (int)myRawImage.GetCols(), GetStereoBayer(&myRawImage)))
+			printf("Could not open %s, not recording\n", myRecordPath);
+		myRecordPath = NULL;
+		myRecordStart = pair.captured;
+	}
+	if(myRecording.isOpen())
+		myRecording.write(pair.captured - myRecordStart, myRawImage.GetData(), myRawImage.GetStride());
+
+	if(!ConvertStereoToOpenCV(&myRawImage, mySplitter, myPool, pair.left, pair.right))
+	{
+		printf("No stereo pair, %d times out of frame buffers\n", myPool.getExhausted());
+		return false;
+	}
+	return true;
+}
+
+bool FlyCaptureSource::grab(StereoFrame &pair)
+{
+	if(myFailed)
+		return false;
+
+	switch(myMode)
+	{
+		case FLYCAPTURE_SINGLE:
+			if(!retrieve())
+				return false;
+			pair.captured = now_seconds();
+			if(!ConvertImageToOpenCV(&myRawImage, myPool, pair.left))
+			{
+				printf("No frame, %d times out of frame buffers\n", myPool.getExhausted());
+				return false;
+			}
+			break;
+
+		case FLYCAPTURE_INTERLEAVED:
+			if(!captureInterleaved(pair))
+				return false;
+			break;
+
+		case FLYCAPTURE_TOGGLE:
+			if(!captureEye(LEFT_EYE, pair.left))
+				return false;
+			pair.captured = now_seconds();
+			if(!captureEye(RIGHT_EYE, pair.right))
+			{
+				pair.left.release();
+				return false;
+			}
+			break;
+	}
+	pair.sequence = mySequence++;
+	return true;
+}
@@ -0,0 +1,73 @@
+/********************************************************
+ *	The Bumblebee2 as a FrameSource
+ *
+ *	The camera setup both programs had in main, Point
+ *	Grey's sample code: the last camera on the bus is
+ *	connected and started. Then one of
+ *		FLYCAPTURE_SINGLE		whatever image the camera
+ *								sends, as the left eye
+ *								(line following)
+ *		FLYCAPTURE_INTERLEAVED	both eyes out of one mode 3
+ *								frame (stereo_deinterleave.h)
+ *		FLYCAPTURE_TOGGLE		each eye on its own, picked
+ *								with register 0x884
+ *	Interleaved falls back to toggle if the camera has no
+ *	mode 3. A failed retrieval ends the source instead of
+ *	the program, so the robot gets shut down properly.
+ ********************************************************/
+
+#ifndef FLYCAPTURE_SOURCE_H
+#define FLYCAPTURE_SOURCE_H
+
+#include "frame_source.h"
+#include "flycapture_frames.h"
+
+enum FlyCaptureMode
+{
+	FLYCAPTURE_SINGLE,
+	FLYCAPTURE_INTERLEAVED,
+	FLYCAPTURE_TOGGLE
+};
+
+class FlyCaptureSource : public FrameSource
+{
+public:
+	FlyCaptureSource(FramePool &pool, FlyCaptureMode mode);
+	~FlyCaptureSource();
+
+	//connects and starts the camera, false with the error printed if it couldn't
+	bool open();
+
+	//saves every interleaved frame to path (stereo_raw_file.h), from the next one on
+	void record(const char* path);
+
+	FlyCaptureMode getMode() const { return myMode; }
+
+	bool grab(StereoFrame &pair);
+	bool atEnd() const { return myFailed; }
+	bool isStereo() const { return myMode != FLYCAPTURE_SINGLE; }
+
+private:
+	bool retrieve();
+	bool captureEye(unsigned int eye, FrameHandle &frame);
+	bool captureInterleaved(StereoFrame &pair);
+
+	FramePool &myPool;
+	FlyCaptureMode myMode;
+	FlyCapture2::Camera myCam;
+	FlyCapture2::Image myRawImage;
+	StereoSplitter mySplitter;
+	bool myStarted;
+	bool myFailed;
+	uint32_t mySequence;
+
+	//raw interleaved frames to keep, the file is opened with the first one when its size is known
+	const char* myRecordPath;
+	StereoRawWriter myRecording;
+	double myRecordStart;
+
+	FlyCaptureSource(const FlyCaptureSource&);
+	FlyCaptureSource& operator=(const FlyCaptureSource&);
+};
+
+#endif
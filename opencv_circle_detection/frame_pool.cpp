@@ -0,0 +1,142 @@
+/********************************************************
+ *	Frame pool, see frame_pool.h
+ ********************************************************/
+
+#include "frame_pool.h"
+
+FrameHandle::FrameHandle(const FrameHandle &other)
+	: myPool(other.myPool), mySlot(other.mySlot)
+{
+	if(myPool)
+		myPool->addRef(mySlot);
+}
+
+FrameHandle& FrameHandle::operator=(const FrameHandle &other)
+{
+	//take the new one first, assigning a handle to itself mustn't free the frame
+	FramePool* pool = other.myPool;
+	int slot = other.mySlot;
+	if(pool)
+		pool->addRef(slot);
+	release();
+	myPool = pool;
+	mySlot = slot;
+	return *this;
+}
+
+void FrameHandle::release()
+{
+	if(myPool)
+		myPool->releaseRef(mySlot);
+	myPool = NULL;
+	mySlot = -1;
+}
+
+int FrameHandle::detach()
+{
+	int slot = mySlot;
+	myPool = NULL;
+	mySlot = -1;
+	return slot;
+}
+
+cv::Mat& FrameHandle::image() const
+{
+	return myPool->mySlots[mySlot].image;
+}
+
+FramePool::FramePool(int count)
+	: mySlots(count), myRows(0), myCols(0), myType(-1), myExhausted(0), myAllocations(0)
+{
+	for(int i = 0; i < count; i++)
+		mySlots[i].refs = 0;
+}
+
+bool FramePool::reserve(int rows, int cols, int type)
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	if(rows == myRows && cols == myCols && type == myType)
+		return true;
+	if((int)myFreeSlots.size() != (int)mySlots.size() && myAllocations > 0)
+		return false;
+
+	//all at once, so a frame in the loop never waits on the allocator
+	myFreeSlots.clear();
+	for(int i = (int)mySlots.size() - 1; i >= 0; i--)
+	{
+		mySlots[i].image.create(rows, cols, type);
+		mySlots[i].refs = 0;
+		myFreeSlots.push_back(i);
+	}
+	myRows = rows;
+	myCols = cols;
+	myType = type;
+	myAllocations++;
+	return true;
+}
+
+bool FramePool::acquire(FrameHandle &frame)
+{
+	frame.release();
+
+	boost::mutex::scoped_lock lock(myMutex);
+	if(myFreeSlots.empty())
+	{
+		if(myAllocations > 0)
+			myExhausted++;
+		return false;
+	}
+	int slot = myFreeSlots.back();
+	myFreeSlots.pop_back();
+	mySlots[slot].refs = 1;
+	frame.myPool = this;
+	frame.mySlot = slot;
+	return true;
+}
+
+void FramePool::adopt(int slot, FrameHandle &frame)
+{
+	frame.release();
+	frame.myPool = this;
+	frame.mySlot = slot;
+}
+
+int FramePool::getFree() const
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	return (int)myFreeSlots.size();
+}
+
+int FramePool::getExhausted() const
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	return myExhausted;
+}
+
+int FramePool::getAllocations() const
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	return myAllocations;
+}
+
+size_t FramePool::getMemoryUsage() const
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	size_t bytes = 0;
+	for(size_t i = 0; i < mySlots.size(); i++)
+		bytes += mySlots[i].image.step[0] * mySlots[i].image.rows;
+	return bytes;
+}
+
+void FramePool::addRef(int slot)
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	mySlots[slot].refs++;
+}
+
+void FramePool::releaseRef(int slot)
+{
+	boost::mutex::scoped_lock lock(myMutex);
+	if(--mySlots[slot].refs == 0)
+		myFreeSlots.push_back(slot);
+}
@@ -0,0 +1,117 @@
+/********************************************************
+ *	Preallocated camera frames with counted handles
+ *
+ *	ConvertImageToOpenCV used to make a new IplImage
+ *	header every frame and never free it, and every color
+ *	frame went into the one global colorImage buffer, so
+ *	the next frame wrote over the image the last header
+ *	still pointed at. Its size was 640x480 whatever the
+ *	camera sent.
+ *
+ *	A FramePool allocates a fixed number of buffers once,
+ *	sized by the first frame the camera sends, each
+ *	wrapped by a cv::Mat that shares its memory. A frame
+ *	is taken with acquire() and goes back to the pool
+ *	when the last FrameHandle pointing at it goes away,
+ *	so a frame stays put as long as anything still looks
+ *	at it and memory doesn't grow in the frame loop. If
+ *	every buffer is still held acquire() fails and the
+ *	pool counts it rather than allocating more, the loop
+ *	is holding on to frames it should have let go.
+ *
+ *	Handles can be copied and released from any thread,
+ *	the pool keeps the counts under its mutex. The pool
+ *	has to outlive its handles.
+ ********************************************************/
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <opencv/cv.h>
+#include <boost/thread.hpp>
+
+#include <vector>
+#include <cstddef>
+
+#define FRAME_POOL_SIZE		4		//frames in flight, one processed, one captured and room to spare
+
+class FramePool;
+
+class FrameHandle
+{
+public:
+	FrameHandle() : myPool(NULL), mySlot(-1) {}
+	FrameHandle(const FrameHandle &other);
+	FrameHandle& operator=(const FrameHandle &other);
+	~FrameHandle() { release(); }
+
+	//lets go of the frame, it goes back to the pool once no handle has it
+	void release();
+
+	bool empty() const { return myPool == NULL; }
+
+	/*
+	 *	Hands the frame's reference over as its slot number, the handle is
+	 *	empty after and the frame stays out until FramePool::adopt takes it
+	 *	back into a handle. For passing frames through lock-free queues.
+	 */
+	int detach();
+
+	//the pooled buffer, rows x cols of the type the pool was sized for
+	cv::Mat& image() const;
+
+private:
+	friend class FramePool;
+
+	FramePool* myPool;
+	int mySlot;
+};
+
+class FramePool
+{
+public:
+	FramePool(int count = FRAME_POOL_SIZE);
+
+	/*
+	 *	Sizes the buffers for frames of rows x cols of an OpenCV type
+	 *	(CV_8UC3, ...). The first call allocates, calls with the same size
+	 *	do nothing. Returns false if the size changes while frames are out.
+	 */
+	bool reserve(int rows, int cols, int type);
+
+	//a free frame, false if every one is still held or the pool wasn't sized yet
+	bool acquire(FrameHandle &frame);
+
+	//frame takes over the reference a handle of this pool detached
+	void adopt(int slot, FrameHandle &frame);
+
+	int getCount() const { return (int)mySlots.size(); }
+	int getFree() const;
+	int getExhausted() const;		//acquire calls that found no free frame
+	int getAllocations() const;		//times the buffers were (re)allocated
+	size_t getMemoryUsage() const;
+
+private:
+	friend class FrameHandle;
+
+	struct Slot
+	{
+		cv::Mat image;
+		int refs;
+	};
+
+	void addRef(int slot);
+	void releaseRef(int slot);
+
+	std::vector<Slot> mySlots;
+	std::vector<int> myFreeSlots;
+	int myRows, myCols, myType;
+	int myExhausted;
+	int myAllocations;
+	mutable boost::mutex myMutex;
+
+	FramePool(const FramePool&);
+	FramePool& operator=(const FramePool&);
+};
+
+#endif
@@ -0,0 +1,200 @@
+/********************************************************
+ *	Stereo frame ring, see frame_ring.h
+ ********************************************************/
+
+#include "frame_ring.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+ *	x86 doesn't reorder loads with loads or stores with stores, so
+ *	acquire and release only have to keep the compiler from moving
+ *	things past them. The compare and swap is a full barrier.
+ */
+static uint32_t load_acquire(const volatile uint32_t* p)
+{
+#ifdef _MSC_VER
+	uint32_t v = *p;
+	_ReadWriteBarrier();
+	return v;
+#else
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void store_release(volatile uint32_t* p, uint32_t v)
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+	*p = v;
+#else
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+#endif
+}
+
+//earlier loads and stores stay before later stores, so the odd version is out before the fields change
+static void fence_release()
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+//earlier loads stay before later loads and stores, so the fields are read before the version is checked again
+static void fence_acquire()
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+static bool compare_and_swap(volatile uint32_t* p, uint32_t expected, uint32_t value)
+{
+#ifdef _MSC_VER
+	return (uint32_t)_InterlockedCompareExchange((volatile long*)p, (long)value, (long)expected) == expected;
+#else
+	return __sync_bool_compare_and_swap(p, expected, value);
+#endif
+}
+
+StereoFrameRing::StereoFrameRing(FramePool &pool, int slots)
+	: myPool(pool), mySlots(slots), myMask(slots - 1), myHead(0), myTail(0), myOverwritten(0), mySkipped(0)
+{
+}
+
+StereoFrameRing::~StereoFrameRing()
+{
+	StereoFrame pair;
+	while(pop(pair))
+		;
+}
+
+void StereoFrameRing::push(StereoFrame &pair)
+{
+	uint32_t tail = myTail;
+
+	//full, the oldest pair goes unless the consumer takes it first
+	for(;;)
+	{
+		uint32_t head = load_acquire(&myHead);
+		if(tail - head < myMask)
+			break;
+		//only this thread writes slots, its own copy can't be torn
+		Entry oldest;
+		read(mySlots[head & myMask], oldest);
+		if(compare_and_swap(&myHead, head, head + 1))
+		{
+			StereoFrame dropped;
+			adopt(oldest, dropped);
+			store_release(&myOverwritten, myOverwritten + 1);
+		}
+	}
+
+	Entry entry;
+	entry.left = pair.left.detach();
+	entry.right = pair.right.detach();
+	entry.captured = pair.captured;
+	entry.sequence = pair.sequence;
+	write(mySlots[tail & myMask], entry);
+	store_release(&myTail, tail + 1);
+}
+
+//producer only
+void StereoFrameRing::write(Slot &slot, const Entry &entry)
+{
+	uint32_t version = slot.version;
+	slot.version = version + 1;
+	fence_release();
+	slot.left = entry.left;
+	slot.right = entry.right;
+	slot.captured = entry.captured;
+	slot.sequence = entry.sequence;
+	store_release(&slot.version, version + 2);
+}
+
+//false if the producer was writing the slot meanwhile, entry is torn then
+bool StereoFrameRing::read(const Slot &slot, Entry &entry) const
+{
+	uint32_t version = load_acquire(&slot.version);
+	if(version & 1)
+		return false;
+	entry.left = slot.left;
+	entry.right = slot.right;
+	entry.captured = slot.captured;
+	entry.sequence = slot.sequence;
+	fence_acquire();
+	return slot.version == version;
+}
+
+//moves head past the oldest pair, entry is only good if this returns true
+bool StereoFrameRing::take(Entry &entry)
+{
+	for(;;)
+	{
+		uint32_t head = load_acquire(&myHead);
+		if(head == load_acquire(&myTail))
+			return false;
+		//being refilled means head is already past it, start over from the new head
+		if(!read(mySlots[head & myMask], entry))
+			continue;
+		if(compare_and_swap(&myHead, head, head + 1))
+			return true;
+		//the producer dropped it meanwhile, try the next one
+	}
+}
+
+void StereoFrameRing::adopt(const Entry &entry, StereoFrame &pair)
+{
+	myPool.adopt(entry.left, pair.left);
+	myPool.adopt(entry.right, pair.right);
+	pair.captured = entry.captured;
+	pair.sequence = entry.sequence;
+}
+
+bool StereoFrameRing::pop(StereoFrame &pair)
+{
+	Entry entry;
+	if(!take(entry))
+		return false;
+	adopt(entry, pair);
+	return true;
+}
+
+bool StereoFrameRing::popNewest(StereoFrame &pair)
+{
+	Entry entry;
+	if(!take(entry))
+		return false;
+
+	Entry newer;
+	while(take(newer))
+	{
+		StereoFrame skipped;
+		adopt(entry, skipped);
+		store_release(&mySkipped, mySkipped + 1);
+		entry = newer;
+	}
+	adopt(entry, pair);
+	return true;
+}
+
+uint32_t StereoFrameRing::getPushed() const
+{
+	return load_acquire(&myTail);
+}
+
+uint32_t StereoFrameRing::getOverwritten() const
+{
+	return load_acquire(&myOverwritten);
+}
+
+uint32_t StereoFrameRing::getSkipped() const
+{
+	return load_acquire(&mySkipped);
+}
@@ -0,0 +1,117 @@
+/********************************************************
+ *	Stereo frame ring between the capture thread and the
+ *	circle detection
+ *
+ *	The thesis loop captured the left eye, processed it,
+ *	waited 100ms, did the same for the right eye and only
+ *	then steered, a command every 200ms and more. Now a
+ *	capture thread keeps grabbing pairs and pushes them
+ *	here while the main loop processes whatever pair is
+ *	newest.
+ *
+ *	One thread pushes and one pops, neither ever waits on
+ *	the other. The ring holds STEREO_RING_SLOTS - 1 pairs.
+ *	When processing falls behind, the capture thread
+ *	drops the oldest pair to make room rather than
+ *	stalling the camera, and popNewest() skips everything
+ *	older than the last pair, the robot steers by the
+ *	freshest picture there is. Both are counted.
+ *
+ *	head (next pair to pop) and tail (next slot to fill)
+ *	only ever count up. The producer fills a slot and
+ *	then bumps tail. Whoever takes a pair off, the
+ *	consumer popping or the producer dropping, has to
+ *	move head past it with a compare and swap, so exactly
+ *	one of them ends up owning its frames. A slot is only
+ *	refilled once head is past it, but the consumer may
+ *	still be copying it then, so each slot is a seqlock:
+ *	its version is odd while the producer writes it and
+ *	the consumer only keeps a copy that saw the same even
+ *	version before and after. A copy of a slot that got
+ *	refilled would lose the swap anyway, the version
+ *	check makes sure the fields were never read while
+ *	they were being written.
+ *
+ *	Frames go through the ring as pool slot numbers
+ *	(FrameHandle::detach), the ring has to be given the
+ *	pool the frames come from.
+ ********************************************************/
+
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include "frame_pool.h"
+
+#include <vector>
+#include <stdint.h>
+
+#define STEREO_RING_SLOTS	4		//power of two, one stays empty
+
+struct StereoFrame
+{
+	FrameHandle left;
+	FrameHandle right;
+	double captured;				//[s] now_seconds() when the left eye was retrieved
+	uint32_t sequence;				//pairs captured before this one
+};
+
+class StereoFrameRing
+{
+public:
+	StereoFrameRing(FramePool &pool, int slots = STEREO_RING_SLOTS);
+	~StereoFrameRing();
+
+	//capture thread only. Takes over the pair's frames, drops the oldest pair if the ring is full
+	void push(StereoFrame &pair);
+
+	//processing thread only. The oldest pair, false if the ring is empty
+	bool pop(StereoFrame &pair);
+
+	//processing thread only. The newest pair, every older one gets dropped
+	bool popNewest(StereoFrame &pair);
+
+	int getCapacity() const { return (int)myMask; }
+	uint32_t getPushed() const;
+	uint32_t getOverwritten() const;	//dropped by push, the ring was full
+	uint32_t getSkipped() const;		//dropped by popNewest for a newer pair
+
+private:
+	//what a slot holds, copied out of it
+	struct Entry
+	{
+		int left;
+		int right;
+		double captured;
+		uint32_t sequence;
+	};
+
+	//an entry behind a version that is odd while it is being written
+	struct Slot
+	{
+		Slot() : version(0), left(-1), right(-1), captured(0), sequence(0) {}
+
+		volatile uint32_t version;
+		volatile int left;
+		volatile int right;
+		volatile double captured;
+		volatile uint32_t sequence;
+	};
+
+	void write(Slot &slot, const Entry &entry);
+	bool read(const Slot &slot, Entry &entry) const;
+	bool take(Entry &entry);
+	void adopt(const Entry &entry, StereoFrame &pair);
+
+	FramePool &myPool;
+	std::vector<Slot> mySlots;
+	uint32_t myMask;
+	volatile uint32_t myHead;
+	volatile uint32_t myTail;
+	volatile uint32_t myOverwritten;
+	volatile uint32_t mySkipped;
+
+	StereoFrameRing(const StereoFrameRing&);
+	StereoFrameRing& operator=(const StereoFrameRing&);
+};
+
+#endif
@@ -0,0 +1,159 @@
+/********************************************************
+ *	Replay frame sources, see frame_source.h
+ ********************************************************/
+
+#include "frame_source.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+bool RawFileSource::open(const char* path)
+{
+	myEnd = !myReader.open(path);
+	mySequence = 0;
+	return !myEnd;
+}
+
+bool RawFileSource::grab(StereoFrame &pair)
+{
+	double time;
+	if(myEnd || !myReader.read(time, myRaw))
+	{
+		myEnd = true;
+		return false;
+	}
+
+	pair.captured = now_seconds();
+	if(!mySplitter.split(&myRaw[0], myReader.getStride(), myReader.getRows(), myReader.getCols(), myReader.getBayer(),
+						 myPool, pair.left, pair.right))
+		return false;
+	pair.sequence = mySequence++;
+	return true;
+}
+
+bool RawFileSource::rewind()
+{
+	myReader.rewind();
+	myEnd = false;
+	mySequence = 0;
+	return true;
+}
+
+bool ImageSource::Stream::open(const char* path)
+{
+	if(!strchr(path, '%'))
+		return myVideo.open(path);
+
+	//sequences are numbered from 0 or from 1
+	myPattern = path;
+	char name[1024];
+	for(myFirst = 0; myFirst < 2; myFirst++)
+	{
+		sprintf(name, path, myFirst);
+		std::ifstream probe(name);
+		if(probe)
+		{
+			myNext = myFirst;
+			return true;
+		}
+	}
+	myPattern.clear();
+	return false;
+}
+
+bool ImageSource::Stream::read(cv::Mat &image)
+{
+	if(myPattern.empty())
+		return myVideo.read(image) && !image.empty();
+
+	char name[1024];
+	sprintf(name, myPattern.c_str(), myNext++);
+	image = cv::imread(name);
+	return !image.empty();
+}
+
+bool ImageSource::Stream::rewind()
+{
+	myNext = myFirst;
+	return !myPattern.empty() || myVideo.set(CV_CAP_PROP_POS_FRAMES, 0);
+}
+
+bool ImageSource::open(const char* left, const char* right)
+{
+	myEnd = !myEyes[0].open(left) || (right && !myEyes[1].open(right));
+	mySequence = 0;
+	return !myEnd;
+}
+
+//decodes into myImage first, the pool frame is only taken once the size is known
+bool ImageSource::readEye(Stream &stream, FrameHandle &frame)
+{
+	if(!stream.read(myImage))
+	{
+		myEnd = true;
+		return false;
+	}
+	if(!myPool.reserve(myImage.rows, myImage.cols, myImage.type()))
+	{
+		printf("Frame size changed to %dx%d while frames were still held\n", myImage.cols, myImage.rows);
+		myEnd = true;
+		return false;
+	}
+	if(!myPool.acquire(frame))
+		return false;
+	myImage.copyTo(frame.image());
+	return true;
+}
+
+bool ImageSource::grab(StereoFrame &pair)
+{
+	if(myEnd)
+		return false;
+
+	pair.captured = now_seconds();
+	if(!readEye(myEyes[0], pair.left))
+		return false;
+	if(isStereo() && !readEye(myEyes[1], pair.right))
+	{
+		pair.left.release();
+		return false;
+	}
+	pair.sequence = mySequence++;
+	return true;
+}
+
+bool ImageSource::rewind()
+{
+	myEnd = !myEyes[0].rewind() || (isStereo() && !myEyes[1].rewind());
+	mySequence = 0;
+	return !myEnd;
+}
+
+static bool is_stereo_recording(const char* path)
+{
+	char magic[8] = {};
+	std::ifstream input(path, std::ios::binary);
+	return input.read(magic, sizeof(magic)) && memcmp(magic, STEREO_RAW_MAGIC, sizeof(magic)) == 0;
+}
+
+FrameSource* open_replay_source(const char* path, const char* right, FramePool &pool)
+{
+	if(is_stereo_recording(path))
+	{
+		if(right)
+			printf("%s has both eyes, not using %s\n", path, right);
+		RawFileSource* source = new RawFileSource(pool);
+		if(source->open(path))
+			return source;
+		delete source;
+		return NULL;
+	}
+
+	ImageSource* source = new ImageSource(pool);
+	if(source->open(path, right))
+		return source;
+	delete source;
+	return NULL;
+}
@@ -0,0 +1,129 @@
+/********************************************************
+ *	Where the vision programs get their frames from
+ *
+ *	Both programs used to set up the camera in main and
+ *	call RetrieveBuffer right in their loops, so none of
+ *	the vision code could run without a Bumblebee2 on the
+ *	FireWire bus. They take their frames from a
+ *	FrameSource now:
+ *		FlyCaptureSource	the camera (flycapture_source.h)
+ *		RawFileSource		an opencv_circle_detection -record
+ *							recording, split like the camera's
+ *							frames are
+ *		ImageSource			a video file or a numbered image
+ *							sequence, one for each eye
+ *	The replay sources need neither FlyCapture nor a
+ *	robot, vision_replay runs the detection code on them
+ *	as fast as the CPU goes.
+ *
+ *	Frames come out of the pool the source is given, sized
+ *	by the first frame, like the camera's always did.
+ ********************************************************/
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "frame_ring.h"
+#include "stereo_raw_file.h"
+
+#include <opencv/highgui.h>
+
+#include <string>
+#include <vector>
+
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	/*
+	 *	The next frame into pooled frames, pair.left always and pair.right
+	 *	too from a stereo source. captured is now_seconds() when it came in.
+	 *	false if there was no frame, atEnd() tells whether there will be.
+	 */
+	virtual bool grab(StereoFrame &pair) = 0;
+
+	//a replay ran out or the camera failed
+	virtual bool atEnd() const = 0;
+	virtual bool isStereo() const = 0;
+
+	//back to the first frame, false if the source can't
+	virtual bool rewind() { return false; }
+};
+
+//interleaved frames saved with -record, split into both eyes as they're read
+class RawFileSource : public FrameSource
+{
+public:
+	RawFileSource(FramePool &pool) : myPool(pool), myEnd(false), mySequence(0) {}
+
+	bool open(const char* path);
+
+	bool grab(StereoFrame &pair);
+	bool atEnd() const { return myEnd; }
+	bool isStereo() const { return true; }
+	bool rewind();
+
+private:
+	FramePool &myPool;
+	StereoRawReader myReader;
+	StereoSplitter mySplitter;
+	std::vector<unsigned char> myRaw;
+	bool myEnd;
+	uint32_t mySequence;
+};
+
+/*
+ *	Frames from a video file through cv::VideoCapture, or from single
+ *	images read with cv::imread if the path has a printf pattern in it
+ *	(left_%04d.png), numbered from 0 or 1. Stereo if it's given a second
+ *	path for the right eye, a pair ends with the shorter of the two.
+ */
+class ImageSource : public FrameSource
+{
+public:
+	ImageSource(FramePool &pool) : myPool(pool), myEnd(false), mySequence(0) {}
+
+	bool open(const char* left, const char* right = NULL);
+
+	bool grab(StereoFrame &pair);
+	bool atEnd() const { return myEnd; }
+	bool isStereo() const { return myEyes[1].isOpen(); }
+	bool rewind();
+
+private:
+	//one eye's video or image sequence
+	class Stream
+	{
+	public:
+		Stream() : myFirst(0), myNext(0) {}
+
+		bool open(const char* path);
+		bool isOpen() const { return !myPattern.empty() || myVideo.isOpened(); }
+		bool read(cv::Mat &image);
+		bool rewind();
+
+	private:
+		cv::VideoCapture myVideo;
+		std::string myPattern;
+		int myFirst;
+		int myNext;
+	};
+
+	bool readEye(Stream &stream, FrameHandle &frame);
+
+	FramePool &myPool;
+	Stream myEyes[2];
+	cv::Mat myImage;				//decoded, waiting to be copied into a frame
+	bool myEnd;
+	uint32_t mySequence;
+};
+
+/*
+ *	A replay source for path: a -record recording if the file starts
+ *	with its magic, otherwise a video or image sequence, with right as
+ *	the right eye's if given. NULL if it can't be opened.
+ */
+FrameSource* open_replay_source(const char* path, const char* right, FramePool &pool);
+
+#endif
@@ -7,6 +7,26 @@
  *
  *	Created By: Daniel Kulas, Bethune-Cookman University
  *				10/3/12
+ *
+ *	A capture thread grabs left/right pairs into a frame ring (frame_ring.h) while the main loop
+ *	finds the circles in the newest pair and steers, every few seconds it prints how many pairs
+ *	were captured and processed and how old a pair was by the time the robot acted on it.
+ *	-serial runs the original loop instead, capture then process one eye at a time with a 100ms
+ *	wait after each, for comparison.
+ *
+ *	The camera sends both eyes in one interleaved frame (Format7 mode 3, stereo_deinterleave.h),
+ *	one RetrieveBuffer per pair. -toggle goes back to picking the eye with register 0x884 and
+ *	retrieving each one on its own, which is also what happens if the camera has no mode 3.
+ *	-record <file> saves the interleaved frames as they came for vision_replay.
+ *
+ *	-replay <file> takes the frames from a recording, a video or an image sequence (frame_source.h)
+ *	instead of the camera, with -right <file> for the right eye's video or images. No robot is
+ *	connected then, the pairs are processed one after the other as fast as they go and the time
+ *	each one took is printed.
+ *
+ *	The ball is tracked from pair to pair (circle_tracker.h), the Hough search only looks at a
+ *	window around where each eye should see it next and the whole frame gets searched when the
+ *	ball is lost and every 30 frames. -fullsearch searches every whole frame like the thesis did.
  ************************************************************************************************/
 
 /*======================================================= 
@@ -16,29 +36,33 @@
 
 #include "Aria.h"
 #include <iostream>
-#include <opencv\cv.h>
-#include <opencv\highgui.h>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "FlyCapture2.h"
+#include "flycapture_source.h"
+#include "frame_ring.h"
+#include "circle_detection.h"
+#include "circle_tracker.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <boost/thread.hpp>
+
+#define SERIAL_WAIT		100		//[ms] after each eye in -serial mode, like the thesis loop
+#define STATS_INTERVAL	5		//[s] between pipeline reports
 
 using namespace cv;
 using namespace std;
 using namespace FlyCapture2;
 
-//opencv class
-IplImage* leftImage;
-IplImage* leftImage_smooth;
-IplImage* rightImage;
-IplImage* rightImage_smooth;
-IplImage* leftGray;
-IplImage* rightGray;
-
 //FlyCapture class
-Image colorImage;
 Error error;
-bool bInit = false;
+
+//camera frames, allocated once at the camera's size. Enough for a full ring plus the pair
+//being captured and the pair being processed
+FramePool frames(2 * (STEREO_RING_SLOTS + 1));
 
 //print out camera specs if desired
 void PrintBuildInfo()
@@ -84,465 +108,305 @@ void PrintError(Error error)
 	error.PrintErrorTrace();
 }
 
-/*	
- *  Important function!	[Point Grey code]
- *	Converts the raw image taken from the Bumblebee2 camera into an
- *	IplImage format so opencv can understand the data.	
- */
-IplImage* ConvertImageToOpenCV(Image* pImage)
+//grabs pairs as fast as the camera sends them, the ring drops the oldest when processing falls behind
+class CaptureThread
 {
-	IplImage* cvImage = NULL;
-	bool bColor = true;
-	CvSize mySize;
-	mySize.height = pImage->GetRows();
-	mySize.width  = pImage->GetCols();
-
-	//switch used in the event that a different camera is being used
-		switch ( pImage->GetPixelFormat() )
+public:
+	CaptureThread(FrameSource &source, StereoFrameRing &ring) : mySource(source), myRing(ring), myStop(false) {}
+
+	void start() { myThread = boost::thread(&CaptureThread::run, this); }
+	void stop()
 	{
-		case PIXEL_FORMAT_MONO8:	 cvImage = cvCreateImageHeader(mySize, 8, 1 );
-									 cvImage->depth = IPL_DEPTH_8U;
-									 cvImage->nChannels = 1;
-									 bColor = false;
-									// printf("PIXEL_FORMAT_MON08()\n");
-									 break;
-
-		case PIXEL_FORMAT_411YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									// printf("PIXEL_FORMAT_411YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_422YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-								//	 printf("PIXEL_FORMAT_433YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_444YUV8:   cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-								//	 printf("PIXEL_FORMAT_444YUV8\n");
-                                     break;
-
-		case PIXEL_FORMAT_RGB8:      cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-                                    // printf("PIXEL_FORMAT_RGB8\n");
-									 break;
-
-		case PIXEL_FORMAT_MONO16:    cvImage = cvCreateImageHeader(mySize, 16, 1 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 1;
-									// printf("PIXEL_FORMAT_MONO16\n");
-									 bColor = false;
-                                     break;
-
-		case PIXEL_FORMAT_RGB16:     cvImage = cvCreateImageHeader(mySize, 16, 3 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 3;
-                                   //  printf("PIXEL_FORMAT_RGB16\n");
-									 break;
-
-		case PIXEL_FORMAT_S_MONO16:  cvImage = cvCreateImageHeader(mySize, 16, 1 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 1;									
-									 bColor = false;
-									// printf("PIXEL_FORMAT_S_MONO16\n");
-                                     break;
-
-		case PIXEL_FORMAT_S_RGB16:   cvImage = cvCreateImageHeader(mySize, 16, 3 );
-                                     cvImage->depth = IPL_DEPTH_16U;
-                                     cvImage->nChannels = 3;
-									// printf("PIXEL_FORMAT_X_RGB16\n");
-                                     break;
-
-		case PIXEL_FORMAT_RAW8:      cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_RAW8\n");
-                                     break;
-
-		case PIXEL_FORMAT_RAW16:     cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_RAW16\n");
-                                     break;
-
-		case PIXEL_FORMAT_MONO12:    printf("Not supported by OpenCV");
-									 bColor = false;
-                                     break;
-
-		case PIXEL_FORMAT_RAW12:	 printf("Not supported by OpenCV");
-									 break;
-
-		case PIXEL_FORMAT_BGR:       cvImage = cvCreateImageHeader(mySize, 8, 3 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 3;
-									 //printf("PIXEL_FORMAT_BGR\n");
-                                     break;
-
-		case PIXEL_FORMAT_BGRU:      cvImage = cvCreateImageHeader(mySize, 8, 4 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 4;
-									 //printf("PIXEL_FORMAT_BGRU\n");
-                                     break;
-
-		case PIXEL_FORMAT_RGBU:      cvImage = cvCreateImageHeader(mySize, 8, 4 );
-                                     cvImage->depth = IPL_DEPTH_8U;
-                                     cvImage->nChannels = 4;
-									// printf("PIXEL_FORMAT_RGBU\n");
-                                     break;
-
-		default: printf("Some error occured...\n");
-				 return NULL;
+		myStop = true;
+		myThread.join();
 	}
 
-	if(bColor)
+private:
+	void run()
 	{
-		if(!bInit)
+		while(!myStop && !mySource.atEnd())
 		{
-			//sets size of buffer to place image data
-			colorImage.SetData(new unsigned char[pImage->GetCols() * pImage->GetRows()*3], pImage->GetCols() * pImage->GetRows()*3);
-			bInit = true;
+			StereoFrame pair;
+			if(mySource.grab(pair))
+				myRing.push(pair);
 		}
-		pImage->Convert(PIXEL_FORMAT_BGR, &colorImage); //needs to be BGR format to save 
-		//sets IplImage header values
-		cvImage->width = 640;//colorImage.GetCols();
-		cvImage->height = 480;//colorImage.GetRows();
-		cvImage->widthStep = colorImage.GetStride();
-		cvImage->origin = 0;		//interleaved color channels
-		cvImage->imageDataOrigin = (char*)colorImage.GetData();	//no region of interest, same pointer
-		cvImage->imageData = (char*)(colorImage.GetData());
-		cvImage->widthStep = colorImage.GetStride();
-		cvImage->nSize = sizeof(IplImage);
-		cvImage->imageSize = cvImage->height * cvImage->widthStep;
 	}
-	else
-	{
-        cvImage->imageDataOrigin = (char*)(pImage->GetData());
-        cvImage->imageData         = (char*)(pImage->GetData());
-        cvImage->widthStep         = pImage->GetStride();
-        cvImage->nSize             = sizeof (IplImage);
-        cvImage->imageSize         = cvImage->height * cvImage->widthStep;
-		//at this point cvImage contains a valid IplImage
-     }
-	return cvImage;
-}
 
-int main(int argc, char* argv[])
+	FrameSource &mySource;
+	StereoFrameRing &myRing;
+	volatile bool myStop;
+	boost::thread myThread;
+
+	CaptureThread(const CaptureThread&);
+	CaptureThread& operator=(const CaptureThread&);
+};
+
+/*
+ *	Finds the ball in image with tracker, or with a search of the whole
+ *	image if there is none (circle_detection.h), and shows the image with
+ *	it marked in window. x gets the center of the ball and keeps its value
+ *	if it wasn't found.
+ */
+void find_circle(IplImage* image, const char* window, CircleTracker* tracker, double time, int &x)
 {
-	//Setup robot stuff
-	ArRobot robot;
-	ArKeyHandler keyHandler;
-	Camera cam;
-	Image rawImage_left;
-	Image rawImage_right;
-	float* p_left;
-	float* p_right;
-	//char keypress;
+	TrackedCircle circle;
+	if(!tracker)
+		detect_circles(image, x);
+	else if(tracker->track(image, time, circle))
+		x = cvRound(circle.x);
+	cvShowImage(window, image);
+}
 
+//turns toward the ball and drives up to it by where it is in the left eye and how far away it is
+void drive(ArRobot &robot, int left_x, int right_x)
+{
 	double focalLen = 6;	//6 millimeters
 	int distance_between_camera = 120;	// in millimeters
-	int distance_from_object;
-	int left_x;
-	int right_x;
-
-	Aria::init();
-	
-	ArSimpleConnector connector(&argc, argv);
-	connector.parseArgs();
-
-	if(argc > 1)
-	{
-		connector.logOptions();
-		exit(1);
-	}
 
-	Aria::setKeyHandler(&keyHandler);
-	
-	robot.attachKeyHandler(&keyHandler);
-	if(!connector.connectRobot(&robot))
-	{
-		std::cout << "Could not connect to robot...abort" << std::endl;
-		Aria::shutdown();
-		return -1;
-	}
+	/*====================================================*/
+	/*=========CALCULATE DISTANCE FROM MOMENTS============*/
+	/*====================================================*/
 
-	robot.comInt(ArCommands::ENABLE, 1);
-	robot.comInt(ArCommands::SOUNDTOG, 0);
+	/* one thing to point out if you haven't noticed.
+		In color detection, I used moments to figure out the position of the colored object
+		Moments don't seem to work for circle detection. Didn't dwell too deep as to the cause of this. */
 
-	//Setup camera stuff
-	PrintBuildInfo();
-	Error error;
+	int distance_from_object = distance_between_camera * (focalLen/(left_x - right_x)) * 34/2.62;
+	cout << "Distance from camera: " << distance_from_object << endl;
+	cout << "p_left: " << left_x << endl;
+	cout << "p_right: " << right_x << endl;
+	cout << "---------------------------" << endl;
 
-	BusManager busMgr;
-	unsigned int numCameras;
+	/*====================================================*/
+	/*=====================ROBOT ROCK=====================*/
+	/*====================================================*/
 
-	error = busMgr.GetNumOfCameras(&numCameras);
-
-	if(error != PGRERROR_OK)
+	if( left_x > 145 && left_x < 250 )
 	{
-		PrintError(error);
-		exit(1);
+		robot.setRotVel(9);
+		//turn right, off center
 	}
-
-	printf("Number of cameras detected: %u\n", numCameras);
-	PGRGuid guid;
-	for (unsigned int i=0; i < numCameras; i++)
-    {
-        error = busMgr.GetCameraFromIndex(i, &guid);
-        if (error != PGRERROR_OK)
-        {
-            PrintError( error );
-            exit(1);
-		}
-
-    }
-
-    //Connect, get info, start getting images
-	error = cam.Connect(&guid);
-	if(error != PGRERROR_OK)
+	else if( left_x < 145 )
 	{
-		PrintError(error);
-		exit(1);
+		robot.setRotVel(14);
+		//turn right faster, way off center
 	}
-
-	CameraInfo camInfo;
-	error = cam.GetCameraInfo(&camInfo);
-	if(error != PGRERROR_OK)
+	else if( left_x > 400 && left_x < 495 )
 	{
-		PrintError(error);
-		exit(1);
+		robot.setRotVel(-9);
+		//turn left, off center
 	}
-
-	error = cam.StartCapture();
-	if(error != PGRERROR_OK)
+	else if( left_x > 495 )
 	{
-		PrintError(error);
-		exit(1);
+		robot.setRotVel(-14);
+		//turn left faster, way off center
 	}
-
-	//run robot on background thread
-	robot.runAsync(true);
-	
-	while(1)
+	else if ( left_x > 250 && left_x < 400)
 	{
-		//grab LEFT image. 		
-		//WriteRegister(Register to write too, value to write to register, broadcast this image)
-		error = cam.WriteRegister(0x884, 0x82000000, true);
-		if(error != PGRERROR_OK)
-		{
-			PrintError(error);
-			exit(1);
-		}
-		
-		error = cam.RetrieveBuffer(&rawImage_left);
-		if(error != PGRERROR_OK)
-		{
-			PrintError(error);
-			exit(1);
-		}
-
-		//get source image
-		leftImage = ConvertImageToOpenCV(&rawImage_left);
-
-		//Set to false...or else things get weird
-		error = cam.WriteRegister(0x884, 0x82000000, false);
-		if(error != PGRERROR_OK)
-		{
-			PrintError(error);
-			exit(1);
-		}
-	
-		//smooth image to prevent false detection of circles
-		cvSmooth(leftImage, leftImage);
-
-		//allocate memory for leftGray, the "1" parameter at the end states how many channels it has
-		//aka, how many colors. 1 channel = gray scale, 3 channels = RGB
-		leftGray = cvCreateImage(cvSize( leftImage->width, leftImage->height), IPL_DEPTH_8U, 1);
-
-		//convert to gray scale
-		cvCvtColor(leftImage, leftGray, CV_BGR2GRAY);
-
-		//Allocates memory to store the locations of circles detected
-		CvMemStorage* circles_storage_left = cvCreateMemStorage(0);
-
-		//magic happens here! Apply the Hough Transform algorithm to detect circles, any circles detected gets 
-		//stored in the circles_storage_left CvMemStorage variable
-		CvSeq* circles_left = cvHoughCircles(leftGray, circles_storage_left, CV_HOUGH_GRADIENT, 2, 20);
-
-		/* 
-			For-loop condition might be a "what the crap is this" for you as it was for me
-			This is called a Ternary Operator.
-				Binary = consisting of two
-				Ternary = consisting of three
-
-			Essentially, if 'circles_left' == true 
-				then the expression evalutes to circles_left->total
-			If false
-				it evalutes to 0
-
-			To break it down some more...
-			If "circles_left" has values inside of it, find out how many values it contains, in this case, circles detected
-			If "circles_left" has no values inside of it, then there are no circles detected. Don't go in for-loop.
-		*/
-			
-		for(size_t i = 0; i < (circles_left ? circles_left->total : 0); i++)
-		{
-			p_left = (float *)cvGetSeqElem(circles_left, i);
-			cvCircle(leftImage, cvPoint(cvRound(p_left[0]), cvRound(p_left[1])), 3, CV_RGB(0, 255, 0), -1, 8, 0); 
-			left_x = p_left[0];
-		}
 
-		/* ===== RELEASE THINGS ONCE DONE WITH IT!!!! =====*/
-		// Unless you want crap loads of memory leaks and programs that crash on you
-		cvShowImage("Circle Detection on LEFT camera", leftImage);
-		cvReleaseImage(&leftImage);
-		cvReleaseImage(&leftGray);
-		cvReleaseImage(&leftImage_smooth);
-		cvReleaseMemStorage(&circles_storage_left);
-		cv::waitKey(100);
-
-		/*=========================================================*/
-		/*================grab RIGHT image=========================*/
-		/*=========================================================*/
-		error = cam.WriteRegister(0x884, 0x82000001, true);
-		if(error != PGRERROR_OK)
+		if(distance_from_object > 200)
 		{
-			PrintError(error);
-			exit(1);
+			robot.setVel(300);	//object is far, speed up
+			robot.setRotVel(0);
+			cout << " < 200 [cm] away from object" << endl;
 		}
-
-		error = cam.RetrieveBuffer(&rawImage_right);
-		if(error != PGRERROR_OK)
+		else if(distance_from_object < 200 && distance_from_object > 100)
 		{
-			PrintError(error);
-			exit(1);
+			robot.setVel(100);	//object near, drive normal speed
+			robot.setRotVel(0);
+			cout << " > 200 [cm] away from object" << endl;
 		}
-
-		rightImage = ConvertImageToOpenCV(&rawImage_right);
-
-		error = cam.WriteRegister(0x884, 0x82000001, false);
-		if(error != PGRERROR_OK)
+		else if ( distance_from_object < 100)
 		{
-			PrintError(error);
-			exit(1);
+			robot.setVel(0);	//object to close. Stop
+			robot.setRotVel(0);
+			cout << " stop" << endl;
 		}
 
-		//smooth image to prevent false detection of circles
-		cvSmooth(rightImage, rightImage);
-
-		rightGray = cvCreateImage(cvSize( rightImage->width, rightImage->height), IPL_DEPTH_8U, 1);
-		cvCvtColor(rightImage, rightGray, CV_BGR2GRAY);
-		CvMemStorage* circles_storage_right = cvCreateMemStorage(0);
-
-		CvSeq* circles_right = cvHoughCircles(rightGray, circles_storage_right, CV_HOUGH_GRADIENT, 2, 20);
+	}
+}
 
-		for(size_t i = 0; i < (circles_right ? circles_right->total : 0); i++)
-		{
-			p_right = (float *)cvGetSeqElem(circles_right, i);
-			cvCircle(rightImage, cvPoint(cvRound(p_right[0]), cvRound(p_right[1])), 3, CV_RGB(0, 255, 0), -1, 8, 0); 
-			right_x = p_right[0];
-		}
+//pairs captured and processed per second since the last report, and how old a pair was when the robot acted on it
+struct PipelineStats
+{
+	PipelineStats() : start(now_seconds()), processed(0), latency(0), maxLatency(0) {}
 
-		cvShowImage("Circle Detection on RIGHT camera", rightImage);
+	double start;
+	int processed;
+	double latency;			//[s] summed
+	double maxLatency;		//[s]
+};
 
-		cvReleaseImage(&rightImage);
-		cvReleaseImage(&rightGray);
-		cvReleaseImage(&rightImage_smooth);
-		cvReleaseMemStorage(&circles_storage_right);
+void report(PipelineStats &stats, uint32_t captured, uint32_t overwritten, uint32_t skipped)
+{
+	double seconds = now_seconds() - stats.start;
+	printf("Pipeline: %.1f pairs/s captured, %.1f pairs/s processed, latency %.0f ms mean %.0f ms max, "
+		   "%u pairs dropped (ring full), %u skipped for newer\n",
+		   captured / seconds, stats.processed / seconds, stats.processed ? stats.latency / stats.processed * 1e3 : 0.0,
+		   stats.maxLatency * 1e3, overwritten, skipped);
+	stats = PipelineStats();
+}
 
-		cv::waitKey(100);
+int main(int argc, char* argv[])
+{
+	//Setup robot stuff
+	ArRobot robot;
+	ArKeyHandler keyHandler;
 
-		/*====================================================*/
-		/*=========CALCULATE DISTANCE FROM MOMENTS============*/
-		/*====================================================*/
+	int left_x = 0;
+	int right_x = 0;
 
-		/* one thing to point out if you haven't noticed.
-			In color detection, I used moments to figure out the position of the colored object
-			Moments don't seem to work for circle detection. Didn't dwell too deep as to the cause of this. */
+	Aria::init();
 
-		distance_from_object = distance_between_camera * (focalLen/(left_x - right_x)) * 34/2.62;
-		cout << "Distance from camera: " << distance_from_object << endl;
-		cout << "p_left: " << left_x << endl;
-		cout << "p_right: " << right_x << endl;
-		cout << "---------------------------" << endl;
+	ArArgumentParser parser(&argc, argv);
+	bool serial = parser.checkArgument("-serial");
+	bool toggle = parser.checkArgument("-toggle");
+	bool fullsearch = parser.checkArgument("-fullsearch");
+	const char* record_path = parser.checkParameterArgument("-record");
+	const char* replay_path = parser.checkParameterArgument("-replay");
+	const char* right_path = parser.checkParameterArgument("-right");
+	
+	ArSimpleConnector connector(&argc, argv);
+	connector.parseArgs();
 
-		/*====================================================*/
-		/*=====================ROBOT ROCK=====================*/
-		/*====================================================*/
+	if(argc > 1)
+	{
+		connector.logOptions();
+		exit(1);
+	}
 
+	//a replay has no robot to drive, drive() just prints what it would do
+	if(!replay_path)
+	{
+		Aria::setKeyHandler(&keyHandler);
 		
-		if( left_x > 145 && left_x < 250 )
-		{
-			robot.setRotVel(9);
-			//turn right, off center
-		}
-		else if( left_x < 145 )
-		{
-			robot.setRotVel(14);
-			//turn right faster, way off center
-		}
-		else if( left_x > 400 && left_x < 495 )
-		{
-			robot.setRotVel(-9);
-			//turn left, off center
-		}
-		else if( left_x > 495 )
+		robot.attachKeyHandler(&keyHandler);
+		if(!connector.connectRobot(&robot))
 		{
-			robot.setRotVel(-14);
-			//turn left faster, way off center
+			std::cout << "Could not connect to robot...abort" << std::endl;
+			Aria::shutdown();
+			return -1;
 		}
-		else if ( left_x > 250 && left_x < 400)
-		{
 
-			if(distance_from_object > 200)
-			{
-				robot.setVel(300);	//object is far, speed up
-				robot.setRotVel(0);
-				cout << " < 200 [cm] away from object" << endl;
-			}
-			else if(distance_from_object < 200 && distance_from_object > 100)
-			{
-				robot.setVel(100);	//object near, drive normal speed
-				robot.setRotVel(0);
-				cout << " > 200 [cm] away from object" << endl;
-			}
-			else if ( distance_from_object < 100)
-			{
-				robot.setVel(0);	//object to close. Stop
-				robot.setRotVel(0);
-				cout << " stop" << endl;
-			}
+		robot.comInt(ArCommands::ENABLE, 1);
+		robot.comInt(ArCommands::SOUNDTOG, 0);
+	}
 
+	//Setup camera stuff, or the recording in its place
+	FrameSource* source;
+	if(replay_path)
+	{
+		source = open_replay_source(replay_path, right_path, frames);
+		if(!source || !source->isStereo())
+		{
+			printf(source ? "%s has one eye only, the right one goes in -right <file>\n" : "Could not open %s\n", replay_path);
+			delete source;
+			Aria::shutdown();
+			return -1;
 		}
+		serial = true;
 	}
+	else
+	{
+		PrintBuildInfo();
+		FlyCaptureSource* camera = new FlyCaptureSource(frames, toggle ? FLYCAPTURE_TOGGLE : FLYCAPTURE_INTERLEAVED);
+		if(!camera->open())
+			exit(1);
+		if(record_path)
+			camera->record(record_path);
+		toggle = camera->getMode() == FLYCAPTURE_TOGGLE;
+		source = camera;
 
-	//Memory management
-	cvReleaseImageHeader(&leftImage);
-	cvReleaseImage(&leftImage);
-	cvReleaseImageHeader(&leftGray);
-	cvReleaseImage(&leftGray);
-
-	cvReleaseImage(&rightImage);
-	cvReleaseImageHeader(&rightImage);
-	cvReleaseImageHeader(&rightGray);
-	cvReleaseImage(&rightGray);
+		//run robot on background thread
+		robot.runAsync(true);
+	}
 
-	error = cam.StopCapture();
-	if(error != PGRERROR_OK)
+	//the camera runs on its own thread too unless -serial
+	StereoFrameRing ring(frames);
+	CaptureThread capture(*source, ring);
+	if(!serial)
+		capture.start();
+	if(replay_path)
+		printf("Replaying %s as fast as it goes\n", replay_path);
+	else
 	{
-		PrintError(error);
-		exit(1);
+		printf(serial ? "Serial capture and processing" : "Pipelined capture and processing");
+		printf(toggle ? ", one eye at a time\n" : ", both eyes per frame\n");
 	}
 
-	error = cam.Disconnect();
-	if(error != PGRERROR_OK)
+	//one for each eye, the ball is somewhere else in each
+	CircleTracker left_tracker, right_tracker;
+
+	uint32_t last_captured = 0, last_overwritten = 0, last_skipped = 0;
+	PipelineStats stats;
+	int wait = replay_path ? 1 : serial ? SERIAL_WAIT : 1;
+	
+	for(;;)
 	{
-		PrintError(error);
-		exit(1);
+		StereoFrame pair;
+		if(serial)
+		{
+			if(!source->grab(pair))
+			{
+				if(source->atEnd())
+					break;
+				continue;
+			}
+		}
+		else if(!ring.popNewest(pair))
+		{
+			if(source->atEnd())
+				break;
+
+			//nothing new yet, keep the windows alive meanwhile
+			cv::waitKey(1);
+			continue;
+		}
+
+		//headers on the stack for the C API, they share the frames' pixels
+		double start = now_seconds();
+		IplImage leftImage = pair.left.image();
+		find_circle(&leftImage, "Circle Detection on LEFT camera", fullsearch ? NULL : &left_tracker, pair.captured, left_x);
+		cv::waitKey(wait);
+
+		double middle = now_seconds();
+		IplImage rightImage = pair.right.image();
+		find_circle(&rightImage, "Circle Detection on RIGHT camera", fullsearch ? NULL : &right_tracker, pair.captured, right_x);
+		cv::waitKey(wait);
+
+		//frames go back to the pool for the capture thread
+		pair.left.release();
+		pair.right.release();
+
+		drive(robot, left_x, right_x);
+
+		double latency = now_seconds() - pair.captured;
+		if(replay_path)
+			printf("Pair %u: grab %.2f ms, left %.2f ms, right %.2f ms\n", pair.sequence,
+				   (start - pair.captured) * 1e3, (middle - start) * 1e3, (now_seconds() - middle) * 1e3);
+		stats.processed++;
+		stats.latency += latency;
+		stats.maxLatency = max(stats.maxLatency, latency);
+		if(now_seconds() - stats.start >= STATS_INTERVAL)
+		{
+			uint32_t captured = serial ? pair.sequence + 1 : ring.getPushed();
+			report(stats, captured - last_captured, ring.getOverwritten() - last_overwritten, ring.getSkipped() - last_skipped);
+			last_captured = captured;
+			last_overwritten = ring.getOverwritten();
+			last_skipped = ring.getSkipped();
+			if(!fullsearch)
+				printf("Tracking so far: %d window and %d full frame searches, ball lost %d times\n",
+					   left_tracker.getWindowSearches() + right_tracker.getWindowSearches(),
+					   left_tracker.getFullSearches() + right_tracker.getFullSearches(),
+					   left_tracker.getLosses() + right_tracker.getLosses());
+		}
 	}
+
+	if(!serial)
+		capture.stop();
+
+	//stops the camera
+	delete source;
 	printf("Done\n");
 
 	Aria::shutdown();
@@ -0,0 +1,81 @@
+/********************************************************
+ *	Stereo de-interleaving, see stereo_deinterleave.h
+ ********************************************************/
+
+#include "stereo_deinterleave.h"
+
+#ifdef STEREO_SSE2
+#include <emmintrin.h>
+#endif
+
+static void deinterleave_row(const unsigned char* src, unsigned char* first, unsigned char* second, int n, bool simd)
+{
+	int i = 0;
+#ifdef STEREO_SSE2
+	if(simd)
+	{
+		const __m128i low = _mm_set1_epi16(0x00FF);
+		for(; i + 16 <= n; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+			_mm_storeu_si128((__m128i*)(first + i), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+			_mm_storeu_si128((__m128i*)(second + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+		}
+	}
+#else
+	(void)simd;
+#endif
+	for(; i < n; i++)
+	{
+		first[i] = src[2 * i];
+		second[i] = src[2 * i + 1];
+	}
+}
+
+void deinterleave_stereo(const unsigned char* src, size_t srcStride, int rows, int cols,
+						 unsigned char* first, size_t firstStride, unsigned char* second, size_t secondStride,
+						 bool simd)
+{
+	for(int y = 0; y < rows; y++)
+		deinterleave_row(src + y * srcStride, first + y * firstStride, second + y * secondStride, cols, simd);
+}
+
+//OpenCV names a Bayer layout by the second row, FlyCapture by the first
+static int bayer_to_bgr(StereoBayer bayer)
+{
+	switch(bayer)
+	{
+		case STEREO_BAYER_RGGB:		return CV_BayerBG2BGR;
+		case STEREO_BAYER_GRBG:		return CV_BayerGB2BGR;
+		case STEREO_BAYER_GBRG:		return CV_BayerGR2BGR;
+		default:					return CV_BayerRG2BGR;
+	}
+}
+
+bool StereoSplitter::split(const unsigned char* raw, size_t stride, int rows, int cols, StereoBayer bayer,
+						   FramePool &pool, FrameHandle &left, FrameHandle &right)
+{
+	bool color = bayer != STEREO_BAYER_NONE;
+	if(!pool.reserve(rows, cols, color ? CV_8UC3 : CV_8UC1) || !pool.acquire(left) || !pool.acquire(right))
+	{
+		left.release();
+		return false;
+	}
+
+	FrameHandle &first = myRightFirst ? right : left;
+	FrameHandle &second = myRightFirst ? left : right;
+	if(!color)
+	{
+		deinterleave_stereo(raw, stride, rows, cols, first.image().data, first.image().step[0],
+							second.image().data, second.image().step[0]);
+		return true;
+	}
+
+	for(int i = 0; i < 2; i++)
+		myPlanes[i].create(rows, cols, CV_8UC1);
+	deinterleave_stereo(raw, stride, rows, cols, myPlanes[0].data, myPlanes[0].step[0], myPlanes[1].data, myPlanes[1].step[0]);
+	cv::cvtColor(myPlanes[0], first.image(), bayer_to_bgr(bayer));
+	cv::cvtColor(myPlanes[1], second.image(), bayer_to_bgr(bayer));
+	return true;
+}
@@ -0,0 +1,79 @@
+/********************************************************
+ *	Both Bumblebee2 eyes out of one pixel-interleaved
+ *	image
+ *
+ *	The thesis got the eyes one at a time, writing
+ *	register 0x884 to pick the eye before and after each
+ *	RetrieveBuffer: four register writes and two
+ *	retrievals per pair, and now and then a frame of the
+ *	wrong eye, which the 100-200ms sleeps were papering
+ *	over. In Format7 mode 3 the camera sends both eyes in
+ *	every frame instead, 16 bits per pixel with one byte
+ *	from each eye, the right one first. The two eyes are
+ *	exposed together, so the pair always matches.
+ *
+ *	deinterleave_stereo splits such an image into the two
+ *	8 bit planes in one pass. With SSE2 it takes 32 bytes
+ *	at a time: masking the low bytes and shifting down the
+ *	high ones gives each eye's 16 pixels as 16 bit lanes,
+ *	one pack turns them into bytes. Each plane is a raw
+ *	Bayer image on the color camera, StereoSplitter
+ *	de-Bayers it into a BGR frame from the pool, on the
+ *	mono one the planes go straight into the frames.
+ *
+ *	Nothing here needs FlyCapture, so recorded buffers
+ *	(stereo_raw_file.h) go through the same code.
+ ********************************************************/
+
+#ifndef STEREO_DEINTERLEAVE_H
+#define STEREO_DEINTERLEAVE_H
+
+#include "frame_pool.h"
+
+#include <cstddef>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define STEREO_SSE2
+#endif
+
+//color filter layout of the sensor, in FlyCapture's naming, NONE for the mono camera
+enum StereoBayer
+{
+	STEREO_BAYER_NONE,
+	STEREO_BAYER_RGGB,
+	STEREO_BAYER_GRBG,
+	STEREO_BAYER_GBRG,
+	STEREO_BAYER_BGGR
+};
+
+/*
+ *	Splits rows x cols 16 bit pixels at src into the first and second
+ *	byte of each, row by row with the given strides [bytes]. simd false
+ *	runs the plain loop, for comparing.
+ */
+void deinterleave_stereo(const unsigned char* src, size_t srcStride, int rows, int cols,
+						 unsigned char* first, size_t firstStride, unsigned char* second, size_t secondStride,
+						 bool simd = true);
+
+class StereoSplitter
+{
+public:
+	StereoSplitter(bool rightFirst = true) : myRightFirst(rightFirst) {}
+
+	/*
+	 *	Splits the interleaved image at raw into a left and a right frame
+	 *	from pool, BGR for a Bayer sensor and grey otherwise. false if no
+	 *	frame was free
+	 */
+	bool split(const unsigned char* raw, size_t stride, int rows, int cols, StereoBayer bayer,
+			   FramePool &pool, FrameHandle &left, FrameHandle &right);
+
+private:
+	bool myRightFirst;
+	cv::Mat myPlanes[2];		//Bayer planes waiting to be converted, color only
+
+	StereoSplitter(const StereoSplitter&);
+	StereoSplitter& operator=(const StereoSplitter&);
+};
+
+#endif
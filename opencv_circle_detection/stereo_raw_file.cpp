@@ -0,0 +1,76 @@
+/********************************************************
+ *	Recorded raw stereo frames, see stereo_raw_file.h
+ ********************************************************/
+
+#include "stereo_raw_file.h"
+
+#include <cstring>
+
+bool StereoRawWriter::open(const char* path, int rows, int cols, StereoBayer bayer)
+{
+	close();
+	myOut.open(path, std::ios::binary | std::ios::trunc);
+	if(!myOut)
+		return false;
+
+	memset(&myHeader, 0, sizeof(myHeader));
+	memcpy(myHeader.magic, STEREO_RAW_MAGIC, sizeof(myHeader.magic));
+	myHeader.version = STEREO_RAW_VERSION;
+	myHeader.rows = rows;
+	myHeader.cols = cols;
+	myHeader.bytesPerPixel = 2;
+	myHeader.bayer = bayer;
+	myOut.write((const char*)&myHeader, sizeof(myHeader));
+	return myOut.good();
+}
+
+void StereoRawWriter::write(double time, const unsigned char* data, size_t stride)
+{
+	if(!myOut.is_open())
+		return;
+
+	myOut.write((const char*)&time, sizeof(time));
+	size_t row = (size_t)myHeader.cols * myHeader.bytesPerPixel;
+	for(uint32_t y = 0; y < myHeader.rows; y++)
+		myOut.write((const char*)(data + y * stride), row);
+}
+
+void StereoRawWriter::close()
+{
+	if(myOut.is_open())
+		myOut.close();
+}
+
+bool StereoRawReader::open(const char* path)
+{
+	myIn.close();
+	myIn.clear();
+	myIn.open(path, std::ios::binary);
+	if(!myIn.read((char*)&myHeader, sizeof(myHeader)) ||
+	   memcmp(myHeader.magic, STEREO_RAW_MAGIC, sizeof(myHeader.magic)) != 0 ||
+	   myHeader.version != STEREO_RAW_VERSION ||
+	   myHeader.bytesPerPixel != 2)
+		return false;
+
+	//frames from the file length, a partial last one doesn't count
+	myStart = myIn.tellg();
+	myIn.seekg(0, std::ios::end);
+	size_t frame = sizeof(double) + myHeader.rows * getStride();
+	myFrames = (int)((size_t)(myIn.tellg() - myStart) / frame);
+	myIn.seekg(myStart);
+	return true;
+}
+
+bool StereoRawReader::read(double &time, std::vector<unsigned char> &data)
+{
+	data.resize(myHeader.rows * getStride());
+	if(data.empty() || !myIn.read((char*)&time, sizeof(time)) || !myIn.read((char*)&data[0], data.size()))
+		return false;
+	return true;
+}
+
+void StereoRawReader::rewind()
+{
+	myIn.clear();
+	myIn.seekg(myStart);
+}
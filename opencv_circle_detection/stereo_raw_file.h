@@ -0,0 +1,84 @@
+/********************************************************
+ *	Recorded raw stereo frames
+ *
+ *	opencv_circle_detection -record <file> keeps every
+ *	interleaved image the camera sent, untouched, so the
+ *	vision code can be run again on the same frames
+ *	without a camera (vision_replay).
+ *
+ *	Layout (little endian, version 1): StereoRawHeader,
+ *	then per frame a double timestamp [s since the
+ *	recording started] and rows x cols 16 bit pixels, no
+ *	row padding. A frame cut short by a crash is dropped
+ *	on reading.
+ ********************************************************/
+
+#ifndef STEREO_RAW_FILE_H
+#define STEREO_RAW_FILE_H
+
+#include "stereo_deinterleave.h"
+
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+
+#define STEREO_RAW_MAGIC	"SRRAW\0\0"
+#define STEREO_RAW_VERSION	1
+
+struct StereoRawHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t bytesPerPixel;		//2, one byte per eye
+	uint32_t bayer;				//StereoBayer of the sensor
+	uint32_t reserved[3];
+};
+
+class StereoRawWriter
+{
+public:
+	~StereoRawWriter() { close(); }
+
+	bool open(const char* path, int rows, int cols, StereoBayer bayer);
+	bool isOpen() const { return myOut.is_open(); }
+
+	//appends one frame, stride is the image's row length [bytes]
+	void write(double time, const unsigned char* data, size_t stride);
+
+	void close();
+
+private:
+	std::ofstream myOut;
+	StereoRawHeader myHeader;
+};
+
+//reads frame by frame, a recording is too big to hold in memory
+class StereoRawReader
+{
+public:
+	StereoRawReader() : myFrames(0) {}
+
+	bool open(const char* path);
+
+	int getRows() const { return (int)myHeader.rows; }
+	int getCols() const { return (int)myHeader.cols; }
+	StereoBayer getBayer() const { return (StereoBayer)myHeader.bayer; }
+	size_t getStride() const { return (size_t)myHeader.cols * myHeader.bytesPerPixel; }
+	int getFrameCount() const { return myFrames; }
+
+	//the next frame into data, rows x getStride() bytes, false at the end
+	bool read(double &time, std::vector<unsigned char> &data);
+
+	//back to the first frame
+	void rewind();
+
+private:
+	std::ifstream myIn;
+	StereoRawHeader myHeader;
+	std::streampos myStart;
+	int myFrames;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/********************************************************
+ *	Stereo de-interleaving test
+ *
+ *	The SSE2 loop of deinterleave_stereo does 16 pixels
+ *	at a time and leaves the rest of each row to the
+ *	plain loop, with unaligned loads and stores. This
+ *	splits random rows of every width from 1 to
+ *	TEST_MAX_COLS both ways, with the source and the
+ *	planes starting 0 to 3 bytes past an aligned address
+ *	and padding after every row, and checks both give
+ *	the first and second byte of each pixel and never
+ *	write into the padding.
+ *
+ *	Then a mono pair goes through StereoSplitter, whose
+ *	right eye is the first byte of each pixel unless it's
+ *	told otherwise, to check the left and right frames
+ *	come out the right way round.
+ *
+ *	Prints what failed and returns 1, 0 if all is well.
+ *
+ *	usage: stereo_deinterleave_test
+ ********************************************************/
+
+#include "../opencv_circle_detection/stereo_deinterleave.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+#define TEST_MAX_COLS		80		//a few whole SSE2 blocks plus every tail length
+#define TEST_ROWS			3
+#define TEST_MAX_OFFSET		3		//[bytes] past an aligned start
+#define TEST_PADDING		5		//[bytes] after every row, never written
+#define TEST_GUARD			0xA5	//what the padding holds
+#define TEST_RIGHT			200		//first byte of every pixel in the pair for StereoSplitter
+#define TEST_LEFT			50		//second byte
+
+//one plane split out of the source, with room to start it off alignment
+struct TestPlane
+{
+	TestPlane(int cols, int offset)
+		: stride(cols + TEST_PADDING), buffer(16 + offset + TEST_ROWS * (cols + TEST_PADDING), TEST_GUARD)
+	{
+		//vector storage is at least 8 byte aligned, round up to 16 so the offset is the misalignment
+		size_t start = (size_t)&buffer[0];
+		data = &buffer[0] + ((16 - start % 16) % 16) + offset;
+	}
+
+	unsigned char* data;
+	size_t stride;
+	vector<unsigned char> buffer;
+};
+
+/*
+ *	Splits random pixels of cols width both ways with the source at
+ *	srcOffset and the planes at planeOffset past alignment. Returns the
+ *	number of wrong bytes, in the planes or in their padding
+ */
+static int check_split(int cols, int srcOffset, int planeOffset, bool simd)
+{
+	size_t srcStride = 2 * cols + TEST_PADDING;
+	vector<unsigned char> srcBuffer(16 + srcOffset + TEST_ROWS * srcStride);
+	size_t start = (size_t)&srcBuffer[0];
+	unsigned char* src = &srcBuffer[0] + ((16 - start % 16) % 16) + srcOffset;
+	for(size_t i = 0; i < srcBuffer.size(); i++)
+		srcBuffer[i] = (unsigned char)(rand() & 0xFF);
+
+	TestPlane first(cols, planeOffset), second(cols, planeOffset);
+	deinterleave_stereo(src, srcStride, TEST_ROWS, cols, first.data, first.stride, second.data, second.stride, simd);
+
+	int wrong = 0;
+	for(int y = 0; y < TEST_ROWS; y++)
+	{
+		for(size_t x = 0; x < first.stride; x++)
+		{
+			bool pixel = x < (size_t)cols;
+			unsigned char a = first.data[y * first.stride + x], b = second.data[y * second.stride + x];
+			if(a != (pixel ? src[y * srcStride + 2 * x] : TEST_GUARD))
+				wrong++;
+			if(b != (pixel ? src[y * srcStride + 2 * x + 1] : TEST_GUARD))
+				wrong++;
+		}
+	}
+	return wrong;
+}
+
+//splits a mono pair whose first bytes are TEST_RIGHT, returns false if the eyes come out the wrong way round
+static bool check_eyes(bool rightFirst)
+{
+	int rows = TEST_ROWS, cols = 2 * 16 + 1;
+	vector<unsigned char> raw((size_t)rows * cols * 2);
+	for(size_t i = 0; i < raw.size(); i += 2)
+	{
+		raw[i] = TEST_RIGHT;
+		raw[i + 1] = TEST_LEFT;
+	}
+
+	FramePool pool(2);
+	StereoSplitter splitter(rightFirst);
+	FrameHandle left, right;
+	if(!splitter.split(&raw[0], 2 * cols, rows, cols, STEREO_BAYER_NONE, pool, left, right))
+	{
+		cout << "StereoSplitter could not get frames" << endl;
+		return false;
+	}
+
+	unsigned char leftValue = rightFirst ? TEST_LEFT : TEST_RIGHT;
+	unsigned char rightValue = rightFirst ? TEST_RIGHT : TEST_LEFT;
+	for(int y = 0; y < rows; y++)
+	{
+		const unsigned char* l = left.image().data + y * left.image().step[0];
+		const unsigned char* r = right.image().data + y * right.image().step[0];
+		for(int x = 0; x < cols; x++)
+		{
+			if(l[x] != leftValue || r[x] != rightValue)
+			{
+				cout << "eyes swapped with " << (rightFirst ? "the right" : "the left") << " eye first, pixel "
+					 << x << "," << y << " left " << (int)l[x] << " right " << (int)r[x] << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main()
+{
+#ifndef STEREO_SSE2
+	cout << "built without SSE2, both loops are the plain one" << endl;
+#endif
+
+	srand(1);
+	int failed = 0, splits = 0;
+	for(int cols = 1; cols <= TEST_MAX_COLS; cols++)
+	{
+		for(int srcOffset = 0; srcOffset <= TEST_MAX_OFFSET; srcOffset++)
+		{
+			for(int planeOffset = 0; planeOffset <= TEST_MAX_OFFSET; planeOffset++)
+			{
+				for(int simd = 0; simd < 2; simd++)
+				{
+					splits++;
+					int wrong = check_split(cols, srcOffset, planeOffset, simd != 0);
+					if(wrong)
+					{
+						failed++;
+						cout << (simd ? "SSE2" : "plain") << " split of " << cols << " columns, source +" << srcOffset
+							 << " planes +" << planeOffset << ": " << wrong << " wrong bytes" << endl;
+					}
+				}
+			}
+		}
+	}
+	cout << splits - failed << " of " << splits << " splits right" << endl;
+
+	if(!check_eyes(true))
+		failed++;
+	if(!check_eyes(false))
+		failed++;
+
+	cout << (failed ? "FAILED" : "all passed") << endl;
+	return failed ? 1 : 0;
+}
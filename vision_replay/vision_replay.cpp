@@ -0,0 +1,489 @@
+/********************************************************
+ *	Vision replay
+ *
+ *	Runs the vision code on recorded frames, with no
+ *	camera, no robot and no FlyCapture or ARIA, as fast
+ *	as the CPU goes. The frames come from a FrameSource
+ *	(frame_source.h): a recording made with
+ *	opencv_circle_detection -record <file>, a video or a
+ *	numbered image sequence.
+ *
+ *	A recording is first split into both eyes three ways:
+ *	the plain loop, the SSE2 one and the StereoSplitter
+ *	the camera program uses, de-Bayering included. The
+ *	first two have to give the same bytes, the times show
+ *	what a pair costs before the circle search starts.
+ *	The first pair is written to left.png and right.png
+ *	to check which eye is which.
+ *
+ *	The recording then goes through the capture hand-off
+ *	of opencv_circle_detection: a thread grabs pairs and
+ *	pushes them into a StereoFrameRing (frame_ring.h),
+ *	this one takes the newest off and lets it go again,
+ *	no processing. That shows how long a pair waits in
+ *	the ring and how many pairs a second get through it.
+ *
+ *	Then every frame goes through the circle detection of
+ *	opencv_circle_detection, on both eyes if there are
+ *	two, or the line detection of line_following, with
+ *	the time to get and to process each frame printed.
+ *	Circles are searched for twice, in the whole frame
+ *	like the thesis did and with the CircleTracker
+ *	(circle_tracker.h), each on its own copy of the frame,
+ *	to compare what a frame costs either way and whether
+ *	they find the ball in the same place, per frame and
+ *	eye and in total at the end. The tracker counts time
+ *	in frames here.
+ *
+ *	usage: vision_replay <source> [runs] [-right <file>] [-line]
+ *		runs	go through the frames this many times and
+ *				report the fastest, 1 by default
+ *		-right	the right eye's video or images
+ *		-line	line detection instead of circles
+ ********************************************************/
+
+#include "../opencv_circle_detection/frame_source.h"
+#include "../opencv_circle_detection/circle_detection.h"
+#include "../opencv_circle_detection/circle_tracker.h"
+#include "../opencv_circle_detection/frame_ring.h"
+#include "../Line_Following_obstacle_avoidance/line_detection.h"
+#include "../aria_robot_mapping/cycle_timer.h"
+
+#include <opencv/highgui.h>
+
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+static const char* bayer_name(StereoBayer bayer)
+{
+	static const char* names[] = { "mono", "RGGB", "GRBG", "GBRG", "BGGR" };
+	return bayer >= STEREO_BAYER_NONE && bayer <= STEREO_BAYER_BGGR ? names[bayer] : "unknown";
+}
+
+//fastest time of all runs for each way of splitting [s]
+struct SplitTimes
+{
+	SplitTimes() : scalar(0), simd(0), split(0) {}
+
+	double scalar;
+	double simd;
+	double split;
+};
+
+/*
+ *	Splits every frame of the recording at path with the plain and the
+ *	SSE2 loop and into frames, runs times, and prints the fastest
+ */
+static bool benchmark_split(const char* path, int runs)
+{
+	StereoRawReader reader;
+	if(!reader.open(path))
+	{
+		cout << "Could not read stereo recording " << path << endl;
+		return false;
+	}
+	int rows = reader.getRows(), cols = reader.getCols(), count = reader.getFrameCount();
+	if(count == 0)
+	{
+		cout << "Stereo recording is empty" << endl;
+		return false;
+	}
+	cout << count << " pairs of " << cols << "x" << rows << " " << bayer_name(reader.getBayer()) << endl;
+
+#ifndef STEREO_SSE2
+	cout << "built without SSE2, both loops are the plain one" << endl;
+#endif
+
+	//the planes each way writes into, compared byte for byte
+	vector<unsigned char> scalar[2], simd[2];
+	for(int i = 0; i < 2; i++)
+	{
+		scalar[i].resize((size_t)rows * cols);
+		simd[i].resize((size_t)rows * cols);
+	}
+
+	FramePool pool(2);
+	StereoSplitter splitter;
+	SplitTimes best;
+	int mismatches = 0;
+	double recorded = 0;
+	vector<unsigned char> raw;
+	for(int run = 0; run < runs; run++)
+	{
+		SplitTimes times;
+		reader.rewind();
+		double time;
+		for(int n = 0; reader.read(time, raw); n++)
+		{
+			recorded = time;
+
+			double start = now_seconds();
+			deinterleave_stereo(&raw[0], reader.getStride(), rows, cols, &scalar[0][0], cols, &scalar[1][0], cols, false);
+			double middle = now_seconds();
+			deinterleave_stereo(&raw[0], reader.getStride(), rows, cols, &simd[0][0], cols, &simd[1][0], cols, true);
+			double end = now_seconds();
+			times.scalar += middle - start;
+			times.simd += end - middle;
+
+			if(run == 0 && (scalar[0] != simd[0] || scalar[1] != simd[1]))
+				mismatches++;
+
+			FrameHandle left, right;
+			start = now_seconds();
+			bool split = splitter.split(&raw[0], reader.getStride(), rows, cols, reader.getBayer(), pool, left, right);
+			times.split += now_seconds() - start;
+			if(!split)
+			{
+				cout << "Could not split pair " << n << endl;
+				return false;
+			}
+
+			if(run == 0 && n == 0)
+			{
+				if(!cv::imwrite("left.png", left.image()) || !cv::imwrite("right.png", right.image()))
+					cout << "Could not write left.png and right.png" << endl;
+			}
+		}
+
+		if(run == 0 || times.scalar < best.scalar)
+			best.scalar = times.scalar;
+		if(run == 0 || times.simd < best.simd)
+			best.simd = times.simd;
+		if(run == 0 || times.split < best.split)
+			best.split = times.split;
+	}
+
+	if(mismatches)
+		cout << mismatches << " pairs split differently with SSE2!" << endl;
+
+	cout << "fastest of " << runs << " runs, per pair: " << fixed << setprecision(3)
+		 << "plain " << best.scalar / count * 1e3 << " ms, "
+		 << "SSE2 " << best.simd / count * 1e3 << " ms, "
+		 << "split into frames " << best.split / count * 1e3 << " ms";
+	if(best.simd > 0)
+		cout << ", SSE2 " << setprecision(1) << best.scalar / best.simd << "x faster";
+	cout << endl;
+	if(recorded > 0)
+		cout << "recorded at " << setprecision(1) << (count - 1) / recorded << " pairs/s, splitting alone would keep up with "
+			 << setprecision(0) << count / best.split << " pairs/s" << endl;
+	return true;
+}
+
+//grabs the recording into the ring as fast as it's read, like the camera program's capture thread
+class HandoffCapture
+{
+public:
+	HandoffCapture(FrameSource &source, StereoFrameRing &ring) : mySource(source), myRing(ring), myDone(false) {}
+
+	void operator()()
+	{
+		while(!mySource.atEnd())
+		{
+			StereoFrame pair;
+			if(mySource.grab(pair))
+				myRing.push(pair);
+		}
+		myDone = true;
+	}
+
+	bool isDone() const { return myDone; }
+
+private:
+	FrameSource &mySource;
+	StereoFrameRing &myRing;
+	volatile bool myDone;
+
+	HandoffCapture(const HandoffCapture&);
+	HandoffCapture& operator=(const HandoffCapture&);
+};
+
+//one run of the hand-off, the latencies are now_seconds() at the pop minus the pair's captured time [s]
+struct HandoffTimes
+{
+	HandoffTimes() : popped(0), elapsed(0), latency(0), maxLatency(0), pushed(0), overwritten(0), skipped(0) {}
+
+	int popped;
+	double elapsed;
+	double latency;
+	double maxLatency;
+	uint32_t pushed;
+	uint32_t overwritten;
+	uint32_t skipped;
+};
+
+/*
+ *	Runs the recording at path through a capture thread and the frame
+ *	ring runs times, taking pairs off with popNewest() like the camera
+ *	program does, and prints the run that got the most pairs through
+ */
+static bool benchmark_handoff(const char* path, int runs)
+{
+	FramePool pool(2 * (STEREO_RING_SLOTS + 1));
+	RawFileSource source(pool);
+	HandoffTimes best;
+	for(int run = 0; run < runs; run++)
+	{
+		if(!source.open(path))
+		{
+			cout << "Could not read stereo recording " << path << endl;
+			return false;
+		}
+
+		StereoFrameRing ring(pool);
+		HandoffCapture capture(source, ring);
+		HandoffTimes times;
+		double start = now_seconds();
+		boost::thread thread(boost::ref(capture));
+		for(;;)
+		{
+			//checked before the pop, a pair pushed after that is still taken
+			bool done = capture.isDone();
+			StereoFrame pair;
+			if(!ring.popNewest(pair))
+			{
+				if(done)
+					break;
+				boost::this_thread::yield();
+				continue;
+			}
+			double latency = now_seconds() - pair.captured;
+			times.popped++;
+			times.latency += latency;
+			times.maxLatency = max(times.maxLatency, latency);
+		}
+		times.elapsed = now_seconds() - start;
+		thread.join();
+		times.pushed = ring.getPushed();
+		times.overwritten = ring.getOverwritten();
+		times.skipped = ring.getSkipped();
+
+		if(run == 0 || times.popped / times.elapsed > best.popped / best.elapsed)
+			best = times;
+	}
+
+	if(best.popped == 0)
+	{
+		cout << "No pairs went through the frame ring" << endl;
+		return false;
+	}
+	cout << "capture hand-off, best of " << runs << " runs: " << best.pushed << " pairs pushed, " << best.popped << " popped, "
+		 << best.overwritten << " dropped (ring full), " << best.skipped << " skipped for newer, " << fixed << setprecision(0)
+		 << best.popped / best.elapsed << " pairs/s, in the ring " << setprecision(3) << best.latency / best.popped * 1e3
+		 << " ms mean " << best.maxLatency * 1e3 << " ms max" << endl;
+	return true;
+}
+
+#define AGREE_PIXELS	5		//[pixels] apart the tracker and the full search still found the same ball
+
+//one run's time to get and to process the frames [s] and how the tracker did against the full search
+struct PipelineTimes
+{
+	PipelineTimes()
+		: frames(0), grab(0), detect(0), maxDetect(0), tracked(0), maxTracked(0),
+		  searches(0), windowed(0), losses(0), agree(0), disagree(0), fullOnly(0), trackedOnly(0) {}
+
+	int frames;
+	double grab;
+	double detect;			//line detection, or the circle search of the whole frame
+	double maxDetect;
+	double tracked;			//the circle tracker
+	double maxTracked;
+
+	//eye frames, two for each stereo frame
+	int searches;
+	int windowed;			//the tracker searched a window only
+	int losses;
+	int agree;				//both found the ball within AGREE_PIXELS
+	int disagree;
+	int fullOnly;
+	int trackedOnly;
+};
+
+/*
+ *	One eye through the search of the whole frame and through tracker,
+ *	each on a copy of its own so neither sees the other's marks.
+ *	full_x and tracked_x keep their values if the ball wasn't found.
+ *	Returns how the two compare, for the frame's line.
+ */
+static const char* compare_circles(const cv::Mat &frame, CircleTracker &tracker, double time, PipelineTimes &times,
+							int &full_x, int &tracked_x)
+{
+	cv::Mat fullCopy = frame.clone(), trackedCopy = frame.clone();
+	IplImage fullImage = fullCopy, trackedImage = trackedCopy;
+
+	double start = now_seconds();
+	bool full = detect_circles(&fullImage, full_x) > 0;
+	double middle = now_seconds();
+	TrackedCircle circle;
+	bool tracked = tracker.track(&trackedImage, time, circle);
+	double end = now_seconds();
+
+	times.detect += middle - start;
+	times.maxDetect = max(times.maxDetect, middle - start);
+	times.tracked += end - middle;
+	times.maxTracked = max(times.maxTracked, end - middle);
+
+	times.searches++;
+	if(!tracker.wasFullSearch())
+		times.windowed++;
+	if(tracked)
+		tracked_x = cvRound(circle.x);
+	if(full && tracked)
+	{
+		bool agree = abs(full_x - tracked_x) <= AGREE_PIXELS;
+		(agree ? times.agree : times.disagree)++;
+		return agree ? "same" : "DIFFERENT";
+	}
+	if(full)
+	{
+		times.fullOnly++;
+		return "FULL ONLY";
+	}
+	if(tracked)
+	{
+		times.trackedOnly++;
+		return "TRACKED ONLY";
+	}
+	return "none";
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = NULL;
+	const char* right = NULL;
+	int runs = 1;
+	bool line = false;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-right") == 0 && i + 1 < argc)
+			right = argv[++i];
+		else if(strcmp(argv[i], "-line") == 0)
+			line = true;
+		else if(!path)
+			path = argv[i];
+		else
+			runs = atoi(argv[i]);
+	}
+	if(!path)
+	{
+		cout << "usage: vision_replay <source> [runs] [-right <file>] [-line]" << endl;
+		return 1;
+	}
+	if(runs < 1)
+		runs = 1;
+
+	//a recording gets the de-interleaving and the hand-off timed first
+	StereoRawReader recording;
+	if(recording.open(path) && (!benchmark_split(path, runs) || !benchmark_handoff(path, runs)))
+		return 1;
+
+	FramePool pool;
+	FrameSource* source = open_replay_source(path, right, pool);
+	if(!source)
+	{
+		cout << "Could not open " << path << endl;
+		return 1;
+	}
+	cout << (line ? "line detection" : "circle detection") << " on " << (source->isStereo() && !line ? "both eyes" : "the left eye") << endl;
+
+	PipelineTimes best;
+	for(int run = 0; run < runs; run++)
+	{
+		if(run > 0 && !source->rewind())
+		{
+			cout << "Can't rewind " << path << ", one run only" << endl;
+			break;
+		}
+
+		//a track doesn't carry over from the end of the frames to their start
+		CircleTracker trackers[2];
+		PipelineTimes times;
+		for(;;)
+		{
+			StereoFrame pair;
+			double start = now_seconds();
+			if(!source->grab(pair))
+			{
+				if(source->atEnd())
+					break;
+				continue;
+			}
+			double grabbed = now_seconds();
+			times.frames++;
+			times.grab += grabbed - start;
+
+			if(line)
+			{
+				//header on the stack for the C API, it shares the frame's pixels
+				LinePosition position;
+				IplImage leftImage = pair.left.image();
+				IplImage* thresholded = getThresholdedImage(&leftImage);
+				line_position(thresholded, position);
+				cvReleaseImage(&thresholded);
+				double detect = now_seconds() - grabbed;
+				times.detect += detect;
+				times.maxDetect = max(times.maxDetect, detect);
+
+				if(run == 0)
+					cout << "frame " << pair.sequence << ": " << fixed << setprecision(2) << "grab " << (grabbed - start) * 1e3
+						 << " ms, line " << detect * 1e3 << " ms, x " << position.x << " area " << setprecision(0) << position.area << endl;
+				continue;
+			}
+
+			int full_x[2] = { -1, -1 }, tracked_x[2] = { -1, -1 };
+			const char* verdict[2] = { "", "" };
+			double detect = times.detect, tracked = times.tracked;
+			verdict[0] = compare_circles(pair.left.image(), trackers[0], pair.sequence, times, full_x[0], tracked_x[0]);
+			if(!pair.right.empty())
+				verdict[1] = compare_circles(pair.right.image(), trackers[1], pair.sequence, times, full_x[1], tracked_x[1]);
+
+			if(run == 0)
+			{
+				cout << "frame " << pair.sequence << ": " << fixed << setprecision(2) << "grab " << (grabbed - start) * 1e3
+					 << " ms, full " << (times.detect - detect) * 1e3 << " ms, tracked " << (times.tracked - tracked) * 1e3
+					 << " ms (" << (trackers[0].wasFullSearch() ? "full" : "window");
+				if(!pair.right.empty())
+					cout << "/" << (trackers[1].wasFullSearch() ? "full" : "window");
+				cout << "), x " << full_x[0] << " / " << full_x[1] << ", tracked " << tracked_x[0] << " / " << tracked_x[1]
+					 << ", " << verdict[0];
+				if(!pair.right.empty())
+					cout << " / " << verdict[1];
+				cout << endl;
+			}
+		}
+		times.losses = trackers[0].getLosses() + trackers[1].getLosses();
+
+		if(run == 0 || times.grab + times.detect + times.tracked < best.grab + best.detect + best.tracked)
+			best = times;
+	}
+	delete source;
+
+	if(best.frames == 0)
+	{
+		cout << "No frames in " << path << endl;
+		return 1;
+	}
+	cout << "fastest of " << runs << " runs, " << best.frames << " frames, per frame: " << fixed << setprecision(3)
+		 << "grab " << best.grab / best.frames * 1e3 << " ms, "
+		 << (line ? "line " : "full search ") << best.detect / best.frames * 1e3 << " ms mean "
+		 << best.maxDetect * 1e3 << " ms max";
+	if(!line)
+	{
+		cout << ", tracked " << best.tracked / best.frames * 1e3 << " ms mean " << best.maxTracked * 1e3 << " ms max";
+		if(best.tracked > 0)
+			cout << ", " << setprecision(1) << best.detect / best.tracked << "x faster";
+	}
+	cout << endl;
+	if(!line)
+		cout << "tracker: " << best.windowed << " of " << best.searches << " eye frames searched in a window, lost "
+			 << best.losses << " times, same ball as the full search " << best.agree << " times, different "
+			 << best.disagree << ", only the full search found one " << best.fullOnly << ", only the tracker "
+			 << best.trackedOnly << endl;
+	return 0;
+}